@@ -0,0 +1,5 @@
+// Per-frame data, from the frame ring buffer.
+layout(std140) uniform Frame
+{
+    mat4 VP;
+};
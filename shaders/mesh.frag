@@ -0,0 +1,24 @@
+#version 330 core
+// ALPHA_TEST: discards texels that are less than half opaque, for cutouts (e.g., foliage).
+// TEXTURE_ARRAY: samples a layer of an array texture (see TexturePacker), selected by textureLayer, instead of a 2D texture.
+out vec4 color;
+in vec2 uv;
+#ifdef TEXTURE_ARRAY
+uniform sampler2DArray textureSampler;
+uniform int textureLayer;
+#else
+uniform sampler2D textureSampler;
+#endif
+
+void main()
+{
+#ifdef TEXTURE_ARRAY
+    color = texture(textureSampler, vec3(uv, textureLayer));
+#else
+    color = texture(textureSampler, uv);
+#endif
+#ifdef ALPHA_TEST
+    if (color.a < 0.5)
+        discard;
+#endif
+}
@@ -0,0 +1,24 @@
+#version 330 core
+// INSTANCED: the model matrix is a per-instance attribute (see Mesh::InstanceModelLocation), instead of a uniform.
+#include "common/frame.glsl"
+
+layout(location = 0) in vec3 vertexPos;
+layout(location = 1) in vec2 vertexUV;
+layout(location = 2) in vec3 vertexNormal;
+#ifdef INSTANCED
+layout(location = 3) in mat4 instanceModel;
+#else
+uniform mat4 model;
+#endif
+out vec2 uv;
+
+void main()
+{
+#ifdef INSTANCED
+    mat4 M = instanceModel;
+#else
+    mat4 M = model;
+#endif
+    gl_Position = VP * M * vec4(vertexPos, 1.0);
+    uv = vec2(vertexUV.x, 1.0-vertexUV.y);
+}
@@ -0,0 +1,365 @@
+/*
+ * game/assets/asset_loader.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <assets/asset_loader.h>
+
+#include <renderer/mesh.h>
+#include <renderer/mesh_format.h>
+#include <renderer/mesh_optimizer.h>
+#include <renderer/model.h>
+#include <renderer/static_batch.h>
+#include <renderer/texture.h>
+#include <renderer/texture_packer.h>
+#include <renderer/vertex_layout.h>
+
+#include <file.h>
+#include <logger.h>
+
+namespace assets
+{
+    AssetLoader::AssetLoader(jobs::JobSystem& jobs)
+        : m_jobs{ jobs }
+    {}
+
+    AssetHandle AssetLoader::submit(std::shared_ptr<request> req)
+    {
+        AssetHandle handle;
+        req->status = std::make_shared<std::atomic<AssetStatus>>(AssetStatus::Pending);
+        handle.m_status = req->status;
+        m_nOutstanding.fetch_add(1, std::memory_order_relaxed);
+        m_jobs.Run([this, req = std::move(req)]() mutable {
+            if (m_stop.load(std::memory_order_relaxed))
+                return;
+            req->loaded = req->load();
+            {
+                std::lock_guard guard{ m_lock };
+                m_loaded.push_back(std::move(req));
+            }
+        }, &m_loads);
+        return handle;
+    }
+
+    size_t AssetLoader::Update(std::chrono::microseconds budget)
+    {
+        auto start = std::chrono::steady_clock::now();
+        size_t nUploaded = 0;
+        do {
+            std::shared_ptr<request> req;
+            {
+                std::lock_guard guard{ m_lock };
+                if (m_loaded.empty())
+                    break;
+                req = std::move(m_loaded.front());
+                m_loaded.pop_front();
+            }
+            bool success = req->loaded && req->upload();
+            req->status->store(success ? AssetStatus::Ready : AssetStatus::Failed, std::memory_order_release);
+            m_nOutstanding.fetch_sub(1, std::memory_order_relaxed);
+            nUploaded++;
+        } while (std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start) < budget);
+        return nUploaded;
+    }
+    void AssetLoader::Finish()
+    {
+        // Uploads can request more loads (e.g., the texture streamer's next level), so keep going until none are left.
+        while (GetOutstandingCount())
+        {
+            // Runs loads on this thread too, while it waits.
+            m_jobs.Wait(m_loads);
+            Update(std::chrono::microseconds::max());
+        }
+    }
+
+    // A mesh, either mapped from its cooked file or imported from its source and packed.
+    struct mesh_data
+    {
+        utility::MappedFile cooked{};
+        renderer::CookedMeshView view{};
+        bool isCooked = false;
+        renderer::VertexLayout layout{};
+        std::vector<uint8_t> vertices{};
+        std::vector<GLuint> indices{};
+        renderer::Bounds bounds{};
+    };
+    // Runs as a job. 'dat' is the source file; if 'region' is set, the texture coordinates are remapped to it.
+    static bool import_mesh(mesh_data& data, const std::string& dat, const renderer::TextureRegion* region = nullptr)
+    {
+        std::vector<GLfloat> vertices, textureCoords, normals;
+        if (!renderer::LoadMesh(dat.c_str(), dat.length(), vertices, data.indices, textureCoords, normals, data.bounds))
+            return false;
+        if (region)
+            renderer::RemapTextureCoords(textureCoords, *region);
+        renderer::OptimizeMesh(vertices, data.indices, textureCoords, normals);
+        data.layout = renderer::VertexLayout::Packed();
+        data.vertices = renderer::PackVertices(data.layout, vertices, normals, textureCoords);
+        return true;
+    }
+    // Runs as a job.
+    static bool load_mesh(mesh_data& data, const std::string& cooked, const std::string& source)
+    {
+        // Prefer the cooked mesh, which needs no parsing; it's uploaded straight from the file mapping.
+        // It's out of date if its source's size or modification time changed since it was cooked (the source itself
+        // isn't read); without the source, it's used as it is.
+        if (data.cooked.Open(cooked.c_str()) &&
+            renderer::ParseCookedMesh(data.cooked.GetData(), data.cooked.GetSize(), data.view))
+        {
+            utility::FileStamp stamp{};
+            if (!utility::GetFileStamp(source.c_str(), stamp) || data.view.source == stamp)
+            {
+                logger::Debug("LoadMesh: Using cooked mesh %s.\n", cooked.c_str());
+                data.isCooked = true;
+                return true;
+            }
+            logger::Debug("LoadMesh: Cooked mesh %s is out of date.\n", cooked.c_str());
+        }
+        data.cooked.Close();
+        logger::Debug("LoadMesh: No usable cooked mesh at %s, importing %s instead.\n", cooked.c_str(), source.c_str());
+        std::string dat = "";
+        if (!utility::LoadFile(source.c_str(), dat))
+        {
+            logger::Error("Could not find file %s.\n", source.c_str());
+            return false;
+        }
+        return import_mesh(data, dat);
+    }
+
+    AssetHandle AssetLoader::LoadMesh(renderer::Mesh& into, renderer::VAO& vao, const char* cookedPath, const char* sourcePath)
+    {
+        auto data = std::make_shared<mesh_data>();
+        auto req = std::make_shared<request>();
+        req->load = [data, cooked = std::string{cookedPath}, source = std::string{sourcePath}]() {
+            return load_mesh(*data, cooked, source);
+        };
+        req->upload = [data, &into, &vao]() {
+            if (!data->isCooked)
+                into.SetBounds(data->bounds);
+            bool loaded = data->isCooked
+                ? into.Load(data->view)
+                : into.Load(data->layout, std::move(data->vertices), std::move(data->indices));
+            return loaded && into.Bind(vao) == GL_TRUE;
+        };
+        return submit(std::move(req));
+    }
+    AssetHandle AssetLoader::LoadStaticMesh(renderer::StaticBatch& into, int32_t& id, const char* cookedPath, const char* sourcePath)
+    {
+        auto data = std::make_shared<mesh_data>();
+        auto req = std::make_shared<request>();
+        req->load = [data, cooked = std::string{cookedPath}, source = std::string{sourcePath}]() {
+            return load_mesh(*data, cooked, source);
+        };
+        req->upload = [data, &into, &id]() {
+            // Only copied into the batch here; the batch uploads everything at once when it's built.
+            id = data->isCooked
+                ? into.Add(data->view)
+                : into.Add(data->layout,
+                    data->vertices.data(), data->vertices.size() / data->layout.GetStride(),
+                    data->indices.data(), data->indices.size(), GL_UNSIGNED_INT,
+                    {}, data->bounds);
+            return id != -1;
+        };
+        return submit(std::move(req));
+    }
+    AssetHandle AssetLoader::LoadTexturedMeshes(renderer::StaticBatch& batch, renderer::Texture& texture, renderer::VAO& vao,
+        std::vector<TexturedMesh>& meshes, uint32_t layerSize)
+    {
+        struct textured_meshes_data
+        {
+            std::vector<std::string> meshPaths{};
+            std::vector<std::string> texturePaths{};
+            // Not a vector, as mesh_data can't be moved.
+            std::deque<mesh_data> meshes{};
+            std::vector<renderer::TextureRegion> regions{};
+            std::vector<uint8_t> pixels{};
+            uint32_t layerSize = 0;
+            uint32_t nLayers = 0;
+            uint32_t nLevels = 0;
+        };
+        auto data = std::make_shared<textured_meshes_data>();
+        for (const TexturedMesh& mesh : meshes)
+        {
+            data->meshPaths.push_back(mesh.meshPath);
+            data->texturePaths.push_back(mesh.texturePath);
+        }
+        auto req = std::make_shared<request>();
+        req->load = [data, layerSize]() {
+            renderer::TexturePacker packer{ layerSize };
+            // The packer's image for each mesh.
+            std::vector<int> images(data->texturePaths.size(), -1);
+            for (size_t i = 0; i < data->texturePaths.size(); i++)
+            {
+                const std::string& path = data->texturePaths[i];
+                for (size_t j = 0; j < i && images[i] == -1; j++)
+                    if (data->texturePaths[j] == path)
+                        images[i] = images[j];
+                if (images[i] != -1)
+                    continue;
+                std::string dat = "";
+                if (!utility::LoadFile(path.c_str(), dat))
+                {
+                    logger::Error("Could not find file %s.\n", path.c_str());
+                    return false;
+                }
+                std::vector<uint8_t> pixels;
+                int width = 0, height = 0;
+                if (!renderer::Texture::DecodeImage(dat.data(), dat.size(), pixels, width, height))
+                {
+                    logger::Error("Could not decode %s.\n", path.c_str());
+                    return false;
+                }
+                images[i] = packer.Add(pixels.data(), width, height);
+                if (images[i] == -1)
+                {
+                    logger::Error("Could not pack %s (%dx%d) into a %ux%u layer.\n", path.c_str(), width, height,
+                        packer.GetLayerSize(), packer.GetLayerSize());
+                    return false;
+                }
+            }
+            packer.Pack();
+            for (size_t i = 0; i < data->meshPaths.size(); i++)
+            {
+                const std::string& path = data->meshPaths[i];
+                std::string dat = "";
+                if (!utility::LoadFile(path.c_str(), dat))
+                {
+                    logger::Error("Could not find file %s.\n", path.c_str());
+                    return false;
+                }
+                data->regions.push_back(packer.GetRegion(images[i]));
+                if (!import_mesh(data->meshes.emplace_back(), dat, &data->regions.back()))
+                    return false;
+            }
+            data->pixels = std::move(packer.GetPixels());
+            data->layerSize = packer.GetLayerSize();
+            data->nLayers = packer.GetLayerCount();
+            data->nLevels = packer.GetLevelCount();
+            return true;
+        };
+        req->upload = [data, &batch, &texture, &vao, &meshes]() {
+            for (size_t i = 0; i < data->meshes.size(); i++)
+            {
+                const mesh_data& mesh = data->meshes[i];
+                // Only copied into the batch here; the batch uploads everything at once when it's built.
+                meshes[i].mesh = batch.Add(mesh.layout,
+                    mesh.vertices.data(), mesh.vertices.size() / mesh.layout.GetStride(),
+                    mesh.indices.data(), mesh.indices.size(), GL_UNSIGNED_INT,
+                    {}, mesh.bounds);
+                meshes[i].region = data->regions[i];
+                if (meshes[i].mesh == -1)
+                    return false;
+            }
+            return texture.LoadLayers(std::move(data->pixels), data->layerSize, data->layerSize, data->nLayers, data->nLevels) &&
+                texture.Bind(vao) == GL_TRUE;
+        };
+        return submit(std::move(req));
+    }
+    AssetHandle AssetLoader::LoadModel(renderer::Model& into, renderer::VAO& vao, const char* path)
+    {
+        auto data = std::make_shared<renderer::ImportedModel>();
+        auto req = std::make_shared<request>();
+        req->load = [data, path = std::string{path}]() {
+            std::string dat = "";
+            if (!utility::LoadFile(path.c_str(), dat))
+            {
+                logger::Error("Could not find file %s.\n", path.c_str());
+                return false;
+            }
+            return renderer::ImportModel(dat.c_str(), dat.length(), *data);
+        };
+        req->upload = [data, &into, &vao]() {
+            return into.Load(std::move(*data)) && into.Bind(vao) == GL_TRUE;
+        };
+        return submit(std::move(req));
+    }
+    AssetHandle AssetLoader::LoadStaticModel(renderer::StaticBatch& into, int32_t& firstMesh, renderer::ImportedModel& model, const char* path)
+    {
+        auto data = std::make_shared<renderer::ImportedModel>();
+        auto req = std::make_shared<request>();
+        req->load = [data, path = std::string{path}]() {
+            std::string dat = "";
+            if (!utility::LoadFile(path.c_str(), dat))
+            {
+                logger::Error("Could not find file %s.\n", path.c_str());
+                return false;
+            }
+            return renderer::ImportModel(dat.c_str(), dat.length(), *data);
+        };
+        req->upload = [data, &into, &firstMesh, &model]() {
+            // Only copied into the batch here; the batch uploads everything at once when it's built.
+            firstMesh = into.Add(*data);
+            if (firstMesh == -1)
+                return false;
+            data->vertices = {};
+            data->textureCoords = {};
+            data->normals = {};
+            data->indices = {};
+            model = std::move(*data);
+            return true;
+        };
+        return submit(std::move(req));
+    }
+    AssetHandle AssetLoader::LoadTexture(renderer::Texture& into, renderer::VAO& vao, const char* path)
+    {
+        struct texture_data
+        {
+            std::vector<uint8_t> image{};
+            bool isDecoded = false;
+            int width = 0;
+            int height = 0;
+        };
+        auto data = std::make_shared<texture_data>();
+        auto req = std::make_shared<request>();
+        req->load = [data, path = std::string{path}]() {
+            if (!utility::LoadFile(path.c_str(), data->image))
+            {
+                logger::Error("Could not find file %s.\n", path.c_str());
+                return false;
+            }
+            if (renderer::Texture::IsDDSImage(data->image.data(), data->image.size()))
+                return true; // Uploaded as-is.
+            std::vector<uint8_t> pixels;
+            if (!renderer::Texture::DecodeImage(data->image.data(), data->image.size(), pixels, data->width, data->height))
+            {
+                logger::Error("Could not decode %s.\n", path.c_str());
+                return false;
+            }
+            data->image = std::move(pixels);
+            data->isDecoded = true;
+            return true;
+        };
+        req->upload = [data, &into, &vao]() {
+            bool loaded = data->isDecoded
+                ? into.LoadPixels(std::move(data->image), data->width, data->height)
+                : into.Load(std::move(data->image));
+            return loaded && into.Bind(vao) == GL_TRUE;
+        };
+        return submit(std::move(req));
+    }
+
+    AssetHandle AssetLoader::Run(std::function<bool()> load, std::function<bool()> upload)
+    {
+        auto req = std::make_shared<request>();
+        req->load = std::move(load);
+        req->upload = std::move(upload);
+        return submit(std::move(req));
+    }
+
+    AssetLoader::~AssetLoader()
+    {
+        // The loads refer to the loader, so wait for the ones already running.
+        m_stop.store(true, std::memory_order_relaxed);
+        m_jobs.Wait(m_loads);
+    }
+}
@@ -0,0 +1,138 @@
+/*
+ * game/assets/asset_loader.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <jobs/job_system.h>
+
+#include <renderer/vao.h>
+#include <renderer/mesh.h>
+#include <renderer/model.h>
+#include <renderer/static_batch.h>
+#include <renderer/texture.h>
+#include <renderer/texture_packer.h>
+
+namespace assets
+{
+    enum class AssetStatus
+    {
+        Pending,
+        Ready,
+        Failed,
+    };
+
+    // A mesh drawn with one of the images of an array texture (see AssetLoader::LoadTexturedMeshes).
+    struct TexturedMesh
+    {
+        // The mesh is always imported from its source, as its texture coordinates are remapped.
+        std::string meshPath{};
+        std::string texturePath{};
+        // Set once the request is ready: the mesh's index in the batch, and where its texture was packed.
+        int32_t mesh = -1;
+        renderer::TextureRegion region{};
+    };
+
+    // Refers to an asset requested from an AssetLoader.
+    // Can be polled from any thread.
+    class AssetHandle
+    {
+    public:
+        AssetHandle() = default;
+
+        AssetStatus GetStatus() const { return m_status ? m_status->load(std::memory_order_acquire) : AssetStatus::Failed; }
+        bool IsReady() const { return GetStatus() == AssetStatus::Ready; }
+        bool IsPending() const { return GetStatus() == AssetStatus::Pending; }
+        bool Failed() const { return GetStatus() == AssetStatus::Failed; }
+
+        friend class AssetLoader;
+    private:
+        std::shared_ptr<std::atomic<AssetStatus>> m_status{};
+    };
+
+    // Loads assets in the background.
+    // File reads, model imports and image decodes run as jobs on a job system, and only the GL uploads run on the
+    // thread that owns the GL context, in Update().
+    // The objects assets are loaded into must outlive the request.
+    // Cannot be copied.
+    // Cannot be moved.
+    class AssetLoader final
+    {
+    public:
+        // 'jobs' runs the loads, and must outlive the loader.
+        explicit AssetLoader(jobs::JobSystem& jobs);
+        AssetLoader(const AssetLoader&) = delete;
+        AssetLoader& operator=(const AssetLoader&) = delete;
+        AssetLoader(AssetLoader&&) = delete;
+        AssetLoader& operator=(AssetLoader&&) = delete;
+
+        // Loads 'cookedPath' if it is a valid cooked mesh, otherwise imports 'sourcePath'; then binds the mesh to 'vao'.
+        AssetHandle LoadMesh(renderer::Mesh& into, renderer::VAO& vao, const char* cookedPath, const char* sourcePath);
+        // Loads a mesh like LoadMesh, and adds it to 'into', which must not be built until the request is ready.
+        // 'id' receives the mesh's index in the batch.
+        AssetHandle LoadStaticMesh(renderer::StaticBatch& into, int32_t& id, const char* cookedPath, const char* sourcePath);
+        // Decodes the meshes' textures and packs them into the layers of 'texture' (see TexturePacker), with layers
+        // 'layerSize' texels wide, then binds it to 'vao'; each texture is packed once, however many meshes use it.
+        // Each mesh is imported with its texture coordinates remapped to where its texture was packed, and added to
+        // 'batch', which must not be built until the request is ready.
+        AssetHandle LoadTexturedMeshes(renderer::StaticBatch& batch, renderer::Texture& texture, renderer::VAO& vao,
+            std::vector<TexturedMesh>& meshes, uint32_t layerSize);
+        // Imports every mesh, material and node of 'path', then binds the model to 'vao'.
+        AssetHandle LoadModel(renderer::Model& into, renderer::VAO& vao, const char* path);
+        // Imports a model like LoadModel, and adds its submeshes to 'into' (see StaticBatch::Add(const ImportedModel&)),
+        // which must not be built until the request is ready.
+        // 'firstMesh' receives the batch's mesh for the first submesh, and 'model' the imported model, without its
+        // vertex and index streams, for placing its instances.
+        AssetHandle LoadStaticModel(renderer::StaticBatch& into, int32_t& firstMesh, renderer::ImportedModel& model, const char* path);
+        // Loads and decodes an image, then binds the texture to 'vao'.
+        AssetHandle LoadTexture(renderer::Texture& into, renderer::VAO& vao, const char* path);
+        // Runs 'load' on a worker thread, then, if it succeeded, 'upload' on the GL thread.
+        AssetHandle Run(std::function<bool()> load, std::function<bool()> upload);
+
+        // Runs finished requests' GL uploads, until 'budget' runs out (at least one upload is always run).
+        // Must be called on the thread that owns the GL context; call it once per frame.
+        // Returns the amount of uploads run.
+        size_t Update(std::chrono::microseconds budget);
+        // Waits for, and uploads, every outstanding request.
+        // Must be called on the thread that owns the GL context.
+        void Finish();
+
+        size_t GetOutstandingCount() const { return m_nOutstanding.load(std::memory_order_relaxed); }
+
+        ~AssetLoader();
+    private:
+        struct request
+        {
+            // Runs as a job.
+            std::function<bool()> load;
+            // Runs on the GL thread, if load() succeeded.
+            std::function<bool()> upload;
+            std::shared_ptr<std::atomic<AssetStatus>> status;
+            bool loaded = false;
+        };
+        AssetHandle submit(std::shared_ptr<request> req);
+
+        jobs::JobSystem& m_jobs;
+        // Counts the loads still running, or waiting to.
+        jobs::Counter m_loads{};
+        std::mutex m_lock{};
+        std::deque<std::shared_ptr<request>> m_loaded{};
+        std::atomic<size_t> m_nOutstanding{0};
+        // Set on destruction; loads that haven't started yet are skipped.
+        std::atomic<bool> m_stop{false};
+    };
+}
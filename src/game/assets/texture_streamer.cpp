@@ -0,0 +1,236 @@
+/*
+ * game/assets/texture_streamer.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <assets/texture_streamer.h>
+
+#include <renderer/texture.h>
+#include <renderer/texture_format.h>
+
+#include <file.h>
+#include <logger.h>
+
+namespace assets
+{
+    struct TextureStreamer::entry
+    {
+        renderer::Texture* texture = nullptr;
+        // Where level data comes from. Written by the worker that loads the texture, and read-only once it's ready.
+        utility::MappedFile file{};
+        std::vector<uint8_t> pixels{};
+        renderer::TextureView view{};
+        // Levels from this one down are always resident.
+        uint32_t minLevel = 0;
+        // The finest level asked for this frame, if any.
+        uint32_t wantedLevel = 0;
+        uint64_t lastUsed = 0;
+        bool requested = false;
+        bool ready = false;
+        // Only one level per texture is loaded at a time.
+        bool streaming = false;
+    };
+
+    static size_t level_size(const renderer::TextureView& view, uint32_t level)
+    {
+        return view.levels[level].size;
+    }
+
+    TextureStreamer::TextureStreamer(AssetLoader& loader, size_t budget)
+        : m_loader{loader}, m_stats{std::make_shared<TextureStreamerStats>()}
+    {
+        m_stats->budget = budget;
+    }
+
+    AssetHandle TextureStreamer::Add(renderer::Texture& into, renderer::VAO& vao, const char* cookedPath, const char* sourcePath)
+    {
+        auto texture = std::make_shared<entry>();
+        texture->texture = &into;
+        m_entries.push_back(texture);
+        m_lookup[&into] = texture.get();
+        m_stats->nTextures++;
+        auto load = [texture, cooked = std::string{cookedPath}, source = std::string{sourcePath}]() {
+            // Prefer the cooked texture, whose (compressed) levels are uploaded straight from the file mapping.
+            if (texture->file.Open(cooked.c_str()) &&
+                renderer::ParseDDS(texture->file.GetData(), texture->file.GetSize(), texture->view) &&
+                renderer::IsFormatSupported(texture->view.format))
+            {
+                logger::Debug("TextureStreamer: Using cooked texture %s.\n", cooked.c_str());
+            }
+            else
+            {
+                texture->file.Close();
+                logger::Debug("TextureStreamer: No usable cooked texture at %s, decoding %s instead.\n", cooked.c_str(), source.c_str());
+                std::vector<uint8_t> image;
+                if (!utility::LoadFile(source.c_str(), image))
+                {
+                    logger::Error("Could not find file %s.\n", source.c_str());
+                    return false;
+                }
+                std::vector<uint8_t> pixels;
+                int width = 0, height = 0;
+                if (!renderer::Texture::DecodeImage(image.data(), image.size(), pixels, width, height))
+                {
+                    logger::Error("Could not decode %s.\n", source.c_str());
+                    return false;
+                }
+                renderer::BuildMipChain(pixels.data(), width, height, texture->pixels, texture->view);
+            }
+            const auto& levels = texture->view.levels;
+            texture->minLevel = levels.size() - 1;
+            for (uint32_t i = 0; i < levels.size(); i++)
+            {
+                if (std::max(levels[i].width, levels[i].height) <= MinResidentSize)
+                {
+                    texture->minLevel = i;
+                    break;
+                }
+            }
+            texture->wantedLevel = texture->minLevel;
+            return true;
+        };
+        auto upload = [texture, &vao, stats = m_stats]() {
+            const renderer::TextureView& view = texture->view;
+            if (texture->texture->BeginStreaming(vao, view.format, view.width, view.height, view.levels.size()) == GL_FALSE)
+                return false;
+            for (uint32_t level = view.levels.size(); level-- > texture->minLevel; )
+            {
+                if (texture->texture->UploadLevel(level, view.data + view.levels[level].offset, level_size(view, level)) == GL_FALSE)
+                    return false;
+                stats->residentBytes += level_size(view, level);
+            }
+            texture->texture->SetBaseLevel(texture->minLevel);
+            texture->ready = true;
+            return true;
+        };
+        return m_loader.Run(std::move(load), std::move(upload));
+    }
+
+    void TextureStreamer::Request(const renderer::Texture& texture, float screenSize)
+    {
+        auto it = m_lookup.find(&texture);
+        if (it == m_lookup.end())
+            return;
+        entry& i = *it->second;
+        if (!i.ready)
+            return;
+        // One texel per pixel: every level coarser than that halves the texels per pixel.
+        float size = (float)std::max(i.view.width, i.view.height);
+        uint32_t level = 0;
+        if (screenSize > 0 && size > screenSize)
+            level = (uint32_t)std::floor(std::log2(size / screenSize));
+        else if (screenSize <= 0)
+            level = i.minLevel;
+        level = std::min(level, i.minLevel);
+        i.wantedLevel = i.requested ? std::min(i.wantedLevel, level) : level;
+        i.requested = true;
+        i.lastUsed = m_frame;
+    }
+
+    bool TextureStreamer::evict_one(const entry* keep)
+    {
+        entry* victim = nullptr;
+        for (auto& i : m_entries)
+        {
+            if (i.get() == keep || !i->ready || i->streaming)
+                continue;
+            uint32_t base = i->texture->GetBaseLevel();
+            if (base >= i->minLevel)
+                continue; // Nothing to spare.
+            // Textures used this frame only give up detail they didn't ask for.
+            if (i->lastUsed == m_frame && base >= i->wantedLevel)
+                continue;
+            if (!victim || i->lastUsed < victim->lastUsed)
+                victim = i.get();
+        }
+        if (!victim)
+            return false;
+        uint32_t base = victim->texture->GetBaseLevel();
+        victim->texture->SetBaseLevel(base + 1);
+        victim->texture->EvictLevel(base);
+        m_stats->residentBytes -= level_size(victim->view, base);
+        m_stats->nEvicted++;
+        return true;
+    }
+    void TextureStreamer::stream_in(const std::shared_ptr<entry>& texture, uint32_t level)
+    {
+        texture->streaming = true;
+        size_t size = level_size(texture->view, level);
+        m_stats->pendingBytes += size;
+        // Copy the level out of the mapping on a worker, so that page faults don't stall the GL thread.
+        auto staging = std::make_shared<std::vector<uint8_t>>();
+        auto load = [texture, level, staging]() {
+            if (texture->file.IsOpen())
+            {
+                const renderer::TextureLevel& i = texture->view.levels[level];
+                staging->assign(texture->view.data + i.offset, texture->view.data + i.offset + i.size);
+            }
+            return true;
+        };
+        auto upload = [texture, level, size, staging, stats = m_stats]() {
+            texture->streaming = false;
+            stats->pendingBytes -= size;
+            const uint8_t* data = staging->empty()
+                ? texture->view.data + texture->view.levels[level].offset
+                : staging->data();
+            if (texture->texture->UploadLevel(level, data, size) == GL_FALSE)
+                return false;
+            texture->texture->SetBaseLevel(level);
+            stats->residentBytes += size;
+            stats->nStreamed++;
+            return true;
+        };
+        m_loader.Run(std::move(load), std::move(upload));
+    }
+
+    void TextureStreamer::Update()
+    {
+        // Shrink to the budget, if it changed.
+        while (m_stats->residentBytes + m_stats->pendingBytes > m_stats->budget && evict_one(nullptr))
+            ;
+        // Serve the textures wanting the most detail first.
+        std::vector<std::shared_ptr<entry>> wanting;
+        for (auto& i : m_entries)
+            if (i->ready && !i->streaming && i->requested && i->wantedLevel < i->texture->GetBaseLevel())
+                wanting.push_back(i);
+        std::sort(wanting.begin(), wanting.end(), [](const auto& a, const auto& b) {
+            return a->wantedLevel < b->wantedLevel;
+        });
+        for (auto& i : wanting)
+        {
+            uint32_t level = i->texture->GetBaseLevel() - 1;
+            size_t size = level_size(i->view, level);
+            bool fits = true;
+            while (m_stats->residentBytes + m_stats->pendingBytes + size > m_stats->budget)
+            {
+                if (!evict_one(i.get()))
+                {
+                    fits = false;
+                    break;
+                }
+            }
+            if (!fits)
+                break;
+            stream_in(i, level);
+        }
+        for (auto& i : m_entries)
+            i->requested = false;
+        m_frame++;
+    }
+
+    void TextureStreamer::SetBudget(size_t budget)
+    {
+        m_stats->budget = budget;
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ * game/assets/texture_streamer.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <assets/asset_loader.h>
+
+#include <renderer/vao.h>
+#include <renderer/texture.h>
+
+namespace assets
+{
+    struct TextureStreamerStats
+    {
+        size_t budget = 0;
+        // Bytes of texture levels in video memory.
+        size_t residentBytes = 0;
+        // Bytes of texture levels being loaded.
+        size_t pendingBytes = 0;
+        size_t nTextures = 0;
+        // Since the streamer was created.
+        size_t nStreamed = 0;
+        size_t nEvicted = 0;
+    };
+
+    // Keeps textures' mip chains partially resident, within a video memory budget.
+    // Only the smallest levels are loaded up front; finer levels are streamed in, one at a time and coarsest first,
+    // as objects using the texture take up more of the screen. When the budget runs out, the finest levels of the least
+    // recently used textures are evicted.
+    // Level data is read from a memory-mapped DDS file, so pre-compressed BCn chains cost nothing to keep around;
+    // other images are decoded, and their mip chain built, in system memory.
+    // Must be used on the thread that owns the GL context. The textures must outlive the streamer.
+    class TextureStreamer final
+    {
+    public:
+        // 'loader' runs the streamer's file reads and uploads, and must outlive it.
+        TextureStreamer(AssetLoader& loader, size_t budget);
+        // Cannot be copied.
+        TextureStreamer(const TextureStreamer&) = delete;
+        TextureStreamer& operator=(const TextureStreamer&) = delete;
+        // Cannot be moved.
+        TextureStreamer(TextureStreamer&&) = delete;
+        TextureStreamer& operator=(TextureStreamer&&) = delete;
+
+        // Streams 'cookedPath' if it is a usable DDS file, otherwise decodes 'sourcePath'; then binds the texture to 'vao'.
+        // The handle becomes ready once the smallest levels are resident.
+        AssetHandle Add(renderer::Texture& into, renderer::VAO& vao, const char* cookedPath, const char* sourcePath);
+        // Asks for enough detail for the texture to cover 'screenSize' pixels (its largest dimension on screen) this frame.
+        void Request(const renderer::Texture& texture, float screenSize);
+        // Evicts and streams levels to satisfy this frame's requests within the budget.
+        // Call once per frame, after making the frame's requests.
+        void Update();
+
+        void SetBudget(size_t budget);
+        const TextureStreamerStats& GetStats() const { return *m_stats; }
+
+        // Levels at most this large (in texels) are always resident.
+        static constexpr uint32_t MinResidentSize = 64;
+
+    private:
+        struct entry;
+        // Evicts the finest level of the least recently used texture that has one to spare, other than 'keep'.
+        bool evict_one(const entry* keep);
+        void stream_in(const std::shared_ptr<entry>& texture, uint32_t level);
+
+        AssetLoader& m_loader;
+        std::vector<std::shared_ptr<entry>> m_entries;
+        std::unordered_map<const renderer::Texture*, entry*> m_lookup;
+        // Shared with requests in flight, which may finish after the streamer is gone.
+        std::shared_ptr<TextureStreamerStats> m_stats;
+        // Starts at one, so that a last use of zero means never.
+        uint64_t m_frame = 1;
+    };
+}
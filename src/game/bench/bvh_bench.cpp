@@ -0,0 +1,161 @@
+/*
+ * game/bench/bvh_bench.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <renderer/bounds.h>
+#include <renderer/culling.h>
+#include <scene/bvh.h>
+
+// Compares scene queries through the BVH against linear scans over the same objects.
+
+static constexpr size_t s_nQueries = 1000;
+
+template<typename F>
+static double time_ms(size_t nIterations, F&& func)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < nIterations; i++)
+        func(i);
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / nIterations;
+}
+static float ray_box(const scene::Ray& ray, const glm::vec3& min, const glm::vec3& max)
+{
+    float tNear = 0, tFar = std::numeric_limits<float>::infinity();
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float inverse = 1.f / ray.direction[axis];
+        float t1 = (min[axis] - ray.origin[axis]) * inverse;
+        float t2 = (max[axis] - ray.origin[axis]) * inverse;
+        tNear = std::max(tNear, std::min(t1, t2));
+        tFar = std::min(tFar, std::max(t1, t2));
+    }
+    return tNear <= tFar ? tNear : std::numeric_limits<float>::infinity();
+}
+
+static void run(size_t nObjects, std::mt19937& rng)
+{
+    // Keep the density constant, so that larger scenes are larger worlds rather than more crowded ones.
+    const float worldSize = 20.f * std::cbrt((float)nObjects);
+    std::uniform_real_distribution<float> position{ -worldSize*0.5f, worldSize*0.5f };
+    std::uniform_real_distribution<float> size{ 0.5f, 4.f };
+    std::uniform_real_distribution<float> unit{ -1.f, 1.f };
+
+    std::vector<renderer::Bounds> bounds(nObjects);
+    for (renderer::Bounds& object : bounds)
+    {
+        glm::vec3 center{ position(rng), position(rng), position(rng) };
+        glm::vec3 extent{ size(rng), size(rng), size(rng) };
+        object.min = center - extent;
+        object.max = center + extent;
+        object.center = center;
+        object.radius = glm::length(extent);
+    }
+
+    renderer::BoundsArray linear;
+    for (const renderer::Bounds& object : bounds)
+        linear.Add(object, glm::mat4(1.f));
+    scene::BVH bvh;
+    double buildTime = time_ms(1, [&](size_t) { bvh.Build(bounds); });
+
+    // Nudge every object, as if they all moved a little.
+    std::vector<renderer::Bounds> moved = bounds;
+    for (renderer::Bounds& object : moved)
+    {
+        glm::vec3 offset{ unit(rng), unit(rng), unit(rng) };
+        object.min += offset;
+        object.max += offset;
+    }
+    double refitTime = time_ms(10, [&](size_t i) { bvh.Refit(i % 2 ? bounds : moved); });
+
+    // Cameras at random places in the world, looking in random directions, with a fixed view distance.
+    std::vector<renderer::Frustum> frustums(s_nQueries);
+    glm::mat4 projection = glm::perspective(glm::radians(70.f), 16.f/9.f, 0.1f, 150.f);
+    for (renderer::Frustum& frustum : frustums)
+    {
+        glm::vec3 eye{ position(rng), position(rng), position(rng) };
+        glm::vec3 direction = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.f, 0.f, 0.01f));
+        frustum = renderer::ExtractFrustum(projection * glm::lookAt(eye, eye + direction, glm::vec3(0, 1, 0)));
+    }
+    std::vector<scene::Ray> rays(s_nQueries);
+    for (scene::Ray& ray : rays)
+    {
+        ray.origin = glm::vec3(position(rng), position(rng), position(rng));
+        ray.direction = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.f, 0.f, 0.01f));
+    }
+    std::vector<glm::vec3> boxes(s_nQueries);
+    for (glm::vec3& box : boxes)
+        box = glm::vec3(position(rng), position(rng), position(rng));
+    const glm::vec3 boxExtent{ 10.f };
+
+    std::vector<uint32_t> results;
+    size_t nVisibleLinear = 0, nVisibleBvh = 0;
+    double frustumLinear = time_ms(s_nQueries, [&](size_t i) {
+        linear.Cull(frustums[i], results);
+        nVisibleLinear += results.size();
+    });
+    double frustumBvh = time_ms(s_nQueries, [&](size_t i) {
+        bvh.QueryFrustum(frustums[i], results);
+        nVisibleBvh += results.size();
+    });
+
+    size_t nHitsLinear = 0, nHitsBvh = 0;
+    double rayLinear = time_ms(s_nQueries, [&](size_t i) {
+        float closest = std::numeric_limits<float>::infinity();
+        for (const renderer::Bounds& object : bounds)
+            closest = std::min(closest, ray_box(rays[i], object.min, object.max));
+        nHitsLinear += closest != std::numeric_limits<float>::infinity();
+    });
+    double rayBvh = time_ms(s_nQueries, [&](size_t i) {
+        scene::RayHit hit{};
+        nHitsBvh += bvh.Raycast(rays[i], hit);
+    });
+
+    size_t nOverlapsLinear = 0, nOverlapsBvh = 0;
+    double overlapLinear = time_ms(s_nQueries, [&](size_t i) {
+        glm::vec3 min = boxes[i] - boxExtent, max = boxes[i] + boxExtent;
+        for (const renderer::Bounds& object : bounds)
+            nOverlapsLinear += object.min.x <= max.x && object.max.x >= min.x &&
+                               object.min.y <= max.y && object.max.y >= min.y &&
+                               object.min.z <= max.z && object.max.z >= min.z;
+    });
+    double overlapBvh = time_ms(s_nQueries, [&](size_t i) {
+        bvh.QueryOverlap(boxes[i] - boxExtent, boxes[i] + boxExtent, results);
+        nOverlapsBvh += results.size();
+    });
+
+    printf("%zu objects (%zu nodes): build %.3f ms, refit %.3f ms\n", nObjects, bvh.GetNodeCount(), buildTime, refitTime);
+    printf("  %-8s %12s %12s %9s\n", "query", "linear (us)", "bvh (us)", "speedup");
+    printf("  %-8s %12.2f %12.2f %8.1fx\n", "frustum", frustumLinear*1000, frustumBvh*1000, frustumLinear/frustumBvh);
+    printf("  %-8s %12.2f %12.2f %8.1fx\n", "ray", rayLinear*1000, rayBvh*1000, rayLinear/rayBvh);
+    printf("  %-8s %12.2f %12.2f %8.1fx\n", "overlap", overlapLinear*1000, overlapBvh*1000, overlapLinear/overlapBvh);
+    // The linear frustum test also uses spheres, so the visible counts only roughly agree.
+    printf("  %zu visible on average (%zu linear)\n", nVisibleBvh / s_nQueries, nVisibleLinear / s_nQueries);
+    if (nHitsLinear != nHitsBvh || nOverlapsLinear != nOverlapsBvh)
+        printf("  warning: the BVH's results differ from the linear scan's (hits %zu/%zu, overlaps %zu/%zu)\n",
+            nHitsBvh, nHitsLinear, nOverlapsBvh, nOverlapsLinear);
+}
+
+int main()
+{
+    // A fixed seed, so that runs are comparable.
+    std::mt19937 rng{ 1337 };
+    for (size_t nObjects : { 1000, 10000, 100000 })
+        run(nObjects, rng);
+    return 0;
+}
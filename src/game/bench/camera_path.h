@@ -0,0 +1,28 @@
+/*
+ * game/bench/camera_path.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+namespace bench
+{
+    // A fixed, deterministic camera path, so that benchmark runs are comparable.
+    // The camera orbits the scene once over 'nFrames' frames, bobbing up and down a little.
+    inline static void CameraPathAt(size_t frame, size_t nFrames, glm::vec3& position, glm::vec3& direction)
+    {
+        const glm::vec3 center{ 2.5f, 0.f, 0.f };
+        const float radius = 10.f;
+        float t = nFrames ? (float)frame / (float)nFrames : 0.f;
+        float angle = t * 2.f * 3.14159265f;
+        position = center + glm::vec3(std::cos(angle) * radius, 3.f + std::sin(angle * 3.f), std::sin(angle) * radius);
+        direction = glm::normalize(center - position);
+    }
+}
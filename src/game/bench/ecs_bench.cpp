@@ -0,0 +1,137 @@
+/*
+ * game/bench/ecs_bench.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <ecs/world.h>
+#include <jobs/job_system.h>
+
+// Updates the same moving objects as heap-allocated objects with a virtual Update(), walked through a std::list of
+// pointers (the way VAO walks its RenderableObjects), and as ECS entities, walked by a query on one thread and across
+// the job system.
+
+static constexpr size_t s_nObjects = 1000000;
+static constexpr size_t s_nIterations = 10;
+static constexpr float s_dt = 1.f / 60;
+
+template<typename F>
+static double time_ms(size_t nIterations, F&& func)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < nIterations; i++)
+        func(i);
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / nIterations;
+}
+
+class object
+{
+public:
+    virtual void Update(float dt) = 0;
+    virtual const glm::mat4& GetWorld() const = 0;
+    virtual ~object() {}
+};
+class moving_object final : public object
+{
+public:
+    moving_object(const glm::vec3& position, const glm::vec3& velocity)
+        : m_position{ position }, m_velocity{ velocity }
+    {}
+    void Update(float dt) override
+    {
+        m_position += m_velocity * dt;
+        m_world = glm::translate(glm::mat4(1.f), m_position);
+    }
+    const glm::mat4& GetWorld() const override { return m_world; }
+private:
+    glm::vec3 m_position;
+    glm::vec3 m_velocity;
+    glm::mat4 m_world{ 1.f };
+};
+
+struct position_component { glm::vec3 position; };
+struct velocity_component { glm::vec3 velocity; };
+struct world_component { glm::mat4 world{ 1.f }; };
+// Gives half of the entities another archetype, so that queries cross archetypes.
+struct tag_component { uint32_t tag; };
+
+int main()
+{
+    // A fixed seed, so that runs are comparable.
+    std::mt19937 rng{ 1337 };
+    std::uniform_real_distribution<float> position{ -500.f, 500.f };
+    std::uniform_real_distribution<float> velocity{ -5.f, 5.f };
+    std::vector<glm::vec3> positions(s_nObjects), velocities(s_nObjects);
+    for (size_t i = 0; i < s_nObjects; i++)
+    {
+        positions[i] = glm::vec3(position(rng), position(rng), position(rng));
+        velocities[i] = glm::vec3(velocity(rng), velocity(rng), velocity(rng));
+    }
+
+    // Allocated in a random order, as objects created and destroyed over a game's lifetime would be.
+    std::vector<size_t> order(s_nObjects);
+    for (size_t i = 0; i < s_nObjects; i++)
+        order[i] = i;
+    std::shuffle(order.begin(), order.end(), rng);
+    std::vector<std::unique_ptr<object>> objects(s_nObjects);
+    for (size_t i : order)
+        objects[i] = std::make_unique<moving_object>(positions[i], velocities[i]);
+    std::list<object*> objectList;
+    for (const std::unique_ptr<object>& created : objects)
+        objectList.push_back(created.get());
+
+    ecs::World world;
+    for (size_t i = 0; i < s_nObjects; i++)
+    {
+        ecs::Entity entity = world.Create(position_component{ positions[i] }, velocity_component{ velocities[i] }, world_component{});
+        if (i % 2)
+            world.Add(entity, tag_component{ (uint32_t)i });
+    }
+
+    double objectTime = time_ms(s_nIterations, [&](size_t) {
+        for (object* updated : objectList)
+            updated->Update(s_dt);
+    });
+    auto update = [](ecs::Entity, position_component& position, const velocity_component& velocity, world_component& world) {
+        position.position += velocity.velocity * s_dt;
+        world.world = glm::translate(glm::mat4(1.f), position.position);
+    };
+    double ecsTime = time_ms(s_nIterations, [&](size_t) {
+        world.Each<position_component, const velocity_component, world_component>(update);
+    });
+    jobs::JobSystem jobSystem;
+    double parallelTime = time_ms(s_nIterations, [&](size_t) {
+        world.ParallelEach<position_component, const velocity_component, world_component>(jobSystem, 8192, update);
+    });
+
+    // Both sides moved their objects the same amount of times.
+    for (size_t i = 0; i < s_nIterations; i++)
+        for (object* updated : objectList)
+            updated->Update(s_dt);
+    glm::vec3 objectSum{ 0 }, ecsSum{ 0 };
+    for (object* updated : objectList)
+        objectSum += glm::vec3(updated->GetWorld()[3]);
+    world.Each<const world_component>([&ecsSum](ecs::Entity, const world_component& world) { ecsSum += glm::vec3(world.world[3]); });
+
+    printf("%zu objects, %zu archetypes, %zu threads\n", s_nObjects, world.GetArchetypeCount(), jobSystem.GetWorkerCount() + 1);
+    printf("  %-32s %9.3f ms\n", "std::list, virtual Update()", objectTime);
+    printf("  %-32s %9.3f ms (%.1fx)\n", "ECS query", ecsTime, objectTime / ecsTime);
+    printf("  %-32s %9.3f ms (%.1fx)\n", "ECS query, across the jobs", parallelTime, objectTime / parallelTime);
+    if (glm::length(objectSum - ecsSum) > 1e-2f * glm::length(objectSum))
+        printf("  warning: the objects ended up elsewhere than the entities\n");
+    return 0;
+}
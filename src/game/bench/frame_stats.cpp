@@ -0,0 +1,95 @@
+/*
+ * game/bench/frame_stats.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include <bench/frame_stats.h>
+
+namespace bench
+{
+    static double percentile(const std::vector<double>& sorted, double p)
+    {
+        // Nearest-rank percentile.
+        size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+        if (rank)
+            rank--;
+        return sorted[std::min(rank, sorted.size() - 1)];
+    }
+    Percentiles ComputePercentiles(std::vector<double> samples)
+    {
+        Percentiles ret{};
+        if (samples.empty())
+            return ret;
+        std::sort(samples.begin(), samples.end());
+        ret.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+        ret.min = samples.front();
+        ret.p50 = percentile(samples, 50);
+        ret.p95 = percentile(samples, 95);
+        ret.p99 = percentile(samples, 99);
+        ret.max = samples.back();
+        return ret;
+    }
+
+    void FrameStats::AddFrame(double cpuTime, double frameTime)
+    {
+        m_cpuTimes.push_back(cpuTime);
+        m_frameTimes.push_back(frameTime);
+    }
+    void FrameStats::AddGpuTimes(const std::vector<double>& gpuTimes)
+    {
+        m_gpuTimes.insert(m_gpuTimes.end(), gpuTimes.begin(), gpuTimes.end());
+    }
+
+    static void write_percentiles(FILE* to, const char* name, const Percentiles& p)
+    {
+        fprintf(to,
+            "    \"%s\": { \"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+            name, p.mean, p.min, p.p50, p.p95, p.p99, p.max);
+    }
+    static void write_escaped(FILE* to, const char* str)
+    {
+        fputc('"', to);
+        for (; str && *str; str++)
+        {
+            if (*str == '"' || *str == '\\')
+                fputc('\\', to);
+            if ((unsigned char)*str < 0x20)
+                continue;
+            fputc(*str, to);
+        }
+        fputc('"', to);
+    }
+    void FrameStats::WriteJSON(FILE* to, const char* renderer, int width, int height) const
+    {
+        fprintf(to, "{\n");
+        fprintf(to, "    \"renderer\": ");
+        write_escaped(to, renderer);
+        fprintf(to, ",\n");
+        fprintf(to, "    \"width\": %d,\n    \"height\": %d,\n", width, height);
+        fprintf(to, "    \"frames\": %zu,\n", m_cpuTimes.size());
+        write_percentiles(to, "cpu_ms", GetCpuPercentiles());
+        write_percentiles(to, "gpu_ms", GetGpuPercentiles());
+        write_percentiles(to, "frame_ms", GetFramePercentiles());
+        fprintf(to, "    \"per_frame\": [\n");
+        for (size_t i = 0; i < m_cpuTimes.size(); i++)
+        {
+            fprintf(to, "        { \"cpu_ms\": %.4f, \"gpu_ms\": ", m_cpuTimes[i]);
+            if (i < m_gpuTimes.size())
+                fprintf(to, "%.4f", m_gpuTimes[i]);
+            else
+                fprintf(to, "null");
+            fprintf(to, ", \"frame_ms\": %.4f }%s\n", m_frameTimes[i], i + 1 < m_cpuTimes.size() ? "," : "");
+        }
+        fprintf(to, "    ]\n");
+        fprintf(to, "}\n");
+    }
+}
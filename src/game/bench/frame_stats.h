@@ -0,0 +1,48 @@
+/*
+ * game/bench/frame_stats.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <vector>
+
+namespace bench
+{
+    struct Percentiles
+    {
+        double mean = 0;
+        double min = 0;
+        double p50 = 0;
+        double p95 = 0;
+        double p99 = 0;
+        double max = 0;
+    };
+    Percentiles ComputePercentiles(std::vector<double> samples);
+
+    // Collects per-frame timings (in milliseconds).
+    // GPU times usually arrive a few frames late, so they are recorded separately, in submission order.
+    class FrameStats final
+    {
+    public:
+        FrameStats() = default;
+
+        void AddFrame(double cpuTime, double frameTime);
+        void AddGpuTimes(const std::vector<double>& gpuTimes);
+
+        size_t GetFrameCount() const { return m_cpuTimes.size(); }
+        Percentiles GetCpuPercentiles() const { return ComputePercentiles(m_cpuTimes); }
+        Percentiles GetGpuPercentiles() const { return ComputePercentiles(m_gpuTimes); }
+        Percentiles GetFramePercentiles() const { return ComputePercentiles(m_frameTimes); }
+
+        void WriteJSON(FILE* to, const char* renderer, int width, int height) const;
+    private:
+        std::vector<double> m_cpuTimes{};
+        std::vector<double> m_gpuTimes{};
+        std::vector<double> m_frameTimes{};
+    };
+}
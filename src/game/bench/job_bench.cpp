@@ -0,0 +1,136 @@
+/*
+ * game/bench/job_bench.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <renderer/culling.h>
+#include <jobs/job_system.h>
+
+// Measures how the job system scales from one thread to every hardware thread, on the kinds of work the engine hands
+// it: transform updates and culling (parallel-for over large arrays), and many small independent jobs.
+
+static constexpr size_t s_nObjects = 1000000;
+static constexpr size_t s_nSmallJobs = 100000;
+static constexpr size_t s_nIterations = 10;
+
+template<typename F>
+static double time_ms(size_t nIterations, F&& func)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < nIterations; i++)
+        func(i);
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / nIterations;
+}
+
+struct results
+{
+    double transforms = 0;
+    double culling = 0;
+    double smallJobs = 0;
+    size_t nVisible = 0;
+    size_t nStolen = 0;
+};
+
+static results run(size_t nThreads, const std::vector<glm::mat4>& locals, const std::vector<glm::vec4>& spheres,
+    const renderer::Frustum& frustum)
+{
+    results ret{};
+    // The thread running the benchmark is one of the threads, since it runs jobs while it waits.
+    jobs::JobSystem jobSystem{ nThreads - 1 };
+
+    std::vector<glm::mat4> worlds(locals.size());
+    const glm::mat4 parent = glm::translate(glm::mat4(1.f), glm::vec3(1, 2, 3));
+    ret.transforms = time_ms(s_nIterations, [&](size_t) {
+        jobSystem.ParallelFor(locals.size(), 4096, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                worlds[i] = parent * locals[i];
+        });
+    });
+
+    std::atomic<size_t> nVisible{0};
+    ret.culling = time_ms(s_nIterations, [&](size_t) {
+        nVisible.store(0, std::memory_order_relaxed);
+        jobSystem.ParallelFor(spheres.size(), 8192, [&](size_t begin, size_t end) {
+            size_t visible = 0;
+            for (size_t i = begin; i < end; i++)
+            {
+                bool inside = true;
+                for (int plane = 0; plane < renderer::Frustum::PlaneCount && inside; plane++)
+                    inside = glm::dot(glm::vec3(frustum.planes[plane]), glm::vec3(spheres[i])) + frustum.planes[plane].w >= -spheres[i].w;
+                visible += inside;
+            }
+            nVisible.fetch_add(visible, std::memory_order_relaxed);
+        });
+    });
+    ret.nVisible = nVisible.load(std::memory_order_relaxed);
+
+    // Barely any work per job, so this measures the scheduler's own overhead.
+    std::atomic<size_t> nRun{0};
+    ret.smallJobs = time_ms(s_nIterations, [&](size_t) {
+        jobs::Counter counter;
+        for (size_t i = 0; i < s_nSmallJobs; i++)
+            jobSystem.Run([&nRun]() { nRun.fetch_add(1, std::memory_order_relaxed); }, &counter);
+        jobSystem.Wait(counter);
+    });
+    if (nRun.load() != s_nSmallJobs*s_nIterations)
+        printf("warning: %zu of %zu small jobs ran\n", nRun.load(), s_nSmallJobs*s_nIterations);
+
+    for (const jobs::WorkerStats& stats : jobSystem.GetStats())
+        ret.nStolen += stats.stolen;
+    return ret;
+}
+
+int main()
+{
+    // A fixed seed, so that runs are comparable.
+    std::mt19937 rng{ 1337 };
+    std::uniform_real_distribution<float> position{ -500.f, 500.f };
+    std::uniform_real_distribution<float> radius{ 0.5f, 4.f };
+    std::vector<glm::mat4> locals(s_nObjects);
+    std::vector<glm::vec4> spheres(s_nObjects);
+    for (size_t i = 0; i < s_nObjects; i++)
+    {
+        glm::vec3 center{ position(rng), position(rng), position(rng) };
+        locals[i] = glm::translate(glm::mat4(1.f), center);
+        spheres[i] = glm::vec4(center, radius(rng));
+    }
+    glm::mat4 projection = glm::perspective(glm::radians(70.f), 16.f/9.f, 0.1f, 1000.f);
+    renderer::Frustum frustum = renderer::ExtractFrustum(projection * glm::lookAt(glm::vec3(0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0)));
+
+    size_t nMaxThreads = std::thread::hardware_concurrency();
+    if (!nMaxThreads)
+        nMaxThreads = 1;
+    printf("%zu objects, %zu small jobs, up to %zu threads\n", s_nObjects, s_nSmallJobs, nMaxThreads);
+    printf("  %-7s %15s %15s %17s %8s\n", "threads", "transforms (ms)", "culling (ms)", "small jobs (ms)", "steals");
+    results single{};
+    for (size_t nThreads = 1; nThreads <= nMaxThreads; nThreads = nThreads < nMaxThreads && nThreads*2 > nMaxThreads ? nMaxThreads : nThreads*2)
+    {
+        results result = run(nThreads, locals, spheres, frustum);
+        if (nThreads == 1)
+            single = result;
+        printf("  %-7zu %9.2f %4.1fx %9.2f %4.1fx %11.2f %4.1fx %8zu\n", nThreads,
+            result.transforms, single.transforms / result.transforms,
+            result.culling, single.culling / result.culling,
+            result.smallJobs, single.smallJobs / result.smallJobs,
+            result.nStolen);
+        if (result.nVisible != single.nVisible)
+            printf("  warning: %zu visible, but %zu on one thread\n", result.nVisible, single.nVisible);
+        if (nThreads == nMaxThreads)
+            break;
+    }
+    return 0;
+}
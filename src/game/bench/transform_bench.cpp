@@ -0,0 +1,139 @@
+/*
+ * game/bench/transform_bench.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include <scene/transform_hierarchy.h>
+
+// Times transform hierarchy updates, with more or less of the hierarchy changed, against recomputing every world
+// matrix with plain glm; and batched MVP computation against a plain glm loop.
+
+static constexpr size_t s_nObjects = 100000;
+static constexpr size_t s_nTrees = 1000;
+static constexpr size_t s_nIterations = 20;
+
+template<typename F>
+static double time_ms(size_t nIterations, F&& func)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < nIterations; i++)
+        func(i);
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / nIterations;
+}
+static float max_difference(const glm::mat4& a, const glm::mat4& b)
+{
+    float difference = 0;
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            difference = std::max(difference, std::fabs(a[i][j] - b[i][j]));
+    return difference;
+}
+
+int main()
+{
+    // A fixed seed, so that runs are comparable.
+    std::mt19937 rng{ 1337 };
+    std::uniform_real_distribution<float> offset{ -5.f, 5.f };
+    std::uniform_real_distribution<float> angle{ -3.14f, 3.14f };
+
+    // Trees of s_nObjects / s_nTrees nodes each, every node parented to a random earlier node of its tree.
+    scene::TransformHierarchy hierarchy;
+    std::vector<uint32_t> nodes, roots, leaves;
+    std::vector<uint8_t> hasChildren;
+    const size_t treeSize = s_nObjects / s_nTrees;
+    for (size_t tree = 0; tree < s_nTrees; tree++)
+    {
+        size_t first = nodes.size();
+        for (size_t i = 0; i < treeSize; i++)
+        {
+            scene::Transform local{};
+            local.position = glm::vec3(offset(rng), offset(rng), offset(rng));
+            local.rotation = glm::angleAxis(angle(rng), glm::normalize(glm::vec3(offset(rng), offset(rng), offset(rng)) + glm::vec3(0, 0.01f, 0)));
+            uint32_t parent = scene::TransformHierarchy::InvalidNode;
+            if (i)
+            {
+                parent = nodes[first + std::uniform_int_distribution<size_t>{ 0, i - 1 }(rng)];
+                hasChildren[parent] = 1;
+            }
+            nodes.push_back(hierarchy.Add(local, parent));
+            hasChildren.push_back(0);
+        }
+        roots.push_back(nodes[first]);
+    }
+    for (uint32_t node : nodes)
+        if (!hasChildren[node])
+            leaves.push_back(node);
+    hierarchy.Update();
+
+    // The baseline: every world matrix, every frame, with glm.
+    std::vector<glm::mat4> baseline(nodes.size());
+    double full = time_ms(s_nIterations, [&](size_t) {
+        for (uint32_t node : nodes)
+        {
+            scene::Transform local = hierarchy.GetLocal(node);
+            glm::mat4 matrix = glm::translate(glm::mat4(1.f), local.position) * glm::toMat4(local.rotation) * glm::scale(glm::mat4(1.f), local.scale);
+            uint32_t parent = hierarchy.GetParent(node);
+            baseline[node] = parent == scene::TransformHierarchy::InvalidNode ? matrix : baseline[parent] * matrix;
+        }
+    });
+
+    auto touch = [&](const std::vector<uint32_t>& touched, size_t count, size_t iteration) {
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t node = touched[(i * 7919 + iteration) % touched.size()];
+            hierarchy.SetPosition(node, hierarchy.GetLocal(node).position);
+        }
+        return hierarchy.Update();
+    };
+    size_t nUpdated[4] = {};
+    double allRoots = time_ms(s_nIterations, [&](size_t i) { nUpdated[0] = touch(roots, roots.size(), i); });
+    double someRoots = time_ms(s_nIterations, [&](size_t i) { nUpdated[1] = touch(roots, roots.size() / 10, i); });
+    double someLeaves = time_ms(s_nIterations, [&](size_t i) { nUpdated[2] = touch(leaves, 1000, i); });
+    double nothing = time_ms(s_nIterations, [&](size_t i) { nUpdated[3] = touch(leaves, 0, i); });
+
+    float difference = 0;
+    for (uint32_t node : nodes)
+        difference = std::max(difference, max_difference(baseline[node], hierarchy.GetWorld(node)));
+
+    glm::mat4 viewProjection = glm::perspective(glm::radians(70.f), 16.f/9.f, 0.1f, 1000.f) *
+        glm::lookAt(glm::vec3(0, 10, -50), glm::vec3(0), glm::vec3(0, 1, 0));
+    const std::vector<glm::mat4>& worlds = hierarchy.GetWorldMatrices();
+    std::vector<glm::mat4> mvps(worlds.size()), mvpsBaseline(worlds.size());
+    double mvpBaseline = time_ms(s_nIterations, [&](size_t) {
+        for (size_t i = 0; i < worlds.size(); i++)
+            mvpsBaseline[i] = viewProjection * worlds[i];
+    });
+    double mvpBatched = time_ms(s_nIterations, [&](size_t) {
+        scene::MultiplyMatrices(viewProjection, worlds.data(), mvps.data(), worlds.size());
+    });
+    float mvpDifference = 0;
+    for (size_t i = 0; i < worlds.size(); i++)
+        mvpDifference = std::max(mvpDifference, max_difference(mvps[i], mvpsBaseline[i]));
+
+    printf("%zu objects in %zu trees (%zu leaves)\n", nodes.size(), s_nTrees, leaves.size());
+    printf("  %-28s %10s %10s\n", "update", "time (ms)", "recomputed");
+    printf("  %-28s %10.3f %10zu\n", "glm, every node", full, nodes.size());
+    printf("  %-28s %10.3f %10zu\n", "hierarchy, every root moved", allRoots, nUpdated[0]);
+    printf("  %-28s %10.3f %10zu\n", "hierarchy, 10% of roots", someRoots, nUpdated[1]);
+    printf("  %-28s %10.3f %10zu\n", "hierarchy, 1000 leaves", someLeaves, nUpdated[2]);
+    printf("  %-28s %10.3f %10zu\n", "hierarchy, nothing moved", nothing, nUpdated[3]);
+    printf("  MVPs: glm %.3f ms, batched %.3f ms (%.1fx)\n", mvpBaseline, mvpBatched, mvpBaseline / mvpBatched);
+    if (difference > 1e-3f || mvpDifference > 1e-3f)
+        printf("  warning: the results differ from glm's by up to %g (world) and %g (MVP)\n", difference, mvpDifference);
+    return 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * game/ecs/scheduler.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <utility>
+
+#include <ecs/scheduler.h>
+
+namespace ecs
+{
+    void Scheduler::Add(const char* name, ComponentMask reads, ComponentMask writes, SystemFunction function)
+    {
+        uint32_t index = m_systems.size();
+        m_systems.push_back(system{ reads, writes, std::move(function) });
+        bool conflicts = m_stages.empty();
+        if (!conflicts)
+        {
+            for (uint32_t other : m_stages.back())
+            {
+                const system& a = m_systems[index];
+                const system& b = m_systems[other];
+                if ((a.writes & (b.reads | b.writes)) || (b.writes & a.reads))
+                {
+                    conflicts = true;
+                    break;
+                }
+            }
+        }
+        // Only the last stage can be joined, so that a system still runs after every system added before it that it
+        // conflicts with.
+        if (conflicts)
+            m_stages.emplace_back();
+        m_stages.back().push_back(index);
+        m_stats.push_back(SystemStats{ name, 0, (uint32_t)m_stages.size() - 1 });
+    }
+    void Scheduler::Run(World& world, jobs::JobSystem& jobSystem)
+    {
+        auto run = [this, &world](uint32_t index)
+        {
+            auto start = std::chrono::steady_clock::now();
+            m_systems[index].function(world);
+            m_stats[index].time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        };
+        for (const std::vector<uint32_t>& stage : m_stages)
+        {
+            if (stage.size() == 1)
+            {
+                run(stage.front());
+                continue;
+            }
+            jobs::Counter counter;
+            // This thread runs the first system itself, and helps with the others while it waits.
+            for (size_t i = 1; i < stage.size(); i++)
+                jobSystem.Run([&run, index = stage[i]]() { run(index); }, &counter);
+            run(stage.front());
+            jobSystem.Wait(counter);
+        }
+    }
+}
@@ -0,0 +1,62 @@
+/*
+ * game/ecs/scheduler.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <ecs/world.h>
+#include <jobs/job_system.h>
+
+namespace ecs
+{
+    struct SystemStats
+    {
+        std::string name;
+        // Of the last Run(), in milliseconds.
+        double time = 0;
+        uint32_t stage = 0;
+    };
+
+    // Runs systems (functions over a World) in the order they were added, except that consecutive systems whose
+    // component accesses don't conflict are grouped into a stage, and a stage's systems run at the same time, as jobs.
+    // Two systems conflict when one writes a component the other reads or writes.
+    // Systems may run queries, including parallel ones on the same job system, but not change the World's structure.
+    class Scheduler final
+    {
+    public:
+        using SystemFunction = std::function<void(World& world)>;
+
+        Scheduler() = default;
+
+        // 'reads' and 'writes' are masks of the components the system accesses (see MaskOf()).
+        // A system that touches state outside of the World should be given a component standing for that state, so
+        // that it's ordered against the other systems that touch it.
+        void Add(const char* name, ComponentMask reads, ComponentMask writes, SystemFunction function);
+        // Runs every system, waiting for each stage to finish before starting the next.
+        void Run(World& world, jobs::JobSystem& jobSystem);
+
+        size_t GetStageCount() const { return m_stages.size(); }
+        const std::vector<SystemStats>& GetStats() const { return m_stats; }
+    private:
+        struct system
+        {
+            ComponentMask reads = 0;
+            ComponentMask writes = 0;
+            SystemFunction function;
+        };
+        std::vector<system> m_systems{};
+        // Indices into m_systems.
+        std::vector<std::vector<uint32_t>> m_stages{};
+        // Parallel to m_systems.
+        std::vector<SystemStats> m_stats{};
+    };
+}
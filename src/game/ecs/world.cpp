@@ -0,0 +1,216 @@
+/*
+ * game/ecs/world.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mutex>
+#include <vector>
+
+#include <ecs/world.h>
+
+#include <logger.h>
+
+namespace ecs
+{
+    struct component_info
+    {
+        size_t size = 0;
+        size_t alignment = 0;
+    };
+    static std::mutex s_componentsLock;
+    static std::vector<component_info> s_components;
+
+    ComponentId detail::register_component(size_t size, size_t alignment)
+    {
+        std::lock_guard<std::mutex> lock{ s_componentsLock };
+        if (s_components.size() >= MaxComponents)
+        {
+            // Every mask would be wrong from here on, so there's no recovering from this.
+            logger::Error("%s: More than %zu component types.\n", __func__, MaxComponents);
+            abort();
+        }
+        s_components.push_back(component_info{ size, alignment });
+        return s_components.size() - 1;
+    }
+    static size_t component_size(ComponentId component)
+    {
+        std::lock_guard<std::mutex> lock{ s_componentsLock };
+        return s_components[component].size;
+    }
+
+    Archetype::Archetype(ComponentMask mask)
+        : m_mask{ mask }
+    {
+        for (ComponentId component = 0; component < MaxComponents; component++)
+        {
+            if (!Has(component))
+                continue;
+            m_columnOf[component] = m_columns.size();
+            m_columns.emplace_back();
+            m_sizes.push_back(component_size(component));
+        }
+    }
+    void* Archetype::GetColumn(ComponentId component)
+    {
+        return Has(component) ? m_columns[m_columnOf[component]].data() : nullptr;
+    }
+    uint32_t Archetype::push(Entity entity)
+    {
+        for (size_t i = 0; i < m_columns.size(); i++)
+            m_columns[i].resize(m_columns[i].size() + m_sizes[i], 0);
+        m_entities.push_back(entity);
+        return m_entities.size() - 1;
+    }
+    Entity Archetype::remove(uint32_t row)
+    {
+        size_t last = m_entities.size() - 1;
+        Entity moved = NullEntity;
+        if (row != last)
+        {
+            for (size_t i = 0; i < m_columns.size(); i++)
+                memcpy(m_columns[i].data() + row*m_sizes[i], m_columns[i].data() + last*m_sizes[i], m_sizes[i]);
+            m_entities[row] = m_entities[last];
+            moved = m_entities[row];
+        }
+        for (size_t i = 0; i < m_columns.size(); i++)
+            m_columns[i].resize(last*m_sizes[i]);
+        m_entities.pop_back();
+        return moved;
+    }
+
+    World::World()
+    {
+        // Entities without components.
+        find_archetype(0);
+    }
+    bool World::check_structural_change(const char* function) const
+    {
+        if (m_nQueries.load(std::memory_order_relaxed))
+        {
+            logger::Error("%s: Entities and their components can't change while a query is running.\n", function);
+            return false;
+        }
+        return true;
+    }
+    Entity World::create(ComponentMask mask)
+    {
+        if (!check_structural_change(__func__))
+            return NullEntity;
+        Entity entity{};
+        if (!m_freeIndices.empty())
+        {
+            entity.index = m_freeIndices.back();
+            m_freeIndices.pop_back();
+        }
+        else
+        {
+            entity.index = m_records.size();
+            m_records.emplace_back();
+        }
+        record& created = m_records[entity.index];
+        entity.generation = created.generation;
+        created.archetype = find_archetype(mask);
+        created.row = m_archetypes[created.archetype]->push(entity);
+        m_nAlive++;
+        return entity;
+    }
+    bool World::Destroy(Entity entity)
+    {
+        if (!IsAlive(entity) || !check_structural_change(__func__))
+            return false;
+        record& destroyed = m_records[entity.index];
+        Entity moved = m_archetypes[destroyed.archetype]->remove(destroyed.row);
+        if (moved != NullEntity)
+            m_records[moved.index].row = destroyed.row;
+        // Stale handles no longer match.
+        destroyed.generation++;
+        m_freeIndices.push_back(entity.index);
+        m_nAlive--;
+        return true;
+    }
+    bool World::IsAlive(Entity entity) const
+    {
+        // Destroying an entity bumps its index's generation, so no handle matches a free index until it's reused.
+        return entity.index < m_records.size() && m_records[entity.index].generation == entity.generation;
+    }
+    void* World::add_component(Entity entity, ComponentId component)
+    {
+        if (!IsAlive(entity))
+            return nullptr;
+        record& added = m_records[entity.index];
+        Archetype* from = m_archetypes[added.archetype].get();
+        if (!from->Has(component))
+        {
+            if (!check_structural_change(__func__))
+                return nullptr;
+            auto edge = from->m_edges.find(component);
+            uint32_t to = edge != from->m_edges.end() ? edge->second : find_archetype(from->GetMask() | (ComponentMask{1} << component));
+            from->m_edges[component] = to;
+            move(entity, to);
+        }
+        Archetype& archetype = *m_archetypes[added.archetype];
+        return static_cast<uint8_t*>(archetype.GetColumn(component)) + added.row*archetype.m_sizes[archetype.m_columnOf[component]];
+    }
+    bool World::remove_component(Entity entity, ComponentId component)
+    {
+        if (!IsAlive(entity))
+            return false;
+        record& removed = m_records[entity.index];
+        Archetype* from = m_archetypes[removed.archetype].get();
+        if (!from->Has(component) || !check_structural_change(__func__))
+            return false;
+        auto edge = from->m_edges.find(component);
+        uint32_t to = edge != from->m_edges.end() ? edge->second : find_archetype(from->GetMask() & ~(ComponentMask{1} << component));
+        from->m_edges[component] = to;
+        move(entity, to);
+        return true;
+    }
+    void* World::get_component(Entity entity, ComponentId component) const
+    {
+        if (!IsAlive(entity))
+            return nullptr;
+        const record& found = m_records[entity.index];
+        Archetype& archetype = *m_archetypes[found.archetype];
+        if (!archetype.Has(component))
+            return nullptr;
+        return static_cast<uint8_t*>(archetype.GetColumn(component)) + found.row*archetype.m_sizes[archetype.m_columnOf[component]];
+    }
+    uint32_t World::find_archetype(ComponentMask mask)
+    {
+        auto found = m_archetypeOf.find(mask);
+        if (found != m_archetypeOf.end())
+            return found->second;
+        uint32_t index = m_archetypes.size();
+        m_archetypes.push_back(std::make_unique<Archetype>(mask));
+        m_archetypeOf.emplace(mask, index);
+        return index;
+    }
+    void World::move(Entity entity, uint32_t to)
+    {
+        record& moved = m_records[entity.index];
+        Archetype& from = *m_archetypes[moved.archetype];
+        Archetype& into = *m_archetypes[to];
+        uint32_t row = into.push(entity);
+        // Copy the components both archetypes have; the rest are either new (and zeroed) or dropped.
+        ComponentMask common = from.GetMask() & into.GetMask();
+        for (ComponentId component = 0; component < MaxComponents; component++)
+        {
+            if (!(common & (ComponentMask{1} << component)))
+                continue;
+            size_t size = from.m_sizes[from.m_columnOf[component]];
+            memcpy(static_cast<uint8_t*>(into.GetColumn(component)) + row*size,
+                static_cast<uint8_t*>(from.GetColumn(component)) + moved.row*size, size);
+        }
+        Entity swapped = from.remove(moved.row);
+        if (swapped != NullEntity)
+            m_records[swapped.index].row = moved.row;
+        moved.archetype = to;
+        moved.row = row;
+    }
+}
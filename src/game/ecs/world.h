@@ -0,0 +1,244 @@
+/*
+ * game/ecs/world.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <jobs/job_system.h>
+
+namespace ecs
+{
+    // Refers to an entity of a World. The generation is bumped whenever an entity is destroyed, so that handles to it
+    // stop being alive even once its index is reused.
+    struct Entity
+    {
+        uint32_t index = UINT32_MAX;
+        uint32_t generation = 0;
+
+        bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; }
+        bool operator!=(const Entity& other) const { return !(*this == other); }
+    };
+    static constexpr Entity NullEntity{};
+
+    using ComponentId = uint32_t;
+    // One bit per component id.
+    using ComponentMask = uint64_t;
+    static constexpr size_t MaxComponents = 64;
+
+    namespace detail
+    {
+        ComponentId register_component(size_t size, size_t alignment);
+    }
+    // Ids are given out on first use, and are the same for every World.
+    // Components are plain data: they're stored as bytes, and moved with memcpy when their entity changes archetype.
+    template<typename T>
+    ComponentId GetComponentId()
+    {
+        // 'const T' is the same component as 'T'.
+        if constexpr (!std::is_same_v<T, std::remove_cv_t<T>>)
+            return GetComponentId<std::remove_cv_t<T>>();
+        else
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "Components must be trivially copyable.");
+            static_assert(alignof(T) <= alignof(max_align_t), "Components can't be over-aligned.");
+            static const ComponentId id = detail::register_component(sizeof(T), alignof(T));
+            return id;
+        }
+    }
+    template<typename... Ts>
+    ComponentMask MaskOf()
+    {
+        return (ComponentMask{0} | ... | (ComponentMask{1} << GetComponentId<Ts>()));
+    }
+
+    // Every entity with exactly the same set of components, with each component in its own packed array, so that a
+    // query walks memory linearly. Entities are kept packed too: removing one moves the last into its place.
+    // Cannot be copied.
+    // Cannot be moved.
+    class Archetype final
+    {
+    public:
+        explicit Archetype(ComponentMask mask);
+        Archetype(const Archetype&) = delete;
+        Archetype& operator=(const Archetype&) = delete;
+        Archetype(Archetype&&) = delete;
+        Archetype& operator=(Archetype&&) = delete;
+
+        ComponentMask GetMask() const { return m_mask; }
+        bool Has(ComponentId component) const { return m_mask & (ComponentMask{1} << component); }
+        size_t GetCount() const { return m_entities.size(); }
+        const Entity* GetEntities() const { return m_entities.data(); }
+
+        // The component's array, indexed like GetEntities(); nullptr if the archetype doesn't have the component.
+        // Invalidated by adding entities to the archetype.
+        template<typename T>
+        T* GetColumn()
+        {
+            ComponentId component = GetComponentId<T>();
+            return Has(component) ? reinterpret_cast<T*>(m_columns[m_columnOf[component]].data()) : nullptr;
+        }
+        void* GetColumn(ComponentId component);
+
+        friend class World;
+    private:
+        // Appends an entity with zeroed components, returning its row.
+        uint32_t push(Entity entity);
+        // Moves the last entity into 'row'. Returns the entity that moved, or NullEntity if 'row' was the last.
+        Entity remove(uint32_t row);
+
+        ComponentMask m_mask = 0;
+        // Parallel to m_columns.
+        std::vector<size_t> m_sizes{};
+        std::vector<std::vector<uint8_t>> m_columns{};
+        uint8_t m_columnOf[MaxComponents]{};
+        std::vector<Entity> m_entities{};
+        // The archetypes with one more or one less component, by component id, found the first time they're needed.
+        std::unordered_map<ComponentId, uint32_t> m_edges{};
+    };
+
+    // Owns entities and their components, grouped into archetypes.
+    // Queries (Each(), ParallelEach()) can run concurrently with each other, and write to the components they're given,
+    // but nothing may create or destroy entities, or add or remove components, while any query is running.
+    // Cannot be copied.
+    // Cannot be moved.
+    class World final
+    {
+    public:
+        World();
+        World(const World&) = delete;
+        World& operator=(const World&) = delete;
+        World(World&&) = delete;
+        World& operator=(World&&) = delete;
+
+        template<typename... Ts>
+        Entity Create(const Ts&... components)
+        {
+            Entity entity = create(MaskOf<Ts...>());
+            if (entity != NullEntity)
+                ((*static_cast<Ts*>(get_component(entity, GetComponentId<Ts>())) = components), ...);
+            return entity;
+        }
+        // Returns false if the entity isn't alive.
+        bool Destroy(Entity entity);
+        bool IsAlive(Entity entity) const;
+
+        // Overwrites the component if the entity already has it. Returns nullptr if the entity isn't alive.
+        template<typename T>
+        T* Add(Entity entity, const T& component = T{})
+        {
+            T* added = static_cast<T*>(add_component(entity, GetComponentId<T>()));
+            if (added)
+                *added = component;
+            return added;
+        }
+        template<typename T>
+        bool Remove(Entity entity) { return remove_component(entity, GetComponentId<T>()); }
+        // Returns nullptr if the entity isn't alive or doesn't have the component.
+        // Invalidated by creating entities, or by adding or removing components.
+        template<typename T>
+        T* Get(Entity entity) { return static_cast<T*>(get_component(entity, GetComponentId<T>())); }
+        template<typename T>
+        const T* Get(Entity entity) const { return static_cast<const T*>(get_component(entity, GetComponentId<T>())); }
+        template<typename T>
+        bool Has(Entity entity) const { return get_component(entity, GetComponentId<T>()) != nullptr; }
+
+        // Calls 'function(entity, components...)' for every entity with all of the components Ts, archetype by
+        // archetype. Components can be const, to document that they're only read.
+        template<typename... Ts, typename F>
+        void Each(F&& function)
+        {
+            const ComponentMask mask = MaskOf<Ts...>();
+            query_scope scope{ *this };
+            for (const std::unique_ptr<Archetype>& archetype : m_archetypes)
+                if ((archetype->GetMask() & mask) == mask)
+                    each_in<Ts...>(*archetype, 0, archetype->GetCount(), function);
+        }
+        // Like Each(), but split into ranges of at most 'grainSize' entities, run across the job system.
+        // 'function' is called concurrently, so it must only write to the components it's given.
+        template<typename... Ts, typename F>
+        void ParallelEach(jobs::JobSystem& jobSystem, size_t grainSize, F&& function)
+        {
+            const ComponentMask mask = MaskOf<Ts...>();
+            query_scope scope{ *this };
+            // One range over the matching archetypes, one after the other.
+            std::vector<Archetype*> matching;
+            std::vector<size_t> starts;
+            size_t count = 0;
+            for (const std::unique_ptr<Archetype>& archetype : m_archetypes)
+            {
+                if ((archetype->GetMask() & mask) != mask || !archetype->GetCount())
+                    continue;
+                matching.push_back(archetype.get());
+                starts.push_back(count);
+                count += archetype->GetCount();
+            }
+            jobSystem.ParallelFor(count, grainSize, [&](size_t begin, size_t end) {
+                size_t i = std::upper_bound(starts.begin(), starts.end(), begin) - starts.begin() - 1;
+                for (; begin < end; i++)
+                {
+                    size_t last = std::min(end, starts[i] + matching[i]->GetCount());
+                    each_in<Ts...>(*matching[i], begin - starts[i], last - starts[i], function);
+                    begin = last;
+                }
+            });
+        }
+
+        size_t GetEntityCount() const { return m_nAlive; }
+        size_t GetArchetypeCount() const { return m_archetypes.size(); }
+    private:
+        struct record
+        {
+            uint32_t archetype = 0;
+            uint32_t row = 0;
+            uint32_t generation = 0;
+        };
+        // Counts the queries running, so that structural changes during one can be refused.
+        struct query_scope
+        {
+            World& world;
+            explicit query_scope(World& world) : world{ world } { world.m_nQueries.fetch_add(1, std::memory_order_relaxed); }
+            ~query_scope() { world.m_nQueries.fetch_sub(1, std::memory_order_relaxed); }
+        };
+
+        template<typename... Ts, typename F>
+        static void each_in(Archetype& archetype, size_t begin, size_t end, F& function)
+        {
+            const Entity* entities = archetype.GetEntities();
+            // The column pointers are looked up once per archetype, not once per entity.
+            std::apply([&](auto*... columns) {
+                for (size_t i = begin; i < end; i++)
+                    function(entities[i], columns[i]...);
+            }, std::make_tuple(archetype.GetColumn<Ts>()...));
+        }
+
+        Entity create(ComponentMask mask);
+        void* add_component(Entity entity, ComponentId component);
+        bool remove_component(Entity entity, ComponentId component);
+        void* get_component(Entity entity, ComponentId component) const;
+        uint32_t find_archetype(ComponentMask mask);
+        // Moves the entity to another archetype, keeping the components both have; new ones are zeroed.
+        void move(Entity entity, uint32_t to);
+        bool check_structural_change(const char* function) const;
+
+        std::vector<std::unique_ptr<Archetype>> m_archetypes{};
+        std::unordered_map<ComponentMask, uint32_t> m_archetypeOf{};
+        // Indexed by entity index.
+        std::vector<record> m_records{};
+        std::vector<uint32_t> m_freeIndices{};
+        size_t m_nAlive = 0;
+        std::atomic<uint32_t> m_nQueries{0};
+    };
+}
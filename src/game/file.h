@@ -4,13 +4,24 @@
  * Copyright (c) 2024 Omar Berrow
 */
 
+#pragma once
+
 #include <cstdint>
 
+#include <filesystem>
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#   define GAME_HAS_MMAP 1
+#endif
+
 namespace utility
 {
     inline static bool LoadFile(const char* path, std::string& str)
@@ -37,4 +48,96 @@ namespace utility
         file.close();
         return true;
     }
-}
\ No newline at end of file
+
+    // A file's size and last modification time, e.g., to tell whether something made from it is out of date, without
+    // reading it.
+    struct FileStamp
+    {
+        uint64_t size = 0;
+        // In the file clock's ticks; only comparable between stamps taken on the same platform.
+        int64_t time = 0;
+
+        bool operator==(const FileStamp& other) const { return size == other.size && time == other.time; }
+    };
+    inline static bool GetFileStamp(const char* path, FileStamp& stamp)
+    {
+        std::error_code error;
+        uintmax_t size = std::filesystem::file_size(path, error);
+        if (error)
+            return false;
+        std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+        if (error)
+            return false;
+        stamp.size = size;
+        stamp.time = time.time_since_epoch().count();
+        return true;
+    }
+
+    // A read-only view of a whole file.
+    // Memory-mapped where possible, so that nothing is read until it's touched, and nothing is copied.
+    // Otherwise, falls back to reading the file into memory.
+    // Cannot be copied.
+    // Cannot be moved.
+    class MappedFile final
+    {
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&&) = delete;
+        MappedFile& operator=(MappedFile&&) = delete;
+
+        bool Open(const char* path)
+        {
+            Close();
+#ifdef GAME_HAS_MMAP
+            int fd = open(path, O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat st{};
+            if (fstat(fd, &st) != 0 || st.st_size <= 0)
+            {
+                close(fd);
+                return false;
+            }
+            void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd); // The mapping keeps its own reference to the file.
+            if (data == MAP_FAILED)
+                return false;
+            m_data = data;
+            m_size = st.st_size;
+            return true;
+#else
+            if (!LoadFile(path, m_fallback))
+                return false;
+            m_data = m_fallback.data();
+            m_size = m_fallback.size();
+            return true;
+#endif
+        }
+        void Close()
+        {
+#ifdef GAME_HAS_MMAP
+            if (m_data)
+                munmap((void*)m_data, m_size);
+#else
+            m_fallback.clear();
+            m_fallback.shrink_to_fit();
+#endif
+            m_data = nullptr;
+            m_size = 0;
+        }
+
+        const void* GetData() const { return m_data; }
+        size_t GetSize() const { return m_size; }
+        bool IsOpen() const { return m_data != nullptr; }
+
+        ~MappedFile() { Close(); }
+    private:
+        const void* m_data = nullptr;
+        size_t m_size = 0;
+#ifndef GAME_HAS_MMAP
+        std::vector<uint8_t> m_fallback{};
+#endif
+    };
+}
@@ -0,0 +1,284 @@
+/*
+ * game/jobs/job_system.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <jobs/job_system.h>
+
+namespace jobs
+{
+    struct job
+    {
+        std::function<void()> function;
+        Counter* counter;
+    };
+
+    static constexpr size_t s_notWorker = (size_t)-1;
+    // The system the current thread runs jobs for, and its queue's index, if any.
+    static thread_local JobSystem* s_system = nullptr;
+    static thread_local size_t s_index = s_notWorker;
+
+    static void lock(std::atomic_flag& flag)
+    {
+        while (flag.test_and_set(std::memory_order_acquire))
+            std::this_thread::yield();
+    }
+    static void unlock(std::atomic_flag& flag)
+    {
+        flag.clear(std::memory_order_release);
+    }
+
+    bool JobSystem::work_deque::Push(job* pushed)
+    {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        int64_t top = m_top.load(std::memory_order_acquire);
+        if (bottom - top >= s_capacity)
+            return false;
+        m_jobs[bottom & (s_capacity - 1)].store(pushed, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        return true;
+    }
+    job* JobSystem::work_deque::Pop()
+    {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = m_top.load(std::memory_order_relaxed);
+        if (top > bottom)
+        {
+            // Empty.
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        job* popped = m_jobs[bottom & (s_capacity - 1)].load(std::memory_order_relaxed);
+        if (top == bottom)
+        {
+            // The last job; a thief may be taking it too.
+            if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                popped = nullptr;
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return popped;
+    }
+    job* JobSystem::work_deque::Steal()
+    {
+        int64_t top = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = m_bottom.load(std::memory_order_acquire);
+        if (top >= bottom)
+            return nullptr;
+        job* stolen = m_jobs[top & (s_capacity - 1)].load(std::memory_order_relaxed);
+        if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr; // Lost the race to another thief, or the owner.
+        return stolen;
+    }
+
+    size_t JobSystem::GetDefaultWorkerCount()
+    {
+        size_t nThreads = std::thread::hardware_concurrency();
+        return nThreads > 1 ? nThreads - 1 : 1;
+    }
+    JobSystem::JobSystem(size_t nWorkers)
+    {
+        for (size_t i = 0; i <= nWorkers; i++)
+            m_queues.push_back(std::make_unique<worker>());
+        s_system = this;
+        s_index = nWorkers;
+        for (size_t i = 0; i < nWorkers; i++)
+            m_workers.emplace_back(&JobSystem::worker_main, this, i);
+    }
+
+    void JobSystem::submit(job* submitted)
+    {
+        m_nOutstanding.fetch_add(1, std::memory_order_relaxed);
+        size_t self = s_system == this ? s_index : s_notWorker;
+        if (self == s_notWorker || !m_queues[self]->deque.Push(submitted))
+        {
+            std::lock_guard guard{ m_sharedLock };
+            m_shared.push_back(submitted);
+            m_nShared.fetch_add(1, std::memory_order_release);
+        }
+        m_epoch.fetch_add(1, std::memory_order_seq_cst);
+        if (m_nSleeping.load(std::memory_order_seq_cst))
+            m_epoch.notify_one();
+    }
+    void JobSystem::Run(std::function<void()> function, Counter* counter)
+    {
+        if (counter)
+            counter->m_count.fetch_add(1, std::memory_order_relaxed);
+        submit(new job{ std::move(function), counter });
+    }
+    void JobSystem::RunAfter(Counter& after, std::function<void()> function, Counter* counter)
+    {
+        if (counter)
+            counter->m_count.fetch_add(1, std::memory_order_relaxed);
+        job* continuation = new job{ std::move(function), counter };
+        lock(after.m_lock);
+        if (after.m_count.load(std::memory_order_acquire) != 0)
+        {
+            after.m_continuations.push_back(continuation);
+            unlock(after.m_lock);
+            return;
+        }
+        unlock(after.m_lock);
+        submit(continuation);
+    }
+    void JobSystem::finish(Counter& counter)
+    {
+        std::vector<job*> continuations;
+        lock(counter.m_lock);
+        if (counter.m_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            continuations.swap(counter.m_continuations);
+        unlock(counter.m_lock);
+        for (job* continuation : continuations)
+            submit(continuation);
+    }
+    void JobSystem::execute(job* executed, size_t self)
+    {
+        executed->function();
+        Counter* counter = executed->counter;
+        delete executed;
+        if (counter)
+            finish(*counter);
+        if (self != s_notWorker)
+            m_queues[self]->executed.fetch_add(1, std::memory_order_relaxed);
+        m_nOutstanding.fetch_sub(1, std::memory_order_release);
+    }
+    job* JobSystem::find_job(size_t self)
+    {
+        if (self != s_notWorker)
+            if (job* popped = m_queues[self]->deque.Pop())
+                return popped;
+        if (m_nShared.load(std::memory_order_acquire))
+        {
+            std::lock_guard guard{ m_sharedLock };
+            if (!m_shared.empty())
+            {
+                job* shared = m_shared.front();
+                m_shared.pop_front();
+                m_nShared.fetch_sub(1, std::memory_order_relaxed);
+                return shared;
+            }
+        }
+        // Start at a different victim on each thread, so that thieves don't all go for the same queue.
+        size_t start = self == s_notWorker ? 0 : self + 1;
+        for (size_t i = 0; i < m_queues.size(); i++)
+        {
+            size_t victim = (start + i) % m_queues.size();
+            if (victim == self)
+                continue;
+            if (job* stolen = m_queues[victim]->deque.Steal())
+            {
+                if (self != s_notWorker)
+                    m_queues[self]->stolen.fetch_add(1, std::memory_order_relaxed);
+                return stolen;
+            }
+        }
+        return nullptr;
+    }
+    void JobSystem::Wait(Counter& counter)
+    {
+        size_t self = s_system == this ? s_index : s_notWorker;
+        while (!counter.IsDone())
+        {
+            if (job* found = find_job(self))
+                execute(found, self);
+            else
+                std::this_thread::yield();
+        }
+        // The job that finished the counter may still hold its lock.
+        lock(counter.m_lock);
+        unlock(counter.m_lock);
+    }
+    void JobSystem::ParallelFor(size_t count, size_t grainSize, const std::function<void(size_t begin, size_t end)>& body)
+    {
+        if (!grainSize)
+            grainSize = 1;
+        if (count <= grainSize)
+        {
+            if (count)
+                body(0, count);
+            return;
+        }
+        Counter counter;
+        // Each range queues its upper half until it's small enough to run; 'body' outlives the jobs, since this waits.
+        std::function<void(size_t, size_t)> split = [&](size_t begin, size_t end)
+        {
+            while (end - begin > grainSize)
+            {
+                size_t middle = begin + (end - begin) / 2;
+                Run([&split, middle, end]() { split(middle, end); }, &counter);
+                end = middle;
+            }
+            body(begin, end);
+        };
+        split(0, count);
+        Wait(counter);
+    }
+    void JobSystem::worker_main(size_t index)
+    {
+        s_system = this;
+        s_index = index;
+        // Spin a little before sleeping, since more work usually follows shortly.
+        static constexpr int s_spinCount = 64;
+        int spins = 0;
+        while (!m_stop.load(std::memory_order_acquire))
+        {
+            // Read before looking for work, so that a job queued after the search changes it, and the wait returns.
+            uint32_t epoch = m_epoch.load(std::memory_order_seq_cst);
+            if (job* found = find_job(index))
+            {
+                execute(found, index);
+                spins = 0;
+                continue;
+            }
+            if (++spins < s_spinCount)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            m_nSleeping.fetch_add(1, std::memory_order_seq_cst);
+            m_epoch.wait(epoch, std::memory_order_seq_cst);
+            m_nSleeping.fetch_sub(1, std::memory_order_relaxed);
+            spins = 0;
+        }
+    }
+    std::vector<WorkerStats> JobSystem::GetStats() const
+    {
+        std::vector<WorkerStats> stats(m_queues.size());
+        for (size_t i = 0; i < m_queues.size(); i++)
+        {
+            stats[i].executed = m_queues[i]->executed.load(std::memory_order_relaxed);
+            stats[i].stolen = m_queues[i]->stolen.load(std::memory_order_relaxed);
+        }
+        return stats;
+    }
+    JobSystem::~JobSystem()
+    {
+        size_t self = s_system == this ? s_index : s_notWorker;
+        while (m_nOutstanding.load(std::memory_order_acquire))
+        {
+            if (job* found = find_job(self))
+                execute(found, self);
+            else
+                std::this_thread::yield();
+        }
+        m_stop.store(true, std::memory_order_release);
+        m_epoch.fetch_add(1, std::memory_order_seq_cst);
+        m_epoch.notify_all();
+        for (std::thread& thread : m_workers)
+            thread.join();
+        if (s_system == this)
+            s_system = nullptr;
+    }
+}
@@ -0,0 +1,137 @@
+/*
+ * game/jobs/job_system.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace jobs
+{
+    class JobSystem;
+    struct job;
+
+    // Counts the jobs of a group that haven't finished yet, so that the group can be waited for, or other jobs can be
+    // run once it has finished (see JobSystem::RunAfter()).
+    // Must outlive its jobs; a counter can be reused once its jobs have finished.
+    // Cannot be copied.
+    // Cannot be moved.
+    class Counter final
+    {
+    public:
+        Counter() = default;
+        Counter(const Counter&) = delete;
+        Counter& operator=(const Counter&) = delete;
+        Counter(Counter&&) = delete;
+        Counter& operator=(Counter&&) = delete;
+
+        bool IsDone() const { return m_count.load(std::memory_order_acquire) == 0; }
+
+        friend class JobSystem;
+    private:
+        std::atomic<size_t> m_count{0};
+        // Guards m_continuations, and is held while the count drops to zero, so that a waiter can't destroy the
+        // counter while the job that finished it is still using it.
+        std::atomic_flag m_lock{};
+        // Jobs to run once the count drops to zero.
+        std::vector<job*> m_continuations{};
+    };
+
+    struct WorkerStats
+    {
+        size_t executed = 0;
+        // Jobs taken from other workers' queues.
+        size_t stolen = 0;
+    };
+
+    // Runs jobs on a pool of worker threads.
+    // Each worker has its own deque of jobs: it pushes and pops jobs at one end, without contention, while idle workers
+    // steal from the other end. Jobs submitted from threads that aren't workers go through a shared queue.
+    // Dependencies are continuations rather than blocking waits: a job run after a counter is only queued once the
+    // counter's jobs have finished. Threads that do wait (see Wait()) run other jobs meanwhile.
+    // Cannot be copied.
+    // Cannot be moved.
+    class JobSystem final
+    {
+    public:
+        // With no workers, jobs only run on threads that wait for them.
+        explicit JobSystem(size_t nWorkers = GetDefaultWorkerCount());
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+        JobSystem(JobSystem&&) = delete;
+        JobSystem& operator=(JobSystem&&) = delete;
+
+        // Queues 'function' to run on a worker, counted by 'counter' if it isn't nullptr.
+        void Run(std::function<void()> function, Counter* counter = nullptr);
+        // Queues 'function' once every job counted by 'after' has finished (immediately if they already have).
+        void RunAfter(Counter& after, std::function<void()> function, Counter* counter = nullptr);
+        // Calls 'body' with subranges of [0, count), of at most 'grainSize' elements each, across the workers, and
+        // waits for all of them.
+        // The range is split in halves, so that a worker stealing from another takes half of its remaining work.
+        void ParallelFor(size_t count, size_t grainSize, const std::function<void(size_t begin, size_t end)>& body);
+        // Runs jobs until every job counted by 'counter' has finished.
+        void Wait(Counter& counter);
+
+        // Not counting the threads that run jobs while they wait.
+        size_t GetWorkerCount() const { return m_workers.size(); }
+        // One per hardware thread, minus one for the thread creating the system, which runs jobs while it waits.
+        static size_t GetDefaultWorkerCount();
+        // One per worker, followed by one for the thread that created the system.
+        std::vector<WorkerStats> GetStats() const;
+
+        // Waits for every queued job first; jobs waiting for counters that never finish are never run.
+        ~JobSystem();
+    private:
+        // A Chase-Lev deque ("Correct and Efficient Work-Stealing for Weak Memory Models", Lê et al.), of fixed
+        // capacity; only its owner pushes and pops, at the bottom, and anyone steals, from the top.
+        class work_deque
+        {
+        public:
+            bool Push(job* pushed);
+            job* Pop();
+            job* Steal();
+        private:
+            static constexpr int64_t s_capacity = 4096;
+            alignas(64) std::atomic<int64_t> m_top{0};
+            alignas(64) std::atomic<int64_t> m_bottom{0};
+            std::atomic<job*> m_jobs[s_capacity]{};
+        };
+        struct worker
+        {
+            work_deque deque{};
+            std::atomic<size_t> executed{0};
+            std::atomic<size_t> stolen{0};
+        };
+
+        void submit(job* submitted);
+        job* find_job(size_t self);
+        void execute(job* executed, size_t self);
+        void finish(Counter& counter);
+        void worker_main(size_t index);
+
+        // m_queues[i] belongs to worker i, and the last one to the thread that created the system.
+        std::vector<std::unique_ptr<worker>> m_queues{};
+        std::vector<std::thread> m_workers{};
+        // Jobs from other threads.
+        std::mutex m_sharedLock{};
+        std::deque<job*> m_shared{};
+        std::atomic<size_t> m_nShared{0};
+        // Bumped whenever a job is queued; sleeping workers wait for it to change.
+        std::atomic<uint32_t> m_epoch{0};
+        std::atomic<uint32_t> m_nSleeping{0};
+        // Jobs queued or running.
+        std::atomic<size_t> m_nOutstanding{0};
+        std::atomic<bool> m_stop{false};
+    };
+}
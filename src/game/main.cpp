@@ -18,15 +18,43 @@
 #endif
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <renderer/shader.h>
+#include <renderer/program_cache.h>
+#include <renderer/shader_library.h>
 #include <renderer/vao.h>
 #include <renderer/mesh.h>
+#include <renderer/mesh_format.h>
 #include <renderer/controls.h>
 #include <renderer/window_callbacks.h>
+#include <renderer/framebuffer.h>
+#include <renderer/gpu_timer.h>
+#include <renderer/frame_ring_buffer.h>
+#include <renderer/culling.h>
+#include <renderer/bounds.h>
+#include <renderer/state_cache.h>
+#include <renderer/render_queue.h>
+#include <renderer/lod.h>
+
+#include <scene/bvh.h>
+#include <scene/transform_hierarchy.h>
+#include <scene/components.h>
+#include <scene/systems.h>
+
+#include <sim/fixed_timestep.h>
+#include <sim/frame_pipeline.h>
+
+#include <bench/frame_stats.h>
+#include <bench/camera_path.h>
 
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/ext/matrix_float4x4.hpp>
@@ -38,26 +66,130 @@
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
 
+#include <assets/asset_loader.h>
+#include <assets/texture_streamer.h>
+
+#include <jobs/job_system.h>
+
+#include <ecs/world.h>
+#include <ecs/scheduler.h>
+
 #include <file.h>
 #include <logger.h>
 
 GLFWwindow* g_window;
 
-int main(int argc, const char** argv)
+struct options
+{
+    logger::log_level logLevel = logger::log_level::Log;
+    // Render into an offscreen framebuffer, without needing a display.
+    bool headless = false;
+    // The amount of frames to render before exiting, or zero to run until the window is closed.
+    size_t nFrames = 0;
+    int width = 1024;
+    int height = 768;
+    // Where to write benchmark results to, or nullptr for stdout.
+    const char* output = nullptr;
+    // The video memory budget for streamed textures, in bytes.
+    size_t textureBudget = 256*1024*1024;
+    // Draw static geometry with one draw call per command instead of glMultiDrawElementsIndirect, even where it's supported.
+    bool noIndirect = false;
+    // Where linked program binaries are cached.
+    const char* shaderCache = "shader_cache";
+    // Simulation ticks per second.
+    double tickRate = 60;
+    // The most ticks run in one frame, however far behind the simulation is.
+    uint32_t maxTicks = 5;
+    // Simulate on the GL thread, instead of a frame ahead on the simulation thread.
+    bool noPipeline = false;
+};
+
+static bool parse_options(int argc, const char** argv, options& opts)
 {
-    if (argc >= 2)
+#ifdef GAME_BENCH
+    opts.headless = true;
+    opts.nFrames = 600;
+#endif
+    for (int i = 1; i < argc; i++)
     {
-        logger::log_level logLevel = (logger::log_level)std::atoi(argv[1]);
-        logger::SetLogLevel(logLevel);
+        const char* arg = argv[i];
+        if (strcmp(arg, "--headless") == 0)
+            opts.headless = true;
+        else if (strncmp(arg, "--frames=", 9) == 0)
+            opts.nFrames = strtoull(arg + 9, nullptr, 10);
+        else if (strncmp(arg, "--width=", 8) == 0)
+            opts.width = atoi(arg + 8);
+        else if (strncmp(arg, "--height=", 9) == 0)
+            opts.height = atoi(arg + 9);
+        else if (strncmp(arg, "--output=", 9) == 0)
+            opts.output = arg + 9;
+        else if (strncmp(arg, "--texture-budget=", 17) == 0)
+            opts.textureBudget = strtoull(arg + 17, nullptr, 10)*1024*1024;
+        else if (strcmp(arg, "--no-indirect") == 0)
+            opts.noIndirect = true;
+        else if (strncmp(arg, "--shader-cache=", 15) == 0)
+            opts.shaderCache = arg + 15;
+        else if (strncmp(arg, "--tick-rate=", 12) == 0)
+            opts.tickRate = atof(arg + 12);
+        else if (strncmp(arg, "--max-ticks=", 12) == 0)
+            opts.maxTicks = strtoul(arg + 12, nullptr, 10);
+        else if (strcmp(arg, "--no-pipeline") == 0)
+            opts.noPipeline = true;
+        else if (arg[0] >= '0' && arg[0] <= '9')
+            opts.logLevel = (logger::log_level)atoi(arg); // For compatibility, a bare number is the log level.
+        else
+        {
+            logger::Error("Unrecognized option '%s'.\n"
+                "Usage: %s [log level] [--headless] [--frames=N] [--width=N] [--height=N] [--output=file.json] [--texture-budget=MB] [--no-indirect] [--shader-cache=dir] [--tick-rate=Hz] [--max-ticks=N] [--no-pipeline]\n",
+                arg, argv[0]);
+            return false;
+        }
+    }
+    if (opts.width <= 0 || opts.height <= 0)
+    {
+        logger::Error("Invalid resolution %dx%d.\n", opts.width, opts.height);
+        return false;
     }
-    else {
-        logger::SetLogLevel(logger::log_level::Log);
+    if (opts.tickRate <= 0 || !opts.maxTicks)
+    {
+        logger::Error("Invalid tick rate %f Hz, or maximum ticks per frame %u.\n", opts.tickRate, opts.maxTicks);
+        return false;
     }
-    logger::Log("Initializing renderer.\n");
+    return true;
+}
+
+static GLFWwindow* open_window(const options& opts)
+{
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (!opts.headless)
+        return glfwCreateWindow(opts.width, opts.height, "Game", nullptr, nullptr);
+    // There is no display to speak of, so we need a context API that can work without one.
+    // Prefer EGL (works with llvmpipe through the surfaceless platform), and fall back to OSMesa.
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+    GLFWwindow* window = glfwCreateWindow(opts.width, opts.height, "Game", nullptr, nullptr);
+    if (window)
+        return window;
+    logger::Debug("%s: Could not create an EGL context, trying OSMesa.\n", __func__);
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+    return glfwCreateWindow(opts.width, opts.height, "Game", nullptr, nullptr);
+}
+
+int main(int argc, const char** argv)
+{
+    options opts{};
+    logger::SetLogLevel(logger::log_level::Log);
+    if (!parse_options(argc, argv, opts))
+        return 1;
+    logger::SetLogLevel(opts.logLevel);
+    logger::Log("Initializing renderer%s.\n", opts.headless ? " (headless)" : "");
     logger::Debug("%s: Starting GLFW.\n", __func__);
 
 #ifdef __linux__
-    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_X11);
+    glfwInitHint(GLFW_PLATFORM, opts.headless ? GLFW_PLATFORM_NULL : GLFW_PLATFORM_X11);
 #endif
 
     glewExperimental = true;
@@ -68,7 +200,7 @@ int main(int argc, const char** argv)
     }
 
 #ifdef __linux__
-    if (glfwGetPlatform() != GLFW_PLATFORM_X11)
+    if (!opts.headless && glfwGetPlatform() != GLFW_PLATFORM_X11)
     {
         logger::Error("Fatal error: GLFW is not using X11 as the windowing system.\n");
         return 2;
@@ -77,22 +209,17 @@ int main(int argc, const char** argv)
 
     logger::Debug("%s: Opening window.\n", __func__);
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    g_window = glfwCreateWindow(1024, 768, "Game", nullptr, nullptr);
+    g_window = open_window(opts);
     if (!g_window)
     {
-        logger::Error("%s: Could not open window.", __func__);
+        logger::Error("%s: Could not open window.\n", __func__);
         glfwTerminate();
         return 1;
     }
     glfwMakeContextCurrent(g_window);
-    // glfwSwapInterval(0);
     glewExperimental = true;
-    glfwSwapInterval(1);
+    // Headless runs are benchmarks, so don't let vsync cap them.
+    glfwSwapInterval(opts.headless ? 0 : 1);
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
     glDepthFunc(GL_LESS);
@@ -100,21 +227,27 @@ int main(int argc, const char** argv)
     // glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 #ifdef DEBUG_SCREEN
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImGuiIO& io = ImGui::GetIO(); (void)io;
-    io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
-    io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;
+    if (!opts.headless)
+    {
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGuiIO& io = ImGui::GetIO(); (void)io;
+        io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
+        io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;
 
-    ImGui_ImplGlfw_InitForOpenGL(g_window, true);
+        ImGui_ImplGlfw_InitForOpenGL(g_window, true);
 
-    ImGui::StyleColorsDark();
+        ImGui::StyleColorsDark();
 
-    ImGui_ImplOpenGL3_Init("#version 330 core");
+        ImGui_ImplOpenGL3_Init("#version 330 core");
+    }
 #endif
 
     logger::Debug("%s: Initializing GLEW.\n", __func__);
     GLenum err = glewInit();
+    // Without GLX, GLEW fails to initialize its GLX extensions but has already loaded the core GL functions.
+    if (err == GLEW_ERROR_NO_GLX_DISPLAY && opts.headless)
+        err = GLEW_OK;
     if (err != GLEW_OK)
     {
         logger::Error("%s: Could not initialize GLEW. Error: %s\n", __func__, glewGetErrorString(err));
@@ -122,114 +255,372 @@ int main(int argc, const char** argv)
     }
 
     logger::Debug("%s: Using GLEW %s.\n", __func__, glewGetString(GLEW_VERSION));
+    const char* rendererName = (const char*)glGetString(GL_RENDERER);
+    logger::Debug("%s: Using renderer %s.\n", __func__, rendererName);
 
-    renderer::Shader vertexShader{ renderer::ShaderType::Vertex };
-    renderer::Shader fragmentShader{ renderer::ShaderType::Fragment };
-    GLint status = vertexShader.CompileShader(""
-        "#version 330 core\n"
-        "layout(location = 0) in vec3 vertexPos;\n"
-        "layout(location = 1) in vec2 vertexUV;\n"
-        "uniform mat4 MVP;\n"
-        "out vec2 uv;\n"
-        "\n"
-        "void main()\n"
-        "{\n"
-        "   gl_Position = MVP * vec4(vertexPos, 1.0);\n"
-        "   uv = vec2(vertexUV.x, 1.0-vertexUV.y);\n"
-        "}"
-    );
-    if (!status)
-    {
-        logger::Error("Vertex shader failed compile!\n%s\n", vertexShader.GetCompileMessages().data());
-        glfwTerminate();
-        return 1;
-    }
-    status = fragmentShader.CompileShader(""
-        "#version 330 core\n"
-        "out vec4 color;\n"
-        "in vec2 uv;\n"
-        "uniform sampler2D textureSampler;\n"
-        "\n"
-        "void main()\n"
-        "{\n"
-        "   color = vec4(texture(textureSampler, uv));\n"
-        "}"
-    );
-
-    if (!status)
-    {
-        logger::Error("Fragment shader failed compile!\n%s\n", fragmentShader.GetCompileMessages().data());
-        glfwTerminate();
-        return 1;
-    }
-    renderer::Program program;
-    vertexShader.BindShader(program);
-    fragmentShader.BindShader(program);
-    program.Link();
-
+    // Start loading assets first, so that they load while we compile shaders.
+    jobs::JobSystem jobSystem;
+    assets::AssetLoader loader{ jobSystem };
     renderer::VAO vao;
-    renderer::Mesh meshObj;
+    // Every static mesh is drawn from one batch.
+    renderer::StaticBatch staticBatch;
+    int32_t cubeMesh = -1;
+    if (opts.noIndirect)
+        staticBatch.DisableIndirect();
     renderer::Texture textureObj;
-    std::string dat = "";
-    std::vector<uint8_t> texture;
-    if (!utility::LoadFile("cube.obj", dat))
+    assets::TextureStreamer textureStreamer{ loader, opts.textureBudget };
+    assets::AssetHandle textureHandle = textureStreamer.Add(textureObj, vao, "cube.dds", "cube.bmp");
+    assets::AssetHandle meshHandle = loader.LoadStaticMesh(staticBatch, cubeMesh, "cube.gmesh", "cube.obj");
+    // The props' textures are small, so they're packed into the layers of one array texture; the props' materials then
+    // share a texture, and switching between them only changes the layer.
+    renderer::Texture propTextures;
+    std::vector<assets::TexturedMesh> propMeshes = {
+        { "cube.obj", "checker.bmp" },
+        { "cube.obj", "grid.bmp" },
+    };
+    assets::AssetHandle propHandle = loader.LoadTexturedMeshes(staticBatch, propTextures, vao, propMeshes, 256);
+    // A whole model, imported with its node hierarchy; each of its submeshes is a mesh of the batch.
+    int32_t modelMesh = -1;
+    renderer::ImportedModel importedModel;
+    assets::AssetHandle modelHandle = loader.LoadStaticModel(staticBatch, modelMesh, importedModel, "cube.obj");
+
+    // Every shader variant is compiled up front, in the background where the driver can, and from the program cache
+    // when possible (so only the first run, or the first after a driver update, compiles them).
+    renderer::ProgramCache programCache{ opts.shaderCache };
+    renderer::ShaderLibrary shaders{ programCache };
+    enum { MeshInstanced = 1 << 0, MeshAlphaTest = 1 << 1, MeshTextureArray = 1 << 2 };
+    const uint32_t meshShaders = shaders.AddPermutations("shaders/mesh.vert", "shaders/mesh.frag", { "INSTANCED", "ALPHA_TEST", "TEXTURE_ARRAY" });
+    const uint32_t meshProgram = meshShaders + MeshInstanced;
+    const uint32_t meshArrayProgram = meshShaders + MeshInstanced + MeshTextureArray;
+    if (!shaders.Compile())
     {
-        logger::Error("Could not find file %s.", "cube.obj");
         glfwTerminate();
         return 1;
     }
-    if (!utility::LoadFile("cube.bmp", texture))
+    renderer::Program* program = nullptr;
+    renderer::Program* arrayProgram = nullptr;
+    // Per-frame data lives in the frame ring buffer, bound to these binding points.
+    const GLuint frameBlockBinding = 0;
+    glClearColor(0.0f, 0.0f, 0.4f, 0.0f);
+    // Scene objects are entities, whose transforms live in the hierarchy; they become renderable once the mesh (and
+    // therefore its bounds) is loaded.
+    scene::TransformHierarchy hierarchy;
+    ecs::World world;
+    // Each model refers to where its mesh's index in the batch is loaded to: the cubes draw the cooked cube, and the
+    // props alternate between the packed textures' meshes. The imported model's instances are added once it's loaded.
+    std::vector<std::pair<ecs::Entity, const int32_t*>> models = {
+        { world.Create(scene::TransformComponent{ hierarchy.Add(scene::Transform{ glm::vec3(0,0,0), glm::quat(glm::vec3(90, 45, 0)) }) },
+            scene::WorldTransformComponent{}), &cubeMesh },
+        { world.Create(scene::TransformComponent{ hierarchy.Add(scene::Transform{ glm::vec3(5,0,0) }) },
+            scene::WorldTransformComponent{}), &cubeMesh },
+    };
+    for (int i = 0; i < 6; i++)
+        models.emplace_back(world.Create(
+            scene::TransformComponent{ hierarchy.Add(scene::Transform{ glm::vec3(i*2.5f - 4, 0, 8), glm::quat(1, 0, 0, 0), glm::vec3(0.5f) }) },
+            scene::WorldTransformComponent{}), &propMeshes[i % propMeshes.size()].mesh);
+    // What the batch's meshes are drawn with, set up once the scene is loaded.
+    struct material
     {
-        logger::Error("Could not find file %s.", "cube.bmp");
-        glfwTerminate();
-        return 1;
-    }
-    std::vector<GLfloat> vertices, textureCoords, normals;
-    std::vector<GLuint> indices;
-    if (!renderer::LoadMesh(dat.c_str(), dat.length(), vertices, indices, textureCoords, normals))
+        renderer::Program* program = nullptr;
+        renderer::Texture* texture = nullptr;
+        uint32_t textureLayer = 0;
+        // The material's range of the batch's commands, this frame.
+        size_t firstCommand = 0;
+        size_t nCommands = 0;
+    };
+    std::vector<material> materials;
+    // Indexed by the batch's meshes.
+    std::vector<size_t> meshMaterials;
+    ecs::Entity camera = world.Create(scene::CameraComponent{});
+    bool sceneReady = false;
+    bool shadersLogged = false;
+    // A BVH over the world-space bounds of every renderable entity; object i is sceneObjects[i].
+    std::vector<renderer::Bounds> worldBounds;
+    std::vector<ecs::Entity> sceneObjects;
+    scene::BVH sceneBvh;
+    renderer::RenderQueue renderQueue;
+    renderer::FrameRingBuffer frameBuffer{ 1024*1024 };
+
+    renderer::Framebuffer offscreen;
+    if (opts.headless)
     {
-        glfwTerminate();
-        return 1;
+        // Benchmarks should measure rendering, not loading.
+        loader.Finish();
+        shaders.Finish();
+        if (offscreen.Create(opts.width, opts.height) == GL_FALSE)
+        {
+            logger::Error("%s: Could not create the offscreen framebuffer.\n", __func__);
+            glfwTerminate();
+            return 1;
+        }
+        renderer::UpdateProjectionMatrix(opts.width, opts.height);
     }
-    meshObj.SetVAAIndex(0);
-    meshObj.Load(vertices, indices);
-    textureObj.Load(texture.data(), texture.size(), textureCoords);
-    textureObj.SetVAAIndex(1);
-    textureObj.Bind(vao);
-    meshObj.Bind(vao);
-    program.Use();
-    GLuint MatrixID = program.GetUniformLocation("MVP");
-    GLuint TextureSamplerId = program.GetUniformLocation("textureSampler");
-    textureObj.SetTextureSamplerUniform(TextureSamplerId);
-    glClearColor(0.0f, 0.0f, 0.4f, 0.0f);
-    glm::quat rotation = glm::quat(glm::vec3(90, 45, 0));
-    glm::mat4 rotationMatrix = glm::toMat4(rotation);
-    glm::mat4 model1{};
-    glm::mat4 model2{};
-    model1 = glm::translate(glm::mat4(1.f), glm::vec3(-0,0,0))*rotationMatrix*glm::mat4(1.f);
-    model2 = glm::translate(glm::mat4(1.f), glm::vec3( 5,0,0))*glm::mat4(1.f);
-
-    renderer::EnableControls();
-    logger::Log("Initialized renderer.\n");
-    while (!glfwWindowShouldClose(g_window))
+    else
+        renderer::EnableControls();
+
+    renderer::GpuTimer gpuTimer;
+    bench::FrameStats frameStats;
+    std::vector<double> gpuTimes;
+    double frameTime = 0;
+    // The simulation runs at a fixed rate, independent of the frame rate; rendering interpolates between its ticks.
+    sim::FixedTimestep timestep{ opts.tickRate, opts.maxTicks };
+    auto lastFrameStart = std::chrono::steady_clock::now();
+
+    // The simulation's systems, run once per frame by the simulation thread. The transform and camera systems don't
+    // touch the same components, so they run at the same time.
+    sim::RenderPacket* renderPacket = nullptr;
+    int renderViewportHeight = 0;
+    ecs::Scheduler systems;
+    systems.Add("transforms", ecs::MaskOf<scene::TransformComponent, scene::RenderableComponent>(),
+        ecs::MaskOf<scene::WorldTransformComponent, scene::BoundsComponent>(), [&](ecs::World& world)
+        {
+            // The BVH only needs refitting when something moved.
+            if (!scene::UpdateTransforms(world, hierarchy, jobSystem) || sceneObjects.empty())
+                return;
+            scene::UpdateBounds(world, jobSystem);
+            world.Each<const scene::RenderableComponent, const scene::BoundsComponent>(
+                [&](ecs::Entity, const scene::RenderableComponent& renderable, const scene::BoundsComponent& bounds) {
+                    worldBounds[renderable.object] = bounds.world;
+                });
+            sceneBvh.Refit(worldBounds);
+        });
+    systems.Add("cameras", 0, ecs::MaskOf<scene::CameraComponent>(), [](ecs::World& world) { scene::UpdateCameras(world); });
+    systems.Add("render", ecs::MaskOf<scene::CameraComponent, scene::WorldTransformComponent, scene::BoundsComponent>(),
+        ecs::MaskOf<scene::RenderableComponent>(), [&](ecs::World& world)
+        {
+            const scene::CameraComponent& view = *world.Get<scene::CameraComponent>(camera);
+            renderPacket->viewProjection = view.viewProjection;
+            renderPacket->cameraPosition = view.position;
+            renderPacket->cameraDirection = view.direction;
+            renderPacket->cameraSpeed = view.speed;
+            if (!sceneObjects.empty())
+                scene::CollectRenderables(world, sceneBvh, sceneObjects, view, staticBatch, renderViewportHeight, *renderPacket);
+        });
+
+    // Runs on the simulation thread, one frame ahead of the GL thread; everything it reads, the GL thread only changes
+    // while it waits for the next packet (i.e., not while it renders).
+    auto simulate = [&](const sim::FrameInput& frameInput, sim::RenderPacket& packet)
     {
-        glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+        if (opts.headless)
+        {
+            // There is no input in headless mode, so follow the benchmark camera path.
+            glm::vec3 position{}, direction{};
+            bench::CameraPathAt(frameInput.frame, opts.nFrames ? opts.nFrames : 600, position, direction);
+            renderer::SetCamera(position, direction);
+        }
+        // Every tick this frame sees the same snapshot of the input.
+        packet.nTicks = timestep.Advance(frameInput.elapsed);
+        for (uint32_t i = 0; i < packet.nTicks; i++)
+            renderer::SimulateCamera(frameInput.input, (float)timestep.GetTickLength());
+        renderer::InterpolateCamera(timestep.GetAlpha());
+        renderPacket = &packet;
+        renderViewportHeight = frameInput.viewportHeight;
+        systems.Run(world, jobSystem);
+    };
+    sim::FramePipeline pipeline{ simulate, !opts.noPipeline };
+    // Changes from the debug screen, applied once the simulation thread is idle.
+    float pendingFov = renderer::g_fov;
+    float pendingMouseSpeed = renderer::g_mouseSpeed;
+    bool pendingToggleControls = false;
+    auto viewportHeight = [&]()
+    {
+        int height = opts.height;
+        if (!opts.headless)
+            glfwGetFramebufferSize(g_window, nullptr, &height);
+        return height;
+    };
+
+    logger::Log("Initialized renderer%s.\n", pipeline.IsThreaded() ? "" : " (without the simulation thread)");
+    // The first frame's packet, which has no frame before it to be built during.
+    sim::FrameInput frameInput{};
+    frameInput.viewportHeight = viewportHeight();
+    pipeline.Kick(frameInput);
+    const sim::RenderPacket* packet = &pipeline.Wait();
+    // Set when the scene can't be loaded; the run then fails, without reporting frame times.
+    int status = 0;
+    for (size_t frame = 0; !glfwWindowShouldClose(g_window); frame++)
+    {
+        if (opts.nFrames && frame >= opts.nFrames)
+            break;
+        auto frameStart = std::chrono::steady_clock::now();
+        frameTime = std::chrono::duration<double, std::milli>(frameStart - lastFrameStart).count();
+        lastFrameStart = frameStart;
+        renderer::state::ResetStats();
+
+        // The simulation thread is idle until the next packet is kicked, so shared state can be changed here.
+        frameInput = sim::FrameInput{};
+        frameInput.frame = frame + 1;
+        frameInput.elapsed = frameTime / 1000;
+        frameInput.viewportHeight = viewportHeight();
+        if (opts.headless)
+            offscreen.Bind();
+        else
+        {
+            // Input is read once per frame.
+            renderer::PollInput(frameInput.input);
+            frameInput.input.toggleControls |= pendingToggleControls;
+            pendingToggleControls = false;
+            renderer::HandleInput(frameInput.input);
+        }
+        renderer::g_fov = pendingFov;
+        renderer::g_mouseSpeed = pendingMouseSpeed;
+
+        loader.Update(std::chrono::milliseconds(2));
+        if (meshHandle.Failed() || textureHandle.Failed() || propHandle.Failed() || modelHandle.Failed())
+        {
+            logger::Error("%s: Could not load the scene.\n", __func__);
+            status = 1;
+            break;
+        }
+        shaders.Poll();
+        if (shaders.Failed(meshProgram) || shaders.Failed(meshArrayProgram))
+        {
+            logger::Error("%s: Could not build the scene's shaders.\n", __func__);
+            status = 1;
+            break;
+        }
+        if (!program && shaders.IsReady(meshProgram))
+        {
+            program = shaders.GetProgram(meshProgram);
+            program->Use();
+            program->BindUniformBlock("Frame", frameBlockBinding);
+        }
+        if (!arrayProgram && shaders.IsReady(meshArrayProgram))
+        {
+            arrayProgram = shaders.GetProgram(meshArrayProgram);
+            arrayProgram->Use();
+            arrayProgram->BindUniformBlock("Frame", frameBlockBinding);
+        }
+        if (program && !shaders.GetPendingCount() && !shadersLogged)
+        {
+            const renderer::ShaderLibraryStats& shaderStats = shaders.GetStats();
+            const renderer::ProgramCacheStats& cacheStats = programCache.GetStats();
+            logger::Log("Shaders: %zu variants (%zu cached, %zu compiled, %zu failed) in %.3f ms; cache saved %.3f ms.\n",
+                shaderStats.nVariants, shaderStats.nCached, shaderStats.nCompiled, shaderStats.nFailed,
+                shaderStats.compileTime, cacheStats.savedTime);
+            shadersLogged = true;
+        }
+        sceneReady = meshHandle.IsReady() && textureHandle.IsReady() && propHandle.IsReady() && modelHandle.IsReady() &&
+            program && arrayProgram;
+        if (sceneReady && !staticBatch.IsBuilt() && staticBatch.Build(vao) != GL_TRUE)
+        {
+            logger::Error("%s: Could not build the static batch.\n", __func__);
+            status = 1;
+            break;
+        }
+        if (sceneReady && sceneObjects.empty())
+        {
+            // The cube and the model's submeshes (which have no textures of their own) use the streamed texture. Each prop
+            // material draws its own copy of the cube, whose texture coordinates were remapped to where its texture was
+            // packed.
+            materials.push_back(material{ program, &textureObj, 0 });
+            meshMaterials.assign(staticBatch.GetMeshCount(), 0);
+            for (const assets::TexturedMesh& prop : propMeshes)
+            {
+                meshMaterials[prop.mesh] = materials.size();
+                materials.push_back(material{ arrayProgram, &propTextures, prop.region.layer });
+            }
+            // The transform system has run since the models were created, so their world matrices are up to date.
+            std::vector<std::pair<ecs::Entity, int32_t>> renderables;
+            for (const auto& [model, mesh] : models)
+                renderables.emplace_back(model, *mesh);
+            // The imported model's nodes become hierarchy nodes under one root, and each of its submesh instances an
+            // entity. The simulation thread is idle, so the hierarchy can be updated here.
+            uint32_t modelRoot = hierarchy.Add(scene::Transform{ glm::vec3(-6, 0, 0) });
+            std::vector<uint32_t> modelNodes(importedModel.nodes.GetCount());
+            for (size_t i = 0; i < modelNodes.size(); i++)
+            {
+                int32_t parent = importedModel.nodes.parents[i];
+                modelNodes[i] = hierarchy.Add(scene::DecomposeTransform(importedModel.nodes.localTransforms[i]),
+                    parent < 0 ? modelRoot : modelNodes[parent]);
+            }
+            hierarchy.Update();
+            for (const renderer::SubmeshInstance& instance : importedModel.instances)
+            {
+                uint32_t node = modelNodes[instance.node];
+                renderables.emplace_back(world.Create(scene::TransformComponent{ node }, scene::WorldTransformComponent{ hierarchy.GetWorld(node) }),
+                    modelMesh + (int32_t)instance.submesh);
+            }
+            for (const auto& [model, mesh] : renderables)
+            {
+                const renderer::Bounds& local = staticBatch.GetBounds(mesh);
+                scene::BoundsComponent bounds{ local, renderer::TransformBounds(local, world.Get<scene::WorldTransformComponent>(model)->world) };
+                world.Add(model, bounds);
+                world.Add(model, scene::RenderableComponent{ mesh, 0, (uint32_t)sceneObjects.size() });
+                worldBounds.push_back(bounds.world);
+                sceneObjects.push_back(model);
+            }
+            sceneBvh.Build(worldBounds);
+        }
 
-        glm::mat4 mvp1 = renderer::ProjectionMatrix*renderer::ViewMatrix*model1;
-        glm::mat4 mvp2 = renderer::ProjectionMatrix*renderer::ViewMatrix*model2;
+        // Simulate the next frame while this one is rendered, from the packet simulated during the last frame.
+        pipeline.Kick(frameInput);
+
+        if (packet->nearestScreenSize > 0)
+            textureStreamer.Request(textureObj, packet->nearestScreenSize);
+        textureStreamer.Update();
+
+        // Write everything the frame needs to the ring buffer, and upload it in one go.
+        // Only visible models get an instance.
+        frameBuffer.BeginFrame();
+        renderer::FrameRingBuffer::Allocation frameData = frameBuffer.Allocate(sizeof(packet->viewProjection));
+        if (frameData)
+            memcpy(frameData.data, &packet->viewProjection, sizeof(packet->viewProjection));
+        renderer::FrameRingBuffer::Allocation instanceData = frameBuffer.Allocate(packet->transforms.size()*sizeof(glm::mat4), 16);
+        if (instanceData)
+            memcpy(instanceData.data, packet->transforms.data(), packet->transforms.size()*sizeof(glm::mat4));
+        // The culling pass's output, as one command per level of detail, grouped into one range of commands per
+        // material; instance i is packet->visible[i].
+        staticBatch.ClearCommands();
+        for (size_t m = 0; m < materials.size(); m++)
+        {
+            materials[m].firstCommand = staticBatch.GetCommands().size();
+            for (size_t i = 0; i < packet->lods.size(); i++)
+                if (meshMaterials[packet->meshes[i]] == m)
+                    staticBatch.AddDraw(packet->meshes[i], packet->lods[i], i);
+            materials[m].nCommands = staticBatch.GetCommands().size() - materials[m].firstCommand;
+        }
+        const std::vector<renderer::DrawElementsIndirectCommand>& commands = staticBatch.GetCommands();
+        renderer::FrameRingBuffer::Allocation commandData =
+            frameBuffer.Allocate(commands.size()*sizeof(renderer::DrawElementsIndirectCommand), 16);
+        if (commandData)
+            memcpy(commandData.data, commands.data(), commands.size()*sizeof(renderer::DrawElementsIndirectCommand));
+        frameBuffer.Flush();
+
+        gpuTimer.Begin();
+        glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 
-        auto start = std::chrono::system_clock::now().time_since_epoch().count();
-    
         // Render shit here.
 
-        program.Use();
-
-        glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &mvp1[0][0]);
-        vao.Render();
-        glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &mvp2[0][0]);
-        vao.Render();
+        frameBuffer.BindRange(GL_UNIFORM_BUFFER, frameBlockBinding, frameData);
+        if (sceneReady && !commands.empty() && instanceData && commandData)
+        {
+            // Every visible object of a material, at every level of detail, is drawn by its range of the batch.
+            // The prop materials share their program and texture, so they sort next to each other, and the queue only
+            // changes the layer between them.
+            for (const material& m : materials)
+            {
+                if (!m.nCommands)
+                    continue;
+                renderer::DrawCommand draw{};
+                draw.program = m.program;
+                draw.texture = m.texture;
+                draw.textureLayer = m.textureLayer;
+                draw.vao = &vao;
+                draw.batch = &staticBatch;
+                draw.commandBuffer = frameBuffer.GetBuffer();
+                draw.commandOffset = commandData.offset;
+                draw.firstCommand = m.firstCommand;
+                draw.nCommands = m.nCommands;
+                draw.instanceBuffer = frameBuffer.GetBuffer();
+                draw.instanceOffset = instanceData.offset;
+                renderQueue.Submit(renderer::RenderPass::Opaque, packet->nearestDistance, draw);
+            }
+        }
+        renderQueue.Execute();
 
-        auto end = std::chrono::system_clock::now().time_since_epoch().count();
+        gpuTimer.End();
+        frameBuffer.EndFrame();
 
 #ifdef DEBUG_SCREEN
         // Render debug screen shit here.        
@@ -240,41 +631,117 @@ int main(int argc, const char** argv)
             ImGui::NewFrame();
 
             ImGui::Begin("Debug screen", &g_dbgScreenEnabled);
-            ImGui::Text("FPS: %f", 1.0f/(end-start)*std::chrono::system_clock::duration::period::den);
-            ImGui::Text("XYZ: %f,%f,%f", renderer::g_position.x,renderer::g_position.y,renderer::g_position.z);
+            ImGui::Text("FPS: %f (%.3f ms)", frameTime ? 1000.0/frameTime : 0.0, frameTime);
+            ImGui::Text("GPU: %.3f ms", gpuTimer.GetLastTime());
+            // The timestep belongs to the simulation thread now, so only its (constant) rate is read here.
+            ImGui::Text("Simulation: %.3f ms%s, %u ticks at %.0f Hz", packet->simTime,
+                pipeline.IsThreaded() ? " (threaded)" : "", packet->nTicks, timestep.GetTickRate());
+            ImGui::Text("Objects: %zu drawn, %zu culled", packet->culling.visible, packet->culling.culled);
+            const renderer::RenderQueueStats& queueStats = renderQueue.GetStats();
+            ImGui::Text("Draws: %zu, %zu GL draw calls%s (%zu program, %zu texture, %zu layer, %zu VAO changes)",
+                queueStats.nDraws, queueStats.nDrawCalls, staticBatch.IsIndirect() ? " (indirect)" : "", queueStats.programChanges, queueStats.textureChanges, queueStats.layerChanges,
+                queueStats.vaoChanges);
+            ImGui::Text("Queue: submit %.3f ms, sort %.3f ms, execute %.3f ms",
+                queueStats.submitTime, queueStats.sortTime, queueStats.executeTime);
+            const assets::TextureStreamerStats& textureStats = textureStreamer.GetStats();
+            ImGui::Text("Textures: %.1f/%.1f MB resident, base level %u",
+                textureStats.residentBytes/1048576.0, textureStats.budget/1048576.0, textureObj.GetBaseLevel());
+            // Counted up to here; the debug screen's own calls don't go through the state cache.
+            const renderer::state::Stats& stateStats = renderer::state::GetStats();
+            ImGui::Text("GL state calls: %zu issued, %zu skipped", stateStats.issued, stateStats.skipped);
+            // Since the programs were built; the queue sets the textures' sampler and layer uniforms through its cache.
+            renderer::UniformStats uniformStats{};
+            for (renderer::Program* i : { program, arrayProgram })
+            {
+                if (!i)
+                    continue;
+                uniformStats.uploads += i->GetUniformStats().uploads;
+                uniformStats.skipped += i->GetUniformStats().skipped;
+            }
+            ImGui::Text("Uniforms: %zu uploaded, %zu skipped", uniformStats.uploads, uniformStats.skipped);
+            // The camera is read from the packet, since the simulation thread is moving it.
+            const glm::vec3& position = packet->cameraPosition;
+            const glm::vec3& direction = packet->cameraDirection;
+            ImGui::Text("XYZ: %f,%f,%f", position.x, position.y, position.z);
             ImGui::Text("Facing: %s,%s,%s", 
-                renderer::g_direction.x < 0 ? "-x" : renderer::g_direction.x == 0 ? "x" : "+x",
-                renderer::g_direction.y < 0 ? "-y" : renderer::g_direction.y == 0 ? "y" : "+y",
-                renderer::g_direction.z < 0 ? "-z" : renderer::g_direction.z == 0 ? "z" : "+z"
+                direction.x < 0 ? "-x" : direction.x == 0 ? "x" : "+x",
+                direction.y < 0 ? "-y" : direction.y == 0 ? "y" : "+y",
+                direction.z < 0 ? "-z" : direction.z == 0 ? "z" : "+z"
             );
-            ImGui::Text("Speed: %f", renderer::g_speed);
-            ImGui::SliderFloat("FoV", &renderer::g_fov, 30, 120);
-            float sensivity = renderer::g_mouseSpeed*10000; 
+            ImGui::Text("Speed: %f", packet->cameraSpeed);
+            ImGui::SliderFloat("FoV", &pendingFov, 30, 120);
+            float sensivity = pendingMouseSpeed*10000;
             if (ImGui::SliderFloat("Sensivity", &sensivity, 0, 100))
-                renderer::g_mouseSpeed = sensivity/10000;
+                pendingMouseSpeed = sensivity/10000;
             bool value = renderer::ControlsEnabled();
             if (ImGui::Checkbox("Enable input", &value))
-                value ? renderer::EnableControls() : renderer::DisableControls();
+                pendingToggleControls = true;
             if (ImGui::Button("Stop"))
                 glfwSetWindowShouldClose(g_window, 1);
             ImGui::End();
         
             ImGui::Render();
+            // The backend restores every binding it changes, so the state cache stays valid.
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
         }
 #endif
 
         glfwSwapBuffers(g_window);
+        packet = &pipeline.Wait();
+        // After waiting, so that the callbacks (e.g., resizing, which changes the projection matrix) don't race the
+        // simulation thread.
         glfwPollEvents();
+
+        double cpuTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+        // The first frame has no previous frame to measure against.
+        frameStats.AddFrame(cpuTime, frame ? frameTime : cpuTime);
+        gpuTimes.clear();
+        gpuTimer.Collect(gpuTimes);
+        frameStats.AddGpuTimes(gpuTimes);
     }
+    gpuTimes.clear();
+    gpuTimer.Collect(gpuTimes, true);
+    frameStats.AddGpuTimes(gpuTimes);
+
+    if (opts.headless && !status)
+    {
+        bench::Percentiles cpu = frameStats.GetCpuPercentiles();
+        bench::Percentiles gpu = frameStats.GetGpuPercentiles();
+        logger::Log("Rendered %zu frames. CPU p50/p95/p99: %.3f/%.3f/%.3f ms. GPU p50/p95/p99: %.3f/%.3f/%.3f ms.\n",
+            frameStats.GetFrameCount(),
+            cpu.p50, cpu.p95, cpu.p99,
+            gpu.p50, gpu.p95, gpu.p99
+        );
+    }
+#ifdef GAME_BENCH
+    FILE* output = nullptr;
+    if (!status)
+    {
+        output = opts.output ? fopen(opts.output, "w") : stdout;
+        if (!output)
+        {
+            logger::Error("Could not open %s for writing.\n", opts.output);
+            status = 1;
+        }
+    }
+    if (output)
+    {
+        frameStats.WriteJSON(output, rendererName, opts.width, opts.height);
+        if (output != stdout)
+            fclose(output);
+    }
+#endif
 
 #ifdef DEBUG_SCREEN
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
+    if (!opts.headless)
+    {
+        ImGui_ImplOpenGL3_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+    }
 #endif
 
     glfwTerminate();
 
-    return 0;
+    return status;
 }
\ No newline at end of file
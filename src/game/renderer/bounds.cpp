@@ -0,0 +1,69 @@
+/*
+ * game/renderer/bounds.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+
+#include <GL/glew.h>
+
+#include <renderer/bounds.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace renderer
+{
+    Bounds ComputeBounds(const std::vector<GLfloat>& positions)
+    {
+        Bounds ret{};
+        if (positions.size() < 3)
+            return ret;
+        ret.min = ret.max = glm::vec3(positions[0], positions[1], positions[2]);
+        for (size_t i = 3; i + 2 < positions.size(); i += 3)
+        {
+            glm::vec3 pos{ positions[i], positions[i+1], positions[i+2] };
+            ret.min = glm::min(ret.min, pos);
+            ret.max = glm::max(ret.max, pos);
+        }
+        ret.center = (ret.min + ret.max) * 0.5f;
+        // The sphere around the box is loose; tighten it by measuring the farthest vertex from the center.
+        float radiusSquared = 0;
+        for (size_t i = 0; i + 2 < positions.size(); i += 3)
+        {
+            glm::vec3 delta = glm::vec3(positions[i], positions[i+1], positions[i+2]) - ret.center;
+            float distanceSquared = glm::dot(delta, delta);
+            if (distanceSquared > radiusSquared)
+                radiusSquared = distanceSquared;
+        }
+        ret.radius = std::sqrt(radiusSquared);
+        return ret;
+    }
+    float GetMaxScale(const glm::mat4& model)
+    {
+        return std::max({
+            glm::length(glm::vec3(model[0])),
+            glm::length(glm::vec3(model[1])),
+            glm::length(glm::vec3(model[2])),
+        });
+    }
+    Bounds TransformBounds(const Bounds& bounds, const glm::mat4& model)
+    {
+        glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+        glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+        // The box around a transformed box has extents |M| * extent (Arvo).
+        glm::vec3 worldCenter = glm::vec3(model * glm::vec4(center, 1.f));
+        glm::vec3 worldExtent{0};
+        for (int column = 0; column < 3; column++)
+            worldExtent += glm::abs(glm::vec3(model[column])) * extent[column];
+        float scale = GetMaxScale(model);
+        Bounds ret{};
+        ret.min = worldCenter - worldExtent;
+        ret.max = worldCenter + worldExtent;
+        ret.center = glm::vec3(model * glm::vec4(bounds.center, 1.f));
+        ret.radius = bounds.radius * scale;
+        return ret;
+    }
+}
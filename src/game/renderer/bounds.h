@@ -0,0 +1,34 @@
+/*
+ * game/renderer/bounds.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace renderer
+{
+    // An axis-aligned bounding box, and the bounding sphere around it.
+    struct Bounds
+    {
+        glm::vec3 min{0};
+        glm::vec3 max{0};
+        glm::vec3 center{0};
+        float radius = 0;
+    };
+    // 'positions' has three floats per vertex.
+    Bounds ComputeBounds(const std::vector<GLfloat>& positions);
+    // The largest of the lengths 'model' scales its axes by.
+    float GetMaxScale(const glm::mat4& model);
+    // Transforms object-space bounds by 'model'. The box is the box around the transformed box,
+    // and the sphere is scaled by the largest axis scale.
+    Bounds TransformBounds(const Bounds& bounds, const glm::mat4& model);
+}
@@ -20,12 +20,14 @@ extern GLFWwindow* g_window;
 static float horizontalAngle = 0.f;
 static float verticalAngle = 0.0f;
 
+// Speeds are in units per second, and accelerations in units per second squared.
 static const float initialSpeedWalk = 0.15f;
 static const float initialSpeedSprint = 0.35f;
 static const float speedCapWalk = 4.f;
 static const float speedCapSprint = 7.f;
-static const float speedIntervalWalk = .1f;
-static const float speedIntervalSprint = .3f;
+// What the old per-key-repeat speed intervals (.1 and .3) came to at a typical 30 Hz key repeat rate.
+static const float accelerationWalk = 3.f;
+static const float accelerationSprint = 9.f;
 
 bool g_dbgScreenEnabled;
 
@@ -38,9 +40,20 @@ namespace renderer
     
     float g_fov = 80.0f;
     glm::vec3 g_position = glm::vec3( 0, 3, 0 ); 
+    glm::vec3 g_direction{0,0,0};
+    static glm::vec3 right{0,0,0};
+    static glm::vec3 up{0,0,0};
+    // The camera's position as of the last two simulation ticks.
+    static glm::vec3 previousPosition = g_position;
+    static glm::vec3 currentPosition = g_position;
+    static bool wasSprinting = false;
     static bool enabled = true;
-    static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
-    static void cursor_position_callback(GLFWwindow* window, double xpos, double ypos);
+    // Where the cursor was at the last poll; reset whenever the controls are enabled, so that the cursor jumping
+    // to the window's center doesn't turn the camera.
+    static double lastCursorX = 0;
+    static double lastCursorY = 0;
+    static bool lastCursorValid = false;
+    static void update_direction();
     void DisableControls()
     {
         enabled = false;
@@ -53,8 +66,8 @@ namespace renderer
     void EnableControls()
     {
         enabled = true;
-        glfwSetCursorPosCallback(g_window, cursor_position_callback);
-        glfwSetKeyCallback(g_window, key_callback);
+        // Sticky keys keep a key reported as pressed until it's polled, so that presses shorter than a frame aren't
+        // missed.
         glfwSetInputMode(g_window, GLFW_STICKY_KEYS, GL_TRUE);
         glfwSetInputMode(g_window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
         glfwSetWindowFocusCallback(g_window, renderer::OnFocusCallback);
@@ -63,110 +76,109 @@ namespace renderer
         int screenHeight = 0;
         glfwGetWindowSize(g_window, &screenWidth, &screenHeight);
         glfwSetCursorPos(g_window, screenWidth/2.0, screenHeight/2.0);
-        cursor_position_callback(g_window, screenWidth/2.0, screenHeight/2.0);
-        ProjectionMatrix = glm::perspective(glm::radians(g_fov), (float)screenWidth/(float)screenHeight, 0.1f, 100.0f);
+        lastCursorValid = false;
+        update_direction();
+        UpdateProjectionMatrix(screenWidth, screenHeight);
         glfwShowWindow(g_window);
     }
-    glm::vec3 g_direction{0,0,0};
-    static glm::vec3 right{0,0,0};
-    static glm::vec3 up{0,0,0};
-    static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+    void UpdateProjectionMatrix(int width, int height)
     {
-        static bool isWPressed = false;
-        static bool isSPressed = false;
-        static bool isAPressed = false;
-        static bool isDPressed = false;
-        
-        static bool isCtrlPressed = false;
-        static bool isEscPressed = false;
-
-        static bool isF3Pressed = false;
-        
-        switch (key)
-        {
-        case GLFW_KEY_W: isWPressed = action == GLFW_PRESS || action == GLFW_REPEAT; break;
-        case GLFW_KEY_S: isSPressed = action == GLFW_PRESS || action == GLFW_REPEAT; break;
-        case GLFW_KEY_A: isAPressed = action == GLFW_PRESS || action == GLFW_REPEAT; break;
-        case GLFW_KEY_D: isDPressed = action == GLFW_PRESS || action == GLFW_REPEAT; break;
-        case GLFW_KEY_ESCAPE: isEscPressed = action == GLFW_PRESS || action == GLFW_REPEAT; break;
-        case GLFW_KEY_F3: isF3Pressed = action == GLFW_PRESS; break;
-        default: return;
-        }
-        if (isF3Pressed)
+        ProjectionMatrix = glm::perspective(glm::radians(g_fov), (float)width/(float)height, 0.1f, 100.0f);
+    }
+    void SetCamera(const glm::vec3& position, const glm::vec3& direction)
+    {
+        previousPosition = currentPosition = position;
+        glm::vec3 dir = glm::normalize(direction);
+        verticalAngle = asin(dir.y);
+        horizontalAngle = atan2(dir.x, dir.z);
+        update_direction();
+        InterpolateCamera(1);
+    }
+    void PollInput(InputState& input)
+    {
+        input = InputState{};
+        auto isDown = [](int key) { return glfwGetKey(g_window, key) == GLFW_PRESS; };
+        // Toggles are read whether or not the controls are enabled, since Escape is what enables them.
+        // They only count when the key goes down, not for as long as it's held.
+        static bool wasF3Down = false;
+        static bool wasEscDown = false;
+        bool isF3Down = isDown(GLFW_KEY_F3);
+        bool isEscDown = isDown(GLFW_KEY_ESCAPE);
+        input.toggleDebugScreen = isF3Down && !wasF3Down;
+        input.toggleControls = isEscDown && !wasEscDown;
+        wasF3Down = isF3Down;
+        wasEscDown = isEscDown;
+        if (!enabled)
+            return;
+        input.forward = isDown(GLFW_KEY_W);
+        input.back = isDown(GLFW_KEY_S);
+        input.left = isDown(GLFW_KEY_A);
+        input.right = isDown(GLFW_KEY_D);
+        input.sprint = isDown(GLFW_KEY_LEFT_CONTROL) || isDown(GLFW_KEY_RIGHT_CONTROL);
+        double cursorX = 0, cursorY = 0;
+        glfwGetCursorPos(g_window, &cursorX, &cursorY);
+        if (lastCursorValid)
+            input.look = glm::vec2(cursorX - lastCursorX, cursorY - lastCursorY);
+        lastCursorX = cursorX;
+        lastCursorY = cursorY;
+        lastCursorValid = true;
+    }
+    void HandleInput(const InputState& input)
+    {
+        if (input.toggleDebugScreen)
             g_dbgScreenEnabled = !g_dbgScreenEnabled;
-        bool prevCtrlStatus = isCtrlPressed;
-        isCtrlPressed = (mods & GLFW_MOD_CONTROL);
-        const float initialSpeed = isCtrlPressed ? initialSpeedSprint : initialSpeedWalk;
-        const float speedCap = isCtrlPressed ? speedCapSprint : speedCapWalk;
-        const float speedInterval = isCtrlPressed ? speedIntervalSprint : speedIntervalWalk;
-        if (!isWPressed && !isSPressed && !isAPressed && !isDPressed)
-            g_speed = initialSpeed;
-        if (prevCtrlStatus != isCtrlPressed)
-            if (g_speed >= speedCapWalk)
-                g_speed = speedCapWalk-2; // Slow down.
-        static double lastTime = glfwGetTime();
-        double currentTime = glfwGetTime();
-        float deltaTime = float(currentTime - lastTime);
-        if (isWPressed)
-        {
-            if (!enabled)
-                    return;
-            g_position += g_direction * deltaTime * g_speed;
-            if (g_speed < speedCap)
-                g_speed += speedInterval;
-        }
-        if (isSPressed)
-        {
-            if (!enabled)
-                return;
-            g_position -= g_direction * deltaTime * g_speed;
-            if (g_speed < speedCap)
-                g_speed += speedInterval;
-        }
-        if (isDPressed)
-        {
-            if (!enabled)
-                return;
-            g_position += right * deltaTime * (g_speed > speedCapWalk ? speedCapWalk : g_speed);
-            if (g_speed < speedCap)
-                g_speed += speedIntervalWalk;
-        }
-        if (isAPressed)
-        {
-            if (!enabled)
-                return;
-            g_position -= right * deltaTime * (g_speed > speedCapWalk ? speedCapWalk : g_speed);
-            if (g_speed < speedCap)
-                g_speed += speedIntervalWalk;
-        }
-        if (isEscPressed)
+        if (input.toggleControls)
         {
             if (enabled)
                 DisableControls();
             else
                 EnableControls();
         }
+        if (input.look.x == 0 && input.look.y == 0)
+            return;
+        horizontalAngle -= g_mouseSpeed * input.look.x;
+        verticalAngle   -= g_mouseSpeed * input.look.y;
+        update_direction();
+    }
+    void SimulateCamera(const InputState& input, float dt)
+    {
+        previousPosition = currentPosition;
+        const float initialSpeed = input.sprint ? initialSpeedSprint : initialSpeedWalk;
+        const float speedCap = input.sprint ? speedCapSprint : speedCapWalk;
+        const float acceleration = input.sprint ? accelerationSprint : accelerationWalk;
+        bool moving = input.forward || input.back || input.left || input.right;
+        if (!moving)
+            g_speed = initialSpeed;
+        if (wasSprinting != input.sprint && g_speed >= speedCapWalk)
+            g_speed = speedCapWalk-2; // Slow down.
+        wasSprinting = input.sprint;
+        if (!moving)
+            return;
+        // Strafing never goes faster than walking.
+        const float strafeSpeed = g_speed > speedCapWalk ? speedCapWalk : g_speed;
+        if (input.forward)
+            currentPosition += g_direction * dt * g_speed;
+        if (input.back)
+            currentPosition -= g_direction * dt * g_speed;
+        if (input.right)
+            currentPosition += right * dt * strafeSpeed;
+        if (input.left)
+            currentPosition -= right * dt * strafeSpeed;
+        g_speed += ((input.forward || input.back) ? acceleration : accelerationWalk) * dt;
+        if (g_speed > speedCap)
+            g_speed = speedCap;
+    }
+    void InterpolateCamera(float alpha)
+    {
+        g_position = glm::mix(previousPosition, currentPosition, alpha);
         ViewMatrix = glm::lookAt(
                 g_position,
                 g_position+g_direction,
                 up
             );
-        lastTime = currentTime;
     }
-    static void cursor_position_callback(GLFWwindow* window, double xpos, double ypos)
+    static void update_direction()
     {
-        if (!enabled)
-                return;
-        // logger::Debug("Cursor moved to %lf,%lf.\n", xpos, ypos);
-        int screenWidth = 0;
-        int screenHeight = 0;
-        glfwGetWindowSize(g_window, &screenWidth, &screenHeight);
-
-        glfwSetCursorPos(g_window, screenWidth/2.f, screenHeight/2.f);
-
-        horizontalAngle += g_mouseSpeed * float(screenWidth/2.f - xpos );
-        verticalAngle   += g_mouseSpeed * float(screenHeight/2.f - ypos );
-
         g_direction = glm::vec3(
             cos(verticalAngle) * sin(horizontalAngle), 
             sin(verticalAngle),
@@ -183,10 +195,5 @@ namespace renderer
         //     up.y = 0;
         // if (up.y > 1)
         //     up.y = 1;
-        ViewMatrix = glm::lookAt(
-                        g_position,
-                        g_position+g_direction,
-                        up
-                    );
     }
-}
\ No newline at end of file
+}
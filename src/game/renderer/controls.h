@@ -12,14 +12,45 @@ extern bool g_dbgScreenEnabled;
 
 namespace renderer
 {
+    // The input state, polled once per frame.
+    struct InputState
+    {
+        bool forward = false;
+        bool back = false;
+        bool left = false;
+        bool right = false;
+        bool sprint = false;
+        // How far the cursor moved since the last poll, in screen coordinates.
+        glm::vec2 look{ 0, 0 };
+        // Pressed since the last poll.
+        bool toggleDebugScreen = false;
+        bool toggleControls = false;
+    };
+
     extern glm::mat4 ViewMatrix;
     extern glm::mat4 ProjectionMatrix;
     extern float g_fov;
+    // The camera as last rendered (i.e., interpolated between simulation ticks).
+    extern glm::vec3 g_position;
     extern glm::vec3 g_direction;
     extern float g_speed;
     extern float g_mouseSpeed;
     void DisableControls();
     void EnableControls();
     bool ControlsEnabled();
-    extern glm::vec3 g_position;
-}
\ No newline at end of file
+    void UpdateProjectionMatrix(int width, int height);
+    // Moves the camera without going through input (e.g., for scripted camera paths), without interpolating from
+    // where it was.
+    void SetCamera(const glm::vec3& position, const glm::vec3& direction);
+
+    // Reads the keyboard and cursor into 'input'. Only movement since the last call is counted.
+    void PollInput(InputState& input);
+    // Handles what responds once per frame rather than per tick: the toggles, and mouse look, so that looking around
+    // is as responsive as the frame rate allows.
+    void HandleInput(const InputState& input);
+    // Runs one simulation tick of camera movement, 'dt' seconds long.
+    void SimulateCamera(const InputState& input, float dt);
+    // Places the rendered camera 'alpha' of the way from the previous tick's position to the last tick's, and
+    // updates the view matrix.
+    void InterpolateCamera(float alpha);
+}
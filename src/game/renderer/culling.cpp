@@ -0,0 +1,116 @@
+/*
+ * game/renderer/culling.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <renderer/culling.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace renderer
+{
+    Frustum ExtractFrustum(const glm::mat4& viewProjection)
+    {
+        // glm is column major, so row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i]).
+        auto row = [&viewProjection](int i) {
+            return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        };
+        glm::vec4 x = row(0), y = row(1), z = row(2), w = row(3);
+        Frustum ret{};
+        ret.planes[Frustum::Left] = w + x;
+        ret.planes[Frustum::Right] = w - x;
+        ret.planes[Frustum::Bottom] = w + y;
+        ret.planes[Frustum::Top] = w - y;
+        ret.planes[Frustum::Near] = w + z;
+        ret.planes[Frustum::Far] = w - z;
+        for (glm::vec4& plane : ret.planes)
+        {
+            float length = glm::length(glm::vec3(plane));
+            if (length > 0)
+                plane /= length;
+        }
+        return ret;
+    }
+
+    uint32_t BoundsArray::Add(const Bounds& bounds, const glm::mat4& model)
+    {
+        size_t index = GetCount();
+        m_centerX.push_back(0); m_centerY.push_back(0); m_centerZ.push_back(0);
+        m_extentX.push_back(0); m_extentY.push_back(0); m_extentZ.push_back(0);
+        m_radius.push_back(0);
+        set(index, bounds, model);
+        return index;
+    }
+    void BoundsArray::Update(uint32_t index, const Bounds& bounds, const glm::mat4& model)
+    {
+        if (index >= GetCount())
+            return;
+        set(index, bounds, model);
+    }
+    void BoundsArray::Clear()
+    {
+        m_centerX.clear(); m_centerY.clear(); m_centerZ.clear();
+        m_extentX.clear(); m_extentY.clear(); m_extentZ.clear();
+        m_radius.clear();
+    }
+    void BoundsArray::set(size_t index, const Bounds& bounds, const glm::mat4& model)
+    {
+        Bounds world = TransformBounds(bounds, model);
+        glm::vec3 center = (world.min + world.max) * 0.5f;
+        glm::vec3 extent = (world.max - world.min) * 0.5f;
+        // Both volumes share a center so the loops only need one; grow the sphere to cover the offset.
+        float radius = world.radius + glm::length(world.center - center);
+        m_centerX[index] = center.x;
+        m_centerY[index] = center.y;
+        m_centerZ[index] = center.z;
+        m_extentX[index] = extent.x;
+        m_extentY[index] = extent.y;
+        m_extentZ[index] = extent.z;
+        // Never let the sphere be looser than the sphere around the box.
+        m_radius[index] = std::min(radius, glm::length(extent));
+    }
+
+    void BoundsArray::Cull(const Frustum& frustum, std::vector<uint32_t>& visible, CullingStats* stats) const
+    {
+        const size_t count = GetCount();
+        visible.clear();
+        m_inside.assign(count, 1);
+        const float* centerX = m_centerX.data();
+        const float* centerY = m_centerY.data();
+        const float* centerZ = m_centerZ.data();
+        const float* extentX = m_extentX.data();
+        const float* extentY = m_extentY.data();
+        const float* extentZ = m_extentZ.data();
+        const float* radius = m_radius.data();
+        uint8_t* inside = m_inside.data();
+        // One branchless pass per plane. Each volume is conservative, so an object is only behind the plane
+        // if the tighter of its sphere and box is.
+        for (const glm::vec4& plane : frustum.planes)
+        {
+            const float nx = plane.x, ny = plane.y, nz = plane.z, d = plane.w;
+            const float ax = std::fabs(nx), ay = std::fabs(ny), az = std::fabs(nz);
+            for (size_t i = 0; i < count; i++)
+            {
+                float distance = nx*centerX[i] + ny*centerY[i] + nz*centerZ[i] + d;
+                float boxRadius = ax*extentX[i] + ay*extentY[i] + az*extentZ[i];
+                float reach = std::min(radius[i], boxRadius);
+                inside[i] &= (distance >= -reach);
+            }
+        }
+        for (size_t i = 0; i < count; i++)
+            if (inside[i])
+                visible.push_back(i);
+        if (stats)
+        {
+            stats->tested = count;
+            stats->visible = visible.size();
+            stats->culled = count - visible.size();
+        }
+    }
+}
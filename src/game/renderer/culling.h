@@ -0,0 +1,71 @@
+/*
+ * game/renderer/culling.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <renderer/bounds.h>
+
+namespace renderer
+{
+    // Planes are stored as (normal, distance), with normals pointing into the frustum.
+    struct Frustum
+    {
+        enum
+        {
+            Left, Right, Bottom, Top, Near, Far,
+            PlaneCount,
+        };
+        glm::vec4 planes[PlaneCount];
+    };
+    // Extracts the normalized frustum planes from a view-projection matrix (Gribb/Hartmann).
+    Frustum ExtractFrustum(const glm::mat4& viewProjection);
+
+    struct CullingStats
+    {
+        size_t tested = 0;
+        size_t visible = 0;
+        size_t culled = 0;
+    };
+
+    // World-space bounds of every object in the scene, stored as a structure of arrays so the culling
+    // loops run over contiguous floats and can be vectorized by the compiler.
+    // The game culls with a BVH (see scene::CollectRenderables); this is the linear baseline bvh_bench measures it
+    // against, and isn't used by the game itself.
+    class BoundsArray
+    {
+    public:
+        BoundsArray() = default;
+
+        // Transforms the object-space bounds into world space.
+        // Returns the index of the new object.
+        uint32_t Add(const Bounds& bounds, const glm::mat4& model);
+        void Update(uint32_t index, const Bounds& bounds, const glm::mat4& model);
+        void Clear();
+
+        size_t GetCount() const { return m_centerX.size(); }
+
+        // Writes the index of every object intersecting the frustum to 'visible', in ascending order.
+        void Cull(const Frustum& frustum, std::vector<uint32_t>& visible, CullingStats* stats = nullptr) const;
+
+    private:
+        void set(size_t index, const Bounds& bounds, const glm::mat4& model);
+
+        // Box center, shared with the sphere.
+        std::vector<float> m_centerX, m_centerY, m_centerZ;
+        // Box half extents.
+        std::vector<float> m_extentX, m_extentY, m_extentZ;
+        std::vector<float> m_radius;
+        // Scratch space for Cull, which keeps the per-object result of the sphere test.
+        mutable std::vector<uint8_t> m_inside;
+    };
+}
@@ -0,0 +1,138 @@
+/*
+ * game/renderer/frame_ring_buffer.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#include <renderer/frame_ring_buffer.h>
+#include <renderer/state_cache.h>
+
+#include <logger.h>
+
+#include <vector>
+
+namespace renderer
+{
+    FrameRingBuffer::FrameRingBuffer(size_t frameSize, size_t nFrames)
+    {
+        GLint alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        if (alignment > 0)
+            m_uniformAlignment = alignment;
+        // Keep every region aligned, so that alignment within a region means alignment within the buffer.
+        m_frameSize = (frameSize + m_uniformAlignment - 1) & ~(m_uniformAlignment - 1);
+        m_nFrames = nFrames ? nFrames : 1;
+        m_fences.resize(m_nFrames, nullptr);
+
+        glGenBuffers(1, &m_buffer);
+        // Use a binding point that doesn't affect rendering.
+        state::BindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+        GLsizeiptr size = m_frameSize * m_nFrames;
+        if (GLEW_ARB_buffer_storage)
+        {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+            m_mapping = (uint8_t*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+            if (!m_mapping)
+            {
+                // Immutable storage can't be respecified; start over with a mutable buffer.
+                logger::Warning("%s: Could not persistently map the frame ring buffer, falling back to glBufferSubData.\n", __func__);
+                state::ForgetBuffer(m_buffer);
+                glDeleteBuffers(1, &m_buffer);
+                glGenBuffers(1, &m_buffer);
+                state::BindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+            }
+        }
+        if (!m_mapping)
+        {
+            glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+            m_staging.resize(m_frameSize);
+        }
+        logger::Debug("%s: Created a %zu byte frame ring buffer (%s).\n", __func__, (size_t)size, m_mapping ? "persistent" : "glBufferSubData");
+        m_initialized = true;
+    }
+
+    void FrameRingBuffer::BeginFrame()
+    {
+        if (!m_initialized)
+            return;
+        m_current = (m_current + 1) % m_nFrames;
+        m_used = 0;
+        m_flushed = 0;
+        GLsync& fence = m_fences[m_current];
+        if (!fence)
+            return;
+        // Wait for the GPU to finish reading this region. This rarely blocks with three regions.
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        while (status == GL_TIMEOUT_EXPIRED)
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+    FrameRingBuffer::Allocation FrameRingBuffer::Allocate(size_t size, size_t alignment)
+    {
+        Allocation ret{};
+        if (!m_initialized)
+            return ret;
+        if (!alignment)
+            alignment = m_uniformAlignment;
+        size_t offset = (m_used + alignment - 1) & ~(alignment - 1);
+        if (offset + size > m_frameSize)
+        {
+            if (!m_warnedFull)
+                logger::Warning("%s: Frame ring buffer is full (%zu bytes per frame).\n", __func__, m_frameSize);
+            m_warnedFull = true;
+            return ret;
+        }
+        m_used = offset + size;
+        ret.data = m_mapping ? m_mapping + m_current*m_frameSize + offset : m_staging.data() + offset;
+        ret.offset = m_current*m_frameSize + offset;
+        ret.size = size;
+        return ret;
+    }
+    void FrameRingBuffer::Flush()
+    {
+        if (!m_initialized || m_mapping)
+            return; // Coherent mappings are already visible to the GPU.
+        if (m_used == m_flushed)
+            return;
+        state::BindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, m_current*m_frameSize + m_flushed, m_used - m_flushed, m_staging.data() + m_flushed);
+        m_flushed = m_used;
+    }
+    void FrameRingBuffer::EndFrame()
+    {
+        if (!m_initialized)
+            return;
+        if (m_fences[m_current])
+            glDeleteSync(m_fences[m_current]);
+        m_fences[m_current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    void FrameRingBuffer::BindRange(GLenum target, GLuint index, const Allocation& allocation) const
+    {
+        if (!allocation)
+            return;
+        state::BindBufferRange(target, index, m_buffer, allocation.offset, allocation.size);
+    }
+
+    FrameRingBuffer::~FrameRingBuffer()
+    {
+        if (!m_initialized)
+            return;
+        for (auto fence : m_fences)
+            if (fence)
+                glDeleteSync(fence);
+        if (m_mapping)
+        {
+            state::BindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+        state::ForgetBuffer(m_buffer);
+        glDeleteBuffers(1, &m_buffer);
+    }
+}
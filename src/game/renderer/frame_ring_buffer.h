@@ -0,0 +1,79 @@
+/*
+ * game/renderer/frame_ring_buffer.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#include <vector>
+
+namespace renderer
+{
+    // A buffer for data that changes every frame (uniform blocks, instance data, etc.).
+    // The buffer is split into one region per frame in flight, and each frame sub-allocates from its own region, so the
+    // CPU never writes to memory the GPU may still be reading. Regions are protected with fences.
+    // Where ARB_buffer_storage is available, the buffer is persistently mapped and written to directly. Otherwise,
+    // allocations are staged in system memory and uploaded with one glBufferSubData call in Flush().
+    // Cannot be copied.
+    // Cannot be moved.
+    class FrameRingBuffer final
+    {
+    public:
+        struct Allocation
+        {
+            // Where to write the data to. Only valid until Flush().
+            void* data = nullptr;
+            // The offset of the allocation in the buffer, for glBindBufferRange or attribute pointers.
+            GLintptr offset = 0;
+            GLsizeiptr size = 0;
+            operator bool() const { return data != nullptr; }
+        };
+
+        FrameRingBuffer() = delete;
+        // 'frameSize' is the amount of bytes each frame can allocate.
+        explicit FrameRingBuffer(size_t frameSize, size_t nFrames = 3);
+        FrameRingBuffer(const FrameRingBuffer&) = delete;
+        FrameRingBuffer& operator=(const FrameRingBuffer&) = delete;
+        FrameRingBuffer(FrameRingBuffer&&) = delete;
+        FrameRingBuffer& operator=(FrameRingBuffer&&) = delete;
+
+        // Moves to the next region, waiting for the GPU to finish with it if needed.
+        void BeginFrame();
+        // 'alignment' defaults to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, and must be a power of two.
+        // Returns an empty allocation if the frame's region is full.
+        Allocation Allocate(size_t size, size_t alignment = 0);
+        // Makes this frame's allocations visible to the GPU. Must be called before anything that reads them is drawn.
+        void Flush();
+        // Fences this frame's region. Must be called after the last draw that reads from it.
+        void EndFrame();
+
+        void BindRange(GLenum target, GLuint index, const Allocation& allocation) const;
+
+        GLuint GetBuffer() const { return m_buffer; }
+        bool IsPersistent() const { return m_mapping != nullptr; }
+        size_t GetFrameSize() const { return m_frameSize; }
+        // Bytes allocated so far in the current frame.
+        size_t GetUsed() const { return m_used; }
+
+        ~FrameRingBuffer();
+    private:
+        bool m_initialized = false;
+        GLuint m_buffer = 0;
+        size_t m_frameSize = 0;
+        size_t m_nFrames = 0;
+        size_t m_current = 0;
+        size_t m_used = 0;
+        size_t m_flushed = 0;
+        size_t m_uniformAlignment = 256;
+        bool m_warnedFull = false;
+        uint8_t* m_mapping = nullptr;
+        std::vector<uint8_t> m_staging{};
+        std::vector<GLsync> m_fences{};
+    };
+}
@@ -0,0 +1,77 @@
+/*
+ * game/renderer/framebuffer.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+
+#include <GL/glew.h>
+
+#include <renderer/framebuffer.h>
+#include <renderer/state_cache.h>
+
+#include <logger.h>
+
+namespace renderer
+{
+    Framebuffer::Framebuffer()
+    {
+        glGenFramebuffers(1, &m_fbo);
+        GLuint renderbuffers[2] = {0,0};
+        glGenRenderbuffers(2, renderbuffers);
+        m_colorAttachment = renderbuffers[0];
+        m_depthAttachment = renderbuffers[1];
+        m_initialized = true;
+    }
+    GLint Framebuffer::Create(GLsizei width, GLsizei height)
+    {
+        if (!m_initialized)
+            return GL_FALSE;
+        if (width <= 0 || height <= 0)
+            return GL_FALSE;
+        glBindRenderbuffer(GL_RENDERBUFFER, m_colorAttachment);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, m_depthAttachment);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        state::BindFramebuffer(m_fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorAttachment);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthAttachment);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        state::BindFramebuffer(0);
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+        {
+            logger::Error("%s: Framebuffer is incomplete (status 0x%x).\n", __func__, status);
+            m_complete = false;
+            return GL_FALSE;
+        }
+        m_width = width;
+        m_height = height;
+        m_complete = true;
+        return GL_TRUE;
+    }
+    GLint Framebuffer::Bind()
+    {
+        if (!m_initialized || !m_complete)
+            return GL_FALSE;
+        state::BindFramebuffer(m_fbo);
+        glViewport(0,0, m_width, m_height);
+        return GL_TRUE;
+    }
+    void Framebuffer::BindDefault()
+    {
+        state::BindFramebuffer(0);
+    }
+    Framebuffer::~Framebuffer()
+    {
+        if (m_initialized)
+        {
+            GLuint renderbuffers[2] = { m_colorAttachment, m_depthAttachment };
+            glDeleteRenderbuffers(2, renderbuffers);
+            state::ForgetFramebuffer(m_fbo);
+            glDeleteFramebuffers(1, &m_fbo);
+        }
+    }
+}
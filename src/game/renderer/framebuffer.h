@@ -0,0 +1,48 @@
+/*
+ * game/renderer/framebuffer.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+#include <GL/glew.h>
+
+namespace renderer
+{
+    // An offscreen render target with a color and depth attachment.
+    // Used by headless mode, where there is no default framebuffer worth drawing to.
+    // Cannot be copied.
+    // Cannot be moved.
+    class Framebuffer final
+    {
+    public:
+        Framebuffer();
+        Framebuffer(const Framebuffer&) = delete;
+        Framebuffer& operator=(const Framebuffer&) = delete;
+        Framebuffer(Framebuffer&&) = delete;
+        Framebuffer& operator=(Framebuffer&&) = delete;
+
+        // (Re)allocates the attachments.
+        GLint Create(GLsizei width, GLsizei height);
+        // Binds the framebuffer and sets the viewport to cover it.
+        GLint Bind();
+        static void BindDefault();
+
+        GLsizei GetWidth() const { return m_width; }
+        GLsizei GetHeight() const { return m_height; }
+        GLuint GetFBO() const { return m_fbo; }
+
+        ~Framebuffer();
+    private:
+        bool m_initialized = false;
+        bool m_complete = false;
+        GLuint m_fbo = 0;
+        GLuint m_colorAttachment = 0;
+        GLuint m_depthAttachment = 0;
+        GLsizei m_width = 0;
+        GLsizei m_height = 0;
+    };
+}
@@ -0,0 +1,70 @@
+/*
+ * game/renderer/gpu_timer.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+
+#include <GL/glew.h>
+
+#include <renderer/gpu_timer.h>
+
+#include <vector>
+
+namespace renderer
+{
+    GpuTimer::GpuTimer()
+    {
+        glGenQueries(s_nQueries, m_queries);
+    }
+    void GpuTimer::Begin()
+    {
+        if (m_inQuery)
+            return;
+        if (m_nPending == s_nQueries)
+            m_results.push_back(read_oldest()); // Ring is full, we have no choice but to wait.
+        glBeginQuery(GL_TIME_ELAPSED, m_queries[m_head]);
+        m_inQuery = true;
+    }
+    void GpuTimer::End()
+    {
+        if (!m_inQuery)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        m_head = (m_head + 1) % s_nQueries;
+        m_nPending++;
+        m_inQuery = false;
+    }
+    size_t GpuTimer::Collect(std::vector<double>& milliseconds, bool wait)
+    {
+        size_t nCollected = m_results.size();
+        milliseconds.insert(milliseconds.end(), m_results.begin(), m_results.end());
+        m_results.clear();
+        while (m_nPending)
+        {
+            GLuint oldest = m_queries[(m_head + s_nQueries - m_nPending) % s_nQueries];
+            GLint available = GL_FALSE;
+            if (!wait)
+                glGetQueryObjectiv(oldest, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!wait && !available)
+                break;
+            milliseconds.push_back(read_oldest());
+            nCollected++;
+        }
+        return nCollected;
+    }
+    double GpuTimer::read_oldest()
+    {
+        GLuint oldest = m_queries[(m_head + s_nQueries - m_nPending) % s_nQueries];
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(oldest, GL_QUERY_RESULT, &elapsed);
+        m_nPending--;
+        m_lastTime = elapsed / 1000000.0;
+        return m_lastTime;
+    }
+    GpuTimer::~GpuTimer()
+    {
+        glDeleteQueries(s_nQueries, m_queries);
+    }
+}
@@ -0,0 +1,52 @@
+/*
+ * game/renderer/gpu_timer.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+#include <GL/glew.h>
+
+#include <vector>
+
+namespace renderer
+{
+    // Measures GPU time between Begin() and End() with GL_TIME_ELAPSED queries.
+    // Queries are kept in a small ring so that reading a result never waits on the frame that was just submitted.
+    // Cannot be copied.
+    // Cannot be moved.
+    class GpuTimer final
+    {
+    public:
+        GpuTimer();
+        GpuTimer(const GpuTimer&) = delete;
+        GpuTimer& operator=(const GpuTimer&) = delete;
+        GpuTimer(GpuTimer&&) = delete;
+        GpuTimer& operator=(GpuTimer&&) = delete;
+
+        void Begin();
+        void End();
+
+        // Appends the results (in milliseconds) of all finished queries to 'milliseconds', oldest first.
+        // If 'wait' is true, this waits for every submitted query to finish.
+        // Returns the amount of results appended.
+        size_t Collect(std::vector<double>& milliseconds, bool wait = false);
+
+        // The most recent result read back, in milliseconds.
+        double GetLastTime() const { return m_lastTime; }
+
+        ~GpuTimer();
+    private:
+        static constexpr size_t s_nQueries = 4;
+        GLuint m_queries[s_nQueries] = {};
+        size_t m_head = 0; // The next query to begin.
+        size_t m_nPending = 0;
+        bool m_inQuery = false;
+        double m_lastTime = 0;
+        std::vector<double> m_results{}; // Results read back early, because the ring was full.
+        double read_oldest();
+    };
+}
@@ -0,0 +1,37 @@
+/*
+ * game/renderer/lod.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <renderer/lod.h>
+
+namespace renderer
+{
+    float GetLodScale(float fovY, int viewportHeight)
+    {
+        return viewportHeight / (2.f * std::tan(fovY * 0.5f));
+    }
+    uint32_t SelectLod(const std::vector<MeshLod>& lods, float distance, float lodScale, uint32_t current, const LodSettings& settings)
+    {
+        if (lods.empty())
+            return 0;
+        // Objects at the camera get the full detail mesh.
+        distance = std::max(distance, 1e-4f);
+        auto screenError = [&](uint32_t lod) { return lods[lod].error * lodScale / distance; };
+        uint32_t lod = std::min<uint32_t>(current, lods.size() - 1);
+        while (lod > 0 && screenError(lod) > settings.maxScreenError)
+            lod--;
+        float coarsenBelow = settings.maxScreenError * (1.f - settings.hysteresis);
+        while (lod + 1 < lods.size() && screenError(lod + 1) <= coarsenBelow)
+            lod++;
+        return lod;
+    }
+}
@@ -0,0 +1,33 @@
+/*
+ * game/renderer/lod.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <renderer/mesh_format.h>
+
+namespace renderer
+{
+    struct LodSettings
+    {
+        // The furthest a level may stray from the full detail mesh on screen, in pixels.
+        float maxScreenError = 1.f;
+        // An object only switches to a coarser level once that level's error is this fraction below the maximum, so that
+        // objects sitting right at a threshold don't flicker between two levels.
+        float hysteresis = 0.25f;
+    };
+
+    // The amount of pixels an object-space unit at a distance of one covers, for a vertical field of view (in radians).
+    float GetLodScale(float fovY, int viewportHeight);
+    // Picks the coarsest level whose error, projected to the screen at 'distance', stays within the settings, starting
+    // from the object's 'current' level.
+    // Errors are in object space, so scaled objects should divide 'distance' by their scale.
+    uint32_t SelectLod(const std::vector<MeshLod>& lods, float distance, float lodScale, uint32_t current, const LodSettings& settings = {});
+}
@@ -12,10 +12,13 @@
 
 #include <renderer/vao.h>
 #include <renderer/mesh.h>
+#include <renderer/state_cache.h>
 
+#include <algorithm>
 #include <sstream>
 #include <string>
 #include <map>
+#include <utility>
 
 #include <string.h>
 
@@ -34,12 +37,54 @@ namespace renderer
         m_eao = buffers[1];
         m_initialized = true;
     }
-    bool Mesh::Load(const std::vector<GLfloat>& vertices, const std::vector<GLuint> indices)
+    bool Mesh::Load(const VertexLayout& layout, std::vector<uint8_t> vertices, std::vector<GLuint> indices)
     {
-        m_vertices = vertices;
-        m_nVertices = vertices.size();
-        m_indices = indices;
-        m_nIndices = indices.size();
+        if (!layout.GetStride() || vertices.size() % layout.GetStride())
+            return false;
+        m_vertices = std::move(vertices);
+        size_t nVertices = m_vertices.size() / layout.GetStride();
+        if (indices.empty() || *std::max_element(indices.begin(), indices.end()) <= 0xffff)
+        {
+            // Every index fits in 16 bits, so upload half as much.
+            m_shortIndices.assign(indices.begin(), indices.end());
+            return Load(layout,
+                m_vertices.data(), nVertices,
+                m_shortIndices.data(), m_shortIndices.size(), GL_UNSIGNED_SHORT);
+        }
+        m_indices = std::move(indices);
+        return Load(layout,
+            m_vertices.data(), nVertices,
+            m_indices.data(), m_indices.size(), GL_UNSIGNED_INT);
+    }
+    bool Mesh::Load(const VertexLayout& layout,
+        const void* vertices, size_t nVertices,
+        const void* indices, size_t nIndices, GLenum indexType)
+    {
+        if (m_vao)
+            return false; // Already uploaded.
+        if (!layout.GetStride() || !vertices || !indices)
+            return false;
+        if (indexType != GL_UNSIGNED_SHORT && indexType != GL_UNSIGNED_INT)
+            return false;
+        m_layout = layout;
+        m_vertexData = vertices;
+        m_nVertices = nVertices;
+        m_indexData = indices;
+        m_nIndices = nIndices;
+        m_indexType = indexType;
+        m_lods = { MeshLod{ 0, nIndices, 0.f } };
+        m_lod = 0;
+        return true;
+    }
+    bool Mesh::Load(const CookedMeshView& mesh)
+    {
+        m_bounds = mesh.bounds;
+        if (!Load(mesh.layout,
+            mesh.vertices, mesh.nVertices,
+            mesh.indices, mesh.nIndices, mesh.indexType))
+            return false;
+        if (!mesh.lods.empty())
+            m_lods = mesh.lods;
         return true;
     }
     GLint Mesh::Bind(VAO& to)
@@ -48,14 +93,26 @@ namespace renderer
             return GL_FALSE;
         if (m_vao)
             return GL_FALSE;
+        if (!m_vertexData || !m_indexData)
+            return GL_FALSE;
+        size_t szIndex = m_indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
         to.Bind();
-        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-        glBufferData(GL_ARRAY_BUFFER, m_vertices.size()*sizeof(GLfloat), m_vertices.data(), GL_STATIC_DRAW);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_eao);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indices.size()*sizeof(GLuint), m_indices.data(), GL_STATIC_DRAW);
+        state::BindBuffer(GL_ARRAY_BUFFER, m_vbo);
+        glBufferData(GL_ARRAY_BUFFER, m_nVertices*m_layout.GetStride(), m_vertexData, GL_STATIC_DRAW);
+        // The attribute format and the element buffer are VAO state, so they only need to be recorded once.
+        m_layout.Apply();
+        state::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_eao);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_nIndices*szIndex, m_indexData, GL_STATIC_DRAW);
         m_vao = &to;
-        // m_vertices.clear();
-        // m_indices.clear();
+        // The GL has its own copy now.
+        m_vertexData = nullptr;
+        m_indexData = nullptr;
+        m_vertices.clear();
+        m_vertices.shrink_to_fit();
+        m_indices.clear();
+        m_indices.shrink_to_fit();
+        m_shortIndices.clear();
+        m_shortIndices.shrink_to_fit();
         add_to_vao();
         return GL_TRUE;
     }
@@ -65,15 +122,85 @@ namespace renderer
             return GL_FALSE;
         if (!m_vao)
             return GL_FALSE;
-        // m_vao->Bind();
-        // glEnableVertexAttribArray(m_vaaIndex);
-        // Send the vertices to the shader.
-        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-        glVertexAttribPointer(m_vaaIndex, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-        // Render the mesh
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_eao);
-        glDrawElements(GL_TRIANGLES, m_nVertices, GL_UNSIGNED_INT, nullptr);
-        // glDisableVertexAttribArray(m_vaaIndex);
+        const MeshLod& lod = m_lods[m_lod];
+        return RenderRange(lod.firstIndex, lod.nIndices);
+    }
+    GLint Mesh::RenderRange(size_t firstIndex, size_t nIndices, GLint baseVertex)
+    {
+        if (!m_initialized || !m_vao)
+            return GL_FALSE;
+        if (firstIndex > m_nIndices || nIndices > m_nIndices - firstIndex)
+            return GL_FALSE;
+        // The VAO already has our buffers and attribute formats; all that's left is to draw.
+        size_t szIndex = m_indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+        void* first = (void*)(firstIndex*szIndex);
+        if (m_instanced)
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, nIndices, m_indexType, first, m_nInstances, baseVertex);
+        else
+            glDrawElementsBaseVertex(GL_TRIANGLES, nIndices, m_indexType, first, baseVertex);
+        return GL_TRUE;
+    }
+    GLint Mesh::SetLod(uint32_t lod)
+    {
+        if (lod >= m_lods.size())
+            return GL_FALSE;
+        m_lod = lod;
+        return GL_TRUE;
+    }
+    void Mesh::point_instance_attributes(GLuint buffer, GLintptr offset)
+    {
+        if (m_instanced && m_instanceSource == buffer && m_instanceOffset == offset)
+            return;
+        // Record the instance attributes in the VAO.
+        // A mat4 attribute is four vec4 attributes, each advancing once per instance.
+        m_vao->Bind();
+        state::BindBuffer(GL_ARRAY_BUFFER, buffer);
+        for (GLuint i = 0; i < 4; i++)
+        {
+            state::EnableVertexAttribArray(InstanceModelLocation + i);
+            glVertexAttribPointer(InstanceModelLocation + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(offset + i*sizeof(glm::vec4)));
+            glVertexAttribDivisor(InstanceModelLocation + i, 1);
+        }
+        m_instanceSource = buffer;
+        m_instanceOffset = offset;
+        m_instanced = true;
+    }
+    GLint Mesh::SetInstances(const glm::mat4* models, size_t count)
+    {
+        if (!m_initialized)
+            return GL_FALSE;
+        if (!m_vao)
+            return GL_FALSE;
+        if (count && !models)
+            return GL_FALSE;
+        if (!m_instanceVbo)
+            glGenBuffers(1, &m_instanceVbo);
+        point_instance_attributes(m_instanceVbo, 0);
+        state::BindBuffer(GL_ARRAY_BUFFER, m_instanceVbo);
+        if (count > m_instanceCapacity)
+        {
+            glBufferData(GL_ARRAY_BUFFER, count*sizeof(glm::mat4), models, GL_DYNAMIC_DRAW);
+            m_instanceCapacity = count;
+        }
+        else if (count)
+        {
+            // Orphan the old storage, so that we don't wait on draws that still read from it.
+            glBufferData(GL_ARRAY_BUFFER, m_instanceCapacity*sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, count*sizeof(glm::mat4), models);
+        }
+        m_nInstances = count;
+        return GL_TRUE;
+    }
+    GLint Mesh::SetInstances(GLuint buffer, GLintptr offset, size_t count)
+    {
+        if (!m_initialized)
+            return GL_FALSE;
+        if (!m_vao)
+            return GL_FALSE;
+        if (!buffer)
+            return GL_FALSE;
+        point_instance_attributes(buffer, offset);
+        m_nInstances = count;
         return GL_TRUE;
     }
     Mesh::~Mesh() 
@@ -82,7 +209,10 @@ namespace renderer
         {
             if (m_vao)
                 remove_from_vao();
-            glDeleteBuffers(1, &m_vbo);
+            GLuint buffers[3] = { m_vbo, m_eao, m_instanceVbo };
+            for (GLuint buffer : buffers)
+                state::ForgetBuffer(buffer);
+            glDeleteBuffers(m_instanceVbo ? 3 : 2, buffers);
         }
     }
 
@@ -90,7 +220,8 @@ namespace renderer
         const char* objFile, size_t size, 
         std::vector<GLfloat> &vertices, std::vector<GLuint> &indices,
         std::vector<GLfloat> &textureCoords,
-        std::vector<GLfloat> &normals
+        std::vector<GLfloat> &normals,
+        Bounds &bounds
     )
     {
         Assimp::Importer importer;
@@ -110,6 +241,8 @@ namespace renderer
             logger::Error("%s: Error importing file.\nError message: %s.\n", __func__, "No meshes in file!");
             return false;
         }        
+        if (scene->mNumMeshes > 1)
+            logger::Warning("%s: File has %u meshes, only the first is loaded. Use ImportModel to load all of them.\n", __func__, scene->mNumMeshes);
         const aiMesh* mesh = scene->mMeshes[0];
         vertices.reserve(mesh->mNumVertices*3);
         for (size_t i = 0; i < mesh->mNumVertices; i++)
@@ -119,6 +252,7 @@ namespace renderer
             vertices.push_back(vec.y);
             vertices.push_back(vec.z);  
         }
+        bounds = ComputeBounds(vertices);
         indices.reserve(3 * mesh->mNumFaces);
 	    for (size_t i = 0; i < mesh->mNumFaces; i++)
         {
@@ -128,12 +262,17 @@ namespace renderer
 	    	indices.push_back(mesh->mFaces[i].mIndices[1]);
 	    	indices.push_back(mesh->mFaces[i].mIndices[2]);
         }
-        textureCoords.reserve(2 * mesh->mNumVertices);
-	    for (size_t i = 0; i < mesh->mNumVertices; i++)
+        if (mesh->HasTextureCoords(0))
         {
-	    	textureCoords.push_back(mesh->mTextureCoords[0][i].x);
-	    	textureCoords.push_back(mesh->mTextureCoords[0][i].y);
+            textureCoords.reserve(2 * mesh->mNumVertices);
+	        for (size_t i = 0; i < mesh->mNumVertices; i++)
+            {
+	        	textureCoords.push_back(mesh->mTextureCoords[0][i].x);
+	        	textureCoords.push_back(mesh->mTextureCoords[0][i].y);
+            }
         }
+        if (!mesh->HasNormals())
+            return true;
         normals.reserve(3 * mesh->mNumVertices);
 	    for (size_t i = 0; i < mesh->mNumVertices; i++)
         {
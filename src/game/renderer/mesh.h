@@ -12,7 +12,12 @@
 
 #include <vector>
 
+#include <glm/ext/matrix_float4x4.hpp>
+
 #include <renderer/vao.h>
+#include <renderer/vertex_layout.h>
+#include <renderer/mesh_format.h>
+#include <renderer/bounds.h>
 
 namespace renderer
 {
@@ -25,29 +30,85 @@ namespace renderer
         Mesh(Mesh&&) = delete;
         Mesh& operator=(Mesh&&) = delete;
 
-        bool Load(const std::vector<GLfloat>& vertices, const std::vector<GLuint> indices);
+        // 'vertices' is interleaved, as described by 'layout' (see PackVertices).
+        // Indices that all fit in 16 bits are uploaded as such.
+        bool Load(const VertexLayout& layout, std::vector<uint8_t> vertices, std::vector<GLuint> indices);
+        // Does not copy anything; 'vertices' and 'indices' must stay valid until Bind() returns.
+        // 'indexType' is either GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+        bool Load(const VertexLayout& layout,
+            const void* vertices, size_t nVertices,
+            const void* indices, size_t nIndices, GLenum indexType);
+        // Does not copy anything; the memory the mesh was parsed from must stay valid until Bind() returns.
+        bool Load(const CookedMeshView& mesh);
 
         GLint Bind(VAO& to) override;
+        // Draws the current level of detail.
         GLint Render() override;
 
+        // From the full detail mesh to the coarsest; meshes that weren't cooked with levels of detail have one.
+        const std::vector<MeshLod>& GetLods() const { return m_lods; }
+        // Selects the level of detail that Render() draws.
+        GLint SetLod(uint32_t lod);
+        // Draws a range of the indices instead of the current level of detail (e.g., a Model's submesh), with the
+        // indices relative to 'baseVertex'.
+        GLint RenderRange(size_t firstIndex, size_t nIndices, GLint baseVertex = 0);
+        uint32_t GetLod() const { return m_lod; }
+
+        // The per-instance model matrix takes up four attribute locations, starting at this one.
+        static constexpr GLuint InstanceModelLocation = 3;
+        // Switches the mesh to instanced rendering (if it isn't already), and replaces the per-instance model
+        // matrices. Render() then draws all 'count' instances in one draw call.
+        // Must be called after Bind().
+        GLint SetInstances(const glm::mat4* models, size_t count);
+        // Same as above, but the model matrices are read from someone else's buffer (e.g., a FrameRingBuffer),
+        // starting at 'offset'.
+        GLint SetInstances(GLuint buffer, GLintptr offset, size_t count);
+        size_t GetInstanceCount() const { return m_nInstances; }
+        bool IsInstanced() const { return m_instanced; }
+
         GLuint GetVBO() const { return m_vbo; }
         GLuint GetEAO() const { return m_eao; }
-        const std::vector<GLfloat>& GetVertices() const { return m_vertices; }
-        const std::vector<GLuint>& GetIndices() const { return m_indices; }
+        // Object-space bounds, for culling.
+        void SetBounds(const Bounds& bounds) { m_bounds = bounds; }
+        const Bounds& GetBounds() const { return m_bounds; }
+
+        const VertexLayout& GetLayout() const { return m_layout; }
+        size_t GetVertexCount() const { return m_nVertices; }
+        size_t GetIndexCount() const { return m_nIndices; }
+        GLenum GetIndexType() const { return m_indexType; }
 
         virtual ~Mesh();
     private:
-        std::vector<GLfloat> m_vertices{};   
-        std::vector<GLuint> m_indices{};   
+        VertexLayout m_layout{};
+        Bounds m_bounds{};
+        std::vector<MeshLod> m_lods{};
+        uint32_t m_lod = 0;
+        // Only used when the mesh owns its data; freed once uploaded.
+        std::vector<uint8_t> m_vertices{};
+        std::vector<GLuint> m_indices{};
+        std::vector<GLushort> m_shortIndices{};
+        // Not guaranteed to exist after Bind call.
+        const void* m_vertexData = nullptr;
+        const void* m_indexData = nullptr;
         size_t m_nVertices = 0;
         size_t m_nIndices = 0;
+        GLenum m_indexType = GL_UNSIGNED_INT;
         GLuint m_vbo = 0;
         GLuint m_eao = 0;
+        GLuint m_instanceVbo = 0;
+        size_t m_nInstances = 0;
+        size_t m_instanceCapacity = 0;
+        bool m_instanced = false;
+        // Where the instance attributes currently point to.
+        GLuint m_instanceSource = 0;
+        GLintptr m_instanceOffset = 0;
+        void point_instance_attributes(GLuint buffer, GLintptr offset);
     };
     bool LoadMesh(
         const char* objFile, size_t size, 
         std::vector<GLfloat> &vertices, std::vector<GLuint> &indices,
         std::vector<GLfloat> &textureCoords,
-        std::vector<GLfloat> &normals
+        std::vector<GLfloat> &normals,
+        Bounds &bounds
     );
 }
\ No newline at end of file
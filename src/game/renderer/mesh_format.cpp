@@ -0,0 +1,186 @@
+/*
+ * game/renderer/mesh_format.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <GL/glew.h>
+
+#include <renderer/mesh_format.h>
+#include <renderer/vertex_layout.h>
+
+#include <logger.h>
+
+#include <vector>
+
+namespace renderer
+{
+    static size_t align_up(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+    static size_t index_size(GLenum indexType)
+    {
+        switch (indexType)
+        {
+        case GL_UNSIGNED_SHORT: return sizeof(GLushort);
+        case GL_UNSIGNED_INT: return sizeof(GLuint);
+        default: return 0;
+        }
+    }
+
+    bool ParseCookedMesh(const void* data, size_t size, CookedMeshView& out)
+    {
+        if (!data || size < sizeof(CookedMeshHeader))
+        {
+            logger::Error("%s: File is too small to be a cooked mesh.\n", __func__);
+            return false;
+        }
+        CookedMeshHeader header{};
+        memcpy(&header, data, sizeof(header));
+        if (header.magic != CookedMeshMagic)
+        {
+            logger::Error("%s: Not a cooked mesh.\n", __func__);
+            return false;
+        }
+        if (header.version != CookedMeshVersion)
+        {
+            logger::Error("%s: Cooked mesh is version %d, expected version %d. Please re-cook it.\n", __func__, header.version, CookedMeshVersion);
+            return false;
+        }
+        size_t szIndex = index_size(header.indexType);
+        if (!szIndex || header.nAttributes > CookedMeshMaxAttributes)
+        {
+            logger::Error("%s: Cooked mesh header is corrupt.\n", __func__);
+            return false;
+        }
+        VertexLayout layout;
+        for (uint32_t i = 0; i < header.nAttributes; i++)
+        {
+            const CookedMeshAttribute& attrib = header.attributes[i];
+            if (attrib.attribute > (uint8_t)VertexAttribute::MaxValue || attrib.format > (uint8_t)VertexFormat::SNorm16)
+            {
+                logger::Error("%s: Cooked mesh header is corrupt.\n", __func__);
+                return false;
+            }
+            layout.Add((VertexAttribute)attrib.attribute, attrib.location, (VertexFormat)attrib.format);
+            if (layout.GetAttributes().back().offset != attrib.offset)
+            {
+                logger::Error("%s: Cooked mesh vertex layout does not match this build's packing rules. Please re-cook it.\n", __func__);
+                return false;
+            }
+        }
+        if ((uint32_t)layout.GetStride() != header.stride)
+        {
+            logger::Error("%s: Cooked mesh vertex layout does not match this build's packing rules. Please re-cook it.\n", __func__);
+            return false;
+        }
+        // Make sure both streams are actually in the file; beware overflow, the header could be anything.
+        uint64_t szVertices = header.nVertices * header.stride;
+        uint64_t szIndices = header.nIndices * szIndex;
+        if (header.nVertices > size || header.nIndices > size ||
+            header.vertexOffset > size || szVertices > size - header.vertexOffset ||
+            header.indexOffset > size || szIndices > size - header.indexOffset)
+        {
+            logger::Error("%s: Cooked mesh is truncated.\n", __func__);
+            return false;
+        }
+        if (!header.nLods || header.nLods > CookedMeshMaxLods)
+        {
+            logger::Error("%s: Cooked mesh header is corrupt.\n", __func__);
+            return false;
+        }
+        std::vector<MeshLod> lods;
+        for (uint32_t i = 0; i < header.nLods; i++)
+        {
+            const CookedMeshLod& lod = header.lods[i];
+            if (lod.firstIndex > header.nIndices || lod.nIndices > header.nIndices - lod.firstIndex || lod.nIndices % 3)
+            {
+                logger::Error("%s: Cooked mesh LOD %d is out of bounds.\n", __func__, i);
+                return false;
+            }
+            lods.push_back(MeshLod{ lod.firstIndex, lod.nIndices, lod.error });
+        }
+        const uint8_t* base = (const uint8_t*)data;
+        out.layout = layout;
+        out.vertices = base + header.vertexOffset;
+        out.nVertices = header.nVertices;
+        out.indices = base + header.indexOffset;
+        out.nIndices = header.nIndices;
+        out.indexType = header.indexType;
+        out.bounds.min = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+        out.bounds.max = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+        out.bounds.center = glm::vec3(header.boundsCenter[0], header.boundsCenter[1], header.boundsCenter[2]);
+        out.bounds.radius = header.boundsRadius;
+        out.lods = std::move(lods);
+        out.source = utility::FileStamp{ header.sourceSize, header.sourceTime };
+        return true;
+    }
+
+    bool WriteCookedMesh(
+        std::vector<uint8_t>& out,
+        const VertexLayout& layout, const std::vector<uint8_t>& vertices,
+        const void* indices, size_t nIndices, GLenum indexType,
+        const Bounds& bounds,
+        const std::vector<MeshLod>& lods,
+        const utility::FileStamp& source
+    )
+    {
+        size_t szIndex = index_size(indexType);
+        if (!szIndex || !layout.GetStride() || vertices.size() % layout.GetStride())
+            return false;
+        if (layout.GetAttributes().size() > CookedMeshMaxAttributes || lods.size() > CookedMeshMaxLods)
+            return false;
+        for (const MeshLod& lod : lods)
+            if (lod.firstIndex > nIndices || lod.nIndices > nIndices - lod.firstIndex || lod.nIndices > UINT32_MAX)
+                return false;
+        CookedMeshHeader header{};
+        header.magic = CookedMeshMagic;
+        header.version = CookedMeshVersion;
+        header.stride = layout.GetStride();
+        header.nAttributes = layout.GetAttributes().size();
+        for (size_t i = 0; i < layout.GetAttributes().size(); i++)
+        {
+            const VertexAttributeDesc& desc = layout.GetAttributes()[i];
+            header.attributes[i].attribute = (uint8_t)desc.attribute;
+            header.attributes[i].format = (uint8_t)desc.format;
+            header.attributes[i].location = desc.location;
+            header.attributes[i].offset = desc.offset;
+        }
+        header.indexType = indexType;
+        header.nVertices = vertices.size() / layout.GetStride();
+        header.nIndices = nIndices;
+        header.vertexOffset = align_up(sizeof(header), 16);
+        header.indexOffset = align_up(header.vertexOffset + vertices.size(), 16);
+        for (int i = 0; i < 3; i++)
+        {
+            header.boundsMin[i] = bounds.min[i];
+            header.boundsMax[i] = bounds.max[i];
+            header.boundsCenter[i] = bounds.center[i];
+        }
+        header.boundsRadius = bounds.radius;
+        header.sourceSize = source.size;
+        header.sourceTime = source.time;
+        if (lods.empty())
+        {
+            header.nLods = 1;
+            header.lods[0] = CookedMeshLod{ 0, (uint32_t)nIndices, 0.f, 0 };
+        }
+        else
+        {
+            header.nLods = lods.size();
+            for (size_t i = 0; i < lods.size(); i++)
+                header.lods[i] = CookedMeshLod{ (uint32_t)lods[i].firstIndex, (uint32_t)lods[i].nIndices, lods[i].error, 0 };
+        }
+
+        out.assign(header.indexOffset + nIndices*szIndex, 0);
+        memcpy(out.data(), &header, sizeof(header));
+        memcpy(out.data() + header.vertexOffset, vertices.data(), vertices.size());
+        memcpy(out.data() + header.indexOffset, indices, nIndices*szIndex);
+        return true;
+    }
+}
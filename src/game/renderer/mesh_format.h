@@ -0,0 +1,120 @@
+/*
+ * game/renderer/mesh_format.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include <renderer/vertex_layout.h>
+#include <renderer/bounds.h>
+
+#include <file.h>
+
+// The cooked mesh format (.gmesh), written by meshcook.
+// Everything is in the byte order of the host that cooked it (little-endian, on every platform the game runs on), and
+// each stream is ready to be handed to glBufferData as-is. A file cooked on a host of the other byte order fails the
+// magic check, and the source is imported instead.
+// The header holds a hash of the source the mesh was cooked from, so that a cooked mesh whose source has changed since
+// is ignored as well.
+//   CookedMeshHeader
+//   vertex stream (interleaved, as described by the header's attributes), 16-byte aligned
+//   index stream (GL_UNSIGNED_SHORT or GL_UNSIGNED_INT), 16-byte aligned
+// The index stream holds every level of detail back to back, from the full detail mesh to the coarsest, as described by
+// the header's LOD table. All levels index the same vertices.
+
+namespace renderer
+{
+    constexpr uint32_t CookedMeshMagic = 0x48534d47; // "GMSH"
+    constexpr uint32_t CookedMeshVersion = 4;
+    constexpr size_t CookedMeshMaxAttributes = 8;
+    constexpr size_t CookedMeshMaxLods = 8;
+
+    // A level of detail: a range of the mesh's indices.
+    struct MeshLod
+    {
+        size_t firstIndex = 0;
+        size_t nIndices = 0;
+        // How far (in object space) the level's surface strays from the full detail mesh.
+        float error = 0;
+    };
+
+    struct CookedMeshAttribute
+    {
+        uint8_t attribute; // VertexAttribute
+        uint8_t format; // VertexFormat
+        uint8_t location;
+        uint8_t reserved;
+        uint32_t offset;
+    };
+    struct CookedMeshLod
+    {
+        uint32_t firstIndex;
+        uint32_t nIndices;
+        float error;
+        uint32_t reserved;
+    };
+    struct CookedMeshHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t stride;
+        uint32_t nAttributes;
+        CookedMeshAttribute attributes[CookedMeshMaxAttributes];
+        uint32_t indexType; // GLenum
+        uint32_t reserved;
+        uint64_t nVertices;
+        uint64_t nIndices;
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+        float boundsMin[3];
+        float boundsMax[3];
+        float boundsCenter[3];
+        float boundsRadius;
+        uint32_t nLods;
+        uint32_t reserved2[3];
+        CookedMeshLod lods[CookedMeshMaxLods];
+        // The size and modification time of the file the mesh was cooked from (see utility::GetFileStamp), or zero.
+        uint64_t sourceSize;
+        int64_t sourceTime;
+    };
+    static_assert(sizeof(CookedMeshHeader) == 320);
+
+    // A cooked mesh, pointing into the memory it was parsed from.
+    struct CookedMeshView
+    {
+        VertexLayout layout{};
+        const void* vertices = nullptr;
+        size_t nVertices = 0;
+        const void* indices = nullptr;
+        size_t nIndices = 0;
+        GLenum indexType = GL_UNSIGNED_INT;
+        Bounds bounds{};
+        // From the full detail mesh to the coarsest; never empty.
+        std::vector<MeshLod> lods{};
+        // The stamp of the file the mesh was cooked from; zero if unknown.
+        utility::FileStamp source{};
+    };
+
+    // Validates a cooked mesh, and fills 'out' with pointers into 'data'. Nothing is copied.
+    bool ParseCookedMesh(const void* data, size_t size, CookedMeshView& out);
+    // Serializes a mesh to the cooked format.
+    // 'indexType' is either GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, and 'indices' must already be in that format.
+    // 'lods' are ranges of 'indices', from the full detail mesh to the coarsest; if empty, the mesh has one level made
+    // of every index.
+    bool WriteCookedMesh(
+        std::vector<uint8_t>& out,
+        const VertexLayout& layout, const std::vector<uint8_t>& vertices,
+        const void* indices, size_t nIndices, GLenum indexType,
+        const Bounds& bounds,
+        const std::vector<MeshLod>& lods = {},
+        const utility::FileStamp& source = {}
+    );
+}
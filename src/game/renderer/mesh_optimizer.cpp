@@ -0,0 +1,261 @@
+/*
+ * game/renderer/mesh_optimizer.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <renderer/mesh_optimizer.h>
+
+namespace renderer
+{
+    VertexCacheStats AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t nVertices, size_t cacheSize)
+    {
+        VertexCacheStats ret{};
+        if (indices.size() < 3)
+            return ret;
+        // A vertex is in the cache if it was transformed less than 'cacheSize' transforms ago.
+        std::vector<size_t> transformedAt(nVertices, SIZE_MAX);
+        std::vector<bool> referenced(nVertices);
+        size_t nTransformed = 0, nReferenced = 0;
+        for (GLuint index : indices)
+        {
+            if (index >= nVertices)
+                continue;
+            if (transformedAt[index] == SIZE_MAX || nTransformed - transformedAt[index] >= cacheSize)
+                transformedAt[index] = nTransformed++;
+            if (!referenced[index])
+            {
+                referenced[index] = true;
+                nReferenced++;
+            }
+        }
+        ret.acmr = (float)nTransformed / (indices.size() / 3);
+        ret.atvr = nReferenced ? (float)nTransformed / nReferenced : 0.f;
+        return ret;
+    }
+
+    // Forsyth's scoring, see "Linear-Speed Vertex Cache Optimisation".
+    static constexpr int s_scoringCacheSize = 32;
+    static float vertex_score(int cachePosition, uint32_t nRemaining)
+    {
+        if (!nRemaining)
+            return -1.f;
+        float score = 0;
+        if (cachePosition >= 0)
+        {
+            // The last triangle's vertices are in the cache regardless, so using them again doesn't win anything extra.
+            if (cachePosition < 3)
+                score = 0.75f;
+            else
+                score = std::pow(1.f - (float)(cachePosition - 3) / (s_scoringCacheSize - 3), 1.5f);
+        }
+        // Finish off vertices with few triangles left, so that they don't end up as lone triangles later on.
+        return score + 2.f / std::sqrt((float)nRemaining);
+    }
+    void OptimizeVertexCache(std::vector<GLuint>& indices, size_t nVertices)
+    {
+        size_t nTriangles = indices.size() / 3;
+        if (nTriangles < 2)
+            return;
+        // The triangles around each vertex; the first nRemaining[vertex] of them haven't been emitted yet.
+        std::vector<uint32_t> nRemaining(nVertices, 0);
+        for (size_t i = 0; i < nTriangles*3; i++)
+            nRemaining[indices[i]]++;
+        std::vector<uint32_t> offsets(nVertices + 1, 0);
+        for (size_t i = 0; i < nVertices; i++)
+            offsets[i + 1] = offsets[i] + nRemaining[i];
+        std::vector<uint32_t> adjacency(nTriangles*3);
+        {
+            std::vector<uint32_t> filled(nVertices, 0);
+            for (size_t i = 0; i < nTriangles*3; i++)
+                adjacency[offsets[indices[i]] + filled[indices[i]]++] = i / 3;
+        }
+
+        std::vector<int> cachePosition(nVertices, -1);
+        std::vector<float> vertexScores(nVertices);
+        for (size_t i = 0; i < nVertices; i++)
+            vertexScores[i] = vertex_score(-1, nRemaining[i]);
+        std::vector<bool> emitted(nTriangles);
+
+        std::vector<GLuint> result;
+        result.reserve(nTriangles*3);
+        std::vector<GLuint> cache, nextCache;
+        size_t nextUnemitted = 0;
+        int64_t best = -1;
+        while (result.size() < nTriangles*3)
+        {
+            if (best < 0)
+            {
+                // Nothing in the cache has triangles left, so start again anywhere.
+                while (emitted[nextUnemitted])
+                    nextUnemitted++;
+                best = nextUnemitted;
+            }
+            const GLuint* triangle = &indices[best*3];
+            result.insert(result.end(), triangle, triangle + 3);
+            emitted[best] = true;
+            for (int corner = 0; corner < 3; corner++)
+            {
+                // Move the triangle past the vertex's remaining ones.
+                GLuint vertex = triangle[corner];
+                uint32_t* first = &adjacency[offsets[vertex]];
+                uint32_t* last = first + nRemaining[vertex];
+                std::iter_swap(std::find(first, last, (uint32_t)best), last - 1);
+                nRemaining[vertex]--;
+            }
+            // The triangle's vertices move to the front of the cache.
+            nextCache.assign(triangle, triangle + 3);
+            for (GLuint vertex : cache)
+                if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+                    nextCache.push_back(vertex);
+            for (size_t i = 0; i < nextCache.size(); i++)
+                cachePosition[nextCache[i]] = i < s_scoringCacheSize ? (int)i : -1;
+            // Rescore everything whose cache position changed (including the evicted), and their triangles.
+            best = -1;
+            float bestScore = -1.f;
+            for (GLuint vertex : nextCache)
+            {
+                vertexScores[vertex] = vertex_score(cachePosition[vertex], nRemaining[vertex]);
+                for (uint32_t i = 0; i < nRemaining[vertex]; i++)
+                {
+                    uint32_t neighbour = adjacency[offsets[vertex] + i];
+                    const GLuint* corners = &indices[neighbour*3];
+                    float score = vertexScores[corners[0]] + vertexScores[corners[1]] + vertexScores[corners[2]];
+                    if (score > bestScore && cachePosition[vertex] >= 0)
+                    {
+                        bestScore = score;
+                        best = neighbour;
+                    }
+                }
+            }
+            if (nextCache.size() > s_scoringCacheSize)
+                nextCache.resize(s_scoringCacheSize);
+            cache.swap(nextCache);
+        }
+        indices.swap(result);
+    }
+
+    void OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<GLfloat>& positions)
+    {
+        size_t nTriangles = indices.size() / 3;
+        size_t nVertices = positions.size() / 3;
+        if (nTriangles < 2)
+            return;
+        // Runs start wherever the cache starts over, i.e., at triangles whose every vertex misses the cache.
+        // Moving whole runs around costs next to nothing in cache efficiency.
+        std::vector<size_t> runs;
+        std::vector<size_t> transformedAt(nVertices, SIZE_MAX);
+        size_t nTransformed = 0;
+        for (size_t i = 0; i < nTriangles; i++)
+        {
+            int nMisses = 0;
+            for (int corner = 0; corner < 3; corner++)
+            {
+                GLuint vertex = indices[i*3 + corner];
+                if (transformedAt[vertex] == SIZE_MAX || nTransformed - transformedAt[vertex] >= 16)
+                {
+                    transformedAt[vertex] = nTransformed++;
+                    nMisses++;
+                }
+            }
+            if (i == 0 || nMisses == 3)
+                runs.push_back(i);
+        }
+        runs.push_back(nTriangles);
+        if (runs.size() <= 2)
+            return;
+
+        auto position = [&](GLuint vertex) { return glm::vec3{ positions[vertex*3], positions[vertex*3 + 1], positions[vertex*3 + 2] }; };
+        glm::vec3 meshCenter{0.f};
+        float meshArea = 0;
+        struct run
+        {
+            size_t first, last;
+            glm::vec3 center, normal;
+            float key;
+        };
+        std::vector<run> sorted;
+        for (size_t i = 0; i + 1 < runs.size(); i++)
+        {
+            run r{ runs[i], runs[i + 1], glm::vec3{0.f}, glm::vec3{0.f}, 0.f };
+            float area = 0;
+            for (size_t t = r.first; t < r.last; t++)
+            {
+                glm::vec3 a = position(indices[t*3]), b = position(indices[t*3 + 1]), c = position(indices[t*3 + 2]);
+                glm::vec3 normal = glm::cross(b - a, c - a);
+                float triangleArea = glm::length(normal);
+                r.center += (a + b + c) * (triangleArea / 3.f);
+                r.normal += normal;
+                area += triangleArea;
+            }
+            meshCenter += r.center;
+            meshArea += area;
+            r.center = area > 0 ? r.center / area : position(indices[r.first*3]);
+            float length = glm::length(r.normal);
+            r.normal = length > 0 ? r.normal / length : glm::vec3{0.f};
+            sorted.push_back(r);
+        }
+        meshCenter = meshArea > 0 ? meshCenter / meshArea : glm::vec3{0.f};
+        // Runs that face away from the middle of the mesh are likely to cover the ones behind them, so they go first.
+        for (run& r : sorted)
+            r.key = glm::dot(r.center - meshCenter, r.normal);
+        std::stable_sort(sorted.begin(), sorted.end(), [](const run& a, const run& b) { return a.key > b.key; });
+        std::vector<GLuint> result;
+        result.reserve(indices.size());
+        for (const run& r : sorted)
+            result.insert(result.end(), indices.begin() + r.first*3, indices.begin() + r.last*3);
+        indices.swap(result);
+    }
+
+    std::vector<GLuint> OptimizeVertexFetch(std::vector<GLuint>& indices, size_t nVertices)
+    {
+        std::vector<GLuint> remap(nVertices, (GLuint)-1);
+        GLuint next = 0;
+        for (GLuint& index : indices)
+        {
+            if (remap[index] == (GLuint)-1)
+                remap[index] = next++;
+            index = remap[index];
+        }
+        return remap;
+    }
+    void RemapVertices(std::vector<GLfloat>& stream, size_t nComponents, const std::vector<GLuint>& remap)
+    {
+        if (stream.empty())
+            return;
+        size_t nUsed = 0;
+        for (GLuint to : remap)
+            nUsed += to != (GLuint)-1;
+        std::vector<GLfloat> result(nUsed*nComponents);
+        for (size_t from = 0; from < remap.size() && (from + 1)*nComponents <= stream.size(); from++)
+            if (remap[from] != (GLuint)-1)
+                std::copy_n(stream.begin() + from*nComponents, nComponents, result.begin() + remap[from]*nComponents);
+        stream.swap(result);
+    }
+
+    void OptimizeMesh(
+        std::vector<GLfloat>& vertices, std::vector<GLuint>& indices,
+        std::vector<GLfloat>& textureCoords, std::vector<GLfloat>& normals
+    )
+    {
+        size_t nVertices = vertices.size() / 3;
+        OptimizeVertexCache(indices, nVertices);
+        OptimizeOverdraw(indices, vertices);
+        std::vector<GLuint> remap = OptimizeVertexFetch(indices, nVertices);
+        RemapVertices(vertices, 3, remap);
+        RemapVertices(textureCoords, 2, remap);
+        RemapVertices(normals, 3, remap);
+    }
+}
@@ -0,0 +1,47 @@
+/*
+ * game/renderer/mesh_optimizer.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+#include <GL/glew.h>
+
+#include <vector>
+
+// Reorders imported meshes for the GPU, without changing what they look like:
+//   OptimizeVertexCache orders triangles so that their vertices are still in the post-transform cache (Forsyth's algorithm);
+//   OptimizeOverdraw then reorders clusters of those triangles so that outward-facing ones are drawn first;
+//   OptimizeVertexFetch finally orders vertices by first use, so that vertex fetches walk memory in order.
+
+namespace renderer
+{
+    struct VertexCacheStats
+    {
+        // Average cache miss ratio: transformed vertices per triangle, from 0.5 (ideal) to 3.
+        float acmr = 0;
+        // Average transformed to vertex ratio: transformed vertices per referenced vertex, from 1 (ideal) up.
+        float atvr = 0;
+    };
+    // Simulates a FIFO post-transform cache of 'cacheSize' vertices.
+    VertexCacheStats AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t nVertices, size_t cacheSize = 16);
+
+    void OptimizeVertexCache(std::vector<GLuint>& indices, size_t nVertices);
+    // 'positions' has three floats per vertex. Expects triangles that already went through OptimizeVertexCache, and only
+    // moves whole runs of them, so that the cache stays about as efficient.
+    void OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<GLfloat>& positions);
+    // Renumbers vertices in order of first use in 'indices', and returns the new index of each old vertex (or -1 for
+    // vertices no triangle uses). Apply it to the vertex streams with RemapVertices.
+    std::vector<GLuint> OptimizeVertexFetch(std::vector<GLuint>& indices, size_t nVertices);
+    // 'stream' has 'nComponents' floats per vertex. Unused vertices are dropped.
+    void RemapVertices(std::vector<GLfloat>& stream, size_t nComponents, const std::vector<GLuint>& remap);
+
+    // All of the above, for a mesh as imported by LoadMesh. 'textureCoords' and 'normals' can be empty.
+    void OptimizeMesh(
+        std::vector<GLfloat>& vertices, std::vector<GLuint>& indices,
+        std::vector<GLfloat>& textureCoords, std::vector<GLfloat>& normals
+    );
+}
@@ -0,0 +1,248 @@
+/*
+ * game/renderer/model.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <algorithm>
+#include <utility>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <renderer/model.h>
+#include <renderer/mesh_optimizer.h>
+#include <renderer/vertex_layout.h>
+
+#include <logger.h>
+
+namespace renderer
+{
+    static glm::mat4 to_mat4(const aiMatrix4x4& m)
+    {
+        // Assimp's matrices are row-major, glm's are column-major.
+        return glm::mat4{
+            glm::vec4{m.a1, m.b1, m.c1, m.d1},
+            glm::vec4{m.a2, m.b2, m.c2, m.d2},
+            glm::vec4{m.a3, m.b3, m.c3, m.d3},
+            glm::vec4{m.a4, m.b4, m.c4, m.d4},
+        };
+    }
+    static Material import_material(const aiMaterial* material)
+    {
+        Material ret{};
+        aiString str{};
+        if (material->Get(AI_MATKEY_NAME, str) == aiReturn_SUCCESS)
+            ret.name = str.C_Str();
+        aiColor4D diffuse{};
+        if (material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse) == aiReturn_SUCCESS)
+            ret.diffuseColor = glm::vec4{diffuse.r, diffuse.g, diffuse.b, diffuse.a};
+        if (material->GetTextureCount(aiTextureType_DIFFUSE) &&
+            material->GetTexture(aiTextureType_DIFFUSE, 0, &str) == aiReturn_SUCCESS)
+            ret.diffuseTexture = str.C_Str();
+        return ret;
+    }
+    // Appends one of the scene's meshes to the model's streams as a new submesh.
+    static void import_submesh(const aiMesh* mesh, bool hasTextureCoords, bool hasNormals, ImportedModel& out)
+    {
+        std::vector<GLfloat> vertices, textureCoords, normals;
+        std::vector<GLuint> indices;
+        vertices.reserve(mesh->mNumVertices*3);
+        for (size_t i = 0; i < mesh->mNumVertices; i++)
+        {
+            auto vec = mesh->mVertices[i];
+            vertices.push_back(vec.x);
+            vertices.push_back(vec.y);
+            vertices.push_back(vec.z);
+        }
+        indices.reserve(3 * mesh->mNumFaces);
+        for (size_t i = 0; i < mesh->mNumFaces; i++)
+        {
+            // Lines and points are sorted into meshes of their own, but may share a mesh with triangles when the
+            // file mixes them; only the triangles are drawn.
+            const aiFace& face = mesh->mFaces[i];
+            if (face.mNumIndices != 3)
+                continue;
+            indices.push_back(face.mIndices[0]);
+            indices.push_back(face.mIndices[1]);
+            indices.push_back(face.mIndices[2]);
+        }
+        // Every submesh shares the streams, so if any submesh has an attribute, they all need one.
+        if (hasTextureCoords)
+        {
+            textureCoords.resize(2 * mesh->mNumVertices);
+            if (mesh->HasTextureCoords(0))
+            {
+                for (size_t i = 0; i < mesh->mNumVertices; i++)
+                {
+                    textureCoords[i*2+0] = mesh->mTextureCoords[0][i].x;
+                    textureCoords[i*2+1] = mesh->mTextureCoords[0][i].y;
+                }
+            }
+        }
+        if (hasNormals)
+        {
+            normals.resize(3 * mesh->mNumVertices);
+            if (mesh->HasNormals())
+            {
+                for (size_t i = 0; i < mesh->mNumVertices; i++)
+                {
+                    normals[i*3+0] = mesh->mNormals[i].x;
+                    normals[i*3+1] = mesh->mNormals[i].y;
+                    normals[i*3+2] = mesh->mNormals[i].z;
+                }
+            }
+        }
+        OptimizeMesh(vertices, indices, textureCoords, normals);
+
+        Submesh submesh{};
+        submesh.firstIndex = out.indices.size();
+        submesh.nIndices = indices.size();
+        submesh.baseVertex = out.vertices.size() / 3;
+        submesh.nVertices = vertices.size() / 3;
+        submesh.material = std::min<uint32_t>(mesh->mMaterialIndex, out.materials.size() - 1);
+        submesh.bounds = ComputeBounds(vertices);
+        out.submeshes.push_back(submesh);
+        // The indices stay relative to the submesh, so that most of them fit in 16 bits.
+        out.indices.insert(out.indices.end(), indices.begin(), indices.end());
+        out.vertices.insert(out.vertices.end(), vertices.begin(), vertices.end());
+        out.textureCoords.insert(out.textureCoords.end(), textureCoords.begin(), textureCoords.end());
+        out.normals.insert(out.normals.end(), normals.begin(), normals.end());
+    }
+    static void import_nodes(const aiNode* root, const ImportedModel& model, ModelNodes& nodes, std::vector<SubmeshInstance>& instances)
+    {
+        struct pending_node
+        {
+            const aiNode* node;
+            int32_t parent;
+        };
+        std::vector<pending_node> stack{ { root, -1 } };
+        while (!stack.empty())
+        {
+            pending_node current = stack.back();
+            stack.pop_back();
+            uint32_t index = nodes.GetCount();
+            glm::mat4 local = to_mat4(current.node->mTransformation);
+            nodes.names.push_back(current.node->mName.C_Str());
+            nodes.parents.push_back(current.parent);
+            nodes.localTransforms.push_back(local);
+            nodes.modelTransforms.push_back(current.parent == -1 ? local : nodes.modelTransforms[current.parent] * local);
+            for (size_t i = 0; i < current.node->mNumMeshes; i++)
+            {
+                uint32_t submesh = current.node->mMeshes[i];
+                if (submesh < model.submeshes.size() && model.submeshes[submesh].nIndices)
+                    instances.push_back({ submesh, index });
+            }
+            // Pushed in reverse, so that children are visited in order.
+            for (size_t i = current.node->mNumChildren; i > 0; i--)
+                stack.push_back({ current.node->mChildren[i-1], (int32_t)index });
+        }
+    }
+
+    bool ImportModel(const char* file, size_t size, ImportedModel& out)
+    {
+        Assimp::Importer importer;
+        auto scene = importer.ReadFileFromMemory(
+            file, size,
+            aiProcess_JoinIdenticalVertices |
+                aiProcess_Triangulate |
+                aiProcess_SortByPType
+        );
+        if (!scene)
+        {
+            logger::Error("%s: Error importing file.\nError message: %s.\n", __func__, importer.GetErrorString());
+            return false;
+        }
+        if (!scene->HasMeshes())
+        {
+            logger::Error("%s: Error importing file.\nError message: %s.\n", __func__, "No meshes in file!");
+            return false;
+        }
+        out = {};
+
+        out.materials.reserve(std::max(scene->mNumMaterials, 1u));
+        for (size_t i = 0; i < scene->mNumMaterials; i++)
+            out.materials.push_back(import_material(scene->mMaterials[i]));
+        if (out.materials.empty())
+            out.materials.push_back(Material{ "default" });
+
+        bool hasTextureCoords = false, hasNormals = false;
+        for (size_t i = 0; i < scene->mNumMeshes; i++)
+        {
+            hasTextureCoords = hasTextureCoords || scene->mMeshes[i]->HasTextureCoords(0);
+            hasNormals = hasNormals || scene->mMeshes[i]->HasNormals();
+        }
+        out.submeshes.reserve(scene->mNumMeshes);
+        for (size_t i = 0; i < scene->mNumMeshes; i++)
+            import_submesh(scene->mMeshes[i], hasTextureCoords, hasNormals, out);
+
+        if (scene->mRootNode)
+            import_nodes(scene->mRootNode, out, out.nodes, out.instances);
+        else
+        {
+            // No hierarchy; place every submesh once, untransformed.
+            out.nodes.names.push_back("root");
+            out.nodes.parents.push_back(-1);
+            out.nodes.localTransforms.push_back(glm::mat4{1.f});
+            out.nodes.modelTransforms.push_back(glm::mat4{1.f});
+            for (uint32_t i = 0; i < out.submeshes.size(); i++)
+                if (out.submeshes[i].nIndices)
+                    out.instances.push_back({ i, 0 });
+        }
+        if (out.instances.empty())
+        {
+            logger::Error("%s: Error importing file.\nError message: %s.\n", __func__, "No triangles in file!");
+            return false;
+        }
+        std::stable_sort(out.instances.begin(), out.instances.end(), [&out](const SubmeshInstance& a, const SubmeshInstance& b) {
+            uint32_t materialA = out.submeshes[a.submesh].material;
+            uint32_t materialB = out.submeshes[b.submesh].material;
+            if (materialA != materialB)
+                return materialA < materialB;
+            return a.submesh < b.submesh;
+        });
+
+        out.bounds = TransformBounds(out.submeshes[out.instances[0].submesh].bounds, out.nodes.modelTransforms[out.instances[0].node]);
+        for (size_t i = 1; i < out.instances.size(); i++)
+        {
+            const SubmeshInstance& instance = out.instances[i];
+            Bounds bounds = TransformBounds(out.submeshes[instance.submesh].bounds, out.nodes.modelTransforms[instance.node]);
+            out.bounds.min = glm::min(out.bounds.min, bounds.min);
+            out.bounds.max = glm::max(out.bounds.max, bounds.max);
+        }
+        out.bounds.center = (out.bounds.min + out.bounds.max) * 0.5f;
+        out.bounds.radius = glm::length(out.bounds.max - out.bounds.center);
+        return true;
+    }
+
+    bool Model::Load(ImportedModel model)
+    {
+        VertexLayout layout = VertexLayout::Packed();
+        std::vector<uint8_t> vertices = PackVertices(layout, model.vertices, model.normals, model.textureCoords);
+        // The packed copy is all that's uploaded.
+        model.vertices = {};
+        model.normals = {};
+        model.textureCoords = {};
+        m_mesh.SetBounds(model.bounds);
+        if (!m_mesh.Load(layout, std::move(vertices), std::move(model.indices)))
+            return false;
+        m_submeshes = std::move(model.submeshes);
+        m_materials = std::move(model.materials);
+        m_nodes = std::move(model.nodes);
+        m_instances = std::move(model.instances);
+        m_bounds = model.bounds;
+        return true;
+    }
+    GLint Model::Bind(VAO& to)
+    {
+        return m_mesh.Bind(to);
+    }
+    GLint Model::RenderSubmesh(uint32_t submesh)
+    {
+        if (submesh >= m_submeshes.size())
+            return GL_FALSE;
+        const Submesh& range = m_submeshes[submesh];
+        return m_mesh.RenderRange(range.firstIndex, range.nIndices, (GLint)range.baseVertex);
+    }
+}
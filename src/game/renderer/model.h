@@ -0,0 +1,119 @@
+/*
+ * game/renderer/model.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <renderer/vao.h>
+#include <renderer/mesh.h>
+#include <renderer/bounds.h>
+
+namespace renderer
+{
+    struct Material
+    {
+        std::string name{};
+        glm::vec4 diffuseColor{1.f};
+        // As written in the model file (usually relative to it); empty if the material has no texture.
+        std::string diffuseTexture{};
+    };
+    // A range of a model's shared buffers, drawn with one material.
+    struct Submesh
+    {
+        size_t firstIndex = 0;
+        size_t nIndices = 0;
+        // The submesh's indices are relative to this vertex.
+        size_t baseVertex = 0;
+        size_t nVertices = 0;
+        uint32_t material = 0;
+        // In the submesh's own space; nodes place it in the model.
+        Bounds bounds{};
+    };
+    // A submesh, placed in the model by a node.
+    struct SubmeshInstance
+    {
+        uint32_t submesh = 0;
+        uint32_t node = 0;
+    };
+    // The node hierarchy, flattened depth first (so parents come before their children), as parallel arrays.
+    struct ModelNodes
+    {
+        std::vector<std::string> names{};
+        // -1 for the root.
+        std::vector<int32_t> parents{};
+        std::vector<glm::mat4> localTransforms{};
+        // Node to model space, i.e., the local transforms concatenated down from the root.
+        std::vector<glm::mat4> modelTransforms{};
+
+        size_t GetCount() const { return parents.size(); }
+    };
+    // A whole model file, with every mesh in one set of vertex streams and one index buffer.
+    struct ImportedModel
+    {
+        // As from LoadMesh, and optimized per submesh (see OptimizeMesh).
+        std::vector<GLfloat> vertices{};
+        std::vector<GLfloat> textureCoords{};
+        std::vector<GLfloat> normals{};
+        std::vector<GLuint> indices{};
+        std::vector<Submesh> submeshes{};
+        // Never empty; models without materials get a default one.
+        std::vector<Material> materials{};
+        ModelNodes nodes{};
+        // Sorted by material, then submesh, so that instances drawn the same way are next to each other.
+        std::vector<SubmeshInstance> instances{};
+        // Model-space bounds of every instance.
+        Bounds bounds{};
+    };
+
+    // Imports every mesh, material and node of a model file (anything Assimp can import).
+    // Does not touch the GL, so it can be called from any thread.
+    bool ImportModel(const char* file, size_t size, ImportedModel& out);
+
+    // An imported model, uploaded as one mesh, so that one VAO bind covers every submesh.
+    class Model final
+    {
+    public:
+        Model() = default;
+        // Cannot be copied.
+        Model(const Model&) = delete;
+        Model& operator=(const Model&) = delete;
+        // Cannot be moved.
+        Model(Model&&) = delete;
+        Model& operator=(Model&&) = delete;
+
+        // Takes the model's streams, which are freed once uploaded.
+        bool Load(ImportedModel model);
+        GLint Bind(VAO& to);
+
+        // Draws one instance of a submesh with the mesh's current instance attributes (see Mesh::SetInstances).
+        // The model's VAO must be bound.
+        GLint RenderSubmesh(uint32_t submesh);
+
+        Mesh& GetMesh() { return m_mesh; }
+        const std::vector<Submesh>& GetSubmeshes() const { return m_submeshes; }
+        const std::vector<Material>& GetMaterials() const { return m_materials; }
+        const ModelNodes& GetNodes() const { return m_nodes; }
+        const std::vector<SubmeshInstance>& GetInstances() const { return m_instances; }
+        const Bounds& GetBounds() const { return m_bounds; }
+
+    private:
+        Mesh m_mesh;
+        std::vector<Submesh> m_submeshes{};
+        std::vector<Material> m_materials{};
+        ModelNodes m_nodes{};
+        std::vector<SubmeshInstance> m_instances{};
+        Bounds m_bounds{};
+    };
+}
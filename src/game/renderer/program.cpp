@@ -5,15 +5,20 @@
 */
 
 #include <stddef.h>
+#include <string.h>
 
 #include <GL/glew.h>
 #include <GL/gl.h>
 
 #include <renderer/shader.h>
+#include <renderer/state_cache.h>
+
+#include <logger.h>
 
 #include <string>
 #include <mutex>
 #include <list>
+#include <vector>
 
 namespace renderer
 {
@@ -22,14 +27,42 @@ namespace renderer
         m_programId = glCreateProgram();
         m_initialized = true;
     }
-    GLint Program::Link()
+    GLint Program::Link(bool retrievable)
+    {
+        if (!BeginLink(retrievable))
+            return GL_FALSE;
+        return FinishLink();
+    }
+    GLint Program::BeginLink(bool retrievable)
     {
         if (!m_initialized)
             throw std::runtime_error{ "Program is uninitialized before link! This is a bug, please report it.\n"};
         if (!m_attached.size())
             return GL_FALSE; // Nothing to link.
+        if (m_linking)
+            return GL_FALSE;
         m_lock.lock();
+        if (retrievable && (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary))
+            glProgramParameteri(m_programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(m_programId);
+        m_linking = true;
+        return GL_TRUE;
+    }
+    bool Program::IsLinkDone() const
+    {
+        if (!m_linking)
+            return true;
+        if (!GLEW_KHR_parallel_shader_compile && !GLEW_ARB_parallel_shader_compile)
+            return true;
+        GLint done = GL_TRUE;
+        glGetProgramiv(m_programId, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
+    }
+    GLint Program::FinishLink()
+    {
+        if (!m_linking)
+            return m_linkSuccess ? GL_TRUE : GL_FALSE;
+        m_linking = false;
         GLint result = GL_TRUE;
         glGetProgramiv(m_programId, GL_LINK_STATUS, &result);
         GLint infoLogLength = 0;
@@ -42,6 +75,7 @@ namespace renderer
         if (result == GL_FALSE)
         {
             m_linkSuccess = false;
+            m_lock.unlock();
             return GL_FALSE; 
         }
         m_linkSuccess = true;
@@ -53,24 +87,264 @@ namespace renderer
         }
         m_attached.clear(); // Remove each shader.
         m_lock.unlock();
+        reflect();
         return GL_TRUE;
     }
+    GLint Program::LinkBinary(GLenum format, const void* binary, size_t size)
+    {
+        if (!m_initialized)
+            throw std::runtime_error{ "Program is uninitialized before link! This is a bug, please report it.\n"};
+        if (m_linkSuccess || !binary || !size)
+            return GL_FALSE;
+        if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+            return GL_FALSE;
+        std::lock_guard guard{ m_lock };
+        glProgramBinary(m_programId, format, binary, size);
+        GLint result = GL_FALSE;
+        glGetProgramiv(m_programId, GL_LINK_STATUS, &result);
+        if (result == GL_FALSE)
+            return GL_FALSE;
+        m_linkSuccess = true;
+        reflect();
+        return GL_TRUE;
+    }
+    bool Program::GetBinary(GLenum& format, std::vector<uint8_t>& binary) const
+    {
+        if (!m_linkSuccess)
+            return false;
+        if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+            return false;
+        GLint size = 0;
+        glGetProgramiv(m_programId, GL_PROGRAM_BINARY_LENGTH, &size);
+        if (size <= 0)
+            return false;
+        binary.resize(size);
+        GLsizei written = 0;
+        glGetProgramBinary(m_programId, size, &written, &format, binary.data());
+        binary.resize(written);
+        return written > 0;
+    }
     GLint Program::Use()
     {
         if (!m_initialized)
             throw std::runtime_error{ "Program is uninitialized before call to Use()! This is a bug, please report it.\n"};
         if (!m_linkSuccess)
             return GL_FALSE;
-        glUseProgram(m_programId);
+        state::UseProgram(m_programId);
         return GL_TRUE;
     }
-    GLuint Program::GetUniformLocation(const char* uniformName)
+    // Adds 'name' to 'lookup'; arrays (named "name[0]") are also added without the "[0]".
+    static void add_name(std::unordered_map<uint32_t, uint32_t>& lookup, const std::string& name, uint32_t index,
+        const char* kind)
+    {
+        std::string_view view = name;
+        for (int i = 0; i < 2; i++)
+        {
+            auto [it, added] = lookup.emplace(HashName(view), index);
+            if (!added && it->second != index)
+                logger::Error("Program: The %s names '%.*s' and #%u collide; the latter can't be looked up by name.\n",
+                    kind, (int)view.size(), view.data(), it->second);
+            if (view.size() < 3 || view.substr(view.size() - 3) != "[0]")
+                break;
+            view.remove_suffix(3);
+        }
+    }
+    void Program::reflect()
+    {
+        m_uniforms.clear();
+        m_uniformBlocks.clear();
+        m_attributes.clear();
+        m_uniformLookup.clear();
+        m_uniformBlockLookup.clear();
+        m_attributeLookup.clear();
+        std::vector<GLchar> name;
+
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(m_programId, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(m_programId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        name.resize(maxLength + 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            UniformInfo uniform{};
+            GLsizei length = 0;
+            glGetActiveUniform(m_programId, i, name.size(), &length, &uniform.size, &uniform.type, name.data());
+            uniform.name.assign(name.data(), length);
+            uniform.location = glGetUniformLocation(m_programId, uniform.name.c_str());
+            add_name(m_uniformLookup, uniform.name, m_uniforms.size(), "uniform");
+            m_uniforms.push_back(std::move(uniform));
+        }
+        m_uniformValues.assign(m_uniforms.size(), uniform_value{});
+
+        glGetProgramiv(m_programId, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        glGetProgramiv(m_programId, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+        name.resize(maxLength + 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            UniformBlockInfo block{};
+            GLsizei length = 0;
+            glGetActiveUniformBlockName(m_programId, i, name.size(), &length, name.data());
+            block.name.assign(name.data(), length);
+            block.index = i;
+            glGetActiveUniformBlockiv(m_programId, i, GL_UNIFORM_BLOCK_DATA_SIZE, &block.dataSize);
+            add_name(m_uniformBlockLookup, block.name, m_uniformBlocks.size(), "uniform block");
+            m_uniformBlocks.push_back(std::move(block));
+        }
+        m_uniformBlockBindings.assign(m_uniformBlocks.size(), -1);
+
+        glGetProgramiv(m_programId, GL_ACTIVE_ATTRIBUTES, &count);
+        glGetProgramiv(m_programId, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+        name.resize(maxLength + 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            AttributeInfo attribute{};
+            GLsizei length = 0;
+            glGetActiveAttrib(m_programId, i, name.size(), &length, &attribute.size, &attribute.type, name.data());
+            attribute.name.assign(name.data(), length);
+            attribute.location = glGetAttribLocation(m_programId, attribute.name.c_str());
+            add_name(m_attributeLookup, attribute.name, m_attributes.size(), "attribute");
+            m_attributes.push_back(std::move(attribute));
+        }
+    }
+    const UniformInfo* Program::FindUniform(ProgramName name) const
+    {
+        auto it = m_uniformLookup.find(name.hash);
+        return it == m_uniformLookup.end() ? nullptr : &m_uniforms[it->second];
+    }
+    const UniformBlockInfo* Program::FindUniformBlock(ProgramName name) const
+    {
+        auto it = m_uniformBlockLookup.find(name.hash);
+        return it == m_uniformBlockLookup.end() ? nullptr : &m_uniformBlocks[it->second];
+    }
+    const AttributeInfo* Program::FindAttribute(ProgramName name) const
+    {
+        auto it = m_attributeLookup.find(name.hash);
+        return it == m_attributeLookup.end() ? nullptr : &m_attributes[it->second];
+    }
+    GLuint Program::GetUniformLocation(ProgramName uniformName)
     {
         if (!m_initialized)
             throw std::runtime_error{ "Program is uninitialized before call to GetUniformLocation()! This is a bug, please report it.\n"};
         if (!m_linkSuccess)
             return (GLuint)-1;
-        return glGetUniformLocation(m_programId, uniformName);
+        const UniformInfo* uniform = FindUniform(uniformName);
+        return uniform ? uniform->location : (GLuint)-1;
+    }
+    GLint Program::BindUniformBlock(ProgramName blockName, GLuint binding)
+    {
+        if (!m_initialized)
+            throw std::runtime_error{ "Program is uninitialized before call to BindUniformBlock()! This is a bug, please report it.\n"};
+        if (!m_linkSuccess)
+            return GL_FALSE;
+        auto it = m_uniformBlockLookup.find(blockName.hash);
+        if (it == m_uniformBlockLookup.end())
+            return GL_FALSE;
+        if (m_uniformBlockBindings[it->second] == (GLint)binding)
+            return GL_TRUE;
+        glUniformBlockBinding(m_programId, m_uniformBlocks[it->second].index, binding);
+        m_uniformBlockBindings[it->second] = binding;
+        return GL_TRUE;
+    }
+
+    static bool is_int_type(GLenum type)
+    {
+        switch (type)
+        {
+        case GL_INT:
+        case GL_BOOL:
+        case GL_SAMPLER_2D:
+        case GL_SAMPLER_3D:
+        case GL_SAMPLER_CUBE:
+        case GL_SAMPLER_2D_ARRAY:
+        case GL_SAMPLER_2D_SHADOW:
+        case GL_SAMPLER_BUFFER:
+            return true;
+        default:
+            return false;
+        }
+    }
+    static bool is_float_type(GLenum type) { return type == GL_FLOAT; }
+    static bool is_vec2_type(GLenum type) { return type == GL_FLOAT_VEC2; }
+    static bool is_vec3_type(GLenum type) { return type == GL_FLOAT_VEC3; }
+    static bool is_vec4_type(GLenum type) { return type == GL_FLOAT_VEC4; }
+    static bool is_mat4_type(GLenum type) { return type == GL_FLOAT_MAT4; }
+    Program::uniform_update Program::update_uniform(ProgramName name, bool (*isType)(GLenum), const void* value, size_t size, GLint& location)
+    {
+        if (!m_linkSuccess)
+            return uniform_update::Rejected;
+        auto it = m_uniformLookup.find(name.hash);
+        if (it == m_uniformLookup.end())
+            return uniform_update::Rejected;
+        const UniformInfo& uniform = m_uniforms[it->second];
+        if (uniform.location < 0 || !isType(uniform.type))
+        {
+            logger::Error("%s: '%.*s' is not a uniform of that type.\n", __func__, (int)name.name.size(), name.name.data());
+            return uniform_update::Rejected;
+        }
+        uniform_value& cached = m_uniformValues[it->second];
+        if (cached.known && memcmp(cached.data.data(), value, size) == 0)
+        {
+            m_uniformStats.skipped++;
+            return uniform_update::Unchanged;
+        }
+        memcpy(cached.data.data(), value, size);
+        cached.known = true;
+        m_uniformStats.uploads++;
+        location = uniform.location;
+        // glUniform*() sets the current program's uniforms.
+        state::UseProgram(m_programId);
+        return uniform_update::Upload;
+    }
+    GLint Program::SetUniform(ProgramName name, GLint value)
+    {
+        GLint location = -1;
+        uniform_update update = update_uniform(name, is_int_type, &value, sizeof(value), location);
+        if (update == uniform_update::Upload)
+            glUniform1i(location, value);
+        return update != uniform_update::Rejected ? GL_TRUE : GL_FALSE;
+    }
+    GLint Program::SetUniform(ProgramName name, GLfloat value)
+    {
+        GLint location = -1;
+        uniform_update update = update_uniform(name, is_float_type, &value, sizeof(value), location);
+        if (update == uniform_update::Upload)
+            glUniform1f(location, value);
+        return update != uniform_update::Rejected ? GL_TRUE : GL_FALSE;
+    }
+    GLint Program::SetUniform(ProgramName name, const glm::vec2& value)
+    {
+        GLint location = -1;
+        uniform_update update = update_uniform(name, is_vec2_type, &value, sizeof(value), location);
+        if (update == uniform_update::Upload)
+            glUniform2fv(location, 1, &value[0]);
+        return update != uniform_update::Rejected ? GL_TRUE : GL_FALSE;
+    }
+    GLint Program::SetUniform(ProgramName name, const glm::vec3& value)
+    {
+        GLint location = -1;
+        uniform_update update = update_uniform(name, is_vec3_type, &value, sizeof(value), location);
+        if (update == uniform_update::Upload)
+            glUniform3fv(location, 1, &value[0]);
+        return update != uniform_update::Rejected ? GL_TRUE : GL_FALSE;
+    }
+    GLint Program::SetUniform(ProgramName name, const glm::vec4& value)
+    {
+        GLint location = -1;
+        uniform_update update = update_uniform(name, is_vec4_type, &value, sizeof(value), location);
+        if (update == uniform_update::Upload)
+            glUniform4fv(location, 1, &value[0]);
+        return update != uniform_update::Rejected ? GL_TRUE : GL_FALSE;
+    }
+    GLint Program::SetUniform(ProgramName name, const glm::mat4& value)
+    {
+        GLint location = -1;
+        uniform_update update = update_uniform(name, is_mat4_type, &value, sizeof(value), location);
+        if (update == uniform_update::Upload)
+            glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]);
+        return update != uniform_update::Rejected ? GL_TRUE : GL_FALSE;
+    }
+    std::string Program::GetLinkMessages() const
+    {
+        return m_linkMessages;
     }
     Program::~Program()
     {
@@ -83,6 +357,7 @@ namespace renderer
             }
             m_attached.clear();
         }
+        state::ForgetProgram(m_programId);
         glDeleteProgram(m_programId);
     }
 }
\ No newline at end of file
@@ -0,0 +1,209 @@
+/*
+ * game/renderer/program_cache.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <system_error>
+
+#include <renderer/program_cache.h>
+
+#include <file.h>
+#include <logger.h>
+
+namespace renderer
+{
+    static constexpr uint32_t s_magic = 0x43505247; // 'GRPC'
+    static constexpr uint32_t s_version = 1;
+    struct cache_header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t format;
+        uint32_t size;
+        // What the program took to compile and link, in milliseconds.
+        float compileTime;
+        uint32_t reserved;
+    };
+    static_assert(sizeof(cache_header) == 32);
+
+    // FNV-1a.
+    static uint64_t hash_bytes(uint64_t seed, const void* data, size_t size)
+    {
+        const uint8_t* bytes = (const uint8_t*)data;
+        for (size_t i = 0; i < size; i++)
+        {
+            seed ^= bytes[i];
+            seed *= 0x100000001b3;
+        }
+        return seed;
+    }
+    static uint64_t hash_string(uint64_t seed, std::string_view str)
+    {
+        // Hash the length too, so that moving text from one string to the next changes the key.
+        uint64_t length = str.size();
+        return hash_bytes(hash_bytes(seed, &length, sizeof(length)), str.data(), str.size());
+    }
+    static const char* shader_type_name(ShaderType type)
+    {
+        switch (type)
+        {
+        case ShaderType::Vertex: return "Vertex";
+        case ShaderType::Fragment: return "Fragment";
+        case ShaderType::Geometry: return "Geometry";
+        default: return "Unknown";
+        }
+    }
+
+    std::string InsertDefines(std::string_view code, const std::vector<std::string>& defines)
+    {
+        if (defines.empty())
+            return std::string{code};
+        // #version must stay the first line.
+        size_t insertAt = 0;
+        size_t start = code.find_first_not_of(" \t\r\n");
+        if (start != std::string_view::npos && code.compare(start, 8, "#version") == 0)
+        {
+            size_t end = code.find('\n', start);
+            insertAt = end == std::string_view::npos ? code.size() : end + 1;
+        }
+        std::string ret{code.substr(0, insertAt)};
+        if (insertAt && ret.back() != '\n')
+            ret += '\n';
+        for (const std::string& define : defines)
+            ret += "#define " + define + "\n";
+        ret += code.substr(insertAt);
+        return ret;
+    }
+
+    ProgramCache::ProgramCache(std::string directory)
+        : m_directory{ std::move(directory) }
+    {}
+    bool ProgramCache::IsSupported() const
+    {
+        return GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary;
+    }
+    GLint ProgramCache::compile(Program& program, const std::vector<ShaderSource>& sources, const std::vector<std::string>& defines)
+    {
+        std::vector<std::unique_ptr<Shader>> shaders;
+        shaders.reserve(sources.size());
+        for (const ShaderSource& source : sources)
+        {
+            shaders.push_back(std::make_unique<Shader>(source.type));
+            Shader& shader = *shaders.back();
+            if (!shader.CompileShader(InsertDefines(source.code, defines)))
+            {
+                logger::Error("%s shader failed compile!\n%s\n", shader_type_name(source.type), shader.GetCompileMessages().data());
+                return GL_FALSE;
+            }
+            shader.BindShader(program);
+        }
+        if (!program.Link(IsSupported()))
+        {
+            logger::Error("Program failed to link!\n%s\n", program.GetLinkMessages().data());
+            return GL_FALSE;
+        }
+        return GL_TRUE;
+    }
+    std::string ProgramCache::get_path(uint64_t key) const
+    {
+        char name[32] = {};
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return m_directory + "/" + name;
+    }
+    uint64_t ProgramCache::GetKey(const std::vector<ShaderSource>& sources, const std::vector<std::string>& defines)
+    {
+        if (m_driver.empty())
+        {
+            for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+            {
+                const char* str = (const char*)glGetString(name);
+                m_driver += str ? str : "";
+                m_driver += '\n';
+            }
+        }
+        uint64_t key = hash_string(0xcbf29ce484222325, m_driver);
+        for (const ShaderSource& source : sources)
+        {
+            key = hash_bytes(key, &source.type, sizeof(source.type));
+            key = hash_string(key, source.code);
+        }
+        for (const std::string& define : defines)
+            key = hash_string(key, define);
+        return key;
+    }
+    bool ProgramCache::Load(Program& program, uint64_t key)
+    {
+        if (!IsSupported())
+            return false;
+        std::string path = get_path(key);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<uint8_t> file;
+        if (!utility::LoadFile(path.c_str(), file) || file.size() < sizeof(cache_header))
+            return false;
+        cache_header header{};
+        memcpy(&header, file.data(), sizeof(header));
+        // The key is checked as well, in case of a hash collision in the name.
+        bool valid = header.magic == s_magic && header.version == s_version && header.key == key &&
+            header.size == file.size() - sizeof(header);
+        if (!valid || !program.LinkBinary(header.format, file.data() + sizeof(header), header.size))
+        {
+            logger::Debug("%s: Cached program %s is stale, rebuilding it.\n", __func__, path.c_str());
+            return false;
+        }
+        double loadTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        m_stats.hits++;
+        m_stats.loadTime += loadTime;
+        m_stats.savedTime += header.compileTime - loadTime;
+        return true;
+    }
+    void ProgramCache::Store(const Program& program, uint64_t key, double compileTime)
+    {
+        m_stats.misses++;
+        m_stats.compileTime += compileTime;
+        GLenum format = 0;
+        std::vector<uint8_t> binary;
+        if (!IsSupported() || !program.GetBinary(format, binary))
+            return; // Some drivers have no binary formats; still linked, just not cached.
+        std::string path = get_path(key);
+        std::error_code error;
+        std::filesystem::create_directories(m_directory, error);
+        // Written to a temporary file first, so that a crash can't leave a truncated binary behind.
+        std::string tmpPath = path + ".tmp";
+        FILE* out = fopen(tmpPath.c_str(), "wb");
+        if (!out)
+        {
+            logger::Warning("%s: Could not open %s for writing.\n", __func__, tmpPath.c_str());
+            return;
+        }
+        cache_header header{ s_magic, s_version, key, format, (uint32_t)binary.size(), (float)compileTime, 0 };
+        bool written = fwrite(&header, sizeof(header), 1, out) == 1 &&
+            fwrite(binary.data(), 1, binary.size(), out) == binary.size();
+        written = fclose(out) == 0 && written;
+        if (written)
+            std::filesystem::rename(tmpPath, path, error);
+        if (!written || error)
+        {
+            logger::Warning("%s: Could not write %s.\n", __func__, path.c_str());
+            std::filesystem::remove(tmpPath, error);
+        }
+    }
+    GLint ProgramCache::Build(Program& program, const std::vector<ShaderSource>& sources, const std::vector<std::string>& defines)
+    {
+        uint64_t key = GetKey(sources, defines);
+        if (Load(program, key))
+            return GL_TRUE;
+        auto start = std::chrono::steady_clock::now();
+        if (!compile(program, sources, defines))
+            return GL_FALSE;
+        Store(program, key, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        return GL_TRUE;
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ * game/renderer/program_cache.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <renderer/shader.h>
+
+namespace renderer
+{
+    struct ShaderSource
+    {
+        ShaderType type = ShaderType::None;
+        std::string_view code{};
+    };
+
+    struct ProgramCacheStats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        // In milliseconds.
+        double loadTime = 0;
+        double compileTime = 0;
+        // What the programs that were loaded took to compile when they were stored, minus what they took to load.
+        double savedTime = 0;
+    };
+
+    // Inserts a '#define' line for each of 'defines' (e.g., "MAX_LIGHTS 4") after the #version line of 'code', or at
+    // its start if it has none.
+    std::string InsertDefines(std::string_view code, const std::vector<std::string>& defines);
+
+    // Stores linked program binaries on disk, so that later runs skip compiling and linking.
+    // Binaries are keyed by a hash of their sources, defines, and the driver (vendor, renderer and version strings), and
+    // any binary the driver rejects is rebuilt from source and replaced.
+    // Needs GL 4.1 or ARB_get_program_binary; without either, every program is compiled from source.
+    // Cannot be copied.
+    // Cannot be moved.
+    class ProgramCache final
+    {
+    public:
+        // The directory is created when the first binary is stored.
+        explicit ProgramCache(std::string directory);
+        ProgramCache(const ProgramCache&) = delete;
+        ProgramCache& operator=(const ProgramCache&) = delete;
+        ProgramCache(ProgramCache&&) = delete;
+        ProgramCache& operator=(ProgramCache&&) = delete;
+
+        // Links 'program' from the cached binary, or compiles and links it from 'sources' (with 'defines' inserted
+        // into each) and stores its binary. Compile and link errors are logged.
+        // The program must not have been linked yet.
+        GLint Build(Program& program, const std::vector<ShaderSource>& sources, const std::vector<std::string>& defines = {});
+
+        // The pieces of Build(), for callers that compile programs themselves (e.g., ShaderLibrary).
+        // The key Build() would store the program under.
+        uint64_t GetKey(const std::vector<ShaderSource>& sources, const std::vector<std::string>& defines);
+        // Links 'program' from the binary stored under 'key', and counts a hit if it could.
+        bool Load(Program& program, uint64_t key);
+        // Counts a miss that took 'compileTime' milliseconds to compile and link, and stores the linked program's binary
+        // under 'key'.
+        void Store(const Program& program, uint64_t key, double compileTime);
+
+        const ProgramCacheStats& GetStats() const { return m_stats; }
+        // Whether binaries can be stored at all.
+        bool IsSupported() const;
+    private:
+        GLint compile(Program& program, const std::vector<ShaderSource>& sources, const std::vector<std::string>& defines);
+        std::string get_path(uint64_t key) const;
+        std::string m_directory{};
+        // The driver part of every key; queried on the first GetKey(), once there's a context.
+        std::string m_driver{};
+        ProgramCacheStats m_stats{};
+    };
+}
@@ -0,0 +1,191 @@
+/*
+ * game/renderer/render_queue.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <GL/glew.h>
+
+#include <renderer/render_queue.h>
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+#include <vector>
+
+namespace renderer
+{
+    static constexpr int s_passBits = 2;
+    static constexpr int s_programBits = 10;
+    static constexpr int s_textureBits = 12;
+    static constexpr int s_vaoBits = 12;
+    static constexpr int s_depthBits = 28;
+    static_assert(s_passBits + s_programBits + s_textureBits + s_vaoBits + s_depthBits == 64);
+
+    static uint64_t bits(uint64_t value, int count)
+    {
+        return value & ((1ull << count) - 1);
+    }
+    static uint64_t quantize_depth(float depth)
+    {
+        if (!(depth > 0))
+            depth = 0;
+        // The bit patterns of non-negative floats sort in the same order as their values,
+        // so dropping low mantissa bits quantizes the depth logarithmically, like a depth buffer.
+        uint32_t raw = 0;
+        memcpy(&raw, &depth, sizeof(raw));
+        return raw >> (32 - s_depthBits);
+    }
+    SortKey MakeSortKey(RenderPass pass, GLuint program, GLuint texture, GLuint vao, float depth)
+    {
+        uint64_t state = (bits(program, s_programBits) << (s_textureBits + s_vaoBits)) |
+                         (bits(texture, s_textureBits) << s_vaoBits) |
+                          bits(vao, s_vaoBits);
+        uint64_t depthBits = quantize_depth(depth);
+        SortKey key = bits((uint64_t)pass, s_passBits) << (64 - s_passBits);
+        if (pass == RenderPass::Transparent)
+            key |= (bits(~depthBits, s_depthBits) << (64 - s_passBits - s_depthBits)) | state;
+        else
+            key |= (state << s_depthBits) | depthBits;
+        return key;
+    }
+
+    void RenderQueue::Submit(SortKey key, const DrawCommand& command)
+    {
+        if (!command.program || !command.vao || (!command.mesh && !command.batch))
+            return;
+        auto start = std::chrono::steady_clock::now();
+        push(key, command);
+        m_stats.submitTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    void RenderQueue::Submit(RenderPass pass, float depth, const DrawCommand& command)
+    {
+        if (!command.program || !command.vao || (!command.mesh && !command.batch))
+            return;
+        auto start = std::chrono::steady_clock::now();
+        SortKey key = MakeSortKey(pass,
+            command.program->GetProgramObject(),
+            command.texture ? command.texture->GetTextureObject() : 0,
+            command.vao->GetVertexArrayObject(),
+            depth);
+        push(key, command);
+        m_stats.submitTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    void RenderQueue::push(SortKey key, const DrawCommand& command)
+    {
+        m_entries.push_back({ key, (uint32_t)m_commands.size() });
+        m_commands.push_back(command);
+        m_sorted = false;
+    }
+    void RenderQueue::Sort()
+    {
+        if (m_sorted || m_entries.empty())
+            return;
+        auto start = std::chrono::steady_clock::now();
+        const size_t count = m_entries.size();
+        m_scratch.resize(count);
+        entry* from = m_entries.data();
+        entry* to = m_scratch.data();
+        // Eight passes of eight bits, skipping bytes that are the same in every key.
+        // Each pass is stable, so the order of the previous passes survives.
+        for (int shift = 0; shift < 64; shift += 8)
+        {
+            size_t histogram[256] = {};
+            for (size_t i = 0; i < count; i++)
+                histogram[(from[i].key >> shift) & 0xff]++;
+            if (histogram[(from[0].key >> shift) & 0xff] == count)
+                continue;
+            size_t offset = 0;
+            for (size_t& bucket : histogram)
+            {
+                size_t bucketSize = bucket;
+                bucket = offset;
+                offset += bucketSize;
+            }
+            for (size_t i = 0; i < count; i++)
+                to[histogram[(from[i].key >> shift) & 0xff]++] = from[i];
+            std::swap(from, to);
+        }
+        if (from != m_entries.data())
+            m_entries.swap(m_scratch);
+        m_sorted = true;
+        m_stats.sortTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    void RenderQueue::Execute()
+    {
+        Sort();
+        auto start = std::chrono::steady_clock::now();
+        Program* program = nullptr;
+        Texture* texture = nullptr;
+        uint32_t layer = 0;
+        VAO* vao = nullptr;
+        for (const entry& i : m_entries)
+        {
+            const DrawCommand& command = m_commands[i.command];
+            if (command.program != program)
+            {
+                command.program->Use();
+                program = command.program;
+                m_stats.programChanges++;
+                // Sampler uniforms belong to the program, so the texture has to set them again (the program's
+                // uniform cache skips them if they're already set).
+                texture = nullptr;
+            }
+            if (command.vao != vao)
+            {
+                command.vao->Bind();
+                vao = command.vao;
+                m_stats.vaoChanges++;
+            }
+            if (command.texture && command.texture != texture)
+            {
+                command.texture->Render(*program);
+                texture = command.texture;
+                m_stats.textureChanges++;
+                if (texture->GetLayerCount())
+                {
+                    texture->SetLayer(*program, command.textureLayer);
+                    layer = command.textureLayer;
+                }
+            }
+            else if (command.texture && texture->GetLayerCount() && command.textureLayer != layer)
+            {
+                texture->SetLayer(*program, command.textureLayer);
+                layer = command.textureLayer;
+                m_stats.layerChanges++;
+            }
+            if (command.batch)
+            {
+                command.batch->Render(command.instanceBuffer, command.instanceOffset, command.commandBuffer, command.commandOffset,
+                    command.firstCommand, command.nCommands);
+                m_stats.nDrawCalls += command.batch->GetDrawCallCount();
+                continue;
+            }
+            m_stats.nDrawCalls++;
+            if (command.nInstances)
+                command.mesh->SetInstances(command.instanceBuffer, command.instanceOffset, command.nInstances);
+            if (command.nIndices)
+            {
+                command.mesh->RenderRange(command.firstIndex, command.nIndices, command.baseVertex);
+                continue;
+            }
+            command.mesh->SetLod(command.lod);
+            command.mesh->Render();
+        }
+        m_stats.nDraws = m_entries.size();
+        m_stats.executeTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        m_lastStats = m_stats;
+        Clear();
+    }
+    void RenderQueue::Clear()
+    {
+        m_commands.clear();
+        m_entries.clear();
+        m_stats = RenderQueueStats{};
+        m_sorted = true;
+    }
+}
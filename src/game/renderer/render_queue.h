@@ -0,0 +1,129 @@
+/*
+ * game/renderer/render_queue.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include <renderer/shader.h>
+#include <renderer/vao.h>
+#include <renderer/mesh.h>
+#include <renderer/static_batch.h>
+#include <renderer/texture.h>
+
+namespace renderer
+{
+    // Passes execute in this order.
+    enum class RenderPass : uint8_t
+    {
+        Opaque,
+        Transparent,
+        Overlay,
+    };
+
+    // Key layout, from the most significant bit:
+    //   opaque/overlay: pass (2) | program (10) | texture (12) | vao (12) | depth (28)
+    //   transparent:    pass (2) | inverted depth (28) | program (10) | texture (12) | vao (12)
+    // Opaque draws are grouped by state and then go front to back, so that early depth testing rejects as much as possible.
+    // Transparent draws must blend back to front, so depth comes before state.
+    // Object names are truncated to fit, so draws with different state can rarely share a key; that only costs a state change.
+    using SortKey = uint64_t;
+    // 'depth' is the view-space distance to the camera; negative distances are clamped to zero.
+    SortKey MakeSortKey(RenderPass pass, GLuint program, GLuint texture, GLuint vao, float depth);
+
+    struct DrawCommand
+    {
+        Program* program = nullptr;
+        // Can be nullptr.
+        Texture* texture = nullptr;
+        // The layer to sample, if 'texture' is layered (see TexturePacker). Draws that only differ by layer share a key,
+        // and don't rebind the texture.
+        uint32_t textureLayer = 0;
+        VAO* vao = nullptr;
+        // Either 'mesh' or 'batch' must be set.
+        Mesh* mesh = nullptr;
+        // If set, every command recorded in the batch is drawn, reading them from 'commandBuffer' at 'commandOffset'
+        // (see StaticBatch::Render), and the mesh fields below are ignored.
+        StaticBatch* batch = nullptr;
+        GLuint commandBuffer = 0;
+        GLintptr commandOffset = 0;
+        // If 'nCommands' isn't zero, only that range of the batch's commands is drawn (e.g., one material's).
+        size_t firstCommand = 0;
+        size_t nCommands = 0;
+        // The mesh's level of detail (see Mesh::GetLods).
+        uint32_t lod = 0;
+        // If 'nIndices' isn't zero, only that range of the mesh is drawn, instead of its level of detail (e.g., one of a
+        // Model's submeshes).
+        size_t firstIndex = 0;
+        size_t nIndices = 0;
+        GLint baseVertex = 0;
+        // If 'nInstances' isn't zero, the mesh is drawn instanced, with models read from 'instanceBuffer' at 'instanceOffset'.
+        GLuint instanceBuffer = 0;
+        GLintptr instanceOffset = 0;
+        size_t nInstances = 0;
+    };
+
+    struct RenderQueueStats
+    {
+        size_t nDraws = 0;
+        // GL draw calls; a batch draws all its commands in one call where it can.
+        size_t nDrawCalls = 0;
+        size_t programChanges = 0;
+        size_t textureChanges = 0;
+        size_t layerChanges = 0;
+        size_t vaoChanges = 0;
+        // In milliseconds.
+        double submitTime = 0;
+        double sortTime = 0;
+        double executeTime = 0;
+    };
+
+    // Collects a frame's draws, then sorts them by key and issues them in one go.
+    class RenderQueue final
+    {
+    public:
+        RenderQueue() = default;
+        // Cannot be copied.
+        RenderQueue(const RenderQueue&) = delete;
+        RenderQueue& operator=(const RenderQueue&) = delete;
+        // Cannot be moved.
+        RenderQueue(RenderQueue&&) = delete;
+        RenderQueue& operator=(RenderQueue&&) = delete;
+
+        void Submit(SortKey key, const DrawCommand& command);
+        // Makes the key from the command's state.
+        void Submit(RenderPass pass, float depth, const DrawCommand& command);
+        // Sorts the queued draws with an LSD radix sort.
+        void Sort();
+        // Issues every queued draw in order, then empties the queue.
+        void Execute();
+        void Clear();
+
+        size_t GetDrawCount() const { return m_commands.size(); }
+        // The stats of the last executed frame.
+        const RenderQueueStats& GetStats() const { return m_lastStats; }
+
+    private:
+        void push(SortKey key, const DrawCommand& command);
+
+        struct entry
+        {
+            SortKey key;
+            uint32_t command;
+        };
+        std::vector<DrawCommand> m_commands;
+        std::vector<entry> m_entries;
+        std::vector<entry> m_scratch;
+        RenderQueueStats m_stats{};
+        RenderQueueStats m_lastStats{};
+        bool m_sorted = true;
+    };
+}
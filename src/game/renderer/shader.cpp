@@ -47,6 +47,12 @@ namespace renderer
         return this->CompileShader(code.data(), code.size());
     }
     GLint Shader::CompileShader(const char* code, size_t size)
+    {
+        if (!BeginCompile(code, size))
+            return GL_FALSE;
+        return FinishCompile();
+    }
+    GLint Shader::BeginCompile(const char* code, size_t size)
     {
         if (!m_initialized)
             throw std::runtime_error{ "Shader is uninitialized before compile! This is a bug, please report it.\n"};
@@ -57,6 +63,25 @@ namespace renderer
         GLint sz = size;
         glShaderSource(m_shaderId, 1, &code, &sz);
         glCompileShader(m_shaderId);
+        // Anything that queries the shader now waits for the compile, so the status is left for FinishCompile().
+        m_compiling = true;
+        return GL_TRUE;
+    }
+    bool Shader::IsCompileDone() const
+    {
+        if (!m_compiling)
+            return true;
+        if (!GLEW_KHR_parallel_shader_compile && !GLEW_ARB_parallel_shader_compile)
+            return true;
+        GLint done = GL_TRUE;
+        glGetShaderiv(m_shaderId, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
+    }
+    GLint Shader::FinishCompile()
+    {
+        if (!m_compiling)
+            return m_compileSuccess ? GL_TRUE : GL_FALSE;
+        m_compiling = false;
         // Get the compile status.
         GLint status = GL_TRUE;
         glGetShaderiv(m_shaderId, GL_COMPILE_STATUS, &status);
@@ -71,6 +96,7 @@ namespace renderer
         if (status == GL_FALSE)
         {
             m_compileSuccess = false;
+            m_lock.unlock();
             return GL_FALSE;
         }
         m_compileSuccess = true;
@@ -85,7 +111,8 @@ namespace renderer
             return GL_FALSE;
         if (program.m_linkSuccess)
             return GL_FALSE;
-        if (!m_compileSuccess || m_program)
+        // Shaders that are still compiling can be attached; the link waits for them.
+        if ((!m_compileSuccess && !m_compiling) || m_program)
             return GL_FALSE;
         program.m_lock.lock();
         glAttachShader(program.m_programId, m_shaderId);
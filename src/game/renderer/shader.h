@@ -7,13 +7,19 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <GL/glew.h>
 
+#include <array>
 #include <string_view>
 #include <string>
 #include <mutex>
 #include <list>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
 
 namespace renderer
 {
@@ -23,6 +29,63 @@ namespace renderer
         MaxValue = Geometry
     };
 
+    // FNV-1a, so that it can run at compile time.
+    constexpr uint32_t HashName(std::string_view name)
+    {
+        uint32_t hash = 0x811c9dc5;
+        for (char c : name)
+        {
+            hash ^= (uint8_t)c;
+            hash *= 0x01000193;
+        }
+        return hash;
+    }
+    // The name of a uniform, uniform block or attribute, and its hash.
+    // Names made from string literals are hashed at compile time; other strings must go through FromString().
+    struct ProgramName
+    {
+        template<size_t N>
+        consteval ProgramName(const char (&str)[N])
+            : hash{ HashName({ str, N - 1 }) }, name{ str, N - 1 }
+        {}
+        static ProgramName FromString(std::string_view str) { return ProgramName{ HashName(str), str }; }
+
+        uint32_t hash;
+        std::string_view name;
+    private:
+        constexpr ProgramName(uint32_t hash, std::string_view name) : hash{ hash }, name{ name } {}
+    };
+
+    // What a program was linked with, reflected once after linking.
+    struct UniformInfo
+    {
+        std::string name{};
+        // -1 for uniforms in a block.
+        GLint location = -1;
+        GLenum type = 0;
+        // Array length, or 1.
+        GLint size = 0;
+    };
+    struct UniformBlockInfo
+    {
+        std::string name{};
+        GLuint index = 0;
+        GLint dataSize = 0;
+    };
+    struct AttributeInfo
+    {
+        std::string name{};
+        GLint location = -1;
+        GLenum type = 0;
+        GLint size = 0;
+    };
+    struct UniformStats
+    {
+        size_t uploads = 0;
+        // Setter calls that were skipped because the value didn't change.
+        size_t skipped = 0;
+    };
+
     // Cannot be copied.
     // Cannot be moved.
     class Program final
@@ -34,12 +97,51 @@ namespace renderer
         Program(Program&&) = delete;
         Program& operator=(Program&&) = delete;
 
-        GLint Link();
+        // 'retrievable' hints to the driver that GetBinary() will be called.
+        GLint Link(bool retrievable = false);
+        // Starts linking without waiting for the result, like Shader::BeginCompile().
+        GLint BeginLink(bool retrievable = false);
+        // Whether FinishLink() would return without waiting; always true without KHR_parallel_shader_compile.
+        bool IsLinkDone() const;
+        // Waits for the link started by BeginLink(), and returns its status.
+        GLint FinishLink();
+        // Links the program from a binary returned by GetBinary(), instead of from its shaders.
+        // The driver may reject binaries it didn't make (e.g., after an update); the program can then still be linked
+        // from shaders.
+        GLint LinkBinary(GLenum format, const void* binary, size_t size);
+        // Needs GL 4.1 or ARB_get_program_binary, and a linked program.
+        bool GetBinary(GLenum& format, std::vector<uint8_t>& binary) const;
         GLint Use();
 
-        GLuint GetUniformLocation(const char* uniformName);
+        // From the reflected uniforms; -1 if the program has no such uniform.
+        GLuint GetUniformLocation(ProgramName uniformName);
+        // Assigns the uniform block 'blockName' to the buffer binding point 'binding' (see glBindBufferRange).
+        GLint BindUniformBlock(ProgramName blockName, GLuint binding);
+
+        // nullptr if the program has no such uniform, block, or attribute.
+        // Arrays can be found by their name with or without "[0]".
+        const UniformInfo* FindUniform(ProgramName name) const;
+        const UniformBlockInfo* FindUniformBlock(ProgramName name) const;
+        const AttributeInfo* FindAttribute(ProgramName name) const;
+        const std::vector<UniformInfo>& GetUniforms() const { return m_uniforms; }
+        const std::vector<UniformBlockInfo>& GetUniformBlocks() const { return m_uniformBlocks; }
+        const std::vector<AttributeInfo>& GetAttributes() const { return m_attributes; }
+
+        // Typed uniform setters. They skip the upload if the uniform already has the value (which still returns
+        // GL_TRUE), and otherwise make the program current to upload it. Setting a uniform the program doesn't have, or
+        // with the wrong type, returns GL_FALSE.
+        // Integers also set bools and samplers.
+        GLint SetUniform(ProgramName name, GLint value);
+        GLint SetUniform(ProgramName name, GLfloat value);
+        GLint SetUniform(ProgramName name, const glm::vec2& value);
+        GLint SetUniform(ProgramName name, const glm::vec3& value);
+        GLint SetUniform(ProgramName name, const glm::vec4& value);
+        GLint SetUniform(ProgramName name, const glm::mat4& value);
+        const UniformStats& GetUniformStats() const { return m_uniformStats; }
+        void ResetUniformStats() { m_uniformStats = UniformStats{}; }
 
         std::string GetLinkMessages() const;
+        GLuint GetProgramObject() const { return m_programId; }
 
         ~Program();
         friend class Shader;
@@ -50,6 +152,36 @@ namespace renderer
         std::list<class Shader*> m_attached{};
         std::string m_linkMessages{};
         bool m_linkSuccess = false;
+        bool m_linking = false;
+
+        void reflect();
+        enum class uniform_update
+        {
+            // No such uniform, or not of that type.
+            Rejected,
+            // The uniform already has the value.
+            Unchanged,
+            // 'location' is set, and the program is current.
+            Upload,
+        };
+        uniform_update update_uniform(ProgramName name, bool (*isType)(GLenum), const void* value, size_t size, GLint& location);
+        std::vector<UniformInfo> m_uniforms{};
+        std::vector<UniformBlockInfo> m_uniformBlocks{};
+        std::vector<AttributeInfo> m_attributes{};
+        // Name hash to index.
+        std::unordered_map<uint32_t, uint32_t> m_uniformLookup{};
+        std::unordered_map<uint32_t, uint32_t> m_uniformBlockLookup{};
+        std::unordered_map<uint32_t, uint32_t> m_attributeLookup{};
+        // The last value set to each uniform (by index), large enough for a mat4.
+        struct uniform_value
+        {
+            std::array<uint8_t, sizeof(glm::mat4)> data{};
+            bool known = false;
+        };
+        std::vector<uniform_value> m_uniformValues{};
+        // The binding point of each block (by index), or -1 if not set through BindUniformBlock().
+        std::vector<GLint> m_uniformBlockBindings{};
+        UniformStats m_uniformStats{};
     };
     // Cannot be copied.
     // Cannot be moved.
@@ -65,6 +197,13 @@ namespace renderer
         
         GLint CompileShader(const std::string_view& code);
         GLint CompileShader(const char* code, size_t size);
+        // Starts compiling without waiting for the result, so that the driver can compile in the background (see
+        // KHR_parallel_shader_compile). The shader can be attached to a program straight away.
+        GLint BeginCompile(const char* code, size_t size);
+        // Whether FinishCompile() would return without waiting; always true without KHR_parallel_shader_compile.
+        bool IsCompileDone() const;
+        // Waits for the compile started by BeginCompile(), and returns its status.
+        GLint FinishCompile();
 
         GLint BindShader(Program& program);
 
@@ -79,6 +218,7 @@ namespace renderer
         std::mutex m_lock{};
         std::string m_compileMessages{};
         bool m_compileSuccess = false;
+        bool m_compiling = false;
         Program* m_program = nullptr;
     };
 }
\ No newline at end of file
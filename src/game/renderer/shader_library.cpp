@@ -0,0 +1,247 @@
+/*
+ * game/renderer/shader_library.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <algorithm>
+#include <filesystem>
+#include <string_view>
+#include <utility>
+
+#include <renderer/shader_library.h>
+
+#include <file.h>
+#include <logger.h>
+
+namespace renderer
+{
+    // If 'line' is an #include directive, returns the included path.
+    static bool parse_include(std::string_view line, std::string_view& path)
+    {
+        size_t i = line.find_first_not_of(" \t");
+        if (i == std::string_view::npos || line[i] != '#')
+            return false;
+        i = line.find_first_not_of(" \t", i + 1);
+        if (i == std::string_view::npos || line.compare(i, 7, "include") != 0)
+            return false;
+        size_t begin = line.find('"', i + 7);
+        size_t end = begin == std::string_view::npos ? begin : line.find('"', begin + 1);
+        if (end == std::string_view::npos)
+            return false;
+        path = line.substr(begin + 1, end - begin - 1);
+        return true;
+    }
+    static bool is_version(std::string_view line)
+    {
+        size_t i = line.find_first_not_of(" \t");
+        return i != std::string_view::npos && line.compare(i, 8, "#version") == 0;
+    }
+    static bool preprocess(const std::filesystem::path& path, std::string& out, std::vector<std::string>& files)
+    {
+        std::string name = path.lexically_normal().generic_string();
+        if (std::find(files.begin(), files.end(), name) != files.end())
+            return true; // Already included.
+        std::string code;
+        if (!utility::LoadFile(name.c_str(), code))
+        {
+            logger::Error("PreprocessShader: Could not find file %s.\n", name.c_str());
+            return false;
+        }
+        size_t index = files.size();
+        files.push_back(name);
+        if (index)
+            out += "#line 1 " + std::to_string(index) + "\n";
+        std::string_view view = code;
+        size_t lineNumber = 1;
+        for (size_t start = 0; start < view.size(); lineNumber++)
+        {
+            size_t end = view.find('\n', start);
+            if (end == std::string_view::npos)
+                end = view.size();
+            std::string_view line = view.substr(start, end - start);
+            start = end + 1;
+            std::string_view include;
+            if (parse_include(line, include))
+            {
+                if (!preprocess(path.parent_path() / include, out, files))
+                {
+                    logger::Error("PreprocessShader: Included from %s:%zu.\n", name.c_str(), lineNumber);
+                    return false;
+                }
+                out += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(index) + "\n";
+                continue;
+            }
+            out += line;
+            out += '\n';
+            // Only the first file can have #version, which has to stay first.
+            if (index == 0 && is_version(line))
+                out += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(index) + "\n";
+        }
+        return true;
+    }
+    bool PreprocessShader(const char* path, std::string& out, std::vector<std::string>& files)
+    {
+        out.clear();
+        files.clear();
+        return preprocess(path, out, files);
+    }
+
+    ShaderLibrary::ShaderLibrary(ProgramCache& cache)
+        : m_cache{ cache }
+    {}
+    uint32_t ShaderLibrary::Add(const std::string& vertexPath, const std::string& fragmentPath, std::vector<std::string> defines)
+    {
+        variant var{};
+        var.vertexPath = vertexPath;
+        var.fragmentPath = fragmentPath;
+        var.defines = std::move(defines);
+        m_variants.push_back(std::move(var));
+        m_stats.nVariants++;
+        return m_variants.size() - 1;
+    }
+    uint32_t ShaderLibrary::AddPermutations(const std::string& vertexPath, const std::string& fragmentPath, const std::vector<std::string>& features)
+    {
+        uint32_t first = m_variants.size();
+        for (uint32_t mask = 0; mask < (1u << features.size()); mask++)
+        {
+            std::vector<std::string> defines;
+            for (size_t i = 0; i < features.size(); i++)
+                if (mask & (1u << i))
+                    defines.push_back(features[i]);
+            Add(vertexPath, fragmentPath, std::move(defines));
+        }
+        return first;
+    }
+    const ShaderLibrary::source_file* ShaderLibrary::load_source(const std::string& path)
+    {
+        auto it = m_sources.find(path);
+        if (it != m_sources.end())
+            return &it->second;
+        source_file file{};
+        if (!PreprocessShader(path.c_str(), file.code, file.files))
+            return nullptr;
+        return &m_sources.emplace(path, std::move(file)).first->second;
+    }
+    bool ShaderLibrary::Compile()
+    {
+        static bool s_setThreads = false;
+        if (!s_setThreads)
+        {
+            // Let the driver decide how many threads to compile on.
+            if (GLEW_KHR_parallel_shader_compile)
+                glMaxShaderCompilerThreadsKHR(0xffffffff);
+            else if (GLEW_ARB_parallel_shader_compile)
+                glMaxShaderCompilerThreadsARB(0xffffffff);
+            s_setThreads = true;
+        }
+        if (!m_nPending)
+            m_compileStart = std::chrono::steady_clock::now();
+        bool loaded = true;
+        for (variant& var : m_variants)
+        {
+            if (var.status != variant_status::Queued)
+                continue;
+            const source_file* vertex = load_source(var.vertexPath);
+            const source_file* fragment = load_source(var.fragmentPath);
+            if (!vertex || !fragment)
+            {
+                var.status = variant_status::Failed;
+                m_stats.nFailed++;
+                loaded = false;
+                continue;
+            }
+            std::vector<ShaderSource> sources = {
+                { ShaderType::Vertex, vertex->code },
+                { ShaderType::Fragment, fragment->code },
+            };
+            var.program = std::make_unique<Program>();
+            var.key = m_cache.GetKey(sources, var.defines);
+            if (m_cache.Load(*var.program, var.key))
+            {
+                var.status = variant_status::Ready;
+                m_stats.nCached++;
+                continue;
+            }
+            // Nothing here queries the shaders or the program, so none of it waits for the driver.
+            var.start = std::chrono::steady_clock::now();
+            for (const ShaderSource& source : sources)
+            {
+                std::string code = InsertDefines(source.code, var.defines);
+                var.shaders.push_back(std::make_unique<Shader>(source.type));
+                var.shaders.back()->BeginCompile(code.data(), code.size());
+                var.shaders.back()->BindShader(*var.program);
+            }
+            var.program->BeginLink(m_cache.IsSupported());
+            var.status = variant_status::Compiling;
+            m_nPending++;
+        }
+        if (!m_nPending)
+        {
+            m_stats.compileTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_compileStart).count();
+            m_sources.clear();
+        }
+        return loaded;
+    }
+    void ShaderLibrary::finish_variant(variant& var)
+    {
+        // Every shader's compile has to be finished, whether or not the link worked, since that's what releases it.
+        std::vector<bool> compiled(var.shaders.size());
+        bool allCompiled = true;
+        for (size_t i = 0; i < var.shaders.size(); i++)
+        {
+            compiled[i] = var.shaders[i]->FinishCompile() == GL_TRUE;
+            allCompiled = allCompiled && compiled[i];
+        }
+        if (var.program->FinishLink() && allCompiled)
+        {
+            m_cache.Store(*var.program, var.key, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - var.start).count());
+            var.status = variant_status::Ready;
+            m_stats.nCompiled++;
+        }
+        else
+        {
+            std::string defines;
+            for (const std::string& define : var.defines)
+                defines += " " + define;
+            logger::Error("%s: Could not build %s and %s (defines:%s).\n", __func__,
+                var.vertexPath.c_str(), var.fragmentPath.c_str(), defines.empty() ? " none" : defines.c_str());
+            for (size_t i = 0; i < var.shaders.size(); i++)
+            {
+                if (compiled[i])
+                    continue;
+                const std::string& path = i == 0 ? var.vertexPath : var.fragmentPath;
+                const source_file* source = load_source(path);
+                std::string files;
+                for (size_t j = 0; source && j < source->files.size(); j++)
+                    files += "  " + std::to_string(j) + ": " + source->files[j] + "\n";
+                logger::Error("%s failed compile!\n%s\nWith files:\n%s", path.c_str(), var.shaders[i]->GetCompileMessages().data(), files.c_str());
+            }
+            logger::Error("Link messages:\n%s\n", var.program->GetLinkMessages().data());
+            var.status = variant_status::Failed;
+            m_stats.nFailed++;
+        }
+        var.shaders.clear();
+        m_nPending--;
+        if (!m_nPending)
+        {
+            m_stats.compileTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_compileStart).count();
+            m_sources.clear();
+        }
+    }
+    size_t ShaderLibrary::Poll()
+    {
+        if (!m_nPending)
+            return 0;
+        for (variant& var : m_variants)
+            if (var.status == variant_status::Compiling && var.program->IsLinkDone())
+                finish_variant(var);
+        return m_nPending;
+    }
+    void ShaderLibrary::Finish()
+    {
+        for (variant& var : m_variants)
+            if (var.status == variant_status::Compiling)
+                finish_variant(var);
+    }
+}
@@ -0,0 +1,115 @@
+/*
+ * game/renderer/shader_library.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <renderer/shader.h>
+#include <renderer/program_cache.h>
+
+namespace renderer
+{
+    // Reads a shader file, replacing every '#include "file"' line (relative to the including file) with that file's
+    // contents. Each file is only included once.
+    // #line directives keep compile errors pointing at the right line, with each file numbered by its index in 'files'.
+    bool PreprocessShader(const char* path, std::string& out, std::vector<std::string>& files);
+
+    struct ShaderLibraryStats
+    {
+        size_t nVariants = 0;
+        // Loaded from the program cache.
+        size_t nCached = 0;
+        size_t nCompiled = 0;
+        size_t nFailed = 0;
+        // From Compile() until the last variant was ready, in milliseconds.
+        double compileTime = 0;
+    };
+
+    // Programs built from shader files, in variants that differ by their defines (e.g., INSTANCED, ALPHA_TEST).
+    // Every variant is compiled up front, by Compile(), which returns as soon as every compile has been issued.
+    // With KHR_parallel_shader_compile, the driver compiles them concurrently in the background, and Poll() picks up
+    // the finished ones without waiting; without it, Poll() waits for them.
+    // Variants are loaded from the program cache when possible, and stored to it once linked.
+    // Cannot be copied.
+    // Cannot be moved.
+    class ShaderLibrary final
+    {
+    public:
+        explicit ShaderLibrary(ProgramCache& cache);
+        ShaderLibrary(const ShaderLibrary&) = delete;
+        ShaderLibrary& operator=(const ShaderLibrary&) = delete;
+        ShaderLibrary(ShaderLibrary&&) = delete;
+        ShaderLibrary& operator=(ShaderLibrary&&) = delete;
+
+        // Returns the variant's index.
+        uint32_t Add(const std::string& vertexPath, const std::string& fragmentPath, std::vector<std::string> defines = {});
+        // Adds a variant for every combination of 'features', each either defined or not.
+        // Returns the first variant's index; the variant with the features in 'mask' (bit i for features[i]) is at
+        // the first index plus 'mask'.
+        uint32_t AddPermutations(const std::string& vertexPath, const std::string& fragmentPath, const std::vector<std::string>& features);
+
+        // Starts compiling every variant added since the last call.
+        // Returns false if any variant's files couldn't be read; the others are still compiled.
+        bool Compile();
+        // Finishes the variants that are done compiling. Returns the amount still compiling.
+        size_t Poll();
+        // Waits for every variant.
+        void Finish();
+
+        bool IsReady(uint32_t variant) const { return m_variants[variant].status == variant_status::Ready; }
+        bool Failed(uint32_t variant) const { return m_variants[variant].status == variant_status::Failed; }
+        // nullptr until the variant is ready.
+        Program* GetProgram(uint32_t variant) { return IsReady(variant) ? m_variants[variant].program.get() : nullptr; }
+        size_t GetPendingCount() const { return m_nPending; }
+
+        const ShaderLibraryStats& GetStats() const { return m_stats; }
+    private:
+        enum class variant_status
+        {
+            Queued,
+            Compiling,
+            Ready,
+            Failed,
+        };
+        struct variant
+        {
+            std::string vertexPath{};
+            std::string fragmentPath{};
+            std::vector<std::string> defines{};
+            variant_status status = variant_status::Queued;
+            std::unique_ptr<Program> program{};
+            // Only kept while compiling.
+            std::vector<std::unique_ptr<Shader>> shaders{};
+            uint64_t key = 0;
+            std::chrono::steady_clock::time_point start{};
+        };
+        struct source_file
+        {
+            std::string code{};
+            std::vector<std::string> files{};
+        };
+        const source_file* load_source(const std::string& path);
+        void finish_variant(variant& var);
+
+        ProgramCache& m_cache;
+        std::vector<variant> m_variants{};
+        // Preprocessed files, shared by the variants; freed once everything is compiled.
+        std::map<std::string, source_file> m_sources{};
+        size_t m_nPending = 0;
+        std::chrono::steady_clock::time_point m_compileStart{};
+        ShaderLibraryStats m_stats{};
+    };
+}
@@ -0,0 +1,363 @@
+/*
+ * game/renderer/state_cache.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#include <renderer/state_cache.h>
+
+#include <unordered_map>
+
+namespace renderer::state
+{
+    // Names are never zero, so use an impossible one to mean "unknown".
+    static constexpr GLuint s_unknown = (GLuint)-1;
+    static constexpr size_t s_nTextureUnits = 32;
+    static constexpr size_t s_nIndexedBindings = 16;
+    // Attribute arrays past this are not shadowed.
+    static constexpr GLuint s_nAttributes = 32;
+
+    enum
+    {
+        Texture2D, Texture2DArray, TextureCubeMap,
+        TextureTargetCount,
+    };
+    enum
+    {
+        ArrayBuffer, UniformBuffer, CopyReadBuffer, CopyWriteBuffer, DrawIndirectBuffer, PixelUnpackBuffer,
+        BufferTargetCount,
+    };
+    enum
+    {
+        IndexedUniformBuffer,
+        IndexedTargetCount,
+    };
+
+    struct vertex_array_state
+    {
+        GLuint elementBuffer = s_unknown;
+        uint32_t enabledAttributes = 0;
+        // Attributes whose enabled state is known.
+        uint32_t knownAttributes = 0;
+    };
+    struct buffer_range
+    {
+        GLuint buffer = s_unknown;
+        GLintptr offset = 0;
+        GLsizeiptr size = 0;
+    };
+    static struct
+    {
+        GLuint program = s_unknown;
+        GLuint vao = s_unknown;
+        GLuint framebuffer = s_unknown;
+        GLuint activeTexture = s_unknown;
+        GLuint textures[s_nTextureUnits][TextureTargetCount];
+        GLuint buffers[BufferTargetCount];
+        buffer_range indexedBuffers[IndexedTargetCount][s_nIndexedBindings];
+        std::unordered_map<GLuint, vertex_array_state> vertexArrays;
+        bool initialized = false;
+    } s_state;
+    static Stats s_stats;
+
+    static void reset()
+    {
+        s_state.program = s_unknown;
+        s_state.vao = s_unknown;
+        s_state.framebuffer = s_unknown;
+        s_state.activeTexture = s_unknown;
+        for (auto& unit : s_state.textures)
+            for (GLuint& texture : unit)
+                texture = s_unknown;
+        for (GLuint& buffer : s_state.buffers)
+            buffer = s_unknown;
+        for (auto& target : s_state.indexedBuffers)
+            for (buffer_range& range : target)
+                range = buffer_range{};
+        s_state.vertexArrays.clear();
+        s_state.initialized = true;
+    }
+    static void init()
+    {
+        if (!s_state.initialized)
+            reset();
+    }
+    // Returns true if the call should be issued, and updates 'shadow' to 'value'.
+    template<typename T>
+    static bool update(T& shadow, const T& value)
+    {
+        if (shadow == value)
+        {
+            s_stats.skipped++;
+            return false;
+        }
+        shadow = value;
+        s_stats.issued++;
+        return true;
+    }
+    static int texture_target_index(GLenum target)
+    {
+        switch (target)
+        {
+            case GL_TEXTURE_2D: return Texture2D;
+            case GL_TEXTURE_2D_ARRAY: return Texture2DArray;
+            case GL_TEXTURE_CUBE_MAP: return TextureCubeMap;
+            default: return -1;
+        }
+    }
+    static int buffer_target_index(GLenum target)
+    {
+        switch (target)
+        {
+            case GL_ARRAY_BUFFER: return ArrayBuffer;
+            case GL_UNIFORM_BUFFER: return UniformBuffer;
+            case GL_COPY_READ_BUFFER: return CopyReadBuffer;
+            case GL_COPY_WRITE_BUFFER: return CopyWriteBuffer;
+            case GL_DRAW_INDIRECT_BUFFER: return DrawIndirectBuffer;
+            case GL_PIXEL_UNPACK_BUFFER: return PixelUnpackBuffer;
+            default: return -1;
+        }
+    }
+    static int indexed_target_index(GLenum target)
+    {
+        switch (target)
+        {
+            case GL_UNIFORM_BUFFER: return IndexedUniformBuffer;
+            default: return -1;
+        }
+    }
+    // The state of the bound vertex array, or nullptr if which one is bound is unknown.
+    static vertex_array_state* current_vertex_array()
+    {
+        if (s_state.vao == s_unknown)
+            return nullptr;
+        return &s_state.vertexArrays[s_state.vao];
+    }
+
+    void UseProgram(GLuint program)
+    {
+        init();
+        if (update(s_state.program, program))
+            glUseProgram(program);
+    }
+    void BindVertexArray(GLuint vao)
+    {
+        init();
+        if (update(s_state.vao, vao))
+            glBindVertexArray(vao);
+    }
+    void BindBuffer(GLenum target, GLuint buffer)
+    {
+        init();
+        if (target == GL_ELEMENT_ARRAY_BUFFER)
+        {
+            vertex_array_state* vao = current_vertex_array();
+            if (vao && !update(vao->elementBuffer, buffer))
+                return;
+            if (!vao)
+                s_stats.issued++;
+            glBindBuffer(target, buffer);
+            return;
+        }
+        int index = buffer_target_index(target);
+        if (index < 0)
+        {
+            s_stats.issued++;
+            glBindBuffer(target, buffer);
+            return;
+        }
+        if (update(s_state.buffers[index], buffer))
+            glBindBuffer(target, buffer);
+    }
+    void BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+    {
+        init();
+        int targetIndex = indexed_target_index(target);
+        int genericIndex = buffer_target_index(target);
+        if (targetIndex < 0 || index >= s_nIndexedBindings)
+        {
+            s_stats.issued++;
+            glBindBufferRange(target, index, buffer, offset, size);
+            if (genericIndex >= 0)
+                s_state.buffers[genericIndex] = buffer;
+            return;
+        }
+        buffer_range& range = s_state.indexedBuffers[targetIndex][index];
+        if (range.buffer == buffer && range.offset == offset && range.size == size)
+        {
+            s_stats.skipped++;
+            return;
+        }
+        range = { buffer, offset, size };
+        s_stats.issued++;
+        glBindBufferRange(target, index, buffer, offset, size);
+        if (genericIndex >= 0)
+            s_state.buffers[genericIndex] = buffer;
+    }
+    void ActiveTexture(GLuint unit)
+    {
+        init();
+        if (update(s_state.activeTexture, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+    }
+    void BindTexture(GLenum target, GLuint texture)
+    {
+        init();
+        int index = texture_target_index(target);
+        if (index < 0 || s_state.activeTexture >= s_nTextureUnits)
+        {
+            s_stats.issued++;
+            glBindTexture(target, texture);
+            return;
+        }
+        if (update(s_state.textures[s_state.activeTexture][index], texture))
+            glBindTexture(target, texture);
+    }
+    void BindTexture(GLuint unit, GLenum target, GLuint texture)
+    {
+        init();
+        int index = texture_target_index(target);
+        // Don't switch units just to find out the texture is already bound.
+        if (index >= 0 && unit < s_nTextureUnits && s_state.textures[unit][index] == texture)
+        {
+            s_stats.skipped++;
+            return;
+        }
+        ActiveTexture(unit);
+        BindTexture(target, texture);
+    }
+    void BindFramebuffer(GLuint framebuffer)
+    {
+        init();
+        if (update(s_state.framebuffer, framebuffer))
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    }
+    void EnableVertexAttribArray(GLuint index)
+    {
+        init();
+        vertex_array_state* vao = current_vertex_array();
+        if (vao && index < s_nAttributes)
+        {
+            uint32_t bit = 1u << index;
+            if ((vao->knownAttributes & bit) && (vao->enabledAttributes & bit))
+            {
+                s_stats.skipped++;
+                return;
+            }
+            vao->knownAttributes |= bit;
+            vao->enabledAttributes |= bit;
+        }
+        s_stats.issued++;
+        glEnableVertexAttribArray(index);
+    }
+    void DisableVertexAttribArray(GLuint index)
+    {
+        init();
+        vertex_array_state* vao = current_vertex_array();
+        if (vao && index < s_nAttributes)
+        {
+            uint32_t bit = 1u << index;
+            if ((vao->knownAttributes & bit) && !(vao->enabledAttributes & bit))
+            {
+                s_stats.skipped++;
+                return;
+            }
+            vao->knownAttributes |= bit;
+            vao->enabledAttributes &= ~bit;
+        }
+        s_stats.issued++;
+        glDisableVertexAttribArray(index);
+    }
+
+    GLuint GetProgram()
+    {
+        init();
+        return s_state.program == s_unknown ? 0 : s_state.program;
+    }
+    GLuint GetVertexArray()
+    {
+        init();
+        return s_state.vao == s_unknown ? 0 : s_state.vao;
+    }
+    GLuint GetBuffer(GLenum target)
+    {
+        init();
+        GLuint buffer = s_unknown;
+        if (target == GL_ELEMENT_ARRAY_BUFFER)
+        {
+            vertex_array_state* vao = current_vertex_array();
+            if (vao)
+                buffer = vao->elementBuffer;
+        }
+        else if (int index = buffer_target_index(target); index >= 0)
+            buffer = s_state.buffers[index];
+        return buffer == s_unknown ? 0 : buffer;
+    }
+    GLuint GetFramebuffer()
+    {
+        init();
+        return s_state.framebuffer == s_unknown ? 0 : s_state.framebuffer;
+    }
+
+    // Deleting a bound object unbinds it, so the shadow copy has to follow.
+    void ForgetProgram(GLuint program)
+    {
+        init();
+        if (s_state.program == program)
+            s_state.program = s_unknown;
+    }
+    void ForgetVertexArray(GLuint vao)
+    {
+        init();
+        if (s_state.vao == vao)
+            s_state.vao = s_unknown;
+        s_state.vertexArrays.erase(vao);
+    }
+    void ForgetBuffer(GLuint buffer)
+    {
+        init();
+        for (GLuint& bound : s_state.buffers)
+            if (bound == buffer)
+                bound = s_unknown;
+        for (auto& target : s_state.indexedBuffers)
+            for (buffer_range& range : target)
+                if (range.buffer == buffer)
+                    range = buffer_range{};
+        for (auto& [name, vao] : s_state.vertexArrays)
+            if (vao.elementBuffer == buffer)
+                vao.elementBuffer = s_unknown;
+    }
+    void ForgetTexture(GLuint texture)
+    {
+        init();
+        for (auto& unit : s_state.textures)
+            for (GLuint& bound : unit)
+                if (bound == texture)
+                    bound = s_unknown;
+    }
+    void ForgetFramebuffer(GLuint framebuffer)
+    {
+        init();
+        if (s_state.framebuffer == framebuffer)
+            s_state.framebuffer = s_unknown;
+    }
+
+    void Invalidate()
+    {
+        reset();
+    }
+
+    const Stats& GetStats()
+    {
+        return s_stats;
+    }
+    void ResetStats()
+    {
+        s_stats = Stats{};
+    }
+}
@@ -0,0 +1,58 @@
+/*
+ * game/renderer/state_cache.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+#include <GL/glew.h>
+
+// Shadows the GL's binding state, so that calls which would not change it are never issued.
+// Everything that binds objects, or enables attribute arrays, must go through here, or the shadow copy goes stale;
+// code that can't (e.g., third party code) must call Invalidate() after touching GL state.
+// Only for use on the thread owning the context.
+namespace renderer::state
+{
+    struct Stats
+    {
+        size_t issued = 0;
+        size_t skipped = 0;
+    };
+
+    void UseProgram(GLuint program);
+    void BindVertexArray(GLuint vao);
+    // GL_ELEMENT_ARRAY_BUFFER bindings are tracked per vertex array, like the GL does.
+    void BindBuffer(GLenum target, GLuint buffer);
+    // Also binds 'buffer' to 'target', like the GL does.
+    void BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    // 'unit' is the texture unit index, not GL_TEXTUREi.
+    void ActiveTexture(GLuint unit);
+    // Binds to the active texture unit.
+    void BindTexture(GLenum target, GLuint texture);
+    void BindTexture(GLuint unit, GLenum target, GLuint texture);
+    void BindFramebuffer(GLuint framebuffer);
+    // Attribute arrays are tracked per vertex array, like the GL does.
+    void EnableVertexAttribArray(GLuint index);
+    void DisableVertexAttribArray(GLuint index);
+
+    GLuint GetProgram();
+    GLuint GetVertexArray();
+    GLuint GetBuffer(GLenum target);
+    GLuint GetFramebuffer();
+
+    // Call these before deleting an object, so that a new object reusing the name isn't mistaken for a bound one.
+    void ForgetProgram(GLuint program);
+    void ForgetVertexArray(GLuint vao);
+    void ForgetBuffer(GLuint buffer);
+    void ForgetTexture(GLuint texture);
+    void ForgetFramebuffer(GLuint framebuffer);
+
+    // Forgets all shadowed state, so that the next call of each kind is issued.
+    void Invalidate();
+
+    const Stats& GetStats();
+    void ResetStats();
+}
@@ -0,0 +1,158 @@
+/*
+ * game/renderer/static_batch.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <utility>
+
+#include <renderer/static_batch.h>
+#include <renderer/state_cache.h>
+
+#include <logger.h>
+
+namespace renderer
+{
+    int32_t StaticBatch::Add(const VertexLayout& layout,
+        const void* vertices, size_t nVertices,
+        const void* indices, size_t nIndices, GLenum indexType,
+        const std::vector<MeshLod>& lods, const Bounds& bounds)
+    {
+        if (m_built)
+            return -1;
+        if (!layout.GetStride() || !vertices || !indices)
+            return -1;
+        if (indexType != GL_UNSIGNED_SHORT && indexType != GL_UNSIGNED_INT)
+            return -1;
+        if (m_meshes.empty())
+            m_layout = layout;
+        else if (!(layout == m_layout))
+        {
+            logger::Error("%s: Every mesh in a batch must have the same vertex layout.\n", __func__);
+            return -1;
+        }
+        mesh_entry entry{};
+        entry.baseVertex = m_vertices.size() / layout.GetStride();
+        entry.bounds = bounds;
+        size_t firstIndex = m_indices.size();
+        entry.lods = lods.empty() ? std::vector<MeshLod>{ MeshLod{ 0, nIndices, 0.f } } : lods;
+        for (MeshLod& lod : entry.lods)
+        {
+            if (lod.firstIndex > nIndices || lod.nIndices > nIndices - lod.firstIndex)
+                return -1;
+            lod.firstIndex += firstIndex;
+        }
+        // The indices stay relative to the mesh's base vertex.
+        const uint8_t* vertexData = (const uint8_t*)vertices;
+        m_vertices.insert(m_vertices.end(), vertexData, vertexData + nVertices*layout.GetStride());
+        m_indices.reserve(m_indices.size() + nIndices);
+        if (indexType == GL_UNSIGNED_SHORT)
+            m_indices.insert(m_indices.end(), (const GLushort*)indices, (const GLushort*)indices + nIndices);
+        else
+            m_indices.insert(m_indices.end(), (const GLuint*)indices, (const GLuint*)indices + nIndices);
+        m_meshes.push_back(std::move(entry));
+        return m_meshes.size() - 1;
+    }
+    int32_t StaticBatch::Add(const CookedMeshView& mesh)
+    {
+        return Add(mesh.layout,
+            mesh.vertices, mesh.nVertices,
+            mesh.indices, mesh.nIndices, mesh.indexType,
+            mesh.lods, mesh.bounds);
+    }
+    int32_t StaticBatch::Add(const ImportedModel& model)
+    {
+        if (model.submeshes.empty())
+            return -1;
+        VertexLayout layout = VertexLayout::Packed();
+        std::vector<uint8_t> vertices = PackVertices(layout, model.vertices, model.normals, model.textureCoords);
+        int32_t first = m_meshes.size();
+        size_t nBatchVertices = m_vertices.size();
+        size_t nBatchIndices = m_indices.size();
+        for (const Submesh& submesh : model.submeshes)
+        {
+            // A submesh's indices are already relative to its base vertex.
+            if (submesh.baseVertex + submesh.nVertices > vertices.size() / layout.GetStride() ||
+                submesh.firstIndex + submesh.nIndices > model.indices.size() ||
+                Add(layout,
+                    vertices.data() + submesh.baseVertex*layout.GetStride(), submesh.nVertices,
+                    model.indices.data() + submesh.firstIndex, submesh.nIndices, GL_UNSIGNED_INT,
+                    {}, submesh.bounds) == -1)
+            {
+                // Don't leave part of the model in the batch.
+                m_meshes.resize(first);
+                m_vertices.resize(nBatchVertices);
+                m_indices.resize(nBatchIndices);
+                return -1;
+            }
+        }
+        return first;
+    }
+    GLint StaticBatch::Build(VAO& to)
+    {
+        if (m_built || m_meshes.empty())
+            return GL_FALSE;
+        if (!m_mesh.Load(m_layout, std::move(m_vertices), std::move(m_indices)))
+            return GL_FALSE;
+        m_vertices = {};
+        m_indices = {};
+        if (m_mesh.Bind(to) != GL_TRUE)
+            return GL_FALSE;
+        m_indirect = m_allowIndirect &&
+            (GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance));
+        logger::Debug("%s: Batched %zu meshes (%zu vertices, %zu indices), drawing with %s.\n", __func__,
+            m_meshes.size(), m_mesh.GetVertexCount(), m_mesh.GetIndexCount(),
+            m_indirect ? "glMultiDrawElementsIndirect" : "one draw per command");
+        m_built = true;
+        return GL_TRUE;
+    }
+    void StaticBatch::AddDraw(uint32_t mesh, uint32_t lod, uint32_t firstInstance, uint32_t nInstances)
+    {
+        if (mesh >= m_meshes.size() || !nInstances)
+            return;
+        const mesh_entry& entry = m_meshes[mesh];
+        if (lod >= entry.lods.size())
+            lod = entry.lods.size() - 1;
+        const MeshLod& range = entry.lods[lod];
+        if (!m_commands.empty())
+        {
+            DrawElementsIndirectCommand& last = m_commands.back();
+            if (last.firstIndex == range.firstIndex && last.count == range.nIndices && last.baseVertex == entry.baseVertex &&
+                last.baseInstance + last.instanceCount == firstInstance)
+            {
+                last.instanceCount += nInstances;
+                return;
+            }
+        }
+        m_commands.push_back({ (GLuint)range.nIndices, nInstances, (GLuint)range.firstIndex, entry.baseVertex, firstInstance });
+    }
+    GLint StaticBatch::Render(GLuint instanceBuffer, GLintptr instanceOffset, GLuint commandBuffer, GLintptr commandOffset,
+        size_t firstCommand, size_t nCommands)
+    {
+        m_nDrawCalls = 0;
+        if (!m_built || firstCommand >= m_commands.size())
+            return GL_FALSE;
+        if (!nCommands || nCommands > m_commands.size() - firstCommand)
+            nCommands = m_commands.size() - firstCommand;
+        if (m_indirect && commandBuffer)
+        {
+            // Instance attributes with a divisor start at the command's base instance, so every command finds its
+            // model matrices without the attribute pointers moving.
+            m_mesh.SetInstances(instanceBuffer, instanceOffset, 0);
+            state::BindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, m_mesh.GetIndexType(),
+                (const void*)(commandOffset + firstCommand*sizeof(DrawElementsIndirectCommand)), nCommands, 0);
+            m_nDrawCalls = 1;
+            return GL_TRUE;
+        }
+        for (size_t i = firstCommand; i < firstCommand + nCommands; i++)
+        {
+            const DrawElementsIndirectCommand& command = m_commands[i];
+            // The attribute pointers are the only way to offset instance data before base instances.
+            m_mesh.SetInstances(instanceBuffer, instanceOffset + command.baseInstance*sizeof(glm::mat4), command.instanceCount);
+            m_mesh.RenderRange(command.firstIndex, command.count, command.baseVertex);
+            m_nDrawCalls++;
+        }
+        return GL_TRUE;
+    }
+}
@@ -0,0 +1,116 @@
+/*
+ * game/renderer/static_batch.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include <renderer/vao.h>
+#include <renderer/mesh.h>
+#include <renderer/mesh_format.h>
+#include <renderer/vertex_layout.h>
+#include <renderer/bounds.h>
+#include <renderer/model.h>
+
+namespace renderer
+{
+    // As glMultiDrawElementsIndirect reads it.
+    struct DrawElementsIndirectCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        // Where the command's per-instance data starts in the instance stream.
+        GLuint baseInstance;
+    };
+    static_assert(sizeof(DrawElementsIndirectCommand) == 20);
+
+    // Static meshes merged into one vertex and one index buffer, so that every draw of every mesh can be issued at once.
+    // Draws are recorded as indirect commands (e.g., one per visible mesh and level of detail, from the culling pass),
+    // and drawn with one glMultiDrawElementsIndirect call, each command's instances reading their model matrices from
+    // the instance stream starting at its base instance.
+    // Without ARB_multi_draw_indirect and ARB_base_instance (i.e., on plain 3.3 contexts), which leaves no way for a
+    // multi-draw to select per-object data, each command is one instanced draw instead, still from the shared buffers.
+    class StaticBatch final
+    {
+    public:
+        StaticBatch() = default;
+        // Cannot be copied.
+        StaticBatch(const StaticBatch&) = delete;
+        StaticBatch& operator=(const StaticBatch&) = delete;
+        // Cannot be moved.
+        StaticBatch(StaticBatch&&) = delete;
+        StaticBatch& operator=(StaticBatch&&) = delete;
+
+        // Copies a mesh into the batch, as Mesh::Load would take it ('lods' is relative to 'indices', and may be
+        // empty for meshes without levels of detail).
+        // Every mesh must have the same vertex layout.
+        // Returns the mesh's index in the batch, or -1 on failure, or if the batch was already built.
+        int32_t Add(const VertexLayout& layout,
+            const void* vertices, size_t nVertices,
+            const void* indices, size_t nIndices, GLenum indexType,
+            const std::vector<MeshLod>& lods, const Bounds& bounds);
+        int32_t Add(const CookedMeshView& mesh);
+        // Adds each of the model's submeshes as a mesh of its own, packed with VertexLayout::Packed(); submesh i is
+        // then the batch's mesh 'first + i', where 'first' is the index returned (or -1 on failure).
+        // Only the model's streams and submeshes are used; placing its instances is up to the caller.
+        int32_t Add(const ImportedModel& model);
+        // Uploads every mesh added so far and binds the merged buffers to 'to'; no meshes can be added afterwards.
+        GLint Build(VAO& to);
+        bool IsBuilt() const { return m_built; }
+
+        size_t GetMeshCount() const { return m_meshes.size(); }
+        const std::vector<MeshLod>& GetLods(uint32_t mesh) const { return m_meshes[mesh].lods; }
+        const Bounds& GetBounds(uint32_t mesh) const { return m_meshes[mesh].bounds; }
+
+        // Records a draw of 'nInstances' instances of one of the mesh's levels of detail, whose model matrices are
+        // stored from 'firstInstance' on in the instance stream.
+        // Draws of the same level that continue the previous draw's instances are merged into one command.
+        void AddDraw(uint32_t mesh, uint32_t lod, uint32_t firstInstance, uint32_t nInstances = 1);
+        const std::vector<DrawElementsIndirectCommand>& GetCommands() const { return m_commands; }
+        void ClearCommands() { m_commands.clear(); }
+
+        // Draws every recorded command; the batch's VAO must be bound.
+        // The model matrices are read from 'instanceBuffer' at 'instanceOffset', and the commands from 'commandBuffer'
+        // at 'commandOffset', where the caller copied GetCommands() to (e.g., in a FrameRingBuffer).
+        // If 'nCommands' isn't zero, only that range of the commands is drawn (e.g., the ones drawn with one material).
+        // Returns GL_FALSE if nothing was drawn.
+        GLint Render(GLuint instanceBuffer, GLintptr instanceOffset, GLuint commandBuffer, GLintptr commandOffset,
+            size_t firstCommand = 0, size_t nCommands = 0);
+
+        // Whether Render() draws with a single glMultiDrawElementsIndirect call.
+        bool IsIndirect() const { return m_indirect; }
+        // Forces the per-command fallback (e.g., to compare the two). Must be called before Build().
+        void DisableIndirect() { m_allowIndirect = false; }
+        // The draw calls issued by the last Render().
+        size_t GetDrawCallCount() const { return m_nDrawCalls; }
+    private:
+        struct mesh_entry
+        {
+            GLint baseVertex = 0;
+            // Relative to the batch's indices.
+            std::vector<MeshLod> lods{};
+            Bounds bounds{};
+        };
+        Mesh m_mesh;
+        VertexLayout m_layout{};
+        std::vector<mesh_entry> m_meshes{};
+        // Freed once built.
+        std::vector<uint8_t> m_vertices{};
+        std::vector<GLuint> m_indices{};
+        std::vector<DrawElementsIndirectCommand> m_commands{};
+        bool m_built = false;
+        bool m_allowIndirect = true;
+        bool m_indirect = false;
+        size_t m_nDrawCalls = 0;
+    };
+}
@@ -11,10 +11,14 @@
 #include <GL/glew.h>
 #include <GL/gl.h>
 
+#include <algorithm>
+#include <utility>
 #include <vector>
 
 #include <renderer/vao.h>
 #include <renderer/texture.h>
+#include <renderer/state_cache.h>
+#include <renderer/texture_format.h>
 
 #define STB_IMAGE_IMPLEMENTATION 1
 #include <external/stb_image.h>
@@ -23,132 +27,231 @@ namespace renderer
 {
     Texture::Texture()
     {
-        m_vbo = 0;
-        GLuint buffers[1] = { 0 };
-        glGenBuffers(1, buffers);
-        m_vbo = buffers[0];
         glGenTextures(1, &m_textureObject);
         m_initialized = true;
     }
-    bool Texture::Load(const void* image, size_t szImage, const std::vector<GLfloat>& textureCoordinates)
+    bool Texture::IsDDSImage(const void* image, size_t szImage)
+    {
+        return IsDDS(image, szImage);
+    }
+    bool Texture::Load(const void* image, size_t szImage)
     {
         if (!image || szImage < 124)
             return false;
-        m_textureCoordinates = textureCoordinates;
-        m_nCoords = textureCoordinates.size();
-        uint8_t* img = (uint8_t*)image;
-        m_isDDSImage = true;
-        if (memcmp(img, "DDS ", 4) != 0)
-        {
-            m_isDDSImage = false;
-            if (!stbi_info_from_memory(img, szImage, nullptr, nullptr, nullptr))
-                return false; // Unrecognized format.
-        }
-        m_image = new uint8_t[szImage];
-        memcpy((void*)m_image, image, szImage);
-        m_szImage = szImage;
+        const uint8_t* img = (const uint8_t*)image;
+        return Load(std::vector<uint8_t>(img, img + szImage));
+    }
+    bool Texture::Load(std::vector<uint8_t> image)
+    {
+        if (image.size() < 124)
+            return false;
+        m_isDDSImage = IsDDSImage(image.data(), image.size());
+        if (!m_isDDSImage && !stbi_info_from_memory(image.data(), image.size(), nullptr, nullptr, nullptr))
+            return false; // Unrecognized format.
+        m_image = std::move(image);
+        m_isDecoded = false;
+        m_target = GL_TEXTURE_2D;
+        m_nLayers = 0;
         return true;
     }
-    #define FOURCC_DXT1 0x31545844
-    #define FOURCC_DXT3 0x33545844
-    #define FOURCC_DXT5 0x35545844
-    
-    GLint Texture::BindDDSTexture()
+    bool Texture::LoadPixels(std::vector<uint8_t> pixels, int width, int height)
     {
-        glBindTexture(GL_TEXTURE_2D, m_textureObject);
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-        uint8_t* header = (uint8_t*)m_image;
-        header += 4;
-        unsigned int height      = *(unsigned int*)&(header[ 8]);
-	    unsigned int width	     = *(unsigned int*)&(header[12]);
-	    unsigned int linearSize	 = *(unsigned int*)&(header[16]);
-	    unsigned int mipMapCount = *(unsigned int*)&(header[24]);
-	    unsigned int fourCC      = *(unsigned int*)&(header[80]);
-        unsigned int components  = (fourCC == FOURCC_DXT1) ? 3 : 4; 
-	    unsigned int format;
-	    switch(fourCC) 
-	    { 
-	    case FOURCC_DXT1: 
-	    	format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; 
-	    	break; 
-	    case FOURCC_DXT3: 
-	    	format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; 
-	    	break; 
-	    case FOURCC_DXT5: 
-	    	format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; 
-	    	break; 
-	    default:
-            delete[] (uint8_t*)m_image;
-	    	return GL_FALSE; 
-	    }
-        uint8_t* buffer = &((uint8_t*)m_image)[124];
-        unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16; 
-	    unsigned int offset = 0;
-	    for (unsigned int level = 0; level < mipMapCount && (width || height); ++level) 
-	    { 
-	    	unsigned int size = ((width+3)/4)*((height+3)/4)*blockSize; 
-	    	glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height, 0, size, buffer + offset); 
-    
-	    	offset += size; 
-	    	width /= 2; 
-	    	height /= 2; 
-
-	    	if(width < 1)
-                width = 1;
-	    	if(height < 1) 
-                height = 1;
-	    } 
-        delete[] (uint8_t*)m_image;
-	    return GL_TRUE; 
+        if (width <= 0 || height <= 0 || pixels.size() < (size_t)width*height*4)
+            return false;
+        m_image = std::move(pixels);
+        m_width = width;
+        m_height = height;
+        m_isDecoded = true;
+        m_isDDSImage = false;
+        m_target = GL_TEXTURE_2D;
+        m_nLayers = 0;
+        return true;
     }
-    GLint Texture::BindOtherFormatTexture()
+    bool Texture::LoadLayers(std::vector<uint8_t> pixels, int width, int height, int nLayers, uint32_t nLevels)
+    {
+        if (width <= 0 || height <= 0 || nLayers <= 0 || pixels.size() < (size_t)width*height*nLayers*4)
+            return false;
+        if (!LoadPixels(std::move(pixels), width, height))
+            return false;
+        m_target = GL_TEXTURE_2D_ARRAY;
+        m_nLayers = nLayers;
+        m_nLevels = std::min(nLevels ? nLevels : GetMipCount(width, height), GetMipCount(width, height));
+        return true;
+    }
+    bool Texture::DecodeImage(const void* image, size_t szImage, std::vector<uint8_t>& pixels, int& width, int& height)
     {
-        // Load the texture through stb_image.
-        int width = 0, height = 0;
-        void* pixels = 
-            stbi_load_from_memory((uint8_t*)m_image, m_szImage,
+        void* decoded = 
+            stbi_load_from_memory((const uint8_t*)image, szImage,
              &width, &height, nullptr,
              STBI_rgb_alpha);
-        if (!pixels)
-            return GL_FALSE;
-        glBindTexture(GL_TEXTURE_2D, m_textureObject);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-
+        if (!decoded)
+            return false;
+        pixels.assign((uint8_t*)decoded, (uint8_t*)decoded + (size_t)width*height*4);
+        stbi_image_free(decoded);
+        return true;
+    }
+    void Texture::set_sampling_parameters()
+    {
         // Set trilinear filtering.
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	    glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(m_target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(m_target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(m_target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(m_target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        // Without this, a chain that stops short of 1x1 would leave the texture incomplete.
+        glTexParameteri(m_target, GL_TEXTURE_BASE_LEVEL, m_baseLevel);
+        glTexParameteri(m_target, GL_TEXTURE_MAX_LEVEL, m_nLevels ? m_nLevels - 1 : 0);
+    }
+    GLint Texture::BindDDSTexture()
+    {
+        TextureView view{};
+        if (!ParseDDS(m_image.data(), m_image.size(), view))
+        {
+            m_image.clear();
+            return GL_FALSE;
+        }
+        state::BindTexture(GL_TEXTURE_2D, m_textureObject);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        m_format = view.format;
+        m_width = view.width;
+        m_height = view.height;
+        m_nLevels = view.levels.size();
+        m_baseLevel = 0;
+        for (size_t level = 0; level < view.levels.size(); level++)
+        {
+            const TextureLevel& i = view.levels[level];
+            upload_level(level, i.width, i.height, view.data + i.offset, i.size);
+        }
+        set_sampling_parameters();
+        m_image.clear();
+        m_image.shrink_to_fit();
+        return GL_TRUE;
+    }
+    void Texture::upload_level(GLint level, GLsizei width, GLsizei height, const void* data, size_t size)
+    {
+        if (IsCompressedFormat(m_format))
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, m_format, width, height, 0, size, data);
+        else
+            glTexImage2D(GL_TEXTURE_2D, level, m_format, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    }
+    GLint Texture::BindOtherFormatTexture()
+    {
+        // Load the texture through stb_image, unless someone already decoded it for us.
+        if (!m_isDecoded)
+        {
+            std::vector<uint8_t> pixels;
+            if (!DecodeImage(m_image.data(), m_image.size(), pixels, m_width, m_height))
+                return GL_FALSE;
+            m_image = std::move(pixels);
+            m_isDecoded = true;
+        }
+        state::BindTexture(GL_TEXTURE_2D, m_textureObject);
+        m_format = GL_RGBA8;
+        m_nLevels = GetMipCount(m_width, m_height);
+        m_baseLevel = 0;
+        upload_level(0, m_width, m_height, m_image.data(), m_image.size());
+        set_sampling_parameters();
+        glGenerateMipmap(GL_TEXTURE_2D);
         
         // Free the image.
-        stbi_image_free(pixels);
-        delete[] (uint8_t*)m_image;
+        m_image.clear();
+        m_image.shrink_to_fit();
         
         return GL_TRUE;
     }
+    GLint Texture::BindLayeredTexture()
+    {
+        state::BindTexture(GL_TEXTURE_2D_ARRAY, m_textureObject);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        m_format = GL_RGBA8;
+        m_baseLevel = 0;
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, m_format, m_width, m_height, m_nLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, m_image.data());
+        // The maximum level stops the chain before atlas images bleed into each other.
+        set_sampling_parameters();
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        m_image.clear();
+        m_image.shrink_to_fit();
+        return GL_TRUE;
+    }
     GLint Texture::Bind(VAO& to)
     {
-        if (!m_image || !m_initialized)
+        if (m_image.empty() || !m_initialized)
+            return GL_FALSE;
+        if (m_vao)
             return GL_FALSE;
     
-        to.Bind();
-        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-        glBufferData(GL_ARRAY_BUFFER, m_textureCoordinates.size()*sizeof(GLfloat), m_textureCoordinates.data(), GL_STATIC_DRAW);
         // Bind the texture.
         
         GLint status = GL_TRUE;
-        if (m_isDDSImage)
+        if (m_nLayers)
+            status = BindLayeredTexture();
+        else if (m_isDDSImage)
             status = BindDDSTexture();
         else
             status = BindOtherFormatTexture();
 
+        if (status == GL_FALSE)
+            return GL_FALSE;
+
         m_vao = &to;
-        add_to_vao();
+        // The texture has to be bound before anything in the VAO draws with it.
+        add_to_vao(true);
         
         return GL_TRUE;
     }
+    GLint Texture::BeginStreaming(VAO& to, GLenum format, uint32_t width, uint32_t height, uint32_t nLevels)
+    {
+        if (!m_initialized || m_vao || m_nLayers)
+            return GL_FALSE;
+        if (!width || !height || !nLevels || nLevels > GetMipCount(width, height))
+            return GL_FALSE;
+        m_format = format;
+        m_width = width;
+        m_height = height;
+        m_nLevels = nLevels;
+        // Nothing is resident yet.
+        m_baseLevel = nLevels - 1;
+        state::BindTexture(GL_TEXTURE_2D, m_textureObject);
+        set_sampling_parameters();
+        m_image.clear();
+        m_image.shrink_to_fit();
+        m_vao = &to;
+        add_to_vao(true);
+        return GL_TRUE;
+    }
+    GLint Texture::UploadLevel(uint32_t level, const void* data, size_t size)
+    {
+        if (!m_vao || level >= m_nLevels || !data)
+            return GL_FALSE;
+        uint32_t width = std::max(m_width >> level, 1);
+        uint32_t height = std::max(m_height >> level, 1);
+        if (size != GetTextureLevelSize(m_format, width, height))
+            return GL_FALSE;
+        state::BindTexture(GL_TEXTURE_2D, m_textureObject);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        upload_level(level, width, height, data, size);
+        return GL_TRUE;
+    }
+    GLint Texture::EvictLevel(uint32_t level)
+    {
+        if (!m_vao || level >= m_nLevels || level >= m_baseLevel)
+            return GL_FALSE; // Evicting a level that can be sampled would leave the texture incomplete.
+        state::BindTexture(GL_TEXTURE_2D, m_textureObject);
+        // Respecifying the level as empty releases its storage.
+        if (IsCompressedFormat(m_format))
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, m_format, 0, 0, 0, 0, nullptr);
+        else
+            glTexImage2D(GL_TEXTURE_2D, level, m_format, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        return GL_TRUE;
+    }
+    GLint Texture::SetBaseLevel(uint32_t level)
+    {
+        if (!m_vao || level >= m_nLevels)
+            return GL_FALSE;
+        m_baseLevel = level;
+        state::BindTexture(GL_TEXTURE_2D, m_textureObject);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+        return GL_TRUE;
+    }
     GLint Texture::Render()
     {
         if (!m_initialized)
@@ -156,23 +259,30 @@ namespace renderer
         if (!m_vao)
             return GL_FALSE;
         // m_vao->Bind();
-        glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, m_textureObject);
-		glUniform1i(m_textureSamplerUniform, 0);
-        // Send the UVs to the shader.
-        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-        // glEnableVertexAttribArray(m_vaaIndex);
-        glVertexAttribPointer(m_vaaIndex, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-        // glDisableVertexAttribArray(m_vaaIndex);
+        state::BindTexture(0, m_target, m_textureObject);
         return GL_TRUE;
     }
+    GLint Texture::Render(Program& program)
+    {
+        if (Render() != GL_TRUE)
+            return GL_FALSE;
+        // Programs that don't sample the texture may not have the uniform; that's fine.
+        program.SetUniform(m_samplerUniform, 0);
+        return GL_TRUE;
+    }
+    GLint Texture::SetLayer(Program& program, uint32_t layer)
+    {
+        if (!m_vao || layer >= (uint32_t)m_nLayers)
+            return GL_FALSE;
+        return program.SetUniform(m_layerUniform, (GLint)layer);
+    }
     Texture::~Texture() 
     {
         if (m_initialized)
         {
             if (m_vao)
                 remove_from_vao();
-            glDeleteBuffers(1, &m_vbo);
+            state::ForgetTexture(m_textureObject);
             glDeleteTextures(1, &m_textureObject);
         }
     }
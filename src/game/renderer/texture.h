@@ -7,12 +7,14 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <GL/glew.h>
 
 #include <vector>
 
 #include <renderer/vao.h>
+#include <renderer/shader.h>
 
 namespace renderer
 {
@@ -25,26 +27,76 @@ namespace renderer
         Texture(Texture&&) = delete;
         Texture& operator=(Texture&&) = delete;
 
-        bool Load(const void* image, size_t szImage, const std::vector<GLfloat>& textureCoordinates);
+        // Copies the image.
+        bool Load(const void* image, size_t szImage);
+        // Takes ownership of the image, without copying it.
+        bool Load(std::vector<uint8_t> image);
+        // Loads an image that was already decoded (see DecodeImage) to RGBA8.
+        bool LoadPixels(std::vector<uint8_t> pixels, int width, int height);
+        // Loads a GL_TEXTURE_2D_ARRAY from the RGBA8 pixels of each layer, back to back (e.g., from a TexturePacker).
+        // Only the first 'nLevels' mip levels are sampled; zero means the full chain.
+        bool LoadLayers(std::vector<uint8_t> pixels, int width, int height, int nLayers, uint32_t nLevels = 0);
+
+        // Decodes an image (anything but DDS) to RGBA8.
+        // Does not touch the GL, so it can be called from any thread.
+        static bool DecodeImage(const void* image, size_t szImage, std::vector<uint8_t>& pixels, int& width, int& height);
+        static bool IsDDSImage(const void* image, size_t szImage);
 
         GLint Bind(VAO& to) override;
+        // Binds the texture to unit zero.
         GLint Render() override;
+        // Binds the texture, and points the program's sampler uniform at it, through the program's uniform cache.
+        GLint Render(Program& program);
+
+        // Streamed textures are bound empty, and have their levels uploaded and evicted afterwards (see assets::TextureStreamer).
+        // Only levels from the base level down are sampled; levels finer than it can be absent.
+        // 'format' is an internal format supported by TextureView.
+        GLint BeginStreaming(VAO& to, GLenum format, uint32_t width, uint32_t height, uint32_t nLevels);
+        // 'size' must be the level's GetTextureLevelSize.
+        GLint UploadLevel(uint32_t level, const void* data, size_t size);
+        // Releases the storage of a level finer than the base level.
+        GLint EvictLevel(uint32_t level);
+        GLint SetBaseLevel(uint32_t level);
+        uint32_t GetBaseLevel() const { return m_baseLevel; }
+        uint32_t GetLevelCount() const { return m_nLevels; }
+        GLenum GetFormat() const { return m_format; }
+        int GetWidth() const { return m_width; }
+        int GetHeight() const { return m_height; }
 
-        GLuint GetVBO() const { return m_vbo; }
+        GLuint GetTextureObject() const { return m_textureObject; }
+        // GL_TEXTURE_2D, or GL_TEXTURE_2D_ARRAY for layered textures.
+        GLenum GetTarget() const { return m_target; }
+        int GetLayerCount() const { return m_nLayers; }
 
-        void SetTextureSamplerUniform(GLuint to) { m_textureSamplerUniform = to; }
+        // The names of the uniforms programs sample the texture with, "textureSampler" by default.
+        void SetSamplerUniform(ProgramName name) { m_samplerUniform = name; }
+        // The integer uniform that selects the layer of a layered texture, "textureLayer" by default.
+        void SetLayerUniform(ProgramName name) { m_layerUniform = name; }
+        // Selects the layer for 'program' to sample. The texture must be bound (see Render).
+        GLint SetLayer(Program& program, uint32_t layer);
 
         virtual ~Texture();
     private:
-        std::vector<GLfloat> m_textureCoordinates{}; 
-        size_t m_nCoords = 0;
-        GLuint m_vbo = 0;
         GLuint m_textureObject = 0;
-        GLuint m_textureSamplerUniform = 0;
-        const void* m_image = nullptr; // Not guaranteed to exist after Bind call.
-        size_t m_szImage = 0;
+        ProgramName m_samplerUniform = "textureSampler";
+        ProgramName m_layerUniform = "textureLayer";
+        GLenum m_target = GL_TEXTURE_2D;
+        // Zero unless the texture is layered.
+        int m_nLayers = 0;
+        // Not guaranteed to exist after Bind call.
+        std::vector<uint8_t> m_image{};
+        // If m_isDecoded, m_image is RGBA8 pixels, otherwise it's the image file.
+        bool m_isDecoded = false;
+        int m_width = 0;
+        int m_height = 0;
         bool m_isDDSImage = false;
+        GLenum m_format = GL_RGBA8;
+        uint32_t m_nLevels = 0;
+        uint32_t m_baseLevel = 0;
         GLint BindDDSTexture();
         GLint BindOtherFormatTexture(); // i.e., using stb_image.
+        GLint BindLayeredTexture();
+        void upload_level(GLint level, GLsizei width, GLsizei height, const void* data, size_t size);
+        void set_sampling_parameters();
     };
 }
\ No newline at end of file
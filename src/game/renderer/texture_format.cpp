@@ -0,0 +1,333 @@
+/*
+ * game/renderer/texture_format.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <GL/glew.h>
+
+#include <renderer/texture_format.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace renderer
+{
+    static constexpr uint32_t s_fourCCDXT1 = 0x31545844; // "DXT1"
+    static constexpr uint32_t s_fourCCDXT3 = 0x33545844; // "DXT3"
+    static constexpr uint32_t s_fourCCDXT5 = 0x35545844; // "DXT5"
+    static constexpr uint32_t s_fourCCDX10 = 0x30315844; // "DX10"
+    // The magic, then the header.
+    static constexpr size_t s_headerSize = 4 + 124;
+    static constexpr size_t s_dx10HeaderSize = 20;
+
+    enum
+    {
+        DXGI_FORMAT_R8G8B8A8_UNORM = 28,
+        DXGI_FORMAT_R8G8B8A8_UNORM_SRGB = 29,
+        DXGI_FORMAT_BC1_UNORM = 71,
+        DXGI_FORMAT_BC1_UNORM_SRGB = 72,
+        DXGI_FORMAT_BC2_UNORM = 74,
+        DXGI_FORMAT_BC2_UNORM_SRGB = 75,
+        DXGI_FORMAT_BC3_UNORM = 77,
+        DXGI_FORMAT_BC3_UNORM_SRGB = 78,
+        DXGI_FORMAT_BC7_UNORM = 98,
+        DXGI_FORMAT_BC7_UNORM_SRGB = 99,
+    };
+
+    static uint32_t read_u32(const uint8_t* at)
+    {
+        uint32_t ret = 0;
+        memcpy(&ret, at, sizeof(ret));
+        return ret;
+    }
+    static void write_u32(std::vector<uint8_t>& out, uint32_t value)
+    {
+        uint8_t bytes[4];
+        memcpy(bytes, &value, sizeof(bytes));
+        out.insert(out.end(), bytes, bytes + 4);
+    }
+    static uint32_t gl_to_dxgi(GLenum format)
+    {
+        switch (format)
+        {
+            case GL_RGBA8: return DXGI_FORMAT_R8G8B8A8_UNORM;
+            case GL_SRGB8_ALPHA8: return DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+            case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: return DXGI_FORMAT_BC1_UNORM;
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT: return DXGI_FORMAT_BC1_UNORM_SRGB;
+            case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT: return DXGI_FORMAT_BC2_UNORM;
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT: return DXGI_FORMAT_BC2_UNORM_SRGB;
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return DXGI_FORMAT_BC3_UNORM;
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT: return DXGI_FORMAT_BC3_UNORM_SRGB;
+            case GL_COMPRESSED_RGBA_BPTC_UNORM: return DXGI_FORMAT_BC7_UNORM;
+            case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM: return DXGI_FORMAT_BC7_UNORM_SRGB;
+            default: return 0;
+        }
+    }
+    static GLenum dxgi_to_gl(uint32_t dxgiFormat)
+    {
+        switch (dxgiFormat)
+        {
+            case DXGI_FORMAT_R8G8B8A8_UNORM: return GL_RGBA8;
+            case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB: return GL_SRGB8_ALPHA8;
+            case DXGI_FORMAT_BC1_UNORM: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+            case DXGI_FORMAT_BC1_UNORM_SRGB: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+            case DXGI_FORMAT_BC2_UNORM: return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+            case DXGI_FORMAT_BC2_UNORM_SRGB: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT;
+            case DXGI_FORMAT_BC3_UNORM: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            case DXGI_FORMAT_BC3_UNORM_SRGB: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+            case DXGI_FORMAT_BC7_UNORM: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+            case DXGI_FORMAT_BC7_UNORM_SRGB: return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+            default: return GL_NONE;
+        }
+    }
+
+    bool IsCompressedFormat(GLenum format)
+    {
+        switch (format)
+        {
+            case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+            case GL_COMPRESSED_RGBA_BPTC_UNORM:
+            case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+                return true;
+            default:
+                return false;
+        }
+    }
+    bool IsSRGBFormat(GLenum format)
+    {
+        switch (format)
+        {
+            case GL_SRGB8_ALPHA8:
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+            case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+                return true;
+            default:
+                return false;
+        }
+    }
+    bool IsFormatSupported(GLenum format)
+    {
+        switch (format)
+        {
+            case GL_RGBA8:
+            case GL_SRGB8_ALPHA8:
+                return true;
+            case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+                return GLEW_EXT_texture_compression_s3tc;
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+                return GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB;
+            case GL_COMPRESSED_RGBA_BPTC_UNORM:
+            case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+                return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+            default:
+                return false;
+        }
+    }
+    size_t GetTextureLevelSize(GLenum format, uint32_t width, uint32_t height)
+    {
+        if (!IsCompressedFormat(format))
+            return (size_t)width*height*4;
+        // Compressed formats are made of 4x4 blocks.
+        size_t blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT || format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT) ? 8 : 16;
+        return (size_t)((width+3)/4)*((height+3)/4)*blockSize;
+    }
+    uint32_t GetMipCount(uint32_t width, uint32_t height)
+    {
+        uint32_t count = 1;
+        for (uint32_t size = std::max(width, height); size > 1; size /= 2)
+            count++;
+        return count;
+    }
+
+    static float srgb_to_linear(float value)
+    {
+        return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+    static float linear_to_srgb(float value)
+    {
+        return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+    }
+    void BuildMipChain(const uint8_t* pixels, uint32_t width, uint32_t height, std::vector<uint8_t>& out, TextureView& view, bool srgb)
+    {
+        view.format = GL_RGBA8;
+        view.width = width;
+        view.height = height;
+        view.levels.clear();
+        uint32_t nLevels = GetMipCount(width, height);
+        size_t total = 0;
+        for (uint32_t i = 0; i < nLevels; i++)
+        {
+            TextureLevel level{};
+            level.width = std::max(width >> i, 1u);
+            level.height = std::max(height >> i, 1u);
+            level.offset = total;
+            level.size = GetTextureLevelSize(GL_RGBA8, level.width, level.height);
+            view.levels.push_back(level);
+            total += level.size;
+        }
+        out.resize(total);
+        memcpy(out.data(), pixels, view.levels[0].size);
+
+        // Filter in linear space, keeping each level at full precision, so that rounding doesn't build up down the chain.
+        float toLinear[256];
+        for (int i = 0; i < 256; i++)
+            toLinear[i] = srgb ? srgb_to_linear(i / 255.f) : i / 255.f;
+        std::vector<float> source((size_t)width*height*4);
+        for (size_t i = 0; i < source.size(); i++)
+            source[i] = (i % 4 == 3) ? pixels[i] / 255.f : toLinear[pixels[i]];
+        std::vector<float> level;
+        uint32_t sourceWidth = width, sourceHeight = height;
+        for (uint32_t i = 1; i < nLevels; i++)
+        {
+            const TextureLevel& info = view.levels[i];
+            level.resize((size_t)info.width*info.height*4);
+            uint8_t* to = out.data() + info.offset;
+            for (uint32_t y = 0; y < info.height; y++)
+            {
+                // Odd sizes repeat the last row or column.
+                uint32_t y0 = std::min(y*2, sourceHeight - 1), y1 = std::min(y*2 + 1, sourceHeight - 1);
+                for (uint32_t x = 0; x < info.width; x++)
+                {
+                    uint32_t x0 = std::min(x*2, sourceWidth - 1), x1 = std::min(x*2 + 1, sourceWidth - 1);
+                    for (int c = 0; c < 4; c++)
+                    {
+                        float value = 0.25f * (
+                            source[(y0*sourceWidth + x0)*4 + c] + source[(y0*sourceWidth + x1)*4 + c] +
+                            source[(y1*sourceWidth + x0)*4 + c] + source[(y1*sourceWidth + x1)*4 + c]);
+                        level[(y*info.width + x)*4 + c] = value;
+                        float encoded = (c == 3 || !srgb) ? value : linear_to_srgb(value);
+                        to[(y*info.width + x)*4 + c] = (uint8_t)std::clamp(encoded * 255.f + 0.5f, 0.f, 255.f);
+                    }
+                }
+            }
+            source.swap(level);
+            sourceWidth = info.width;
+            sourceHeight = info.height;
+        }
+        view.data = out.data();
+    }
+
+    bool IsDDS(const void* data, size_t size)
+    {
+        return data && size >= s_headerSize && memcmp(data, "DDS ", 4) == 0;
+    }
+    bool ParseDDS(const void* data, size_t size, TextureView& out)
+    {
+        if (!IsDDS(data, size))
+            return false;
+        const uint8_t* header = (const uint8_t*)data + 4;
+        uint32_t height = read_u32(header + 8);
+        uint32_t width = read_u32(header + 12);
+        uint32_t mipCount = read_u32(header + 24);
+        uint32_t fourCC = read_u32(header + 80);
+        size_t dataOffset = s_headerSize;
+        GLenum format = GL_NONE;
+        switch (fourCC)
+        {
+            case s_fourCCDXT1: format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; break;
+            case s_fourCCDXT3: format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; break;
+            case s_fourCCDXT5: format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+            case s_fourCCDX10:
+                if (size < s_headerSize + s_dx10HeaderSize)
+                    return false;
+                format = dxgi_to_gl(read_u32((const uint8_t*)data + s_headerSize));
+                dataOffset += s_dx10HeaderSize;
+                break;
+            default:
+                break;
+        }
+        if (format == GL_NONE || !width || !height)
+            return false;
+        if (!mipCount)
+            mipCount = 1;
+        mipCount = std::min(mipCount, GetMipCount(width, height));
+
+        out.format = format;
+        out.width = width;
+        out.height = height;
+        out.data = (const uint8_t*)data + dataOffset;
+        out.levels.clear();
+        size_t offset = 0;
+        for (uint32_t i = 0; i < mipCount; i++)
+        {
+            TextureLevel level{};
+            level.width = std::max(width >> i, 1u);
+            level.height = std::max(height >> i, 1u);
+            level.offset = offset;
+            level.size = GetTextureLevelSize(format, level.width, level.height);
+            if (dataOffset + offset + level.size > size)
+                break; // Truncated file.
+            out.levels.push_back(level);
+            offset += level.size;
+        }
+        return !out.levels.empty();
+    }
+    bool WriteDDS(std::vector<uint8_t>& out, const TextureView& texture)
+    {
+        uint32_t dxgiFormat = gl_to_dxgi(texture.format);
+        if (!dxgiFormat || texture.levels.empty() || !texture.data)
+            return false;
+        uint32_t fourCC = s_fourCCDX10;
+        if (texture.format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT)
+            fourCC = s_fourCCDXT1;
+        else if (texture.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+            fourCC = s_fourCCDXT5;
+        enum
+        {
+            DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000,
+            DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000,
+            DDPF_FOURCC = 0x4,
+            DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000,
+            D3D10_RESOURCE_DIMENSION_TEXTURE2D = 3,
+        };
+
+        out.clear();
+        out.insert(out.end(), { 'D', 'D', 'S', ' ' });
+        write_u32(out, 124);
+        write_u32(out, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE);
+        write_u32(out, texture.height);
+        write_u32(out, texture.width);
+        write_u32(out, texture.levels[0].size);
+        write_u32(out, 0); // Depth.
+        write_u32(out, texture.levels.size());
+        for (int i = 0; i < 11; i++)
+            write_u32(out, 0); // Reserved.
+        // The pixel format.
+        write_u32(out, 32);
+        write_u32(out, DDPF_FOURCC);
+        write_u32(out, fourCC);
+        for (int i = 0; i < 5; i++)
+            write_u32(out, 0); // Bit count and masks, unused with a FourCC.
+        write_u32(out, DDSCAPS_TEXTURE | (texture.levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0));
+        for (int i = 0; i < 4; i++)
+            write_u32(out, 0); // Caps 2-4 and reserved.
+        if (fourCC == s_fourCCDX10)
+        {
+            write_u32(out, dxgiFormat);
+            write_u32(out, D3D10_RESOURCE_DIMENSION_TEXTURE2D);
+            write_u32(out, 0); // Misc flags.
+            write_u32(out, 1); // Array size.
+            write_u32(out, 0); // Alpha mode (unknown).
+        }
+        for (const TextureLevel& level : texture.levels)
+            out.insert(out.end(), texture.data + level.offset, texture.data + level.offset + level.size);
+        return true;
+    }
+}
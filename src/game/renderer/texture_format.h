@@ -0,0 +1,63 @@
+/*
+ * game/renderer/texture_format.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#include <vector>
+
+// Texture images with their mip chains, as read from DDS files.
+// Supported are BC1 (DXT1), BC2 (DXT3), BC3 (DXT5), BC7 (through the DX10 header), and RGBA8 (through the DX10 header).
+
+namespace renderer
+{
+    struct TextureLevel
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        // The offset of the level from the start of the image data.
+        size_t offset = 0;
+        size_t size = 0;
+    };
+    // A texture, pointing into the memory it was parsed from.
+    struct TextureView
+    {
+        // The internal format, e.g., GL_COMPRESSED_RGBA_S3TC_DXT1_EXT or GL_RGBA8.
+        GLenum format = GL_RGBA8;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        // From largest to smallest.
+        std::vector<TextureLevel> levels{};
+        const uint8_t* data = nullptr;
+    };
+
+    bool IsCompressedFormat(GLenum format);
+    bool IsSRGBFormat(GLenum format);
+    // Whether the GL can sample 'format'. Needs GLEW to be initialized.
+    bool IsFormatSupported(GLenum format);
+    // The amount of bytes a width*height level takes in 'format'.
+    size_t GetTextureLevelSize(GLenum format, uint32_t width, uint32_t height);
+    // The amount of levels in a full mip chain down to 1x1.
+    uint32_t GetMipCount(uint32_t width, uint32_t height);
+
+    // Builds a full GL_RGBA8 mip chain from RGBA8 pixels, by averaging 2x2 blocks.
+    // If 'srgb', color channels are sRGB encoded (as in most images), and are averaged in linear space so that
+    // smaller levels keep the brightness of the larger ones; otherwise (e.g., normal maps), they are averaged as-is.
+    // 'out' receives every level, and 'view' describes them and points into 'out'.
+    void BuildMipChain(const uint8_t* pixels, uint32_t width, uint32_t height, std::vector<uint8_t>& out, TextureView& view, bool srgb = true);
+
+    bool IsDDS(const void* data, size_t size);
+    // Validates a DDS file, and fills 'out' with pointers into 'data'. Nothing is copied.
+    // Levels cut off by the end of the file are dropped.
+    bool ParseDDS(const void* data, size_t size, TextureView& out);
+    // Serializes a texture to a DDS file. BC1 and BC3 textures use the legacy header, and everything else (including sRGB
+    // formats) the DX10 header.
+    bool WriteDDS(std::vector<uint8_t>& out, const TextureView& texture);
+}
@@ -0,0 +1,142 @@
+/*
+ * game/renderer/texture_packer.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include <renderer/texture_packer.h>
+#include <renderer/texture_format.h>
+
+namespace renderer
+{
+    static uint32_t align_up(uint32_t value, uint32_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+    TexturePacker::TexturePacker(uint32_t layerSize)
+        : m_layerSize{align_up(std::max(layerSize, 1u), s_alignment)}
+    {}
+    int TexturePacker::Add(const uint8_t* pixels, uint32_t width, uint32_t height, bool repeats)
+    {
+        if (!pixels || !width || !height)
+            return -1;
+        image img{};
+        img.width = width;
+        img.height = height;
+        img.ownsLayer = width == m_layerSize && height == m_layerSize;
+        if (repeats && !img.ownsLayer)
+            return -1; // Repeating would sample the neighbouring images.
+        if (!img.ownsLayer && (width + s_padding*2 > m_layerSize || height + s_padding*2 > m_layerSize))
+            return -1;
+        img.pixels.assign(pixels, pixels + (size_t)width*height*4);
+        m_images.push_back(std::move(img));
+        return (int)m_images.size() - 1;
+    }
+    void TexturePacker::copy(const image& from, uint32_t layer, uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t padding)
+    {
+        uint8_t* to = m_pixels.data() + (size_t)layer*m_layerSize*m_layerSize*4;
+        for (uint32_t row = 0; row < height; row++)
+        {
+            uint32_t sourceRow = row < padding ? 0 : std::min(row - padding, from.height - 1);
+            for (uint32_t column = 0; column < width; column++)
+            {
+                uint32_t sourceColumn = column < padding ? 0 : std::min(column - padding, from.width - 1);
+                memcpy(to + ((size_t)(y + row)*m_layerSize + x + column)*4,
+                    from.pixels.data() + ((size_t)sourceRow*from.width + sourceColumn)*4, 4);
+            }
+        }
+    }
+    void TexturePacker::Pack()
+    {
+        m_nLayers = 0;
+        m_hasAtlas = false;
+        std::vector<shelf> shelves;
+        // The next free row of each atlas layer.
+        std::vector<std::pair<uint32_t, uint32_t>> layerTops;
+        // Tallest first, so that shelves waste less space.
+        std::vector<size_t> order(m_images.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) { return m_images[a].height > m_images[b].height; });
+        for (size_t i : order)
+        {
+            image& img = m_images[i];
+            if (img.ownsLayer)
+            {
+                img.region = TextureRegion{ m_nLayers++, glm::vec2{0.f}, glm::vec2{1.f} };
+                continue;
+            }
+            m_hasAtlas = true;
+            uint32_t slotWidth = align_up(img.width + s_padding*2, s_alignment);
+            uint32_t slotHeight = align_up(img.height + s_padding*2, s_alignment);
+            shelf* found = nullptr;
+            for (shelf& candidate : shelves)
+            {
+                if (slotHeight <= candidate.height && candidate.used + slotWidth <= m_layerSize)
+                {
+                    found = &candidate;
+                    break;
+                }
+            }
+            if (!found)
+            {
+                auto layer = std::find_if(layerTops.begin(), layerTops.end(),
+                    [&](const std::pair<uint32_t, uint32_t>& top) { return top.second + slotHeight <= m_layerSize; });
+                if (layer == layerTops.end())
+                {
+                    layerTops.emplace_back(m_nLayers++, 0);
+                    layer = layerTops.end() - 1;
+                }
+                shelves.push_back(shelf{ layer->first, layer->second, slotHeight, 0 });
+                layer->second += slotHeight;
+                found = &shelves.back();
+            }
+            img.x = found->used;
+            img.y = found->y;
+            img.region.layer = found->layer;
+            img.region.offset = glm::vec2{ (float)(img.x + s_padding) / m_layerSize, (float)(img.y + s_padding) / m_layerSize };
+            img.region.scale = glm::vec2{ (float)img.width / m_layerSize, (float)img.height / m_layerSize };
+            found->used += slotWidth;
+        }
+
+        m_pixels.assign((size_t)m_nLayers*m_layerSize*m_layerSize*4, 0);
+        for (const image& img : m_images)
+        {
+            if (img.ownsLayer)
+            {
+                copy(img, img.region.layer, 0, 0, m_layerSize, m_layerSize, 0);
+                continue;
+            }
+            // Fill the whole slot, so that the padding (and the alignment slack past it) repeats the image's edges.
+            uint32_t slotWidth = align_up(img.width + s_padding*2, s_alignment);
+            uint32_t slotHeight = align_up(img.height + s_padding*2, s_alignment);
+            copy(img, img.region.layer, img.x, img.y, slotWidth, slotHeight, s_padding);
+        }
+    }
+    uint32_t TexturePacker::GetLevelCount() const
+    {
+        uint32_t nLevels = GetMipCount(m_layerSize, m_layerSize);
+        if (!m_hasAtlas)
+            return nLevels;
+        uint32_t nAtlasLevels = 1;
+        for (uint32_t alignment = s_alignment; alignment > 1; alignment >>= 1)
+            nAtlasLevels++;
+        return std::min(nLevels, nAtlasLevels);
+    }
+    void RemapTextureCoords(std::vector<GLfloat>& textureCoords, const TextureRegion& region)
+    {
+        for (size_t i = 0; i + 1 < textureCoords.size(); i += 2)
+        {
+            textureCoords[i] = region.offset.x + textureCoords[i]*region.scale.x;
+            // Regions are measured from the layer's first row, which is where v = 1 (see mesh.vert).
+            textureCoords[i + 1] = 1.f - (region.offset.y + (1.f - textureCoords[i + 1])*region.scale.y);
+        }
+    }
+}
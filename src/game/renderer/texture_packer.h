@@ -0,0 +1,97 @@
+/*
+ * game/renderer/texture_packer.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace renderer
+{
+    // Where a packed image ended up: its layer, and the transform from its texture coordinates to the layer's.
+    struct TextureRegion
+    {
+        uint32_t layer = 0;
+        glm::vec2 offset{0.f};
+        glm::vec2 scale{1.f};
+    };
+
+    // Packs RGBA8 images into the layers of an array texture (see Texture::LoadLayers), so that draws using any of them
+    // share one texture bind and differ only by layer.
+    // Images the size of a layer get a layer of their own, and can repeat. Smaller images share layers as an atlas, padded
+    // with copies of their edges; their texture coordinates must stay within [0, 1], and be remapped with RemapTextureCoords.
+    // Does not touch the GL, so it can be used from any thread.
+    class TexturePacker final
+    {
+    public:
+        // 'layerSize' is the width and height of a layer, and is rounded up to a multiple of s_alignment.
+        explicit TexturePacker(uint32_t layerSize);
+        // Cannot be copied.
+        TexturePacker(const TexturePacker&) = delete;
+        TexturePacker& operator=(const TexturePacker&) = delete;
+        // Cannot be moved.
+        TexturePacker(TexturePacker&&) = delete;
+        TexturePacker& operator=(TexturePacker&&) = delete;
+
+        // Copies the image, and returns its index, or -1 if it doesn't fit in a layer, or if it repeats but isn't the size
+        // of a layer.
+        int Add(const uint8_t* pixels, uint32_t width, uint32_t height, bool repeats = false);
+        // Lays out every image added so far, and fills the layers.
+        void Pack();
+
+        // Only valid after Pack.
+        const TextureRegion& GetRegion(int image) const { return m_images[image].region; }
+        uint32_t GetLayerCount() const { return m_nLayers; }
+        uint32_t GetLayerSize() const { return m_layerSize; }
+        // The amount of mip levels that can be sampled before atlas images bleed into each other.
+        uint32_t GetLevelCount() const;
+        // Every layer's pixels, back to back.
+        std::vector<uint8_t>& GetPixels() { return m_pixels; }
+
+        // Edges are repeated this far around atlas images, so that filtering at their borders doesn't pick up their neighbours.
+        static constexpr uint32_t s_padding = 4;
+        // Atlas images start on multiples of this, so that the texels of the first log2(s_alignment) levels below the
+        // base level never average two images.
+        static constexpr uint32_t s_alignment = 8;
+    private:
+        struct image
+        {
+            std::vector<uint8_t> pixels;
+            uint32_t width = 0;
+            uint32_t height = 0;
+            bool ownsLayer = false;
+            TextureRegion region{};
+            // The top left of the image's slot, padding included.
+            uint32_t x = 0;
+            uint32_t y = 0;
+        };
+        // A row of atlas images, as tall as its tallest image.
+        struct shelf
+        {
+            uint32_t layer = 0;
+            uint32_t y = 0;
+            uint32_t height = 0;
+            uint32_t used = 0;
+        };
+        void copy(const image& from, uint32_t layer, uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t padding);
+
+        std::vector<image> m_images;
+        std::vector<uint8_t> m_pixels;
+        uint32_t m_layerSize = 0;
+        uint32_t m_nLayers = 0;
+        bool m_hasAtlas = false;
+    };
+
+    // Maps texture coordinates (two floats per vertex, as from LoadMesh, with v pointing up) from an image to the region it
+    // was packed into.
+    void RemapTextureCoords(std::vector<GLfloat>& textureCoords, const TextureRegion& region);
+}
@@ -12,6 +12,7 @@
 #include <glm/ext/matrix_float4x4.hpp>
 
 #include <renderer/vao.h>
+#include <renderer/state_cache.h>
 
 #include <cassert>
 #include <stdexcept>
@@ -35,7 +36,7 @@ namespace renderer
     {
         if (!m_initialized)
             return GL_FALSE;
-        glBindVertexArray(m_vao);
+        state::BindVertexArray(m_vao);
         return GL_TRUE;
     }
     GLint VAO::Render()
@@ -44,13 +45,9 @@ namespace renderer
             return GL_FALSE;
         if (Bind() == GL_FALSE)
             return GL_FALSE;
+        // Attribute arrays are enabled once, when each object is bound, and are remembered by the VAO.
         for (auto& i : m_objs)
-        {
-            glEnableVertexAttribArray(i->m_vaaIndex);
             i->Render();
-        }
-        for (auto& i : m_objs)
-            glDisableVertexAttribArray(i->m_vaaIndex);
         return GL_TRUE;
     }
     VAO::~VAO()
@@ -58,13 +55,17 @@ namespace renderer
         if (m_initialized)
         {
             m_objs.clear();
+            state::ForgetVertexArray(m_vao);
             glDeleteVertexArrays(1, &m_vao);
         }
     }
-    void RenderableObject::add_to_vao()
+    void RenderableObject::add_to_vao(bool front)
     {
         assert(m_vao);
-        m_vao->m_objs.push_back(this);
+        if (front)
+            m_vao->m_objs.push_front(this);
+        else
+            m_vao->m_objs.push_back(this);
     }
     void RenderableObject::remove_from_vao()
     {
@@ -26,9 +26,6 @@ namespace renderer
         virtual GLint Bind(class VAO& to) = 0;
         virtual GLint Render() = 0;
 
-        virtual void SetVAAIndex(GLuint vaaIndex) { m_vaaIndex = vaaIndex; };
-        virtual GLuint GetVAAIndex() const { return m_vaaIndex; };
-
         class VAO& GetVAO() const;
 
         virtual ~RenderableObject() {}
@@ -36,10 +33,8 @@ namespace renderer
     protected:
         class VAO* m_vao = nullptr;
         bool m_initialized;
-        // Set to 0xffffffff if unused.
-        // Enabled and disabled by VAO::Render.
-        GLuint m_vaaIndex; 
-        void add_to_vao();
+        // Objects are rendered in order; 'front' puts this object before every other object in the VAO.
+        void add_to_vao(bool front = false);
         void remove_from_vao();
     };
     class VAO
@@ -54,6 +49,8 @@ namespace renderer
         GLint Bind();
         GLint Render();
 
+        GLuint GetVertexArrayObject() const { return m_vao; }
+
         virtual ~VAO();
         friend class RenderableObject;
     private:
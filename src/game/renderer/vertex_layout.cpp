@@ -0,0 +1,165 @@
+/*
+ * game/renderer/vertex_layout.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <GL/glew.h>
+
+#include <glm/gtc/packing.hpp>
+
+#include <renderer/vertex_layout.h>
+#include <renderer/state_cache.h>
+
+#include <vector>
+
+namespace renderer
+{
+    static GLint attribute_components(VertexAttribute attribute)
+    {
+        switch (attribute)
+        {
+        case VertexAttribute::Position: return 3;
+        case VertexAttribute::Normal: return 3;
+        case VertexAttribute::TexCoord: return 2;
+        default: return 0;
+        }
+    }
+    static size_t format_size(VertexFormat format)
+    {
+        switch (format)
+        {
+        case VertexFormat::Float: return sizeof(GLfloat);
+        case VertexFormat::HalfFloat: return sizeof(GLhalf);
+        case VertexFormat::SNorm16: return sizeof(GLshort);
+        default: return 0;
+        }
+    }
+    static GLenum format_type(VertexFormat format)
+    {
+        switch (format)
+        {
+        case VertexFormat::Float: return GL_FLOAT;
+        case VertexFormat::HalfFloat: return GL_HALF_FLOAT;
+        case VertexFormat::SNorm16: return GL_SHORT;
+        default: return GL_FALSE;
+        }
+    }
+
+    VertexLayout& VertexLayout::Add(VertexAttribute attribute, GLuint location, VertexFormat format)
+    {
+        VertexAttributeDesc desc{};
+        desc.attribute = attribute;
+        desc.format = format;
+        desc.location = location;
+        desc.components = attribute_components(attribute);
+        desc.offset = m_stride;
+        size_t size = desc.components * format_size(format);
+        m_stride += (size + 3) & ~3;
+        m_attributes.push_back(desc);
+        return *this;
+    }
+    void VertexLayout::Apply() const
+    {
+        for (auto& i : m_attributes)
+        {
+            state::EnableVertexAttribArray(i.location);
+            glVertexAttribPointer(i.location, i.components, format_type(i.format),
+                i.format == VertexFormat::SNorm16, m_stride,
+                (void*)(uintptr_t)i.offset);
+        }
+    }
+    const VertexAttributeDesc* VertexLayout::Find(VertexAttribute attribute) const
+    {
+        for (auto& i : m_attributes)
+            if (i.attribute == attribute)
+                return &i;
+        return nullptr;
+    }
+    bool VertexLayout::operator==(const VertexLayout& other) const
+    {
+        if (m_stride != other.m_stride || m_attributes.size() != other.m_attributes.size())
+            return false;
+        for (size_t i = 0; i < m_attributes.size(); i++)
+        {
+            const VertexAttributeDesc& a = m_attributes[i];
+            const VertexAttributeDesc& b = other.m_attributes[i];
+            if (a.attribute != b.attribute || a.format != b.format || a.location != b.location ||
+                a.components != b.components || a.offset != b.offset)
+                return false;
+        }
+        return true;
+    }
+    VertexLayout VertexLayout::Packed()
+    {
+        VertexLayout layout;
+        layout.Add(VertexAttribute::Position, 0, VertexFormat::Float);
+        layout.Add(VertexAttribute::TexCoord, 1, VertexFormat::HalfFloat);
+        layout.Add(VertexAttribute::Normal, 2, VertexFormat::SNorm16);
+        return layout;
+    }
+    VertexLayout VertexLayout::Unpacked()
+    {
+        VertexLayout layout;
+        layout.Add(VertexAttribute::Position, 0, VertexFormat::Float);
+        layout.Add(VertexAttribute::TexCoord, 1, VertexFormat::Float);
+        layout.Add(VertexAttribute::Normal, 2, VertexFormat::Float);
+        return layout;
+    }
+
+    static void pack_attribute(uint8_t* to, const VertexAttributeDesc& desc, const GLfloat* from)
+    {
+        for (GLint i = 0; i < desc.components; i++)
+        {
+            switch (desc.format)
+            {
+            case VertexFormat::Float:
+                memcpy(to + i*sizeof(GLfloat), &from[i], sizeof(GLfloat));
+                break;
+            case VertexFormat::HalfFloat:
+            {
+                GLhalf half = glm::packHalf1x16(from[i]);
+                memcpy(to + i*sizeof(GLhalf), &half, sizeof(GLhalf));
+                break;
+            }
+            case VertexFormat::SNorm16:
+            {
+                uint16_t snorm = glm::packSnorm1x16(from[i]);
+                memcpy(to + i*sizeof(GLshort), &snorm, sizeof(GLshort));
+                break;
+            }
+            }
+        }
+    }
+    std::vector<uint8_t> PackVertices(
+        const VertexLayout& layout,
+        const std::vector<GLfloat>& positions,
+        const std::vector<GLfloat>& normals,
+        const std::vector<GLfloat>& textureCoords
+    )
+    {
+        size_t nVertices = positions.size() / 3;
+        std::vector<uint8_t> buffer(nVertices * layout.GetStride());
+        for (auto& desc : layout.GetAttributes())
+        {
+            const std::vector<GLfloat>* stream = nullptr;
+            switch (desc.attribute)
+            {
+            case VertexAttribute::Position: stream = &positions; break;
+            case VertexAttribute::Normal: stream = &normals; break;
+            case VertexAttribute::TexCoord: stream = &textureCoords; break;
+            }
+            if (stream->size() < nVertices * desc.components)
+                continue; // Missing; leave it zeroed.
+            uint8_t* out = buffer.data() + desc.offset;
+            const GLfloat* in = stream->data();
+            for (size_t i = 0; i < nVertices; i++, out += layout.GetStride(), in += desc.components)
+                pack_attribute(out, desc, in);
+        }
+        return buffer;
+    }
+}
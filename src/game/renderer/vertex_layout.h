@@ -0,0 +1,79 @@
+/*
+ * game/renderer/vertex_layout.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#include <vector>
+
+namespace renderer
+{
+    enum class VertexAttribute
+    {
+        Position, Normal, TexCoord,
+        MaxValue = TexCoord
+    };
+    enum class VertexFormat
+    {
+        Float,
+        HalfFloat,
+        // Signed, normalized 16-bit integers, for values in [-1,1] (e.g., normals).
+        SNorm16,
+    };
+    struct VertexAttributeDesc
+    {
+        VertexAttribute attribute;
+        VertexFormat format;
+        GLuint location;
+        GLint components;
+        GLuint offset; // In bytes, from the start of the vertex.
+    };
+
+    // Describes an interleaved vertex, with every attribute in one buffer.
+    class VertexLayout final
+    {
+    public:
+        VertexLayout() = default;
+
+        // Appends an attribute to the vertex.
+        // Every attribute is padded to four bytes.
+        VertexLayout& Add(VertexAttribute attribute, GLuint location, VertexFormat format);
+
+        // Records the attribute formats in the currently bound VAO, sourcing from the buffer currently bound to
+        // GL_ARRAY_BUFFER.
+        void Apply() const;
+
+        GLsizei GetStride() const { return m_stride; }
+        const std::vector<VertexAttributeDesc>& GetAttributes() const { return m_attributes; }
+        const VertexAttributeDesc* Find(VertexAttribute attribute) const;
+        // Whether both layouts describe the same vertex.
+        bool operator==(const VertexLayout& other) const;
+
+        // Position as floats at location 0, UVs as half-floats at location 1, and normals as SNorm16 at location 2.
+        // 24 bytes per vertex.
+        static VertexLayout Packed();
+        // Everything as floats, for when precision matters more than size.
+        // 32 bytes per vertex.
+        static VertexLayout Unpacked();
+    private:
+        std::vector<VertexAttributeDesc> m_attributes{};
+        GLsizei m_stride = 0;
+    };
+
+    // Interleaves the vertex streams into one buffer, following 'layout'.
+    // 'positions' and 'normals' have three floats per vertex, and 'textureCoords' has two.
+    // Streams the layout does not have are ignored, and attributes missing from the streams are zeroed.
+    std::vector<uint8_t> PackVertices(
+        const VertexLayout& layout,
+        const std::vector<GLfloat>& positions,
+        const std::vector<GLfloat>& normals,
+        const std::vector<GLfloat>& textureCoords
+    );
+}
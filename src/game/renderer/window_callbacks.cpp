@@ -27,6 +27,6 @@ namespace renderer
     {
         glViewport(0,0, width, height);
         // Recalculate the projection matrix.
-        ProjectionMatrix = glm::perspective(glm::radians(g_fov), (float)width/(float)height, 0.1f, 100.0f);
+        UpdateProjectionMatrix(width, height);
     }
 }
\ No newline at end of file
@@ -0,0 +1,384 @@
+/*
+ * game/scene/bvh.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <scene/bvh.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace scene
+{
+    // The number of bins the centroids are sorted into when looking for the best split.
+    static constexpr size_t s_nBins = 16;
+    // The cost of visiting a node, relative to testing an object.
+    static constexpr float s_traversalCost = 1.f;
+    // Bounds the traversal stacks. Nodes this deep become leaves, however many objects they have.
+    static constexpr uint32_t s_maxDepth = 48;
+
+    static float surface_area(const glm::vec3& min, const glm::vec3& max)
+    {
+        glm::vec3 size = max - min;
+        return 2.f * (size.x*size.y + size.y*size.z + size.z*size.x);
+    }
+    static bool overlaps(const glm::vec3& minA, const glm::vec3& maxA, const glm::vec3& minB, const glm::vec3& maxB)
+    {
+        return minA.x <= maxB.x && maxA.x >= minB.x &&
+               minA.y <= maxB.y && maxA.y >= minB.y &&
+               minA.z <= maxB.z && maxA.z >= minB.z;
+    }
+    // Slab test. Returns the distance to the box along the ray, or infinity if it is missed.
+    static float intersect_ray(const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, const glm::vec3& min, const glm::vec3& max)
+    {
+        float tNear = 0, tFar = maxDistance;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float t1 = (min[axis] - origin[axis]) * inverseDirection[axis];
+            float t2 = (max[axis] - origin[axis]) * inverseDirection[axis];
+            // A zero direction gives infinities, or NaNs on a slab boundary, which min/max's argument order discards.
+            tNear = std::max(tNear, std::min(t1, t2));
+            tFar = std::min(tFar, std::max(t1, t2));
+        }
+        return tNear <= tFar ? tNear : std::numeric_limits<float>::infinity();
+    }
+
+    void BVH::Build(const std::vector<renderer::Bounds>& bounds)
+    {
+        Clear();
+        if (bounds.empty())
+            return;
+        const size_t count = bounds.size();
+        m_objects.resize(count);
+        m_objectMin.resize(count);
+        m_objectMax.resize(count);
+        m_centroids.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            m_objects[i] = i;
+            m_objectMin[i] = bounds[i].min;
+            m_objectMax[i] = bounds[i].max;
+            m_centroids[i] = (bounds[i].min + bounds[i].max) * 0.5f;
+        }
+        // A binary tree with at least one object per leaf has at most 2n-1 nodes.
+        m_nodes.reserve(count*2 - 1);
+        node root{};
+        root.first = 0;
+        root.count = count;
+        m_nodes.push_back(root);
+        update_node_bounds(0);
+        subdivide(0, 0);
+        m_nodes.shrink_to_fit();
+        m_centroids.clear();
+        m_centroids.shrink_to_fit();
+    }
+    void BVH::update_node_bounds(uint32_t index)
+    {
+        node& current = m_nodes[index];
+        current.min = glm::vec3(std::numeric_limits<float>::infinity());
+        current.max = glm::vec3(-std::numeric_limits<float>::infinity());
+        for (uint32_t i = current.first; i < current.first + current.count; i++)
+        {
+            current.min = glm::min(current.min, m_objectMin[m_objects[i]]);
+            current.max = glm::max(current.max, m_objectMax[m_objects[i]]);
+        }
+    }
+    void BVH::subdivide(uint32_t index, uint32_t depth)
+    {
+        const uint32_t first = m_nodes[index].first;
+        const uint32_t count = m_nodes[index].count;
+        if (count <= 1 || depth >= s_maxDepth)
+            return;
+
+        glm::vec3 centroidMin{ std::numeric_limits<float>::infinity() };
+        glm::vec3 centroidMax{ -std::numeric_limits<float>::infinity() };
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            centroidMin = glm::min(centroidMin, m_centroids[m_objects[i]]);
+            centroidMax = glm::max(centroidMax, m_centroids[m_objects[i]]);
+        }
+
+        // Find the cheapest split plane among the bin boundaries of every axis.
+        int bestAxis = -1;
+        size_t bestSplit = 0;
+        float bestCost = std::numeric_limits<float>::infinity();
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float extent = centroidMax[axis] - centroidMin[axis];
+            if (extent <= 0)
+                continue;
+            struct bin
+            {
+                glm::vec3 min{ std::numeric_limits<float>::infinity() };
+                glm::vec3 max{ -std::numeric_limits<float>::infinity() };
+                uint32_t count = 0;
+            } bins[s_nBins];
+            const float scale = s_nBins / extent;
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                uint32_t object = m_objects[i];
+                size_t binIndex = std::min(s_nBins - 1, (size_t)((m_centroids[object][axis] - centroidMin[axis]) * scale));
+                bins[binIndex].count++;
+                bins[binIndex].min = glm::min(bins[binIndex].min, m_objectMin[object]);
+                bins[binIndex].max = glm::max(bins[binIndex].max, m_objectMax[object]);
+            }
+            // Sweep from both sides to get the area and count left and right of every boundary.
+            float leftArea[s_nBins - 1], rightArea[s_nBins - 1];
+            uint32_t leftCount[s_nBins - 1], rightCount[s_nBins - 1];
+            bin left{}, right{};
+            for (size_t i = 0; i < s_nBins - 1; i++)
+            {
+                left.count += bins[i].count;
+                left.min = glm::min(left.min, bins[i].min);
+                left.max = glm::max(left.max, bins[i].max);
+                leftCount[i] = left.count;
+                leftArea[i] = left.count ? surface_area(left.min, left.max) : 0;
+                size_t j = s_nBins - 1 - i;
+                right.count += bins[j].count;
+                right.min = glm::min(right.min, bins[j].min);
+                right.max = glm::max(right.max, bins[j].max);
+                rightCount[j - 1] = right.count;
+                rightArea[j - 1] = right.count ? surface_area(right.min, right.max) : 0;
+            }
+            for (size_t i = 0; i < s_nBins - 1; i++)
+            {
+                if (!leftCount[i] || !rightCount[i])
+                    continue;
+                float cost = leftCount[i]*leftArea[i] + rightCount[i]*rightArea[i];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+
+        node& current = m_nodes[index];
+        float nodeArea = surface_area(current.min, current.max);
+        float leafCost = count * nodeArea;
+        float splitCost = s_traversalCost * nodeArea + bestCost;
+        uint32_t middle = first;
+        if (bestAxis >= 0)
+        {
+            if (count <= MaxLeafSize && splitCost >= leafCost)
+                return;
+            const float scale = s_nBins / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+            uint32_t* begin = m_objects.data() + first;
+            uint32_t* split = std::partition(begin, begin + count, [&](uint32_t object) {
+                size_t binIndex = std::min(s_nBins - 1, (size_t)((m_centroids[object][bestAxis] - centroidMin[bestAxis]) * scale));
+                return binIndex <= bestSplit;
+            });
+            middle = split - m_objects.data();
+        }
+        else
+        {
+            // Every centroid is in the same place, so no plane separates them.
+            if (count <= MaxLeafSize)
+                return;
+            middle = first + count/2;
+        }
+
+        uint32_t leftIndex = m_nodes.size();
+        node left{}, right{};
+        left.first = first;
+        left.count = middle - first;
+        right.first = middle;
+        right.count = count - left.count;
+        m_nodes.push_back(left);
+        m_nodes.push_back(right);
+        // push_back may have moved the nodes.
+        m_nodes[index].first = leftIndex;
+        m_nodes[index].count = 0;
+        update_node_bounds(leftIndex);
+        update_node_bounds(leftIndex + 1);
+        subdivide(leftIndex, depth + 1);
+        subdivide(leftIndex + 1, depth + 1);
+    }
+    bool BVH::Refit(const std::vector<renderer::Bounds>& bounds)
+    {
+        if (bounds.size() != m_objects.size())
+            return false;
+        for (size_t i = 0; i < bounds.size(); i++)
+        {
+            m_objectMin[i] = bounds[i].min;
+            m_objectMax[i] = bounds[i].max;
+        }
+        // Children always come after their parents, so walking backwards visits them first.
+        for (size_t i = m_nodes.size(); i-- > 0; )
+        {
+            node& current = m_nodes[i];
+            if (current.IsLeaf())
+            {
+                update_node_bounds(i);
+                continue;
+            }
+            const node& left = m_nodes[current.first];
+            const node& right = m_nodes[current.first + 1];
+            current.min = glm::min(left.min, right.min);
+            current.max = glm::max(left.max, right.max);
+        }
+        return true;
+    }
+    void BVH::Clear()
+    {
+        m_nodes.clear();
+        m_objects.clear();
+        m_objectMin.clear();
+        m_objectMax.clear();
+        m_centroids.clear();
+    }
+
+    void BVH::QueryFrustum(const renderer::Frustum& frustum, std::vector<uint32_t>& visible, renderer::CullingStats* stats) const
+    {
+        visible.clear();
+        if (!m_nodes.empty())
+        {
+            constexpr uint8_t allPlanes = (1 << renderer::Frustum::PlaneCount) - 1;
+            // Each entry carries the planes its parent was not fully inside of;
+            // once a node is inside every plane, its subtree is accepted without further tests.
+            std::pair<uint32_t, uint8_t> stack[64];
+            size_t top = 0;
+            stack[top++] = { 0, allPlanes };
+            while (top)
+            {
+                auto [index, planeMask] = stack[--top];
+                const node& current = m_nodes[index];
+                glm::vec3 center = (current.min + current.max) * 0.5f;
+                glm::vec3 extent = (current.max - current.min) * 0.5f;
+                bool outside = false;
+                for (int plane = 0; plane < renderer::Frustum::PlaneCount && !outside; plane++)
+                {
+                    if (!(planeMask & (1 << plane)))
+                        continue;
+                    const glm::vec4& p = frustum.planes[plane];
+                    float distance = p.x*center.x + p.y*center.y + p.z*center.z + p.w;
+                    float radius = std::fabs(p.x)*extent.x + std::fabs(p.y)*extent.y + std::fabs(p.z)*extent.z;
+                    if (distance < -radius)
+                        outside = true;
+                    else if (distance >= radius)
+                        planeMask &= ~(1 << plane);
+                }
+                if (outside)
+                    continue;
+                if (current.IsLeaf())
+                {
+                    for (uint32_t i = current.first; i < current.first + current.count; i++)
+                    {
+                        uint32_t object = m_objects[i];
+                        if (planeMask && current.count > 1)
+                        {
+                            // The leaf straddles a plane, so test its objects individually.
+                            glm::vec3 objectCenter = (m_objectMin[object] + m_objectMax[object]) * 0.5f;
+                            glm::vec3 objectExtent = (m_objectMax[object] - m_objectMin[object]) * 0.5f;
+                            bool objectOutside = false;
+                            for (int plane = 0; plane < renderer::Frustum::PlaneCount && !objectOutside; plane++)
+                            {
+                                if (!(planeMask & (1 << plane)))
+                                    continue;
+                                const glm::vec4& p = frustum.planes[plane];
+                                float distance = p.x*objectCenter.x + p.y*objectCenter.y + p.z*objectCenter.z + p.w;
+                                float radius = std::fabs(p.x)*objectExtent.x + std::fabs(p.y)*objectExtent.y + std::fabs(p.z)*objectExtent.z;
+                                objectOutside = distance < -radius;
+                            }
+                            if (objectOutside)
+                                continue;
+                        }
+                        visible.push_back(object);
+                    }
+                    continue;
+                }
+                stack[top++] = { current.first + 1, planeMask };
+                stack[top++] = { current.first, planeMask };
+            }
+        }
+        if (stats)
+        {
+            stats->tested = m_objects.size();
+            stats->visible = visible.size();
+            stats->culled = m_objects.size() - visible.size();
+        }
+    }
+    bool BVH::Raycast(const Ray& ray, RayHit& hit, float maxDistance) const
+    {
+        if (m_nodes.empty())
+            return false;
+        const glm::vec3 inverseDirection = 1.f / ray.direction;
+        const float infinity = std::numeric_limits<float>::infinity();
+        float closest = maxDistance;
+        bool found = false;
+        if (intersect_ray(ray.origin, inverseDirection, closest, m_nodes[0].min, m_nodes[0].max) == infinity)
+            return false;
+        uint32_t stack[64];
+        size_t top = 0;
+        stack[top++] = 0;
+        while (top)
+        {
+            const node& current = m_nodes[stack[--top]];
+            if (current.IsLeaf())
+            {
+                for (uint32_t i = current.first; i < current.first + current.count; i++)
+                {
+                    uint32_t object = m_objects[i];
+                    float distance = intersect_ray(ray.origin, inverseDirection, closest, m_objectMin[object], m_objectMax[object]);
+                    if (distance != infinity && (distance < closest || !found))
+                    {
+                        closest = distance;
+                        hit.object = object;
+                        hit.distance = distance;
+                        found = true;
+                    }
+                }
+                continue;
+            }
+            // Visit the nearer child first, so that the farther one can be skipped if something closer was hit.
+            uint32_t near = current.first, far = current.first + 1;
+            float nearDistance = intersect_ray(ray.origin, inverseDirection, closest, m_nodes[near].min, m_nodes[near].max);
+            float farDistance = intersect_ray(ray.origin, inverseDirection, closest, m_nodes[far].min, m_nodes[far].max);
+            if (farDistance < nearDistance)
+            {
+                std::swap(near, far);
+                std::swap(nearDistance, farDistance);
+            }
+            if (farDistance != infinity)
+                stack[top++] = far;
+            if (nearDistance != infinity)
+                stack[top++] = near;
+        }
+        return found;
+    }
+    void BVH::QueryOverlap(const glm::vec3& min, const glm::vec3& max, std::vector<uint32_t>& objects) const
+    {
+        objects.clear();
+        if (m_nodes.empty())
+            return;
+        uint32_t stack[64];
+        size_t top = 0;
+        stack[top++] = 0;
+        while (top)
+        {
+            const node& current = m_nodes[stack[--top]];
+            if (!overlaps(current.min, current.max, min, max))
+                continue;
+            if (current.IsLeaf())
+            {
+                for (uint32_t i = current.first; i < current.first + current.count; i++)
+                {
+                    uint32_t object = m_objects[i];
+                    if (overlaps(m_objectMin[object], m_objectMax[object], min, max))
+                        objects.push_back(object);
+                }
+                continue;
+            }
+            stack[top++] = current.first + 1;
+            stack[top++] = current.first;
+        }
+    }
+}
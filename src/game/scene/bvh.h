@@ -0,0 +1,83 @@
+/*
+ * game/scene/bvh.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <renderer/bounds.h>
+#include <renderer/culling.h>
+
+namespace scene
+{
+    struct Ray
+    {
+        glm::vec3 origin{0};
+        // Does not need to be normalized, distances are in multiples of it.
+        glm::vec3 direction{0,0,-1};
+    };
+    struct RayHit
+    {
+        uint32_t object = 0;
+        float distance = 0;
+    };
+
+    // A bounding volume hierarchy over the world-space boxes of scene objects.
+    // Objects are referred to by their index in the array passed to Build.
+    class BVH final
+    {
+    public:
+        BVH() = default;
+
+        // Builds the tree with the surface area heuristic.
+        void Build(const std::vector<renderer::Bounds>& bounds);
+        // Updates the boxes of the tree for objects that moved, without changing its topology.
+        // 'bounds' must have as many objects as the array the tree was built from.
+        // Cheap, but the tree degrades as objects move far from where they were at build time.
+        bool Refit(const std::vector<renderer::Bounds>& bounds);
+        void Clear();
+
+        // Writes every object whose box intersects the frustum to 'visible'.
+        void QueryFrustum(const renderer::Frustum& frustum, std::vector<uint32_t>& visible, renderer::CullingStats* stats = nullptr) const;
+        // Finds the closest object whose box is hit by the ray. Returns false if there is none.
+        bool Raycast(const Ray& ray, RayHit& hit, float maxDistance = std::numeric_limits<float>::infinity()) const;
+        // Writes every object whose box overlaps 'min'-'max' to 'objects'.
+        void QueryOverlap(const glm::vec3& min, const glm::vec3& max, std::vector<uint32_t>& objects) const;
+
+        size_t GetObjectCount() const { return m_objects.size(); }
+        size_t GetNodeCount() const { return m_nodes.size(); }
+
+        static constexpr size_t MaxLeafSize = 4;
+
+    private:
+        struct node
+        {
+            glm::vec3 min{0};
+            // The first object index in m_objects if a leaf, otherwise the index of the left child.
+            // The right child always follows the left one.
+            uint32_t first = 0;
+            glm::vec3 max{0};
+            uint32_t count = 0;
+            bool IsLeaf() const { return count != 0; }
+        };
+        void update_node_bounds(uint32_t index);
+        void subdivide(uint32_t index, uint32_t depth);
+
+        std::vector<node> m_nodes;
+        // Object indices, ordered so that each leaf refers to a contiguous range.
+        std::vector<uint32_t> m_objects;
+        // Boxes of the objects, indexed by object.
+        std::vector<glm::vec3> m_objectMin, m_objectMax;
+        // Only needed while building.
+        std::vector<glm::vec3> m_centroids;
+    };
+}
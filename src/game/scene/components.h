@@ -0,0 +1,56 @@
+/*
+ * game/scene/components.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+#include <renderer/bounds.h>
+
+#include <scene/transform_hierarchy.h>
+
+// The components of scene entities (see ecs::World), and what the scene's systems (see scene/systems.h) do with them.
+
+namespace scene
+{
+    // The entity's node in the scene's TransformHierarchy, which owns its local transform and parent.
+    struct TransformComponent
+    {
+        uint32_t node = TransformHierarchy::InvalidNode;
+    };
+    // The node's world matrix, copied out of the hierarchy by UpdateTransforms().
+    struct WorldTransformComponent
+    {
+        glm::mat4 world{ 1.f };
+    };
+    // 'world' is 'local' transformed by the entity's world matrix, by UpdateBounds().
+    struct BoundsComponent
+    {
+        renderer::Bounds local{};
+        renderer::Bounds world{};
+    };
+    // A static batch mesh, drawn at the level of detail CollectRenderables() last chose for it.
+    struct RenderableComponent
+    {
+        int32_t mesh = -1;
+        uint32_t lod = 0;
+        // The entity's object in the scene BVH.
+        uint32_t object = UINT32_MAX;
+    };
+    // Follows the camera controls (see renderer/controls.h), through UpdateCameras().
+    struct CameraComponent
+    {
+        glm::vec3 position{ 0, 0, 0 };
+        glm::vec3 direction{ 0, 0, 1 };
+        float speed = 0;
+        // Vertical, in degrees.
+        float fov = 70;
+        glm::mat4 viewProjection{ 1.f };
+    };
+}
@@ -0,0 +1,115 @@
+/*
+ * game/scene/systems.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <renderer/bounds.h>
+#include <renderer/controls.h>
+#include <renderer/culling.h>
+#include <renderer/lod.h>
+
+#include <scene/systems.h>
+
+namespace scene
+{
+    // Entities per job; copying a matrix is cheap, so ranges need to be large to be worth a job.
+    static constexpr size_t s_grainSize = 4096;
+
+    size_t UpdateTransforms(ecs::World& world, TransformHierarchy& hierarchy, jobs::JobSystem& jobSystem)
+    {
+        size_t nUpdated = hierarchy.Update();
+        world.ParallelEach<const TransformComponent, WorldTransformComponent>(jobSystem, s_grainSize,
+            [&hierarchy](ecs::Entity, const TransformComponent& transform, WorldTransformComponent& worldTransform) {
+                worldTransform.world = hierarchy.GetWorld(transform.node);
+            });
+        return nUpdated;
+    }
+    void UpdateBounds(ecs::World& world, jobs::JobSystem& jobSystem)
+    {
+        world.ParallelEach<const WorldTransformComponent, BoundsComponent>(jobSystem, s_grainSize,
+            [](ecs::Entity, const WorldTransformComponent& worldTransform, BoundsComponent& bounds) {
+                bounds.world = renderer::TransformBounds(bounds.local, worldTransform.world);
+            });
+    }
+    void UpdateCameras(ecs::World& world)
+    {
+        world.Each<CameraComponent>([](ecs::Entity, CameraComponent& camera) {
+            camera.position = renderer::g_position;
+            camera.direction = renderer::g_direction;
+            camera.speed = renderer::g_speed;
+            camera.fov = renderer::g_fov;
+            camera.viewProjection = renderer::ProjectionMatrix*renderer::ViewMatrix;
+        });
+    }
+
+    void CollectRenderables(ecs::World& world, const BVH& bvh, const std::vector<ecs::Entity>& objects,
+        const CameraComponent& camera, const renderer::StaticBatch& batch, int viewportHeight, sim::RenderPacket& packet)
+    {
+        struct visible_object
+        {
+            uint32_t object;
+            float distance;
+            RenderableComponent* renderable;
+            const WorldTransformComponent* transform;
+            float radius;
+        };
+        std::vector<uint32_t>& visible = packet.visible;
+        bvh.QueryFrustum(renderer::ExtractFrustum(camera.viewProjection), visible, &packet.culling);
+        // The components are looked up once per visible object, rather than on every comparison.
+        std::vector<visible_object> found;
+        found.reserve(visible.size());
+        for (uint32_t object : visible)
+        {
+            ecs::Entity entity = objects[object];
+            RenderableComponent* renderable = world.Get<RenderableComponent>(entity);
+            const WorldTransformComponent* transform = world.Get<WorldTransformComponent>(entity);
+            const BoundsComponent* bounds = world.Get<BoundsComponent>(entity);
+            if (!renderable || !transform || !bounds || renderable->mesh < 0)
+                continue;
+            found.push_back(visible_object{ object, glm::length(bounds->world.center - camera.position), renderable, transform, bounds->world.radius });
+        }
+        // Instances are drawn in order, so order them front to back as well.
+        std::sort(found.begin(), found.end(), [](const visible_object& a, const visible_object& b) { return a.distance < b.distance; });
+        // The texture needs as much detail as the nearest object takes up on screen.
+        if (!found.empty())
+        {
+            packet.nearestDistance = found.front().distance;
+            packet.nearestScreenSize = found.front().radius * viewportHeight /
+                (packet.nearestDistance * std::tan(glm::radians(camera.fov) * 0.5f));
+        }
+
+        // Each mesh's level of detail is its own indirect command, so group the instances by both, keeping them front
+        // to back.
+        float lodScale = renderer::GetLodScale(glm::radians(camera.fov), viewportHeight);
+        for (visible_object& object : found)
+        {
+            // The levels' errors are in object space, so scaled objects are as detailed as unscaled ones that much nearer.
+            float scale = renderer::GetMaxScale(object.transform->world);
+            float distance = scale > 0 ? object.distance / scale : object.distance;
+            object.renderable->lod = renderer::SelectLod(batch.GetLods(object.renderable->mesh), distance, lodScale, object.renderable->lod);
+        }
+        std::stable_sort(found.begin(), found.end(), [](const visible_object& a, const visible_object& b) {
+            if (a.renderable->mesh != b.renderable->mesh)
+                return a.renderable->mesh < b.renderable->mesh;
+            return a.renderable->lod < b.renderable->lod;
+        });
+        visible.clear();
+        for (const visible_object& object : found)
+        {
+            visible.push_back(object.object);
+            packet.transforms.push_back(object.transform->world);
+            packet.meshes.push_back(object.renderable->mesh);
+            packet.lods.push_back(object.renderable->lod);
+        }
+    }
+}
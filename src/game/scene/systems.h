@@ -0,0 +1,38 @@
+/*
+ * game/scene/systems.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <ecs/world.h>
+#include <jobs/job_system.h>
+
+#include <renderer/static_batch.h>
+
+#include <scene/bvh.h>
+#include <scene/components.h>
+#include <scene/transform_hierarchy.h>
+
+#include <sim/frame_pipeline.h>
+
+namespace scene
+{
+    // Updates the hierarchy, then copies every TransformComponent's world matrix into its WorldTransformComponent.
+    // Returns the amount of hierarchy nodes recomputed, i.e., zero if nothing moved.
+    size_t UpdateTransforms(ecs::World& world, TransformHierarchy& hierarchy, jobs::JobSystem& jobSystem);
+    // Moves every BoundsComponent to where its WorldTransformComponent puts it.
+    void UpdateBounds(ecs::World& world, jobs::JobSystem& jobSystem);
+    // Copies the camera's current (interpolated) state into every CameraComponent.
+    void UpdateCameras(ecs::World& world);
+    // The render system: culls the RenderableComponents through the BVH, whose object i is 'objects[i]', picks their
+    // levels of detail, and writes what the GL thread draws (and the nearest object's distance and size) to 'packet'.
+    void CollectRenderables(ecs::World& world, const BVH& bvh, const std::vector<ecs::Entity>& objects,
+        const CameraComponent& camera, const renderer::StaticBatch& batch, int viewportHeight, sim::RenderPacket& packet);
+}
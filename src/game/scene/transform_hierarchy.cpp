@@ -0,0 +1,311 @@
+/*
+ * game/scene/transform_hierarchy.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+#   include <xmmintrin.h>
+#   define SCENE_SSE 1
+#endif
+
+#include <scene/transform_hierarchy.h>
+
+namespace scene
+{
+#ifdef SCENE_SSE
+    // One column of left*right: the left matrix's columns, weighted by the right column's elements.
+    static inline __m128 multiply_column(const __m128 (&left)[4], const float* right)
+    {
+        __m128 column = _mm_mul_ps(left[0], _mm_set1_ps(right[0]));
+        column = _mm_add_ps(column, _mm_mul_ps(left[1], _mm_set1_ps(right[1])));
+        column = _mm_add_ps(column, _mm_mul_ps(left[2], _mm_set1_ps(right[2])));
+        column = _mm_add_ps(column, _mm_mul_ps(left[3], _mm_set1_ps(right[3])));
+        return column;
+    }
+    static inline void multiply(const __m128 (&left)[4], const glm::mat4& right, glm::mat4& out)
+    {
+        // Every column is computed before any is stored, so that 'out' can alias 'right'.
+        const float* from = &right[0][0];
+        __m128 c0 = multiply_column(left, from);
+        __m128 c1 = multiply_column(left, from + 4);
+        __m128 c2 = multiply_column(left, from + 8);
+        __m128 c3 = multiply_column(left, from + 12);
+        float* to = &out[0][0];
+        _mm_storeu_ps(to, c0);
+        _mm_storeu_ps(to + 4, c1);
+        _mm_storeu_ps(to + 8, c2);
+        _mm_storeu_ps(to + 12, c3);
+    }
+    static inline void load(const glm::mat4& matrix, __m128 (&columns)[4])
+    {
+        const float* from = &matrix[0][0];
+        for (int i = 0; i < 4; i++)
+            columns[i] = _mm_loadu_ps(from + i*4);
+    }
+#endif
+    void MultiplyMatrix(const glm::mat4& a, const glm::mat4& b, glm::mat4& out)
+    {
+#ifdef SCENE_SSE
+        __m128 left[4];
+        load(a, left);
+        multiply(left, b, out);
+#else
+        out = a * b;
+#endif
+    }
+    void MultiplyMatrices(const glm::mat4& left, const glm::mat4* right, glm::mat4* out, size_t count)
+    {
+#ifdef SCENE_SSE
+        // The left matrix stays in registers for the whole batch.
+        __m128 columns[4];
+        load(left, columns);
+        for (size_t i = 0; i < count; i++)
+            multiply(columns, right[i], out[i]);
+#else
+        for (size_t i = 0; i < count; i++)
+            out[i] = left * right[i];
+#endif
+    }
+    Transform DecomposeTransform(const glm::mat4& matrix)
+    {
+        Transform transform{};
+        transform.position = glm::vec3(matrix[3]);
+        glm::mat3 rotation{ matrix };
+        for (int i = 0; i < 3; i++)
+        {
+            transform.scale[i] = glm::length(rotation[i]);
+            if (transform.scale[i] > 0)
+                rotation[i] /= transform.scale[i];
+        }
+        // A mirrored basis isn't a rotation; fold the mirroring into the scale.
+        if (glm::dot(glm::cross(rotation[0], rotation[1]), rotation[2]) < 0)
+        {
+            transform.scale.x = -transform.scale.x;
+            rotation[0] = -rotation[0];
+        }
+        transform.rotation = glm::normalize(glm::quat_cast(rotation));
+        return transform;
+    }
+    glm::mat4 ComposeTransform(const Transform& transform)
+    {
+        const glm::quat& q = transform.rotation;
+        const glm::vec3& s = transform.scale;
+        float xx = q.x*q.x, yy = q.y*q.y, zz = q.z*q.z;
+        float xy = q.x*q.y, xz = q.x*q.z, yz = q.y*q.z;
+        float wx = q.w*q.x, wy = q.w*q.y, wz = q.w*q.z;
+        return glm::mat4(
+            glm::vec4(1 - 2*(yy + zz), 2*(xy + wz), 2*(xz - wy), 0) * s.x,
+            glm::vec4(2*(xy - wz), 1 - 2*(xx + zz), 2*(yz + wx), 0) * s.y,
+            glm::vec4(2*(xz + wy), 2*(yz - wx), 1 - 2*(xx + yy), 0) * s.z,
+            glm::vec4(transform.position, 1)
+        );
+    }
+
+    uint32_t TransformHierarchy::Add(const Transform& local, uint32_t parent)
+    {
+        uint32_t index = m_parents.size();
+        uint32_t id = 0;
+        if (!m_freeIds.empty())
+        {
+            id = m_freeIds.back();
+            m_freeIds.pop_back();
+            m_indices[id] = index;
+        }
+        else
+        {
+            id = m_indices.size();
+            m_indices.push_back(index);
+        }
+        m_positions.push_back(local.position);
+        m_rotations.push_back(local.rotation);
+        m_scales.push_back(local.scale);
+        // The parent already exists, so it's before the new node.
+        m_parents.push_back(IsValid(parent) ? m_indices[parent] : InvalidNode);
+        m_worlds.push_back(glm::mat4(1.f));
+        m_dirty.push_back(0);
+        m_ids.push_back(id);
+        mark_dirty(index);
+        return id;
+    }
+    void TransformHierarchy::Remove(uint32_t node)
+    {
+        if (!IsValid(node))
+            return;
+        // Descendants are found in one pass from the node on, which needs parents before children.
+        if (m_needsSort)
+            sort();
+        size_t first = m_indices[node];
+        std::vector<uint8_t> removed(m_parents.size() - first, 0);
+        removed[0] = 1;
+        for (size_t i = first + 1; i < m_parents.size(); i++)
+            removed[i - first] = m_parents[i] != InvalidNode && m_parents[i] >= first && removed[m_parents[i] - first];
+        // Compact everything after the node, keeping the order; nodes before it keep their positions.
+        std::vector<uint32_t> newIndices(m_parents.size() - first, InvalidNode);
+        size_t to = first;
+        for (size_t i = first; i < m_parents.size(); i++)
+        {
+            if (removed[i - first])
+            {
+                m_freeIds.push_back(m_ids[i]);
+                m_indices[m_ids[i]] = InvalidNode;
+                continue;
+            }
+            newIndices[i - first] = to;
+            m_positions[to] = m_positions[i];
+            m_rotations[to] = m_rotations[i];
+            m_scales[to] = m_scales[i];
+            m_parents[to] = m_parents[i] == InvalidNode || m_parents[i] < first ? m_parents[i] : newIndices[m_parents[i] - first];
+            m_worlds[to] = m_worlds[i];
+            m_dirty[to] = m_dirty[i];
+            m_ids[to] = m_ids[i];
+            m_indices[m_ids[to]] = to;
+            to++;
+        }
+        m_positions.resize(to);
+        m_rotations.resize(to);
+        m_scales.resize(to);
+        m_parents.resize(to);
+        m_worlds.resize(to);
+        m_dirty.resize(to);
+        m_ids.resize(to);
+        // Dirty nodes after the removed ones moved back.
+        m_firstDirty = std::min(m_firstDirty, first);
+    }
+    bool TransformHierarchy::SetParent(uint32_t node, uint32_t parent)
+    {
+        if (!IsValid(node) || (parent != InvalidNode && !IsValid(parent)))
+            return false;
+        uint32_t index = m_indices[node];
+        uint32_t parentIndex = parent == InvalidNode ? InvalidNode : m_indices[parent];
+        for (uint32_t ancestor = parentIndex; ancestor != InvalidNode; ancestor = m_parents[ancestor])
+            if (ancestor == index)
+                return false; // Would make a cycle.
+        m_parents[index] = parentIndex;
+        if (parentIndex != InvalidNode && parentIndex > index)
+            m_needsSort = true;
+        mark_dirty(index);
+        return true;
+    }
+    uint32_t TransformHierarchy::GetParent(uint32_t node) const
+    {
+        uint32_t parent = m_parents[m_indices[node]];
+        return parent == InvalidNode ? InvalidNode : m_ids[parent];
+    }
+    void TransformHierarchy::SetLocal(uint32_t node, const Transform& local)
+    {
+        uint32_t index = m_indices[node];
+        m_positions[index] = local.position;
+        m_rotations[index] = local.rotation;
+        m_scales[index] = local.scale;
+        mark_dirty(index);
+    }
+    void TransformHierarchy::SetPosition(uint32_t node, const glm::vec3& position)
+    {
+        m_positions[m_indices[node]] = position;
+        mark_dirty(m_indices[node]);
+    }
+    void TransformHierarchy::SetRotation(uint32_t node, const glm::quat& rotation)
+    {
+        m_rotations[m_indices[node]] = rotation;
+        mark_dirty(m_indices[node]);
+    }
+    void TransformHierarchy::SetScale(uint32_t node, const glm::vec3& scale)
+    {
+        m_scales[m_indices[node]] = scale;
+        mark_dirty(m_indices[node]);
+    }
+    Transform TransformHierarchy::GetLocal(uint32_t node) const
+    {
+        uint32_t index = m_indices[node];
+        return Transform{ m_positions[index], m_rotations[index], m_scales[index] };
+    }
+    void TransformHierarchy::mark_dirty(uint32_t index)
+    {
+        m_dirty[index] = 1;
+        m_firstDirty = std::min<size_t>(m_firstDirty, index);
+    }
+    void TransformHierarchy::sort()
+    {
+        size_t count = m_parents.size();
+        // Ordering by depth puts every parent before its children.
+        std::vector<uint32_t> depths(count, InvalidNode);
+        std::vector<uint32_t> chain;
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t current = i;
+            while (depths[current] == InvalidNode && m_parents[current] != InvalidNode)
+            {
+                chain.push_back(current);
+                current = m_parents[current];
+            }
+            uint32_t depth = depths[current] == InvalidNode ? 0 : depths[current];
+            depths[current] = depth;
+            for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+                depths[*it] = ++depth;
+            chain.clear();
+        }
+        std::vector<uint32_t> order(count);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return depths[a] < depths[b]; });
+        std::vector<uint32_t> newIndices(count);
+        for (size_t i = 0; i < count; i++)
+            newIndices[order[i]] = i;
+
+        auto permute = [&](auto& array)
+        {
+            std::remove_reference_t<decltype(array)> sorted(count);
+            for (size_t i = 0; i < count; i++)
+                sorted[i] = array[order[i]];
+            array.swap(sorted);
+        };
+        permute(m_positions);
+        permute(m_rotations);
+        permute(m_scales);
+        permute(m_parents);
+        permute(m_worlds);
+        permute(m_dirty);
+        permute(m_ids);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (m_parents[i] != InvalidNode)
+                m_parents[i] = newIndices[m_parents[i]];
+            m_indices[m_ids[i]] = i;
+        }
+        m_firstDirty = 0;
+        m_needsSort = false;
+    }
+    size_t TransformHierarchy::Update()
+    {
+        if (m_needsSort)
+            sort();
+        size_t count = m_parents.size();
+        size_t nUpdated = 0;
+        for (size_t i = m_firstDirty; i < count; i++)
+        {
+            uint32_t parent = m_parents[i];
+            // A dirty parent was just recomputed; mark the node too, so that its own children see it.
+            if (!m_dirty[i] && (parent == InvalidNode || !m_dirty[parent]))
+                continue;
+            m_dirty[i] = 1;
+            glm::mat4 local = ComposeTransform(Transform{ m_positions[i], m_rotations[i], m_scales[i] });
+            if (parent == InvalidNode)
+                m_worlds[i] = local;
+            else
+                MultiplyMatrix(m_worlds[parent], local, m_worlds[i]);
+            nUpdated++;
+        }
+        if (m_firstDirty < count)
+            memset(m_dirty.data() + m_firstDirty, 0, count - m_firstDirty);
+        m_firstDirty = count;
+        return nUpdated;
+    }
+}
@@ -0,0 +1,94 @@
+/*
+ * game/scene/transform_hierarchy.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace scene
+{
+    // out = a*b. Uses SSE where available; 'out' may alias either input.
+    void MultiplyMatrix(const glm::mat4& a, const glm::mat4& b, glm::mat4& out);
+    // out[i] = left*right[i], for 'count' matrices (e.g., view-projection times every world matrix).
+    // 'out' may alias 'right'.
+    void MultiplyMatrices(const glm::mat4& left, const glm::mat4* right, glm::mat4* out, size_t count);
+
+    struct Transform
+    {
+        glm::vec3 position{ 0, 0, 0 };
+        glm::quat rotation{ 1, 0, 0, 0 };
+        glm::vec3 scale{ 1, 1, 1 };
+    };
+    // Translation, then rotation, then scale, as one matrix.
+    glm::mat4 ComposeTransform(const Transform& transform);
+    // The inverse of ComposeTransform, for matrices without shear or projection (e.g., a model's node transforms).
+    Transform DecomposeTransform(const glm::mat4& matrix);
+
+    // The local transforms (position, rotation and scale), parents and world matrices of scene nodes, stored as a
+    // structure of arrays, and sorted so that parents come before their children.
+    // Changing a node only marks it dirty; Update() then recomputes the world matrices of dirty nodes and their
+    // descendants, in one pass in array order, leaving every other node alone.
+    // Nodes are referred to by ids, which stay the same while nodes move around in the arrays (e.g., on SetParent()).
+    class TransformHierarchy final
+    {
+    public:
+        static constexpr uint32_t InvalidNode = UINT32_MAX;
+
+        TransformHierarchy() = default;
+
+        // Returns the new node's id.
+        uint32_t Add(const Transform& local, uint32_t parent = InvalidNode);
+        // Removes the node and all of its descendants. Their ids can be reused.
+        void Remove(uint32_t node);
+        // 'parent' can be InvalidNode, to make the node a root; a node can't be parented to its own descendant.
+        bool SetParent(uint32_t node, uint32_t parent);
+        uint32_t GetParent(uint32_t node) const;
+
+        void SetLocal(uint32_t node, const Transform& local);
+        void SetPosition(uint32_t node, const glm::vec3& position);
+        void SetRotation(uint32_t node, const glm::quat& rotation);
+        void SetScale(uint32_t node, const glm::vec3& scale);
+        Transform GetLocal(uint32_t node) const;
+
+        // Recomputes the world matrices of dirty nodes and their descendants (re-sorting the nodes first if
+        // SetParent() put a child before its parent). Returns the amount of nodes recomputed.
+        size_t Update();
+        // As of the last Update().
+        const glm::mat4& GetWorld(uint32_t node) const { return m_worlds[m_indices[node]]; }
+
+        // The arrays are indexed by GetIndex(), which changes whenever the nodes are re-sorted or removed.
+        uint32_t GetIndex(uint32_t node) const { return m_indices[node]; }
+        const std::vector<glm::mat4>& GetWorldMatrices() const { return m_worlds; }
+        const std::vector<uint32_t>& GetParents() const { return m_parents; }
+        size_t GetCount() const { return m_parents.size(); }
+        bool IsValid(uint32_t node) const { return node < m_indices.size() && m_indices[node] != InvalidNode; }
+    private:
+        void mark_dirty(uint32_t index);
+        void sort();
+
+        // Indexed by array position.
+        std::vector<glm::vec3> m_positions{};
+        std::vector<glm::quat> m_rotations{};
+        std::vector<glm::vec3> m_scales{};
+        // Array positions, or InvalidNode for roots.
+        std::vector<uint32_t> m_parents{};
+        std::vector<glm::mat4> m_worlds{};
+        std::vector<uint8_t> m_dirty{};
+        std::vector<uint32_t> m_ids{};
+        // Indexed by id; InvalidNode for removed ids.
+        std::vector<uint32_t> m_indices{};
+        std::vector<uint32_t> m_freeIds{};
+        // Nodes before this one are clean.
+        size_t m_firstDirty = 0;
+        bool m_needsSort = false;
+    };
+}
@@ -0,0 +1,34 @@
+/*
+ * game/sim/fixed_timestep.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <sim/fixed_timestep.h>
+
+namespace sim
+{
+    FixedTimestep::FixedTimestep(double tickRate, uint32_t maxSteps)
+        : m_tickLength{ 1 / tickRate }, m_maxSteps{ maxSteps ? maxSteps : 1 }
+    {}
+    uint32_t FixedTimestep::Advance(double elapsed)
+    {
+        if (elapsed > 0)
+            m_accumulator += elapsed;
+        uint32_t nSteps = 0;
+        while (m_accumulator >= m_tickLength && nSteps < m_maxSteps)
+        {
+            m_accumulator -= m_tickLength;
+            nSteps++;
+        }
+        if (m_accumulator >= m_tickLength)
+        {
+            // Keep the fraction of a tick, so that interpolation stays smooth.
+            uint64_t nDropped = (uint64_t)(m_accumulator / m_tickLength);
+            m_accumulator -= nDropped * m_tickLength;
+            m_nDropped += nDropped;
+        }
+        m_nTicks += nSteps;
+        return nSteps;
+    }
+}
@@ -0,0 +1,43 @@
+/*
+ * game/sim/fixed_timestep.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace sim
+{
+    // Splits the time between frames into simulation ticks of a fixed length, so that the simulation advances the same
+    // way however fast (or unevenly) frames are rendered.
+    // Time left over after the last whole tick carries into the next frame; GetAlpha() says how far into the next tick
+    // the frame is, for interpolating between the last two ticks' states.
+    class FixedTimestep final
+    {
+    public:
+        // 'maxSteps' caps the ticks run per frame: after a stall (e.g., a breakpoint, or a slow load), the simulation
+        // drops the time it can't catch up on instead of spending ever longer frames catching up.
+        explicit FixedTimestep(double tickRate = 60, uint32_t maxSteps = 5);
+
+        // Adds the time the last frame took, in seconds. Returns the amount of ticks to run this frame.
+        uint32_t Advance(double elapsed);
+
+        // In seconds.
+        double GetTickLength() const { return m_tickLength; }
+        double GetTickRate() const { return 1 / m_tickLength; }
+        // Between 0 (the last tick's state) and 1 (the next tick's).
+        float GetAlpha() const { return (float)(m_accumulator / m_tickLength); }
+        uint64_t GetTickCount() const { return m_nTicks; }
+        // Ticks that were owed but dropped because of 'maxSteps'.
+        uint64_t GetDroppedTicks() const { return m_nDropped; }
+    private:
+        double m_tickLength = 0;
+        uint32_t m_maxSteps = 0;
+        double m_accumulator = 0;
+        uint64_t m_nTicks = 0;
+        uint64_t m_nDropped = 0;
+    };
+}
@@ -0,0 +1,91 @@
+/*
+ * game/sim/frame_pipeline.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <chrono>
+
+#include <sim/frame_pipeline.h>
+
+namespace sim
+{
+    void RenderPacket::Clear()
+    {
+        visible.clear();
+        transforms.clear();
+        meshes.clear();
+        lods.clear();
+        nearestDistance = 0;
+        nearestScreenSize = 0;
+        culling = renderer::CullingStats{};
+        nTicks = 0;
+        simTime = 0;
+    }
+
+    FramePipeline::FramePipeline(SimulateFunction simulate, bool threaded)
+        : m_simulate{ std::move(simulate) }
+    {
+        if (threaded)
+            m_thread = std::thread{ &FramePipeline::thread_main, this };
+    }
+    static void run(const FramePipeline::SimulateFunction& simulate, const FrameInput& input, RenderPacket& packet)
+    {
+        auto start = std::chrono::steady_clock::now();
+        packet.Clear();
+        packet.frame = input.frame;
+        simulate(input, packet);
+        packet.simTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    void FramePipeline::Kick(const FrameInput& input)
+    {
+        // The previous packet was waited for, so the simulation thread is idle and not reading m_input.
+        m_input = input;
+        uint64_t nKicked = m_nKicked.load(std::memory_order_relaxed) + 1;
+        if (!IsThreaded())
+        {
+            run(m_simulate, m_input, m_packets[(nKicked - 1) % 2]);
+            m_nKicked.store(nKicked, std::memory_order_relaxed);
+            m_nFinished.store(nKicked, std::memory_order_relaxed);
+            return;
+        }
+        m_nKicked.store(nKicked, std::memory_order_release);
+        m_nKicked.notify_one();
+    }
+    const RenderPacket& FramePipeline::Wait()
+    {
+        uint64_t nKicked = m_nKicked.load(std::memory_order_relaxed);
+        uint64_t nFinished = m_nFinished.load(std::memory_order_acquire);
+        while (nFinished != nKicked)
+        {
+            m_nFinished.wait(nFinished, std::memory_order_acquire);
+            nFinished = m_nFinished.load(std::memory_order_acquire);
+        }
+        return m_packets[(nFinished - 1) % 2];
+    }
+    void FramePipeline::thread_main()
+    {
+        uint64_t nFinished = 0;
+        while (true)
+        {
+            m_nKicked.wait(nFinished, std::memory_order_acquire);
+            if (m_stop.load(std::memory_order_acquire))
+                break;
+            if (m_nKicked.load(std::memory_order_acquire) == nFinished)
+                continue; // Woken up spuriously.
+            run(m_simulate, m_input, m_packets[nFinished % 2]);
+            m_nFinished.store(++nFinished, std::memory_order_release);
+            m_nFinished.notify_one();
+        }
+    }
+    FramePipeline::~FramePipeline()
+    {
+        if (!IsThreaded())
+            return;
+        m_stop.store(true, std::memory_order_release);
+        // Wake the thread up through the counter it waits on.
+        m_nKicked.fetch_add(1, std::memory_order_release);
+        m_nKicked.notify_one();
+        m_thread.join();
+    }
+}
@@ -0,0 +1,101 @@
+/*
+ * game/sim/frame_pipeline.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <renderer/controls.h>
+#include <renderer/culling.h>
+
+namespace sim
+{
+    // What the GL thread hands the simulation thread for a frame.
+    struct FrameInput
+    {
+        uint64_t frame = 0;
+        // The time the frame before took, in seconds.
+        double elapsed = 0;
+        renderer::InputState input{};
+        int viewportHeight = 0;
+    };
+
+    // Everything the GL thread needs to render a frame, produced by the simulation thread.
+    // Once published, a packet isn't changed until the GL thread is done with it.
+    struct RenderPacket
+    {
+        uint64_t frame = 0;
+        glm::mat4 viewProjection{ 1.f };
+        glm::vec3 cameraPosition{ 0, 0, 0 };
+        glm::vec3 cameraDirection{ 0, 0, 0 };
+        float cameraSpeed = 0;
+        // The visible objects, grouped by mesh and level of detail and front to back within each group, with their
+        // model matrices, meshes and levels of detail.
+        std::vector<uint32_t> visible{};
+        std::vector<glm::mat4> transforms{};
+        std::vector<int32_t> meshes{};
+        std::vector<uint32_t> lods{};
+        // The distance to the nearest visible object, and how many pixels tall it is on screen.
+        float nearestDistance = 0;
+        float nearestScreenSize = 0;
+        renderer::CullingStats culling{};
+        uint32_t nTicks = 0;
+        // How long the simulation thread took to build the packet, in milliseconds.
+        double simTime = 0;
+
+        // Keeps the vectors' storage, so that steady-state frames don't allocate.
+        void Clear();
+    };
+
+    // Runs the simulation (ticks, culling, level of detail selection) for frame N+1 on its own thread, while the GL
+    // thread renders frame N.
+    // Packets are double-buffered: the simulation thread writes one while the GL thread reads the other, and the two
+    // only hand packets over through atomics, with no locks.
+    // The simulation function must only touch state the GL thread leaves alone between Kick() and Wait(); the GL
+    // thread can change shared state (e.g., finish loading the scene) after Wait() and before the next Kick().
+    // Cannot be copied.
+    // Cannot be moved.
+    class FramePipeline final
+    {
+    public:
+        using SimulateFunction = std::function<void(const FrameInput& input, RenderPacket& packet)>;
+
+        // If 'threaded' is false, Kick() runs the simulation itself, on the calling thread (e.g., to compare the two).
+        explicit FramePipeline(SimulateFunction simulate, bool threaded = true);
+        FramePipeline(const FramePipeline&) = delete;
+        FramePipeline& operator=(const FramePipeline&) = delete;
+        FramePipeline(FramePipeline&&) = delete;
+        FramePipeline& operator=(FramePipeline&&) = delete;
+
+        // Starts building the packet for 'input'. The packet kicked before must have been waited for.
+        void Kick(const FrameInput& input);
+        // Waits for the packet kicked last. It stays valid, and unchanged, until the Kick() after next.
+        const RenderPacket& Wait();
+
+        bool IsThreaded() const { return m_thread.joinable(); }
+
+        ~FramePipeline();
+    private:
+        void thread_main();
+
+        SimulateFunction m_simulate{};
+        RenderPacket m_packets[2]{};
+        FrameInput m_input{};
+        // Packets kicked, and packets finished; the packet being built is m_packets[m_nFinished % 2].
+        std::atomic<uint64_t> m_nKicked{0};
+        std::atomic<uint64_t> m_nFinished{0};
+        std::atomic<bool> m_stop{false};
+        std::thread m_thread{};
+    };
+}
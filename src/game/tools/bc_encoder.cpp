@@ -0,0 +1,422 @@
+/*
+ * game/tools/bc_encoder.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <tools/bc_encoder.h>
+
+namespace tools
+{
+    static constexpr int s_nPixels = 16;
+
+    // One row per channel (RGBA), with values from 0 to 255.
+    struct block
+    {
+        alignas(16) float channels[4][s_nPixels];
+    };
+    static block load_block(const uint8_t* pixels)
+    {
+        block ret{};
+        for (int i = 0; i < s_nPixels; i++)
+            for (int c = 0; c < 4; c++)
+                ret.channels[c][i] = pixels[i*4 + c];
+        return ret;
+    }
+
+    // Finds the weighted mean of the block's first 'nChannels' channels, and the axis along which they vary the most
+    // (the principal eigenvector of their covariance, by power iteration).
+    static void principal_axis(const block& b, const float* weights, int nChannels, float* mean, float* axis)
+    {
+        float total = 0;
+        for (int i = 0; i < s_nPixels; i++)
+            total += weights[i];
+        for (int c = 0; c < nChannels; c++)
+        {
+            float sum = 0;
+            for (int i = 0; i < s_nPixels; i++)
+                sum += weights[i] * b.channels[c][i];
+            mean[c] = total > 0 ? sum / total : 0;
+        }
+        float covariance[4][4] = {};
+        for (int c1 = 0; c1 < nChannels; c1++)
+        {
+            for (int c2 = c1; c2 < nChannels; c2++)
+            {
+                float sum = 0;
+                for (int i = 0; i < s_nPixels; i++)
+                    sum += weights[i] * (b.channels[c1][i] - mean[c1]) * (b.channels[c2][i] - mean[c2]);
+                covariance[c1][c2] = covariance[c2][c1] = sum;
+            }
+        }
+        for (int c = 0; c < nChannels; c++)
+            axis[c] = 1.f;
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[4] = {};
+            float length = 0;
+            for (int c1 = 0; c1 < nChannels; c1++)
+            {
+                for (int c2 = 0; c2 < nChannels; c2++)
+                    next[c1] += covariance[c1][c2] * axis[c2];
+                length = std::max(length, std::fabs(next[c1]));
+            }
+            if (length <= 0)
+                break; // Every pixel is the same; any axis will do.
+            for (int c = 0; c < nChannels; c++)
+                axis[c] = next[c] / length;
+        }
+        float length = 0;
+        for (int c = 0; c < nChannels; c++)
+            length += axis[c]*axis[c];
+        length = std::sqrt(length);
+        for (int c = 0; c < nChannels; c++)
+            axis[c] = length > 0 ? axis[c] / length : 0;
+    }
+    // Puts the endpoints at the extremes of the weighted pixels' projections onto the principal axis.
+    static void fit_endpoints(const block& b, const float* weights, int nChannels, float inset, float* low, float* high)
+    {
+        float mean[4], axis[4];
+        principal_axis(b, weights, nChannels, mean, axis);
+        float tMin = std::numeric_limits<float>::infinity(), tMax = -std::numeric_limits<float>::infinity();
+        for (int i = 0; i < s_nPixels; i++)
+        {
+            if (weights[i] <= 0)
+                continue;
+            float t = 0;
+            for (int c = 0; c < nChannels; c++)
+                t += (b.channels[c][i] - mean[c]) * axis[c];
+            tMin = std::min(tMin, t);
+            tMax = std::max(tMax, t);
+        }
+        if (tMin > tMax)
+            tMin = tMax = 0;
+        // Pulling the endpoints in a little makes better use of the interpolated colors.
+        float delta = (tMax - tMin) * inset;
+        tMin += delta;
+        tMax -= delta;
+        for (int c = 0; c < nChannels; c++)
+        {
+            low[c] = std::clamp(mean[c] + axis[c]*tMin, 0.f, 255.f);
+            high[c] = std::clamp(mean[c] + axis[c]*tMax, 0.f, 255.f);
+        }
+    }
+    // Picks the nearest palette entry for each weighted pixel. Returns the total squared error.
+    static float pick_indices(const block& b, const float* weights, int nChannels, const float (*palette)[4], int nEntries, uint8_t* indices)
+    {
+        float best[s_nPixels];
+        for (int i = 0; i < s_nPixels; i++)
+        {
+            best[i] = std::numeric_limits<float>::infinity();
+            indices[i] = 0;
+        }
+        for (int entry = 0; entry < nEntries; entry++)
+        {
+            float distance[s_nPixels] = {};
+            for (int c = 0; c < nChannels; c++)
+            {
+                for (int i = 0; i < s_nPixels; i++)
+                {
+                    float delta = b.channels[c][i] - palette[entry][c];
+                    distance[i] += delta*delta;
+                }
+            }
+            for (int i = 0; i < s_nPixels; i++)
+            {
+                bool closer = distance[i] < best[i];
+                best[i] = closer ? distance[i] : best[i];
+                indices[i] = closer ? entry : indices[i];
+            }
+        }
+        float error = 0;
+        for (int i = 0; i < s_nPixels; i++)
+            error += weights[i] > 0 ? best[i] : 0;
+        return error;
+    }
+    // Solves for the endpoints that best reproduce the pixels, given each pixel's interpolation factor toward 'high'.
+    // Returns false if the factors don't determine the endpoints (e.g., all pixels use the same one).
+    static bool least_squares(const block& b, const float* weights, int nChannels, const float* factors, float* low, float* high)
+    {
+        float aa = 0, ab = 0, bb = 0;
+        float ax[4] = {}, bx[4] = {};
+        for (int i = 0; i < s_nPixels; i++)
+        {
+            float beta = factors[i], alpha = 1.f - beta;
+            aa += weights[i] * alpha*alpha;
+            ab += weights[i] * alpha*beta;
+            bb += weights[i] * beta*beta;
+            for (int c = 0; c < nChannels; c++)
+            {
+                ax[c] += weights[i] * alpha * b.channels[c][i];
+                bx[c] += weights[i] * beta * b.channels[c][i];
+            }
+        }
+        float determinant = aa*bb - ab*ab;
+        if (std::fabs(determinant) < 1e-6f)
+            return false;
+        for (int c = 0; c < nChannels; c++)
+        {
+            low[c] = std::clamp((bb*ax[c] - ab*bx[c]) / determinant, 0.f, 255.f);
+            high[c] = std::clamp((aa*bx[c] - ab*ax[c]) / determinant, 0.f, 255.f);
+        }
+        return true;
+    }
+
+    static uint16_t pack_565(const float* color)
+    {
+        uint16_t r = (uint16_t)std::lround(color[0] * 31.f / 255.f);
+        uint16_t g = (uint16_t)std::lround(color[1] * 63.f / 255.f);
+        uint16_t b = (uint16_t)std::lround(color[2] * 31.f / 255.f);
+        return (r << 11) | (g << 5) | b;
+    }
+    static void unpack_565(uint16_t packed, float* color)
+    {
+        uint32_t r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+        color[0] = (float)((r << 3) | (r >> 2));
+        color[1] = (float)((g << 2) | (g >> 4));
+        color[2] = (float)((b << 3) | (b >> 2));
+        color[3] = 255.f;
+    }
+    struct color_block
+    {
+        uint16_t color0 = 0, color1 = 0;
+        uint8_t indices[s_nPixels] = {};
+        float error = std::numeric_limits<float>::infinity();
+    };
+    // Quantizes the endpoints, orders them for the mode, and picks indices.
+    // In four color mode, color0 > color1; in three color mode (where index 3 is transparent), color0 <= color1.
+    static color_block quantize_color_block(const block& b, const float* weights, bool threeColor, const float* low, const float* high)
+    {
+        color_block ret{};
+        uint16_t a = pack_565(high), c = pack_565(low);
+        ret.color0 = threeColor ? std::min(a, c) : std::max(a, c);
+        ret.color1 = threeColor ? std::max(a, c) : std::min(a, c);
+        float palette[4][4];
+        unpack_565(ret.color0, palette[0]);
+        unpack_565(ret.color1, palette[1]);
+        for (int ch = 0; ch < 3; ch++)
+        {
+            if (threeColor)
+            {
+                palette[2][ch] = (palette[0][ch] + palette[1][ch]) / 2.f;
+                palette[3][ch] = 0;
+            }
+            else
+            {
+                palette[2][ch] = (2.f*palette[0][ch] + palette[1][ch]) / 3.f;
+                palette[3][ch] = (palette[0][ch] + 2.f*palette[1][ch]) / 3.f;
+            }
+        }
+        // Equal endpoints always decode in three color mode, so stick to index zero.
+        int nEntries = (threeColor || ret.color0 == ret.color1) ? 3 : 4;
+        if (ret.color0 == ret.color1)
+            nEntries = 1;
+        ret.error = pick_indices(b, weights, 3, palette, nEntries, ret.indices);
+        if (threeColor)
+            for (int i = 0; i < s_nPixels; i++)
+                if (weights[i] <= 0)
+                    ret.indices[i] = 3;
+        return ret;
+    }
+    static void encode_color_block(const block& b, bool allowTransparent, uint8_t* out)
+    {
+        float weights[s_nPixels];
+        bool threeColor = false;
+        bool anyOpaque = false;
+        for (int i = 0; i < s_nPixels; i++)
+        {
+            bool transparent = allowTransparent && b.channels[3][i] < 128.f;
+            weights[i] = transparent ? 0.f : 1.f;
+            threeColor |= transparent;
+            anyOpaque |= !transparent;
+        }
+        color_block best{};
+        if (!anyOpaque)
+        {
+            best.color0 = best.color1 = 0;
+            memset(best.indices, 3, sizeof(best.indices));
+        }
+        else
+        {
+            float low[4], high[4];
+            fit_endpoints(b, weights, 3, 1.f/16.f, low, high);
+            best = quantize_color_block(b, weights, threeColor, low, high);
+            // Refit the endpoints to the chosen indices, for as long as that helps.
+            for (int iteration = 0; iteration < 2; iteration++)
+            {
+                float factors[s_nPixels];
+                static const float fourColorFactors[4] = { 0.f, 1.f, 1.f/3.f, 2.f/3.f };
+                static const float threeColorFactors[4] = { 0.f, 1.f, 0.5f, 0.f };
+                for (int i = 0; i < s_nPixels; i++)
+                    factors[i] = (threeColor ? threeColorFactors : fourColorFactors)[best.indices[i]];
+                float color0[4], color1[4];
+                if (!least_squares(b, weights, 3, factors, color0, color1))
+                    break;
+                color_block candidate = quantize_color_block(b, weights, threeColor, color0, color1);
+                if (candidate.error >= best.error)
+                    break;
+                best = candidate;
+            }
+        }
+        uint32_t indices = 0;
+        for (int i = 0; i < s_nPixels; i++)
+            indices |= (uint32_t)best.indices[i] << (i*2);
+        out[0] = best.color0 & 0xff;
+        out[1] = best.color0 >> 8;
+        out[2] = best.color1 & 0xff;
+        out[3] = best.color1 >> 8;
+        memcpy(out + 4, &indices, sizeof(indices));
+    }
+
+    void EncodeBC1(const uint8_t* pixels, uint8_t* out)
+    {
+        block b = load_block(pixels);
+        encode_color_block(b, true, out);
+    }
+
+    static void encode_alpha_block(const block& b, uint8_t* out)
+    {
+        float minimum = 255.f, maximum = 0.f;
+        for (int i = 0; i < s_nPixels; i++)
+        {
+            minimum = std::min(minimum, b.channels[3][i]);
+            maximum = std::max(maximum, b.channels[3][i]);
+        }
+        uint8_t alpha0 = (uint8_t)maximum, alpha1 = (uint8_t)minimum;
+        memset(out, 0, 8);
+        out[0] = alpha0;
+        out[1] = alpha1;
+        if (alpha0 == alpha1)
+            return;
+        // alpha0 > alpha1 selects the mode with six interpolated values.
+        float palette[8];
+        palette[0] = alpha0;
+        palette[1] = alpha1;
+        for (int i = 1; i < 7; i++)
+            palette[i + 1] = (float)(((7 - i)*alpha0 + i*alpha1) / 7);
+        uint64_t indices = 0;
+        for (int i = 0; i < s_nPixels; i++)
+        {
+            int best = 0;
+            for (int entry = 1; entry < 8; entry++)
+                if (std::fabs(b.channels[3][i] - palette[entry]) < std::fabs(b.channels[3][i] - palette[best]))
+                    best = entry;
+            indices |= (uint64_t)best << (i*3);
+        }
+        for (int i = 0; i < 6; i++)
+            out[2 + i] = (indices >> (i*8)) & 0xff;
+    }
+    void EncodeBC3(const uint8_t* pixels, uint8_t* out)
+    {
+        block b = load_block(pixels);
+        encode_alpha_block(b, out);
+        // BC3's color block always decodes in four color mode.
+        encode_color_block(b, false, out + 8);
+    }
+
+    namespace
+    {
+        class bit_writer
+        {
+        public:
+            explicit bit_writer(uint8_t* out) : m_out{out} { memset(out, 0, 16); }
+            void Write(uint32_t value, int nBits)
+            {
+                for (int i = 0; i < nBits; i++, m_position++)
+                    if ((value >> i) & 1)
+                        m_out[m_position / 8] |= 1 << (m_position % 8);
+            }
+        private:
+            uint8_t* m_out;
+            int m_position = 0;
+        };
+    }
+    static constexpr int s_bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+    struct bc7_block
+    {
+        // 7-bit endpoints, and their shared lowest bits.
+        uint8_t endpoints[2][4] = {};
+        uint8_t pBits[2] = {};
+        uint8_t indices[s_nPixels] = {};
+        float error = std::numeric_limits<float>::infinity();
+    };
+    // Tries every combination of p-bits for the endpoints, and keeps the best in 'best'.
+    static void quantize_bc7_block(const block& b, const float* weights, const float* low, const float* high, bc7_block& best)
+    {
+        for (int p0 = 0; p0 < 2; p0++)
+        {
+            for (int p1 = 0; p1 < 2; p1++)
+            {
+                bc7_block candidate{};
+                candidate.pBits[0] = p0;
+                candidate.pBits[1] = p1;
+                int expanded[2][4];
+                for (int c = 0; c < 4; c++)
+                {
+                    candidate.endpoints[0][c] = (uint8_t)std::clamp((int)std::lround((low[c] - p0) / 2.f), 0, 127);
+                    candidate.endpoints[1][c] = (uint8_t)std::clamp((int)std::lround((high[c] - p1) / 2.f), 0, 127);
+                    expanded[0][c] = (candidate.endpoints[0][c] << 1) | p0;
+                    expanded[1][c] = (candidate.endpoints[1][c] << 1) | p1;
+                }
+                float palette[16][4];
+                for (int entry = 0; entry < 16; entry++)
+                    for (int c = 0; c < 4; c++)
+                        palette[entry][c] = (float)(((64 - s_bc7Weights[entry])*expanded[0][c] + s_bc7Weights[entry]*expanded[1][c] + 32) >> 6);
+                candidate.error = pick_indices(b, weights, 4, palette, 16, candidate.indices);
+                if (candidate.error < best.error)
+                    best = candidate;
+            }
+        }
+    }
+    void EncodeBC7(const uint8_t* pixels, uint8_t* out)
+    {
+        block b = load_block(pixels);
+        float weights[s_nPixels];
+        for (float& weight : weights)
+            weight = 1.f;
+        float low[4], high[4];
+        fit_endpoints(b, weights, 4, 1.f/32.f, low, high);
+        bc7_block best{};
+        quantize_bc7_block(b, weights, low, high, best);
+        for (int iteration = 0; iteration < 2; iteration++)
+        {
+            float factors[s_nPixels];
+            for (int i = 0; i < s_nPixels; i++)
+                factors[i] = s_bc7Weights[best.indices[i]] / 64.f;
+            float error = best.error;
+            if (!least_squares(b, weights, 4, factors, low, high))
+                break;
+            quantize_bc7_block(b, weights, low, high, best);
+            if (best.error >= error)
+                break;
+        }
+        // The first pixel's index is stored without its top bit, which must therefore be zero.
+        if (best.indices[0] >= 8)
+        {
+            std::swap(best.endpoints[0], best.endpoints[1]);
+            std::swap(best.pBits[0], best.pBits[1]);
+            for (uint8_t& index : best.indices)
+                index = 15 - index;
+        }
+        bit_writer writer{ out };
+        writer.Write(1 << 6, 7); // Mode 6.
+        for (int c = 0; c < 4; c++)
+        {
+            writer.Write(best.endpoints[0][c], 7);
+            writer.Write(best.endpoints[1][c], 7);
+        }
+        writer.Write(best.pBits[0], 1);
+        writer.Write(best.pBits[1], 1);
+        writer.Write(best.indices[0], 3);
+        for (int i = 1; i < s_nPixels; i++)
+            writer.Write(best.indices[i], 4);
+    }
+}
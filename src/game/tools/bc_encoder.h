@@ -0,0 +1,25 @@
+/*
+ * game/tools/bc_encoder.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Block compression encoders, for texcook.
+// Each encodes one 4x4 block of RGBA8 pixels (64 bytes, in rows) to its compressed form.
+// The encoders work on the block's pixels as rows of floats, one row per channel, so that the compiler can vectorize
+// the per-pixel loops.
+
+namespace tools
+{
+    // BC1 (DXT1), 8 bytes. Blocks with pixels of alpha below 128 use BC1's transparent mode.
+    void EncodeBC1(const uint8_t* pixels, uint8_t* out);
+    // BC3 (DXT5), 16 bytes: BC1 colors, plus interpolated alpha.
+    void EncodeBC3(const uint8_t* pixels, uint8_t* out);
+    // BC7, 16 bytes, in mode 6 (one subset, RGBA endpoints with 4-bit indices).
+    void EncodeBC7(const uint8_t* pixels, uint8_t* out);
+}
@@ -0,0 +1,316 @@
+/*
+ * game/tools/mesh_simplifier.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <tools/mesh_simplifier.h>
+
+namespace tools
+{
+    // Open borders are weighted this much more than surfaces, so that they are the last to go.
+    static constexpr double s_borderWeight = 10.0;
+
+    // The sum of squared distances to a set of weighted planes, as a symmetric 4x4 matrix.
+    struct quadric
+    {
+        double xx = 0, xy = 0, xz = 0, xw = 0;
+        double yy = 0, yz = 0, yw = 0;
+        double zz = 0, zw = 0;
+        double ww = 0;
+        double weight = 0;
+
+        void AddPlane(const glm::dvec3& normal, double distance, double planeWeight)
+        {
+            xx += planeWeight*normal.x*normal.x; xy += planeWeight*normal.x*normal.y; xz += planeWeight*normal.x*normal.z;
+            xw += planeWeight*normal.x*distance;
+            yy += planeWeight*normal.y*normal.y; yz += planeWeight*normal.y*normal.z; yw += planeWeight*normal.y*distance;
+            zz += planeWeight*normal.z*normal.z; zw += planeWeight*normal.z*distance;
+            ww += planeWeight*distance*distance;
+            weight += planeWeight;
+        }
+        quadric& operator+=(const quadric& rhs)
+        {
+            xx += rhs.xx; xy += rhs.xy; xz += rhs.xz; xw += rhs.xw;
+            yy += rhs.yy; yz += rhs.yz; yw += rhs.yw;
+            zz += rhs.zz; zw += rhs.zw;
+            ww += rhs.ww;
+            weight += rhs.weight;
+            return *this;
+        }
+        // The weighted mean of the squared distances from 'p' to the planes.
+        double Evaluate(const glm::dvec3& p) const
+        {
+            double sum =
+                xx*p.x*p.x + 2*xy*p.x*p.y + 2*xz*p.x*p.z + 2*xw*p.x +
+                yy*p.y*p.y + 2*yz*p.y*p.z + 2*yw*p.y +
+                zz*p.z*p.z + 2*zw*p.z +
+                ww;
+            return weight > 0 ? std::max(sum, 0.0) / weight : 0;
+        }
+    };
+
+    enum class vertex_kind : uint8_t
+    {
+        Manifold,
+        // On an open border; only collapses along it.
+        Border,
+        // On a seam, or somewhere the mesh isn't manifold; never moves.
+        Locked,
+    };
+
+    static uint64_t edge_key(GLuint a, GLuint b)
+    {
+        return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+    }
+    static glm::dvec3 get_position(const std::vector<GLfloat>& positions, GLuint vertex)
+    {
+        return glm::dvec3{ positions[vertex*3], positions[vertex*3 + 1], positions[vertex*3 + 2] };
+    }
+    // Vertices that share their position with another vertex are on a seam.
+    static std::vector<vertex_kind> find_seams(const std::vector<GLfloat>& positions)
+    {
+        size_t nVertices = positions.size() / 3;
+        std::vector<GLuint> order(nVertices);
+        std::iota(order.begin(), order.end(), 0);
+        auto less = [&](GLuint a, GLuint b)
+        {
+            return std::lexicographical_compare(&positions[a*3], &positions[a*3 + 3], &positions[b*3], &positions[b*3 + 3]);
+        };
+        std::sort(order.begin(), order.end(), less);
+        std::vector<vertex_kind> kinds(nVertices, vertex_kind::Manifold);
+        for (size_t i = 1; i < nVertices; i++)
+        {
+            if (!less(order[i - 1], order[i]))
+                kinds[order[i - 1]] = kinds[order[i]] = vertex_kind::Locked;
+        }
+        return kinds;
+    }
+    // Counts how many triangles use each edge.
+    static void count_edges(const std::vector<GLuint>& indices, std::unordered_map<uint64_t, uint32_t>& edges)
+    {
+        edges.clear();
+        edges.reserve(indices.size());
+        for (size_t i = 0; i < indices.size(); i += 3)
+            for (int corner = 0; corner < 3; corner++)
+                edges[edge_key(indices[i + corner], indices[i + (corner + 1) % 3])]++;
+    }
+    static void compute_quadrics(const std::vector<GLfloat>& positions, const std::vector<GLuint>& indices,
+        const std::unordered_map<uint64_t, uint32_t>& edges, std::vector<quadric>& quadrics)
+    {
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            glm::dvec3 p[3];
+            for (int corner = 0; corner < 3; corner++)
+                p[corner] = get_position(positions, indices[i + corner]);
+            glm::dvec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+            double length = glm::length(normal);
+            if (length <= 0)
+                continue;
+            normal /= length;
+            // Weighted by area, so that small triangles don't count as much as large ones.
+            for (int corner = 0; corner < 3; corner++)
+                quadrics[indices[i + corner]].AddPlane(normal, -glm::dot(normal, p[0]), length * 0.5);
+            for (int corner = 0; corner < 3; corner++)
+            {
+                GLuint a = indices[i + corner], b = indices[i + (corner + 1) % 3];
+                if (edges.at(edge_key(a, b)) != 1)
+                    continue;
+                // Keep border vertices on the plane through the border, perpendicular to the triangle.
+                glm::dvec3 edge = p[(corner + 1) % 3] - p[corner];
+                glm::dvec3 borderNormal = glm::cross(edge, normal);
+                double borderLength = glm::length(borderNormal);
+                if (borderLength <= 0)
+                    continue;
+                borderNormal /= borderLength;
+                double distance = -glm::dot(borderNormal, p[corner]);
+                double edgeWeight = glm::dot(edge, edge) * s_borderWeight;
+                quadrics[a].AddPlane(borderNormal, distance, edgeWeight);
+                quadrics[b].AddPlane(borderNormal, distance, edgeWeight);
+            }
+        }
+    }
+
+    namespace
+    {
+        struct collapse
+        {
+            GLuint from;
+            GLuint to;
+            double cost;
+        };
+    }
+
+    std::vector<GLuint> SimplifyMesh(
+        const std::vector<GLfloat>& positions, const std::vector<GLuint>& indices,
+        size_t targetIndexCount, float maxError, float& error
+    )
+    {
+        error = 0;
+        size_t nVertices = positions.size() / 3;
+        std::vector<GLuint> result = indices;
+        result.resize(result.size() / 3 * 3);
+        for (GLuint index : result)
+            if (index >= nVertices)
+                return indices; // Corrupt mesh; leave it alone.
+
+        std::vector<vertex_kind> seams = find_seams(positions);
+        std::unordered_map<uint64_t, uint32_t> edges;
+        count_edges(result, edges);
+        std::vector<quadric> quadrics(nVertices);
+        compute_quadrics(positions, result, edges, quadrics);
+
+        double maxCost = (double)maxError * maxError;
+        std::vector<vertex_kind> kinds;
+        std::vector<uint32_t> triangleOffsets, triangleCounts, vertexTriangles;
+        std::vector<collapse> collapses;
+        std::vector<GLuint> remap(nVertices);
+        std::vector<uint8_t> touched(nVertices);
+        std::vector<GLuint> ringA, ringB;
+        while (result.size() > targetIndexCount)
+        {
+            // Borders move as the mesh is simplified, so classify the vertices again.
+            kinds = seams;
+            for (const auto& [key, count] : edges)
+            {
+                GLuint a = key >> 32, b = key & 0xffffffff;
+                vertex_kind kind = count == 1 ? vertex_kind::Border : count > 2 ? vertex_kind::Locked : vertex_kind::Manifold;
+                for (GLuint vertex : { a, b })
+                    kinds[vertex] = std::max(kinds[vertex], kind);
+            }
+            // The triangles around each vertex.
+            size_t nTriangles = result.size() / 3;
+            triangleCounts.assign(nVertices, 0);
+            for (GLuint index : result)
+                triangleCounts[index]++;
+            triangleOffsets.assign(nVertices + 1, 0);
+            for (size_t i = 0; i < nVertices; i++)
+                triangleOffsets[i + 1] = triangleOffsets[i] + triangleCounts[i];
+            vertexTriangles.resize(result.size());
+            triangleCounts.assign(nVertices, 0);
+            for (size_t i = 0; i < result.size(); i++)
+                vertexTriangles[triangleOffsets[result[i]] + triangleCounts[result[i]]++] = i / 3;
+
+            collapses.clear();
+            for (size_t i = 0; i < result.size(); i += 3)
+            {
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    GLuint a = result[i + corner], b = result[i + (corner + 1) % 3];
+                    for (auto [from, to] : { std::pair{ a, b }, std::pair{ b, a } })
+                    {
+                        if (kinds[from] == vertex_kind::Locked || seams[to] == vertex_kind::Locked)
+                            continue;
+                        if (kinds[from] == vertex_kind::Border && edges[edge_key(from, to)] != 1)
+                            continue;
+                        quadric q = quadrics[from];
+                        q += quadrics[to];
+                        collapses.push_back(collapse{ from, to, q.Evaluate(get_position(positions, to)) });
+                    }
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const collapse& a, const collapse& b) { return a.cost < b.cost; });
+
+            size_t toRemove = (result.size() - targetIndexCount + 2) / 3;
+            size_t removed = 0;
+            std::iota(remap.begin(), remap.end(), 0);
+            std::fill(touched.begin(), touched.end(), 0);
+            for (const collapse& candidate : collapses)
+            {
+                if (candidate.cost > maxCost || removed >= toRemove)
+                    break;
+                GLuint a = candidate.from, b = candidate.to;
+                if (touched[a] || touched[b])
+                    continue;
+                // Edges (a, b) are shared by the triangles being removed; every other neighbour they share would turn
+                // into a fold (the link condition).
+                ringA.clear();
+                ringB.clear();
+                size_t nShared = 0;
+                for (uint32_t t = triangleOffsets[a]; t < triangleOffsets[a + 1]; t++)
+                {
+                    const GLuint* triangle = &result[vertexTriangles[t]*3];
+                    bool shared = triangle[0] == b || triangle[1] == b || triangle[2] == b;
+                    nShared += shared;
+                    for (int corner = 0; corner < 3; corner++)
+                        if (triangle[corner] != a)
+                            ringA.push_back(triangle[corner]);
+                }
+                for (uint32_t t = triangleOffsets[b]; t < triangleOffsets[b + 1]; t++)
+                {
+                    const GLuint* triangle = &result[vertexTriangles[t]*3];
+                    for (int corner = 0; corner < 3; corner++)
+                        if (triangle[corner] != b)
+                            ringB.push_back(triangle[corner]);
+                }
+                std::sort(ringA.begin(), ringA.end());
+                ringA.erase(std::unique(ringA.begin(), ringA.end()), ringA.end());
+                std::sort(ringB.begin(), ringB.end());
+                ringB.erase(std::unique(ringB.begin(), ringB.end()), ringB.end());
+                size_t nCommon = 0;
+                for (GLuint vertex : ringA)
+                    nCommon += vertex != b && std::binary_search(ringB.begin(), ringB.end(), vertex);
+                if (!nShared || nCommon != nShared)
+                    continue;
+                // Don't let any remaining triangle flip over.
+                glm::dvec3 target = get_position(positions, b);
+                bool flips = false;
+                for (uint32_t t = triangleOffsets[a]; t < triangleOffsets[a + 1] && !flips; t++)
+                {
+                    const GLuint* triangle = &result[vertexTriangles[t]*3];
+                    if (triangle[0] == b || triangle[1] == b || triangle[2] == b)
+                        continue;
+                    glm::dvec3 before[3], after[3];
+                    for (int corner = 0; corner < 3; corner++)
+                    {
+                        before[corner] = get_position(positions, triangle[corner]);
+                        after[corner] = triangle[corner] == a ? target : before[corner];
+                    }
+                    glm::dvec3 oldNormal = glm::cross(before[1] - before[0], before[2] - before[0]);
+                    glm::dvec3 newNormal = glm::cross(after[1] - after[0], after[2] - after[0]);
+                    flips = glm::dot(oldNormal, newNormal) <= 0;
+                }
+                if (flips)
+                    continue;
+
+                remap[a] = b;
+                quadrics[b] += quadrics[a];
+                touched[a] = touched[b] = 1;
+                // The triangles around 'a' change, so their vertices have to wait for the next pass.
+                for (GLuint vertex : ringA)
+                    touched[vertex] = 1;
+                removed += nShared;
+                error = std::max(error, (float)std::sqrt(candidate.cost));
+            }
+            if (!removed)
+                break;
+
+            size_t kept = 0;
+            for (size_t i = 0; i < nTriangles; i++)
+            {
+                GLuint a = remap[result[i*3]], b = remap[result[i*3 + 1]], c = remap[result[i*3 + 2]];
+                if (a == b || b == c || c == a)
+                    continue;
+                result[kept++] = a;
+                result[kept++] = b;
+                result[kept++] = c;
+            }
+            result.resize(kept);
+            count_edges(result, edges);
+        }
+        return result;
+    }
+}
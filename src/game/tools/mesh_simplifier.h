@@ -0,0 +1,29 @@
+/*
+ * game/tools/mesh_simplifier.h
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+#include <GL/glew.h>
+
+#include <vector>
+
+// Mesh simplification, for meshcook's LOD chains.
+
+namespace tools
+{
+    // Simplifies a triangle mesh by collapsing edges in order of their quadric error (Garland and Heckbert), until it has at
+    // most 'targetIndexCount' indices, or every remaining collapse would move the surface further than 'maxError'.
+    // Vertices are only ever merged into other vertices, so the result indexes the same vertices as 'indices' does.
+    // Vertices on seams (sharing their position with another vertex, e.g., for different texture coordinates) stay put,
+    // and open borders only collapse along themselves, so that the mesh doesn't tear or shrink.
+    // 'positions' has three floats per vertex. 'error' receives how far the surface moved, in the positions' units.
+    std::vector<GLuint> SimplifyMesh(
+        const std::vector<GLfloat>& positions, const std::vector<GLuint>& indices,
+        size_t targetIndexCount, float maxError, float& error
+    );
+}
@@ -0,0 +1,149 @@
+/*
+ * game/tools/meshcook.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+// Converts a model (anything Assimp can import) to the cooked mesh format, so that the game can load it without
+// parsing anything.
+// Usage: meshcook [--unpacked] [--lods=N] input output.gmesh
+// Up to N levels of detail (4 by default, including the full detail mesh) are generated, each with about half the
+// triangles of the previous one. Every level is then ordered for the vertex cache and overdraw, and the vertices for
+// fetch locality.
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <renderer/mesh.h>
+#include <renderer/mesh_format.h>
+#include <renderer/vertex_layout.h>
+#include <renderer/bounds.h>
+#include <renderer/mesh_optimizer.h>
+
+#include <tools/mesh_simplifier.h>
+
+#include <file.h>
+#include <logger.h>
+
+// Levels may stray from the full detail mesh by at most this fraction of its bounding radius.
+static constexpr float s_maxLodError = 0.1f;
+
+int main(int argc, const char** argv)
+{
+    logger::SetLogLevel(logger::log_level::Log);
+    bool unpacked = false;
+    size_t nLods = 4;
+    const char* input = nullptr;
+    const char* output = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--unpacked") == 0)
+            unpacked = true;
+        else if (strncmp(argv[i], "--lods=", 7) == 0)
+            nLods = std::clamp<size_t>(strtoul(argv[i] + 7, nullptr, 10), 1, renderer::CookedMeshMaxLods);
+        else if (!input)
+            input = argv[i];
+        else if (!output)
+            output = argv[i];
+        else
+            input = nullptr; // Too many arguments.
+    }
+    if (!input || !output)
+    {
+        logger::Error("Usage: %s [--unpacked] [--lods=N] input output.gmesh\n", argv[0]);
+        return 1;
+    }
+
+    std::string source;
+    if (!utility::LoadFile(input, source))
+    {
+        logger::Error("Could not find file %s.\n", input);
+        return 1;
+    }
+    std::vector<GLfloat> vertices, textureCoords, normals;
+    std::vector<GLuint> indices;
+    renderer::Bounds bounds{};
+    if (!renderer::LoadMesh(source.c_str(), source.length(), vertices, indices, textureCoords, normals, bounds))
+        return 1;
+
+    size_t nVertices = vertices.size() / 3;
+    renderer::VertexCacheStats before = renderer::AnalyzeVertexCache(indices, nVertices);
+    std::vector<std::vector<GLuint>> levels = { indices };
+    std::vector<float> errors = { 0.f };
+    while (levels.size() < nLods)
+    {
+        size_t previous = levels.back().size();
+        float error = 0;
+        std::vector<GLuint> simplified = tools::SimplifyMesh(vertices, indices, previous / 6 * 3, s_maxLodError * bounds.radius, error);
+        // Stop once simplifying stops paying for the extra level.
+        if (simplified.empty() || simplified.size() > previous * 9 / 10)
+            break;
+        levels.push_back(std::move(simplified));
+        errors.push_back(std::max(error, errors.back()));
+    }
+    for (std::vector<GLuint>& level : levels)
+    {
+        renderer::OptimizeVertexCache(level, nVertices);
+        renderer::OptimizeOverdraw(level, vertices);
+    }
+    renderer::VertexCacheStats after = renderer::AnalyzeVertexCache(levels[0], nVertices);
+
+    // Every level indexes the same vertices, so the levels just go one after the other in the index stream.
+    // The vertices are then ordered by their first use, which is mostly by the full detail mesh.
+    std::vector<renderer::MeshLod> lods;
+    std::vector<GLuint> allIndices;
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        lods.push_back(renderer::MeshLod{ allIndices.size(), levels[i].size(), errors[i] });
+        allIndices.insert(allIndices.end(), levels[i].begin(), levels[i].end());
+    }
+    std::vector<GLuint> remap = renderer::OptimizeVertexFetch(allIndices, nVertices);
+    renderer::RemapVertices(vertices, 3, remap);
+    renderer::RemapVertices(textureCoords, 2, remap);
+    renderer::RemapVertices(normals, 3, remap);
+
+    renderer::VertexLayout layout = unpacked ? renderer::VertexLayout::Unpacked() : renderer::VertexLayout::Packed();
+    std::vector<uint8_t> packed = renderer::PackVertices(layout, vertices, normals, textureCoords);
+    std::vector<uint8_t> cooked;
+    // Halve the index stream when every vertex can be indexed in 16 bits.
+    bool shortIndices = vertices.size() / 3 <= 0xffff;
+    std::vector<GLushort> indices16;
+    if (shortIndices)
+        indices16.assign(allIndices.begin(), allIndices.end());
+    const void* indexData = shortIndices ? (const void*)indices16.data() : (const void*)allIndices.data();
+    GLenum indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    // The game compares the stamp with its copy of the source, to tell whether the mesh is out of date.
+    utility::FileStamp stamp{};
+    utility::GetFileStamp(input, stamp);
+    if (!renderer::WriteCookedMesh(cooked, layout, packed, indexData, allIndices.size(), indexType, bounds, lods, stamp))
+    {
+        logger::Error("Could not cook %s.\n", input);
+        return 1;
+    }
+
+    FILE* out = fopen(output, "wb");
+    if (!out)
+    {
+        logger::Error("Could not open %s for writing.\n", output);
+        return 1;
+    }
+    size_t written = fwrite(cooked.data(), 1, cooked.size(), out);
+    fclose(out);
+    if (written != cooked.size())
+    {
+        logger::Error("Could not write %s.\n", output);
+        return 1;
+    }
+    logger::Log("Cooked %s: %zu vertices (%d bytes each), %zu %d-bit indices, %zu bytes.\n",
+        input, vertices.size() / 3, layout.GetStride(), allIndices.size(), shortIndices ? 16 : 32, cooked.size());
+    logger::Log("  Vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f.\n", before.acmr, after.acmr, before.atvr, after.atvr);
+    for (size_t i = 0; i < lods.size(); i++)
+        logger::Log("  LOD %zu: %zu triangles, error %g.\n", i, lods[i].nIndices / 3, lods[i].error);
+    return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ * game/tools/texcook.cpp
+ *
+ * Copyright (c) 2024 Omar Berrow
+*/
+
+// Converts an image (anything stb_image can decode) to a block compressed DDS with a full mip chain, so that the game
+// can stream it straight into video memory.
+// Usage: texcook [--format=bc1|bc3|bc7] [--linear|--unorm] [--threads=N] input output.dds
+// Without --format, opaque images are cooked to BC1, and others to BC3. Images are taken to be sRGB encoded (as
+// colors usually are) unless --linear is passed (e.g., for normal maps).
+// sRGB images are stored in sRGB formats, unless --unorm is passed; their mip chains are still averaged in linear space,
+// but the GL samples the stored values as they are (e.g., for renderers that don't write to sRGB framebuffers).
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <renderer/texture_format.h>
+
+#include <tools/bc_encoder.h>
+
+#include <jobs/job_system.h>
+
+#include <file.h>
+#include <logger.h>
+
+#define STB_IMAGE_IMPLEMENTATION 1
+#include <external/stb_image.h>
+
+enum class block_format
+{
+    Default,
+    BC1,
+    BC3,
+    BC7,
+};
+static GLenum get_gl_format(block_format format, bool srgb)
+{
+    switch (format)
+    {
+        case block_format::BC1: return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        case block_format::BC3: return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case block_format::BC7: return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+        default: return 0;
+    }
+}
+// One 4x4 block of a level, to be encoded.
+struct block_job
+{
+    uint32_t level;
+    uint32_t x, y;
+};
+static void encode_block(block_format format, const renderer::TextureView& source, const renderer::TextureView& cooked, const block_job& job, uint8_t* out)
+{
+    const renderer::TextureLevel& level = source.levels[job.level];
+    const uint8_t* pixels = source.data + level.offset;
+    // Blocks hanging off the edge of the level repeat its last row or column.
+    uint8_t block[16*4];
+    for (uint32_t y = 0; y < 4; y++)
+    {
+        uint32_t sourceY = std::min(job.y*4 + y, level.height - 1);
+        for (uint32_t x = 0; x < 4; x++)
+        {
+            uint32_t sourceX = std::min(job.x*4 + x, level.width - 1);
+            memcpy(block + (y*4 + x)*4, pixels + ((size_t)sourceY*level.width + sourceX)*4, 4);
+        }
+    }
+    size_t blockSize = format == block_format::BC1 ? 8 : 16;
+    uint32_t blocksPerRow = (level.width + 3) / 4;
+    uint8_t* to = out + cooked.levels[job.level].offset + ((size_t)job.y*blocksPerRow + job.x)*blockSize;
+    switch (format)
+    {
+        case block_format::BC1: tools::EncodeBC1(block, to); break;
+        case block_format::BC3: tools::EncodeBC3(block, to); break;
+        case block_format::BC7: tools::EncodeBC7(block, to); break;
+        default: break;
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    logger::SetLogLevel(logger::log_level::Log);
+    block_format format = block_format::Default;
+    bool srgb = true;
+    // Whether sRGB images are stored in sRGB formats.
+    bool srgbFormat = true;
+    unsigned nThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    const char* input = nullptr;
+    const char* output = nullptr;
+    bool badArguments = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--format=bc1") == 0)
+            format = block_format::BC1;
+        else if (strcmp(argv[i], "--format=bc3") == 0)
+            format = block_format::BC3;
+        else if (strcmp(argv[i], "--format=bc7") == 0)
+            format = block_format::BC7;
+        else if (strcmp(argv[i], "--linear") == 0)
+            srgb = false;
+        else if (strcmp(argv[i], "--unorm") == 0)
+            srgbFormat = false;
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+            nThreads = std::max(atoi(argv[i] + 10), 1);
+        else if (!input)
+            input = argv[i];
+        else if (!output)
+            output = argv[i];
+        else
+            badArguments = true;
+    }
+    if (!input || !output || badArguments)
+    {
+        logger::Error("Usage: %s [--format=bc1|bc3|bc7] [--linear|--unorm] [--threads=N] input output.dds\n", argv[0]);
+        return 1;
+    }
+
+    std::string source;
+    if (!utility::LoadFile(input, source))
+    {
+        logger::Error("Could not find file %s.\n", input);
+        return 1;
+    }
+    int width = 0, height = 0, nChannels = 0;
+    stbi_uc* pixels = stbi_load_from_memory((const stbi_uc*)source.data(), (int)source.length(), &width, &height, &nChannels, 4);
+    if (!pixels)
+    {
+        logger::Error("Could not decode %s: %s.\n", input, stbi_failure_reason());
+        return 1;
+    }
+    if (format == block_format::Default)
+    {
+        bool opaque = true;
+        for (size_t i = 3; i < (size_t)width*height*4 && opaque; i += 4)
+            opaque = pixels[i] == 255;
+        format = opaque ? block_format::BC1 : block_format::BC3;
+    }
+
+    std::vector<uint8_t> mips;
+    renderer::TextureView mipChain{};
+    renderer::BuildMipChain(pixels, width, height, mips, mipChain, srgb);
+    stbi_image_free(pixels);
+
+    renderer::TextureView cooked{};
+    cooked.format = get_gl_format(format, srgb && srgbFormat);
+    cooked.width = width;
+    cooked.height = height;
+    std::vector<block_job> jobs;
+    size_t total = 0;
+    for (uint32_t i = 0; i < mipChain.levels.size(); i++)
+    {
+        renderer::TextureLevel level = mipChain.levels[i];
+        level.offset = total;
+        level.size = renderer::GetTextureLevelSize(cooked.format, level.width, level.height);
+        cooked.levels.push_back(level);
+        total += level.size;
+        for (uint32_t y = 0; y < (level.height + 3) / 4; y++)
+            for (uint32_t x = 0; x < (level.width + 3) / 4; x++)
+                jobs.push_back(block_job{ i, x, y });
+    }
+    std::vector<uint8_t> compressed(total);
+
+    // Blocks are independent, so they're encoded in chunks across the job system's workers, and this thread.
+    static constexpr size_t chunkSize = 64;
+    auto begin = std::chrono::steady_clock::now();
+    {
+        jobs::JobSystem jobSystem{ nThreads - 1 };
+        jobSystem.ParallelFor(jobs.size(), chunkSize, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; i++)
+                encode_block(format, mipChain, cooked, jobs[i], compressed.data());
+        });
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    cooked.data = compressed.data();
+
+    std::vector<uint8_t> dds;
+    if (!renderer::WriteDDS(dds, cooked))
+    {
+        logger::Error("Could not cook %s.\n", input);
+        return 1;
+    }
+    FILE* out = fopen(output, "wb");
+    if (!out)
+    {
+        logger::Error("Could not open %s for writing.\n", output);
+        return 1;
+    }
+    size_t written = fwrite(dds.data(), 1, dds.size(), out);
+    fclose(out);
+    if (written != dds.size())
+    {
+        logger::Error("Could not write %s.\n", output);
+        return 1;
+    }
+    static const char* formatNames[] = { "", "BC1", "BC3", "BC7" };
+    logger::Log("Cooked %s: %dx%d %s%s, %zu levels, %zu blocks in %.2fs on %u threads, %zu bytes.\n",
+        input, width, height, formatNames[(int)format], !srgb ? "" : srgbFormat ? " (sRGB)" : " (sRGB, stored as UNORM)", cooked.levels.size(), jobs.size(),
+        elapsed, std::max(nThreads, 1u), dds.size());
+    return 0;
+}